@@ -0,0 +1,402 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "libcmpiutil.h"
+#include "cu_mem.h"
+#include "cu_arena.h"
+
+#define ARENA_ALIGN 16
+
+/* The first block of an arena, and the most later ones grow to */
+#define BLOCK_MIN (16 * 1024)
+#define BLOCK_MAX (1024 * 1024)
+
+/* The largest block a thread keeps for its next arena */
+#define SPARE_MAX (256 * 1024)
+
+/*
+ * Memory from cu_tmp_alloc() starts with a header that says where it
+ * came from, so that cu_tmp_free() and cu_tmp_realloc() can tell arena
+ * memory from the heap's on any thread, not only the one whose arena
+ * it is.  It keeps the memory after it aligned.
+ */
+#define TMP_HEADER ARENA_ALIGN
+#define TMP_ARENA 0x61726e61    /* "arna" */
+#define TMP_HEAP 0x68656170     /* "heap" */
+
+struct cu_arena_block {
+        struct cu_arena_block *next;
+        size_t size;
+        size_t used;
+        size_t last;            /* Where the last allocation starts */
+        char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+static __thread struct cu_arena *cur_arena = NULL;
+static __thread struct cu_arena_block *spare = NULL;
+static __thread bool spare_registered = false;
+
+static pthread_key_t spare_key;
+static bool spare_key_ok = false;
+
+static size_t align_up(size_t size)
+{
+        if (size == 0)
+                return ARENA_ALIGN;
+
+        return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static void spare_release(void *data)
+{
+        struct cu_arena_block **block = data;
+
+        cu_mem_free(CU_MEM_ARENA, *block);
+        *block = NULL;
+}
+
+/* Keep the largest block small enough for the thread's next arena */
+static void release_block(struct cu_arena_block *block)
+{
+        if (!spare_key_ok || (block->size > SPARE_MAX) ||
+            ((spare != NULL) && (spare->size >= block->size))) {
+                cu_mem_free(CU_MEM_ARENA, block);
+                return;
+        }
+
+        if (!spare_registered) {
+                if (pthread_setspecific(spare_key, &spare) != 0) {
+                        cu_mem_free(CU_MEM_ARENA, block);
+                        return;
+                }
+                spare_registered = true;
+        }
+
+        cu_mem_free(CU_MEM_ARENA, spare);
+        spare = block;
+}
+
+static struct cu_arena_block *new_block(struct cu_arena *arena, size_t need)
+{
+        struct cu_arena_block *block;
+        size_t size = BLOCK_MIN;
+
+        if (arena->blocks != NULL)
+                size = arena->blocks->size * 2;
+
+        if (size > BLOCK_MAX)
+                size = BLOCK_MAX;
+
+        if (size < need)
+                size = need;
+
+        if ((spare != NULL) && (spare->size >= need)) {
+                block = spare;
+                spare = NULL;
+        } else {
+                block = cu_mem_alloc(CU_MEM_ARENA, sizeof(*block) + size);
+                if (block == NULL)
+                        return NULL;
+
+                block->size = size;
+        }
+
+        block->used = 0;
+        block->last = 0;
+        block->next = arena->blocks;
+        arena->blocks = block;
+
+        return block;
+}
+
+void cu_arena_begin(struct cu_arena *arena)
+{
+        arena->blocks = NULL;
+        arena->prev = cur_arena;
+        cur_arena = arena;
+}
+
+void cu_arena_end(struct cu_arena *arena)
+{
+        struct cu_arena_block *block;
+        struct cu_arena_block *next;
+
+        for (block = arena->blocks; block != NULL; block = next) {
+                next = block->next;
+                release_block(block);
+        }
+
+        arena->blocks = NULL;
+        cur_arena = arena->prev;
+}
+
+struct cu_arena *cu_arena_current(void)
+{
+        return cur_arena;
+}
+
+void *cu_arena_alloc(struct cu_arena *arena, size_t size)
+{
+        struct cu_arena_block *block = arena->blocks;
+        size_t need;
+
+        need = align_up(size);
+        if (need < size)
+                return NULL;
+
+        if ((block == NULL) || ((block->size - block->used) < need)) {
+                block = new_block(arena, need);
+                if (block == NULL)
+                        return NULL;
+        }
+
+        block->last = block->used;
+        block->used += need;
+
+        return block->data + block->last;
+}
+
+void *cu_arena_realloc(struct cu_arena *arena,
+                       void *ptr,
+                       size_t old_size,
+                       size_t size)
+{
+        struct cu_arena_block *block = arena->blocks;
+        size_t need;
+        void *new;
+
+        if (ptr == NULL)
+                return cu_arena_alloc(arena, size);
+
+        need = align_up(size);
+        if (need < size)
+                return NULL;
+
+        if ((block != NULL) &&
+            (ptr == block->data + block->last) &&
+            ((block->size - block->last) >= need)) {
+                block->used = block->last + need;
+                return ptr;
+        }
+
+        new = cu_arena_alloc(arena, size);
+        if (new == NULL)
+                return NULL;
+
+        memcpy(new, ptr, (old_size < size) ? old_size : size);
+
+        return new;
+}
+
+char *cu_arena_vasprintf(struct cu_arena *arena, const char *fmt, va_list ap)
+{
+        struct cu_arena_block *block = arena->blocks;
+        size_t room = 0;
+        char *str = NULL;
+        va_list copy;
+        int len;
+
+        /* Try the rest of the block first, which usually has room */
+        if (block != NULL) {
+                room = block->size - block->used;
+                str = block->data + block->used;
+        }
+
+        va_copy(copy, ap);
+        len = vsnprintf(str, room, fmt, copy);
+        va_end(copy);
+
+        if (len < 0)
+                return NULL;
+
+        /* The allocation takes what was formatted, if it fits there */
+        if (align_up((size_t)len + 1) <= room)
+                return cu_arena_alloc(arena, len + 1);
+
+        str = cu_arena_alloc(arena, len + 1);
+        if (str != NULL)
+                vsnprintf(str, len + 1, fmt, ap);
+
+        return str;
+}
+
+void cu_arena_reset(struct cu_arena *arena)
+{
+        struct cu_arena_block *block = arena->blocks;
+        struct cu_arena_block *next;
+
+        if (block == NULL)
+                return;
+
+        /* The newest block is the largest */
+        for (next = block->next; next != NULL; next = block->next) {
+                block->next = next->next;
+                release_block(next);
+        }
+
+        block->used = 0;
+        block->last = 0;
+}
+
+static bool block_owns(const struct cu_arena_block *block, const void *ptr)
+{
+        const char *p = ptr;
+
+        return (p >= block->data) && (p < (block->data + block->size));
+}
+
+struct cu_arena *cu_arena_find(const void *ptr)
+{
+        struct cu_arena *arena;
+        struct cu_arena_block *block;
+
+        if (ptr == NULL)
+                return NULL;
+
+        for (arena = cur_arena; arena != NULL; arena = arena->prev) {
+                for (block = arena->blocks; block != NULL; block = block->next)
+                        if (block_owns(block, ptr))
+                                return arena;
+        }
+
+        return NULL;
+}
+
+static void *tmp_tag(void *base, unsigned int tag)
+{
+        if (base == NULL)
+                return NULL;
+
+        *(unsigned int *)base = tag;
+
+        return (char *)base + TMP_HEADER;
+}
+
+static unsigned int tmp_tag_of(const void *ptr)
+{
+        return *(const unsigned int *)((const char *)ptr - TMP_HEADER);
+}
+
+void *cu_tmp_alloc(enum cu_mem_subsystem sub, size_t size)
+{
+        if (size > SIZE_MAX - TMP_HEADER)
+                return NULL;
+
+        if (cur_arena != NULL)
+                return tmp_tag(cu_arena_alloc(cur_arena, TMP_HEADER + size),
+                               TMP_ARENA);
+
+        return tmp_tag(cu_mem_alloc(sub, TMP_HEADER + size), TMP_HEAP);
+}
+
+void *cu_tmp_realloc(enum cu_mem_subsystem sub,
+                     void *ptr,
+                     size_t old_size,
+                     size_t size)
+{
+        struct cu_arena *arena;
+        char *base;
+        void *new;
+
+        if (ptr == NULL)
+                return cu_tmp_alloc(sub, size);
+
+        if (size > SIZE_MAX - TMP_HEADER)
+                return NULL;
+
+        base = (char *)ptr - TMP_HEADER;
+
+        if (tmp_tag_of(ptr) == TMP_HEAP)
+                return tmp_tag(cu_mem_realloc(sub, base, TMP_HEADER + size),
+                               TMP_HEAP);
+
+        if (tmp_tag_of(ptr) != TMP_ARENA) {
+                CU_DEBUG("cu_tmp_realloc() of %p, not from cu_tmp_alloc()",
+                         ptr);
+                return NULL;
+        }
+
+        /*
+         * Only the thread an arena belongs to finds it.  Memory from
+         * another thread's arena is copied out and left to that arena.
+         */
+        arena = cu_arena_find(base);
+        if (arena != NULL)
+                return tmp_tag(cu_arena_realloc(arena, base,
+                                                TMP_HEADER + old_size,
+                                                TMP_HEADER + size),
+                               TMP_ARENA);
+
+        new = cu_tmp_alloc(sub, size);
+        if (new != NULL)
+                memcpy(new, ptr, (old_size < size) ? old_size : size);
+
+        return new;
+}
+
+char *cu_tmp_strdup(enum cu_mem_subsystem sub, const char *str)
+{
+        size_t len = strlen(str) + 1;
+        char *copy;
+
+        copy = cu_tmp_alloc(sub, len);
+        if (copy != NULL)
+                memcpy(copy, str, len);
+
+        return copy;
+}
+
+void cu_tmp_free(enum cu_mem_subsystem sub, void *ptr)
+{
+        if (ptr == NULL)
+                return;
+
+        if (tmp_tag_of(ptr) == TMP_HEAP)
+                cu_mem_free(sub, (char *)ptr - TMP_HEADER);
+        else if (tmp_tag_of(ptr) != TMP_ARENA)
+                CU_DEBUG("cu_tmp_free() of %p, not from cu_tmp_alloc()", ptr);
+}
+
+static void arena_init(void) __attribute__((constructor));
+static void arena_init(void)
+{
+        spare_key_ok = (pthread_key_create(&spare_key, spare_release) == 0);
+}
+
+static void arena_cleanup(void) __attribute__((destructor));
+static void arena_cleanup(void)
+{
+        if (spare_key_ok)
+                pthread_key_delete(spare_key);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
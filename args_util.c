@@ -19,6 +19,8 @@
  * License along with this library; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
+#define CU_LOG_CATEGORY CU_LOG_ARGS
+
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -27,6 +29,9 @@
 #include <cmpimacs.h>
 
 #include "libcmpiutil.h"
+#include "cu_upcall.h"
+#include "cu_mem.h"
+#include "cu_arena.h"
 
 #define CU_WEAK_TYPES 1
 
@@ -37,6 +42,7 @@ CMPIrc cu_get_str_path(const CMPIObjectPath *reference,
         CMPIData data;
         CMPIStatus s;
         const char *value;
+        CU_UPCALL_SITE();
 
         data = CMGetKey(reference, key, &s);
         if ((s.rc != CMPI_RC_OK) ||
@@ -59,6 +65,7 @@ CMPIrc cu_get_u16_path(const CMPIObjectPath *reference,
 {
         CMPIData data;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         data = CMGetKey(reference, key, &s);
         if ((s.rc != CMPI_RC_OK) ||
@@ -73,6 +80,7 @@ CMPIrc cu_get_u16_path(const CMPIObjectPath *reference,
 const char *cu_check_args(const CMPIArgs *args, const char **names)
 {
         int i;
+        CU_UPCALL_SITE();
 
         for (i = 0; names[i]; i++) {
                 const char *argname = names[i];
@@ -91,6 +99,7 @@ CMPIrc cu_get_str_arg(const CMPIArgs *args, const char *name, const char **val)
 {
         CMPIData argdata;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         argdata = CMGetArg(args, name, &s);
         if ((s.rc != CMPI_RC_OK) || (CMIsNullValue(argdata)))
@@ -111,6 +120,7 @@ CMPIrc cu_get_ref_arg(const CMPIArgs *args,
 {
         CMPIData argdata;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         argdata = CMGetArg(args, name, &s);
         if ((s.rc != CMPI_RC_OK) || (CMIsNullValue(argdata)))
@@ -130,6 +140,7 @@ CMPIrc cu_get_inst_arg(const CMPIArgs *args,
 {
         CMPIData argdata;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         argdata = CMGetArg(args, name, &s);
         if ((s.rc != CMPI_RC_OK) || (CMIsNullValue(argdata)))
@@ -150,6 +161,7 @@ CMPIrc cu_get_array_arg(const CMPIArgs *args,
 {
         CMPIData argdata;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         argdata = CMGetArg(args, name, &s);
         if ((s.rc != CMPI_RC_OK) || CMIsNullValue(argdata))
@@ -167,6 +179,7 @@ CMPIrc cu_get_u16_arg(const CMPIArgs *args, const char *name, uint16_t *target)
 {
         CMPIData argdata;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         argdata = CMGetArg(args, name, &s);
         if ((s.rc != CMPI_RC_OK) || CMIsNullValue(argdata))
@@ -197,6 +210,7 @@ CMPIrc cu_get_array_prop(const CMPIInstance *inst,
 {
         CMPIData value;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         REQUIRE_PROPERTY_DEFINED(inst, prop, value, &s);
 
@@ -219,6 +233,7 @@ CMPIrc cu_get_str_prop(const CMPIInstance *inst,
         CMPIData value;
         CMPIStatus s;
         const char *prop_val;
+        CU_UPCALL_SITE();
 
         *target = NULL;
 
@@ -241,6 +256,7 @@ CMPIrc cu_get_bool_prop(const CMPIInstance *inst,
 {
         CMPIData value;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         REQUIRE_PROPERTY_DEFINED(inst, prop, value, &s);
 
@@ -258,6 +274,7 @@ CMPIrc cu_get_u16_prop(const CMPIInstance *inst,
 {
         CMPIData value;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         REQUIRE_PROPERTY_DEFINED(inst, prop, value, &s);
 
@@ -279,6 +296,7 @@ CMPIrc cu_get_u32_prop(const CMPIInstance *inst,
 {
         CMPIData value;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         REQUIRE_PROPERTY_DEFINED(inst, prop, value, &s);
 
@@ -300,6 +318,7 @@ CMPIrc cu_get_u64_prop(const CMPIInstance *inst,
 {
         CMPIData value;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         REQUIRE_PROPERTY_DEFINED(inst, prop, value, &s);
 
@@ -320,17 +339,27 @@ int cu_statusf(const CMPIBroker *broker,
                CMPIrc rc,
                char *fmt, ...)
 {
+        struct cu_arena *arena = cu_arena_current();
         va_list ap;
         char *msg = NULL;
         int ret;
+        CU_UPCALL_SITE();
 
         va_start(ap, fmt);
-        ret = vasprintf(&msg, fmt, ap);
+        if (arena != NULL) {
+                msg = cu_arena_vasprintf(arena, fmt, ap);
+                ret = (msg != NULL) ? (int)strlen(msg) : -1;
+        } else {
+                ret = vasprintf(&msg, fmt, ap);
+                if (ret != -1)
+                        cu_mem_track(CU_MEM_STATUS, msg);
+        }
         va_end(ap);
 
         if (ret != -1) {
                 CMSetStatusWithChars(broker, s, rc, msg);
-                free(msg);
+                if (arena == NULL)
+                        cu_mem_free(CU_MEM_STATUS, msg);
         } else {
                 CMSetStatus(s, rc);
         }
@@ -342,6 +371,7 @@ CMPIType cu_prop_type(const CMPIInstance *inst, const char *prop)
 {
         CMPIData value;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         value = CMGetProperty(inst, prop, &s);
         if ((s.rc != CMPI_RC_OK) || (CMIsNullValue(value)))
@@ -354,6 +384,7 @@ CMPIType cu_arg_type(const CMPIArgs *args, const char *arg)
 {
         CMPIData value;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         value = CMGetArg(args, arg, &s);
         if ((s.rc != CMPI_RC_OK) || (CMIsNullValue(value)))
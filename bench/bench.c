@@ -0,0 +1,546 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cu_mem.h"
+
+#include "bench.h"
+#include "mock/mock_broker.h"
+
+/* Each sample times a batch of operations at least this long */
+#define SAMPLE_NS   20000ULL
+
+#define MIN_SAMPLES 10
+#define MAX_SAMPLES 10000
+#define MAX_BATCH   (1UL << 24)
+
+/*
+ * Every heap allocation in the process goes through these, so that
+ * allocations per operation can be reported.  The counters are
+ * per-thread, which keeps them cheap and keeps a case's numbers free
+ * of noise from other threads.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static __thread unsigned long alloc_count = 0;
+static __thread unsigned long alloc_bytes = 0;
+
+void *malloc(size_t size)
+{
+        alloc_count++;
+        alloc_bytes += size;
+
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+        alloc_count++;
+        alloc_bytes += nmemb * size;
+
+        return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+        alloc_count++;
+        alloc_bytes += size;
+
+        return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+        __libc_free(ptr);
+}
+
+void bench_alloc_stats(unsigned long *count, unsigned long *bytes)
+{
+        *count = alloc_count;
+        *bytes = alloc_bytes;
+}
+
+uint64_t bench_now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static int parse_sizes(const char *str,
+                       unsigned long *sizes,
+                       int *count)
+{
+        char *end;
+        unsigned long val;
+
+        *count = 0;
+
+        while (*str != '\0') {
+                if (*count == BENCH_MAX_SIZES)
+                        return 0;
+
+                val = strtoul(str, &end, 10);
+                if ((end == str) || (val == 0))
+                        return 0;
+
+                sizes[(*count)++] = val;
+
+                if (*end == ',')
+                        end++;
+                else if (*end != '\0')
+                        return 0;
+
+                str = end;
+        }
+
+        return *count > 0;
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "Usage: %s [-n LIST] [-p LIST] [-t MS] [-f text|csv|json]\n"
+                "       [-o FILE] [-b STRING] [-l]\n"
+                "\n"
+                "  -n LIST    Instance counts (default 10,1000,100000)\n"
+                "  -p LIST    Property counts (default 1,50,500)\n"
+                "  -t MS      Minimum time per case (default 200)\n"
+                "  -f FORMAT  Output format (default text)\n"
+                "  -o FILE    Write results to FILE\n"
+                "  -b STRING  Only run cases whose name contains STRING\n"
+                "  -l         List cases and exit\n",
+                prog);
+}
+
+int bench_parse_args(struct bench_opts *opts, int argc, char **argv)
+{
+        int c;
+
+        memset(opts, 0, sizeof(*opts));
+
+        opts->instances[0] = 10;
+        opts->instances[1] = 1000;
+        opts->instances[2] = 100000;
+        opts->num_instances = 3;
+
+        opts->props[0] = 1;
+        opts->props[1] = 50;
+        opts->props[2] = 500;
+        opts->num_props = 3;
+
+        opts->min_time_ms = 200;
+        opts->format = BENCH_FMT_TEXT;
+
+        while ((c = getopt(argc, argv, "n:p:t:f:o:b:lh")) != -1) {
+                switch (c) {
+                case 'n':
+                        if (!parse_sizes(optarg,
+                                         opts->instances,
+                                         &opts->num_instances))
+                                goto err;
+                        break;
+                case 'p':
+                        if (!parse_sizes(optarg,
+                                         opts->props,
+                                         &opts->num_props))
+                                goto err;
+                        break;
+                case 't':
+                        opts->min_time_ms = strtoul(optarg, NULL, 10);
+                        break;
+                case 'f':
+                        if (strcmp(optarg, "text") == 0)
+                                opts->format = BENCH_FMT_TEXT;
+                        else if (strcmp(optarg, "csv") == 0)
+                                opts->format = BENCH_FMT_CSV;
+                        else if (strcmp(optarg, "json") == 0)
+                                opts->format = BENCH_FMT_JSON;
+                        else
+                                goto err;
+                        break;
+                case 'o':
+                        opts->output = optarg;
+                        break;
+                case 'b':
+                        opts->filter = optarg;
+                        break;
+                case 'l':
+                        opts->list = 1;
+                        break;
+                default:
+                        goto err;
+                }
+        }
+
+        if (optind == argc)
+                return 1;
+ err:
+        usage(argv[0]);
+        return 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+        double x = *(const double *)a;
+        double y = *(const double *)b;
+
+        if (x < y)
+                return -1;
+        else if (x > y)
+                return 1;
+        else
+                return 0;
+}
+
+static double percentile(const double *sorted, int count, double pct)
+{
+        int idx;
+
+        idx = (int)((pct / 100.0) * count + 0.5) - 1;
+        if (idx < 0)
+                idx = 0;
+        else if (idx >= count)
+                idx = count - 1;
+
+        return sorted[idx];
+}
+
+static int run_batch(const struct bench_case *bc,
+                     struct bench_env *env,
+                     unsigned long batch)
+{
+        unsigned long i;
+
+        for (i = 0; i < batch; i++) {
+                if (!bc->run(env))
+                        return 0;
+        }
+
+        return 1;
+}
+
+/* Bytes the library's memory accounting holds now, and at its peak */
+static void lib_mem(long *bytes, long *peak)
+{
+        struct cu_mem_usage usage;
+        int i;
+
+        *bytes = 0;
+        *peak = 0;
+
+        for (i = 0; i < CU_MEM_SUBSYSTEMS; i++) {
+                cu_mem_get(i, &usage);
+                *bytes += usage.bytes;
+                *peak += usage.peak_bytes;
+        }
+}
+
+static int run_case(const struct bench_case *bc,
+                    struct bench_env *env,
+                    unsigned long min_time_ms,
+                    struct bench_result *res)
+{
+        const void *mark;
+        unsigned long batch = 1;
+        unsigned long allocs = 0;
+        unsigned long bytes = 0;
+        unsigned long mock_allocs = 0;
+        unsigned long mock_bytes = 0;
+        unsigned long c0, c1, b0, b1, m0, m1, mb0, mb1;
+        long lib_base;
+        long lib_bytes;
+        long lib_peak;
+        uint64_t start;
+        uint64_t t0;
+        uint64_t t1;
+        uint64_t timed = 0;
+        double *samples;
+        int count = 0;
+        int ret = 0;
+
+        samples = calloc(MAX_SAMPLES, sizeof(*samples));
+        if (samples == NULL)
+                return 0;
+
+        cu_mem_reset_peak();
+        lib_mem(&lib_base, &lib_peak);
+
+        env->data = NULL;
+        if ((bc->setup != NULL) && !bc->setup(env)) {
+                fprintf(stderr, "%s: setup failed\n", bc->name);
+                goto out;
+        }
+
+        mark = mock_objects_mark();
+
+        /* Warm up, and find a batch size that the clock can resolve */
+        for (;;) {
+                t0 = bench_now_ns();
+                if (!run_batch(bc, env, batch))
+                        goto fail;
+                t1 = bench_now_ns();
+
+                mock_release_objects_since(mark);
+
+                if (((t1 - t0) >= SAMPLE_NS) || (batch >= MAX_BATCH))
+                        break;
+
+                batch *= 2;
+        }
+
+        start = bench_now_ns();
+
+        while ((count < MIN_SAMPLES) ||
+               ((count < MAX_SAMPLES) &&
+                ((bench_now_ns() - start) < min_time_ms * 1000000ULL))) {
+                bench_alloc_stats(&c0, &b0);
+                mock_get_alloc_stats(&m0, &mb0);
+                t0 = bench_now_ns();
+
+                if (!run_batch(bc, env, batch))
+                        goto fail;
+
+                t1 = bench_now_ns();
+                bench_alloc_stats(&c1, &b1);
+                mock_get_alloc_stats(&m1, &mb1);
+
+                mock_release_objects_since(mark);
+
+                samples[count++] = (double)(t1 - t0) / batch;
+                timed += t1 - t0;
+                allocs += c1 - c0;
+                bytes += b1 - b0;
+                mock_allocs += m1 - m0;
+                mock_bytes += mb1 - mb0;
+        }
+
+        qsort(samples, count, sizeof(*samples), cmp_double);
+
+        memset(res, 0, sizeof(*res));
+        res->name = bc->name;
+        res->instances = (bc->flags & BENCH_SCALE_INSTANCES) ?
+                env->instances : 0;
+        res->props = (bc->flags & BENCH_SCALE_PROPS) ? env->props : 0;
+        res->ops = batch * count;
+        res->ns_op = (double)timed / res->ops;
+        /* The hooks are bypassed when running under a sanitizer */
+        if (allocs >= mock_allocs) {
+                res->allocs_op = (double)(allocs - mock_allocs) / res->ops;
+                res->bytes_op = (double)(bytes - mock_bytes) / res->ops;
+        }
+        res->broker_allocs_op = (double)mock_allocs / res->ops;
+        res->p50 = percentile(samples, count, 50.0);
+        res->p90 = percentile(samples, count, 90.0);
+        res->p99 = percentile(samples, count, 99.0);
+        res->max = samples[count - 1];
+
+        ret = 1;
+        goto done;
+
+ fail:
+        fprintf(stderr, "%s: operation failed\n", bc->name);
+ done:
+        mock_release_objects_since(mark);
+        if (bc->teardown != NULL)
+                bc->teardown(env);
+
+        /* What setup and teardown held counts too */
+        lib_mem(&lib_bytes, &lib_peak);
+        res->lib_peak = lib_peak - lib_base;
+        res->lib_kept = lib_bytes - lib_base;
+ out:
+        free(samples);
+
+        return ret;
+}
+
+static void print_header(FILE *out, enum bench_format format)
+{
+        if (format == BENCH_FMT_TEXT)
+                fprintf(out,
+                        "%-32s %7s %5s %10s %12s %9s %10s %9s "
+                        "%10s %9s %12s %12s %12s %12s\n",
+                        "case", "insts", "props", "ops", "ns/op",
+                        "allocs/op", "bytes/op", "brkr/op",
+                        "lib_peak", "lib_kept",
+                        "p50", "p90", "p99", "max");
+        else if (format == BENCH_FMT_CSV)
+                fprintf(out,
+                        "case,instances,props,ops,ns_op,allocs_op,bytes_op,"
+                        "broker_allocs_op,lib_peak_bytes,lib_kept_bytes,"
+                        "p50_ns,p90_ns,p99_ns,max_ns\n");
+        else
+                fprintf(out, "{\"results\": [");
+}
+
+static void print_result(FILE *out,
+                         enum bench_format format,
+                         const struct bench_result *res,
+                         int first)
+{
+        char insts[32] = "-";
+        char props[32] = "-";
+
+        if (res->instances != 0)
+                snprintf(insts, sizeof(insts), "%lu", res->instances);
+        if (res->props != 0)
+                snprintf(props, sizeof(props), "%lu", res->props);
+
+        if (format == BENCH_FMT_TEXT) {
+                fprintf(out,
+                        "%-32s %7s %5s %10lu %12.1f %9.2f %10.1f %9.2f "
+                        "%10ld %9ld %12.1f %12.1f %12.1f %12.1f\n",
+                        res->name, insts, props, res->ops, res->ns_op,
+                        res->allocs_op, res->bytes_op,
+                        res->broker_allocs_op,
+                        res->lib_peak, res->lib_kept,
+                        res->p50, res->p90, res->p99, res->max);
+        } else if (format == BENCH_FMT_CSV) {
+                fprintf(out,
+                        "%s,%lu,%lu,%lu,%.1f,%.3f,%.1f,%.3f,%ld,%ld,"
+                        "%.1f,%.1f,%.1f,%.1f\n",
+                        res->name, res->instances, res->props, res->ops,
+                        res->ns_op, res->allocs_op, res->bytes_op,
+                        res->broker_allocs_op,
+                        res->lib_peak, res->lib_kept,
+                        res->p50, res->p90, res->p99, res->max);
+        } else {
+                fprintf(out,
+                        "%s\n  {\"case\": \"%s\", \"instances\": %lu, "
+                        "\"props\": %lu, \"ops\": %lu, \"ns_op\": %.1f, "
+                        "\"allocs_op\": %.3f, \"bytes_op\": %.1f, "
+                        "\"broker_allocs_op\": %.3f, "
+                        "\"lib_peak_bytes\": %ld, \"lib_kept_bytes\": %ld, "
+                        "\"p50_ns\": %.1f, "
+                        "\"p90_ns\": %.1f, \"p99_ns\": %.1f, "
+                        "\"max_ns\": %.1f}",
+                        first ? "" : ",",
+                        res->name, res->instances, res->props, res->ops,
+                        res->ns_op, res->allocs_op, res->bytes_op,
+                        res->broker_allocs_op,
+                        res->lib_peak, res->lib_kept,
+                        res->p50, res->p90, res->p99, res->max);
+        }
+
+        fflush(out);
+}
+
+int bench_run(const struct bench_opts *opts,
+              const struct bench_case *cases,
+              const CMPIBroker *broker,
+              const CMPIContext *context)
+{
+        const struct bench_case *bc;
+        struct bench_env env;
+        struct bench_result res;
+        unsigned long none = 0;
+        const unsigned long *insts;
+        const unsigned long *props;
+        int num_insts;
+        int num_props;
+        int i;
+        int j;
+        int first = 1;
+        int failed = 0;
+        FILE *out = stdout;
+
+        if (opts->list) {
+                for (bc = cases; bc->name != NULL; bc++)
+                        printf("%s\n", bc->name);
+                return 0;
+        }
+
+        if (opts->output != NULL) {
+                out = fopen(opts->output, "w");
+                if (out == NULL) {
+                        perror(opts->output);
+                        return 1;
+                }
+        }
+
+        print_header(out, opts->format);
+
+        for (bc = cases; bc->name != NULL; bc++) {
+                if ((opts->filter != NULL) &&
+                    (strstr(bc->name, opts->filter) == NULL))
+                        continue;
+
+                if (bc->flags & BENCH_SCALE_INSTANCES) {
+                        insts = opts->instances;
+                        num_insts = opts->num_instances;
+                } else {
+                        insts = &none;
+                        num_insts = 1;
+                }
+
+                if (bc->flags & BENCH_SCALE_PROPS) {
+                        props = opts->props;
+                        num_props = opts->num_props;
+                } else {
+                        props = &none;
+                        num_props = 1;
+                }
+
+                for (i = 0; i < num_insts; i++) {
+                        for (j = 0; j < num_props; j++) {
+                                memset(&env, 0, sizeof(env));
+                                env.broker = broker;
+                                env.context = context;
+                                env.instances = insts[i];
+                                env.props = props[j];
+
+                                if (!run_case(bc, &env,
+                                              opts->min_time_ms, &res)) {
+                                        failed++;
+                                        continue;
+                                }
+
+                                print_result(out, opts->format, &res, first);
+                                first = 0;
+                        }
+                }
+        }
+
+        if (opts->format == BENCH_FMT_JSON)
+                fprintf(out, "\n]}\n");
+
+        if (out != stdout)
+                fclose(out);
+
+        return failed;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
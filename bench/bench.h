@@ -0,0 +1,153 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+
+/* The case is run once for every instance count given with -n */
+#define BENCH_SCALE_INSTANCES 0x1
+
+/* The case is run once for every property count given with -p */
+#define BENCH_SCALE_PROPS     0x2
+
+#define BENCH_MAX_SIZES 16
+
+enum bench_format {
+        BENCH_FMT_TEXT,
+        BENCH_FMT_CSV,
+        BENCH_FMT_JSON,
+};
+
+/*
+ * State handed to every callback of a case
+ */
+struct bench_env {
+        const CMPIBroker *broker;
+        const CMPIContext *context;
+        unsigned long instances;
+        unsigned long props;
+        void *data;
+};
+
+/*
+ * A single benchmark.  setup() and teardown() are not timed; run()
+ * performs exactly one operation and returns nonzero on success.
+ */
+struct bench_case {
+        const char *name;
+        unsigned int flags;
+        int (*setup)(struct bench_env *env);
+        int (*run)(struct bench_env *env);
+        void (*teardown)(struct bench_env *env);
+};
+
+#define BENCH_END {NULL, 0, NULL, NULL, NULL}
+
+struct bench_result {
+        const char *name;
+        unsigned long instances;
+        unsigned long props;
+        unsigned long ops;
+        double ns_op;
+        double allocs_op;
+        double bytes_op;
+        double broker_allocs_op;
+        long lib_peak;
+        long lib_kept;
+        double p50;
+        double p90;
+        double p99;
+        double max;
+};
+
+struct bench_opts {
+        unsigned long instances[BENCH_MAX_SIZES];
+        int num_instances;
+        unsigned long props[BENCH_MAX_SIZES];
+        int num_props;
+        unsigned long min_time_ms;
+        enum bench_format format;
+        const char *filter;
+        const char *output;
+        int list;
+};
+
+/**
+ * Parse the options common to all benchmark programs:
+ *
+ *   -n LIST    Comma-separated instance counts
+ *   -p LIST    Comma-separated property counts
+ *   -t MS      Minimum time spent timing each case
+ *   -f FORMAT  One of text, csv or json
+ *   -o FILE    Write results to FILE instead of stdout
+ *   -b STRING  Only run cases whose name contains STRING
+ *   -l         List cases and exit
+ *
+ * @param opts The options to fill in
+ * @param argc Argument count from main()
+ * @param argv Argument vector from main()
+ * @returns nonzero on success, zero on a usage error
+ */
+int bench_parse_args(struct bench_opts *opts, int argc, char **argv);
+
+/**
+ * Run a table of cases and report the results
+ *
+ * @param opts Options from bench_parse_args()
+ * @param cases A table terminated by BENCH_END
+ * @param broker The broker passed to each case
+ * @param context The context passed to each case
+ * @returns The number of cases that failed
+ */
+int bench_run(const struct bench_opts *opts,
+              const struct bench_case *cases,
+              const CMPIBroker *broker,
+              const CMPIContext *context);
+
+/**
+ * Get the number of heap allocations, and the bytes requested, made
+ * by the calling thread so far
+ *
+ * @param count Set to the number of allocations
+ * @param bytes Set to the number of bytes requested
+ */
+void bench_alloc_stats(unsigned long *count, unsigned long *bytes);
+
+/**
+ * Get a monotonic timestamp
+ *
+ * @returns Nanoseconds since an arbitrary point
+ */
+uint64_t bench_now_ns(void);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
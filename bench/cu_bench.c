@@ -0,0 +1,1164 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+#include "std_association.h"
+#include "std_invokemethod.h"
+#include "std_indication.h"
+#include "cu_mem.h"
+
+#include "mock/mock_broker.h"
+#include "bench.h"
+
+#define BENCH_NS "root/bench"
+
+static const CMPIBroker *_BROKER;
+
+/*
+ * Test data
+ */
+
+static const char *system_keys[] = {"CreationClassName", "Name", NULL};
+static const char *device_keys[] = {"SystemName", "DeviceID", NULL};
+static const char *assoc_keys[] = {"GroupComponent", "PartComponent", NULL};
+
+static int add_classes(CMPIBroker *broker)
+{
+        return mock_broker_add_class(broker, "CIM_ManagedElement",
+                                     NULL, NULL) &&
+                mock_broker_add_class(broker, "CIM_System",
+                                      "CIM_ManagedElement", NULL) &&
+                mock_broker_add_class(broker, "CIM_LogicalDevice",
+                                      "CIM_ManagedElement", NULL) &&
+                mock_broker_add_class(broker, "CIM_SystemDevice",
+                                      NULL, NULL) &&
+                mock_broker_add_class(broker, "CIM_Indication",
+                                      NULL, NULL) &&
+                mock_broker_add_class(broker, "Bench_System",
+                                      "CIM_System", system_keys) &&
+                mock_broker_add_class(broker, "Bench_Device",
+                                      "CIM_LogicalDevice", device_keys) &&
+                mock_broker_add_class(broker, "Bench_Other",
+                                      "CIM_LogicalDevice", device_keys) &&
+                mock_broker_add_class(broker, "Bench_SystemDevice",
+                                      "CIM_SystemDevice", assoc_keys) &&
+                mock_broker_add_class(broker, "Bench_Indication",
+                                      "CIM_Indication", NULL);
+}
+
+static CMPIArray *make_str_array(const CMPIBroker *broker, int count)
+{
+        CMPIArray *array;
+        CMPIStatus s;
+        int i;
+
+        array = CMNewArray(broker, count, CMPI_string, &s);
+        if ((array == NULL) || (s.rc != CMPI_RC_OK))
+                return NULL;
+
+        for (i = 0; i < count; i++)
+                CMSetArrayElementAt(array, i,
+                                    (CMPIValue *)"element", CMPI_chars);
+
+        return array;
+}
+
+/*
+ * Set count filler properties of mixed types, so that lookups of the
+ * properties that follow them have to walk past count entries
+ */
+static void set_filler_props(CMPIInstance *inst, unsigned long count)
+{
+        unsigned long i;
+        char name[32];
+        uint16_t u16;
+        uint32_t u32;
+
+        for (i = 0; i < count; i++) {
+                snprintf(name, sizeof(name), "Prop%lu", i);
+
+                switch (i % 3) {
+                case 0:
+                        CMSetProperty(inst, name,
+                                      (CMPIValue *)"value", CMPI_chars);
+                        break;
+                case 1:
+                        u16 = i;
+                        CMSetProperty(inst, name,
+                                      (CMPIValue *)&u16, CMPI_uint16);
+                        break;
+                case 2:
+                        u32 = i;
+                        CMSetProperty(inst, name,
+                                      (CMPIValue *)&u32, CMPI_uint32);
+                        break;
+                }
+        }
+}
+
+static CMPIInstance *make_device(const CMPIBroker *broker,
+                                 unsigned long id,
+                                 unsigned long props)
+{
+        CMPIObjectPath *op;
+        CMPIInstance *inst;
+        CMPIArray *array;
+        char devid[32];
+        uint16_t u16 = 16;
+        uint32_t u32 = 32;
+        uint64_t u64 = 64;
+        CMPIBoolean b = true;
+
+        op = CMNewObjectPath(broker, BENCH_NS, "Bench_Device", NULL);
+        if (op == NULL)
+                return NULL;
+
+        inst = CMNewInstance(broker, op, NULL);
+        if (inst == NULL)
+                return NULL;
+
+        snprintf(devid, sizeof(devid), "dev%lu", id);
+
+        CMSetProperty(inst, "SystemName", (CMPIValue *)"bench", CMPI_chars);
+        CMSetProperty(inst, "DeviceID", (CMPIValue *)devid, CMPI_chars);
+
+        set_filler_props(inst, props);
+
+        array = make_str_array(broker, 4);
+
+        CMSetProperty(inst, "LastString", (CMPIValue *)"last", CMPI_chars);
+        CMSetProperty(inst, "LastU16", (CMPIValue *)&u16, CMPI_uint16);
+        CMSetProperty(inst, "LastU32", (CMPIValue *)&u32, CMPI_uint32);
+        CMSetProperty(inst, "LastU64", (CMPIValue *)&u64, CMPI_uint64);
+        CMSetProperty(inst, "LastBool", (CMPIValue *)&b, CMPI_boolean);
+        CMSetProperty(inst, "LastArray", (CMPIValue *)&array, CMPI_stringA);
+
+        return inst;
+}
+
+static CMPIObjectPath *system_path(const CMPIBroker *broker)
+{
+        return mock_path_parse(broker,
+                               BENCH_NS ":Bench_System."
+                               "CreationClassName=\"Bench_System\","
+                               "Name=\"bench\"");
+}
+
+/*
+ * Instance lists and property accessors
+ */
+
+struct pool {
+        struct inst_list list;
+        CMPIInstance *dest;
+};
+
+static int pool_setup(struct bench_env *env)
+{
+        struct pool *pool;
+        unsigned long i;
+        CMPIInstance *inst;
+
+        pool = calloc(1, sizeof(*pool));
+        if (pool == NULL)
+                return 0;
+
+        env->data = pool;
+        inst_list_init(&pool->list);
+
+        /* Cases that only scale properties use a single instance */
+        for (i = 0; (i == 0) || (i < env->instances); i++) {
+                inst = make_device(env->broker, i, env->props);
+                if ((inst == NULL) || !inst_list_add(&pool->list, inst))
+                        return 0;
+        }
+
+        pool->dest = make_device(env->broker, 0, 0);
+
+        return pool->dest != NULL;
+}
+
+static void pool_teardown(struct bench_env *env)
+{
+        struct pool *pool = env->data;
+
+        if (pool == NULL)
+                return;
+
+        inst_list_free(&pool->list);
+        free(pool);
+}
+
+static CMPIInstance *pool_first(struct bench_env *env)
+{
+        struct pool *pool = env->data;
+
+        return pool->list.list[0];
+}
+
+static int run_inst_list_add(struct bench_env *env)
+{
+        struct pool *pool = env->data;
+        struct inst_list list;
+        unsigned long i;
+        int ret = 1;
+
+        inst_list_init(&list);
+
+        for (i = 0; i < env->instances; i++) {
+                if (!inst_list_add(&list, pool->list.list[i])) {
+                        ret = 0;
+                        break;
+                }
+        }
+
+        inst_list_free(&list);
+
+        return ret;
+}
+
+static int run_inst_list_add_many(struct bench_env *env)
+{
+        struct pool *pool = env->data;
+        struct inst_list list;
+        int ret;
+
+        inst_list_init(&list);
+
+        ret = inst_list_add_many(&list, pool->list.list, env->instances);
+
+        inst_list_free(&list);
+
+        return ret;
+}
+
+static int run_inst_chunk_list_add(struct bench_env *env)
+{
+        struct pool *pool = env->data;
+        struct inst_chunk_list list;
+        unsigned long i;
+        int ret = 1;
+
+        inst_chunk_list_init(&list);
+
+        for (i = 0; i < env->instances; i++) {
+                if (!inst_chunk_list_add(&list, pool->list.list[i])) {
+                        ret = 0;
+                        break;
+                }
+        }
+
+        inst_chunk_list_free(&list);
+
+        return ret;
+}
+
+/* The pool twice over, as a handler run for two assocClasses returns it */
+static int run_inst_list_dedup(struct bench_env *env)
+{
+        struct pool *pool = env->data;
+        struct inst_list list;
+        int ret;
+
+        inst_list_init(&list);
+
+        ret = inst_list_reserve(&list, pool->list.cur * 2) &&
+                inst_list_add_many(&list, pool->list.list, pool->list.cur) &&
+                inst_list_add_many(&list, pool->list.list, pool->list.cur) &&
+                (inst_list_dedup(&list) == (int)pool->list.cur);
+
+        inst_list_free(&list);
+
+        return ret;
+}
+
+static int run_get_str_prop(struct bench_env *env)
+{
+        const char *val;
+
+        return cu_get_str_prop(pool_first(env), "LastString", &val) ==
+                CMPI_RC_OK;
+}
+
+static int run_get_u16_prop(struct bench_env *env)
+{
+        uint16_t val;
+
+        return cu_get_u16_prop(pool_first(env), "LastU16", &val) ==
+                CMPI_RC_OK;
+}
+
+static int run_get_u32_prop(struct bench_env *env)
+{
+        uint32_t val;
+
+        return cu_get_u32_prop(pool_first(env), "LastU32", &val) ==
+                CMPI_RC_OK;
+}
+
+static int run_get_u64_prop(struct bench_env *env)
+{
+        uint64_t val;
+
+        return cu_get_u64_prop(pool_first(env), "LastU64", &val) ==
+                CMPI_RC_OK;
+}
+
+static int run_get_bool_prop(struct bench_env *env)
+{
+        bool val;
+
+        return cu_get_bool_prop(pool_first(env), "LastBool", &val) ==
+                CMPI_RC_OK;
+}
+
+static int run_get_array_prop(struct bench_env *env)
+{
+        CMPIArray *val;
+
+        return cu_get_array_prop(pool_first(env), "LastArray", &val) ==
+                CMPI_RC_OK;
+}
+
+static int run_compare_ref(struct bench_env *env)
+{
+        CMPIInstance *inst = pool_first(env);
+        CMPIObjectPath *ref;
+
+        ref = CMGetObjectPath(inst, NULL);
+
+        return cu_compare_ref(ref, inst) == NULL;
+}
+
+static int run_dup_instance(struct bench_env *env)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+
+        return cu_dup_instance(env->broker, pool_first(env), &s) != NULL;
+}
+
+static int run_merge_instances(struct bench_env *env)
+{
+        struct pool *pool = env->data;
+        CMPIStatus s;
+
+        s = cu_merge_instances(pool_first(env), pool->dest);
+
+        return s.rc == CMPI_RC_OK;
+}
+
+/*
+ * Method arguments
+ */
+
+static int args_setup(struct bench_env *env)
+{
+        CMPIArgs *args;
+        CMPIInstance *inst;
+        CMPIObjectPath *ref;
+        CMPIArray *array;
+        unsigned long i;
+        char name[32];
+        uint16_t u16 = 16;
+
+        args = CMNewArgs(env->broker, NULL);
+        if (args == NULL)
+                return 0;
+
+        for (i = 0; i < env->props; i++) {
+                snprintf(name, sizeof(name), "Arg%lu", i);
+                CMAddArg(args, name, (CMPIValue *)"value", CMPI_chars);
+        }
+
+        inst = make_device(env->broker, 0, 0);
+        ref = system_path(env->broker);
+        array = make_str_array(env->broker, 4);
+        if ((inst == NULL) || (ref == NULL) || (array == NULL))
+                return 0;
+
+        CMAddArg(args, "StrArg", (CMPIValue *)"value", CMPI_chars);
+        CMAddArg(args, "U16Arg", (CMPIValue *)&u16, CMPI_uint16);
+        CMAddArg(args, "RefArg", (CMPIValue *)&ref, CMPI_ref);
+        CMAddArg(args, "InstArg", (CMPIValue *)&inst, CMPI_instance);
+        CMAddArg(args, "ArrayArg", (CMPIValue *)&array, CMPI_stringA);
+
+        env->data = args;
+
+        return 1;
+}
+
+static int run_get_str_arg(struct bench_env *env)
+{
+        const char *val;
+
+        return cu_get_str_arg(env->data, "StrArg", &val) == CMPI_RC_OK;
+}
+
+static int run_get_u16_arg(struct bench_env *env)
+{
+        uint16_t val;
+
+        return cu_get_u16_arg(env->data, "U16Arg", &val) == CMPI_RC_OK;
+}
+
+static int run_get_ref_arg(struct bench_env *env)
+{
+        CMPIObjectPath *val;
+
+        return cu_get_ref_arg(env->data, "RefArg", &val) == CMPI_RC_OK;
+}
+
+static int run_get_inst_arg(struct bench_env *env)
+{
+        CMPIInstance *val;
+
+        return cu_get_inst_arg(env->data, "InstArg", &val) == CMPI_RC_OK;
+}
+
+static int run_get_array_arg(struct bench_env *env)
+{
+        CMPIArray *val;
+
+        return cu_get_array_arg(env->data, "ArrayArg", &val) == CMPI_RC_OK;
+}
+
+/*
+ * Embedded instance parsing
+ */
+
+static char *make_ei_xml(unsigned long props)
+{
+        char *buf = NULL;
+        size_t size;
+        FILE *fp;
+        unsigned long i;
+
+        fp = open_memstream(&buf, &size);
+        if (fp == NULL)
+                return NULL;
+
+        fprintf(fp, "<INSTANCE CLASSNAME=\"Bench_Device\">\n");
+
+        for (i = 0; i < props; i++) {
+                if (i % 3 == 0)
+                        fprintf(fp,
+                                "<PROPERTY NAME=\"Prop%lu\" TYPE=\"string\">"
+                                "<VALUE>value &amp; more</VALUE>"
+                                "</PROPERTY>\n", i);
+                else if (i % 3 == 1)
+                        fprintf(fp,
+                                "<PROPERTY NAME=\"Prop%lu\" TYPE=\"uint16\">"
+                                "<VALUE>%lu</VALUE></PROPERTY>\n",
+                                i, i % 65536);
+                else
+                        fprintf(fp,
+                                "<PROPERTY NAME=\"Prop%lu\" TYPE=\"boolean\">"
+                                "<VALUE>TRUE</VALUE></PROPERTY>\n", i);
+        }
+
+        fprintf(fp, "</INSTANCE>\n");
+        fclose(fp);
+
+        return buf;
+}
+
+static int run_parse_ei(struct bench_env *env)
+{
+        CMPIInstance *inst = NULL;
+
+        return cu_parse_embedded_instance(env->data,
+                                          env->broker,
+                                          BENCH_NS,
+                                          &inst) == 0;
+}
+
+static int ei_xml_setup(struct bench_env *env)
+{
+        env->data = make_ei_xml(env->props);
+
+        return env->data != NULL;
+}
+
+static void free_data_teardown(struct bench_env *env)
+{
+        free(env->data);
+}
+
+#ifdef HAVE_EOPARSER
+static int ei_mof_setup(struct bench_env *env)
+{
+        char *buf = NULL;
+        size_t size;
+        FILE *fp;
+        unsigned long i;
+
+        fp = open_memstream(&buf, &size);
+        if (fp == NULL)
+                return 0;
+
+        fprintf(fp, "instance of Bench_Device {\n");
+
+        for (i = 0; i < env->props; i++) {
+                if (i % 3 == 0)
+                        fprintf(fp, "Prop%lu = \"value\";\n", i);
+                else if (i % 3 == 1)
+                        fprintf(fp, "Prop%lu = %lu;\n", i, i % 65536);
+                else
+                        fprintf(fp, "Prop%lu = true;\n", i);
+        }
+
+        fprintf(fp, "};\n");
+        fclose(fp);
+
+        env->data = buf;
+
+        return 1;
+}
+#endif
+
+/*
+ * std_association dispatch
+ */
+
+static struct inst_list *assoc_pool;
+
+static CMPIStatus bench_assoc_handler(const CMPIObjectPath *ref,
+                                      struct std_assoc_info *info,
+                                      struct inst_list *list)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+        unsigned int i;
+
+        for (i = 0; i < assoc_pool->cur; i++) {
+                if (!inst_list_add(list, assoc_pool->list[i])) {
+                        cu_statusf(_BROKER, &s,
+                                   CMPI_RC_ERR_FAILED,
+                                   "Unable to add instance");
+                        break;
+                }
+        }
+
+        return s;
+}
+
+static CMPIStatus bench_assoc_stream_handler(const CMPIObjectPath *ref,
+                                             struct std_assoc_info *info,
+                                             struct cu_result_sink *sink)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+        unsigned int i;
+
+        for (i = 0; i < assoc_pool->cur; i++) {
+                s = cu_sink_emit(sink, assoc_pool->list[i]);
+                if (s.rc != CMPI_RC_OK)
+                        break;
+        }
+
+        return s;
+}
+
+static CMPIInstance *bench_make_ref(const CMPIObjectPath *source_ref,
+                                    const CMPIInstance *target_inst,
+                                    struct std_assoc_info *info,
+                                    struct std_assoc *assoc)
+{
+        CMPIObjectPath *op;
+        CMPIInstance *inst;
+
+        op = CMNewObjectPath(_BROKER, BENCH_NS, "Bench_SystemDevice", NULL);
+        if (op == NULL)
+                return NULL;
+
+        inst = CMNewInstance(_BROKER, op, NULL);
+        if (inst == NULL)
+                return NULL;
+
+        set_reference(assoc, inst,
+                      source_ref,
+                      CMGetObjectPath(target_inst, NULL));
+
+        return inst;
+}
+
+static char *other_classes[] = {"Bench_Other", NULL};
+static char *system_classes[] = {"Bench_System", NULL};
+static char *device_classes[] = {"Bench_Device", NULL};
+static char *sysdev_classes[] = {"Bench_SystemDevice", NULL};
+
+/* Handlers that never match, so that dispatch has to skip them */
+static struct std_assoc other_to_system = {
+        .source_class = other_classes,
+        .source_prop = "PartComponent",
+
+        .target_class = system_classes,
+        .target_prop = "GroupComponent",
+
+        .assoc_class = sysdev_classes,
+
+        .handler = bench_assoc_handler,
+        .make_ref = bench_make_ref,
+};
+
+static struct std_assoc device_to_system = {
+        .source_class = device_classes,
+        .source_prop = "PartComponent",
+
+        .target_class = system_classes,
+        .target_prop = "GroupComponent",
+
+        .assoc_class = sysdev_classes,
+
+        .handler = bench_assoc_handler,
+        .make_ref = bench_make_ref,
+};
+
+static struct std_assoc system_to_device = {
+        .source_class = system_classes,
+        .source_prop = "GroupComponent",
+
+        .target_class = device_classes,
+        .target_prop = "PartComponent",
+
+        .assoc_class = sysdev_classes,
+
+        .handler = bench_assoc_handler,
+        .make_ref = bench_make_ref,
+};
+
+static struct std_assoc *assoc_handlers[] = {
+        &other_to_system,
+        &device_to_system,
+        &system_to_device,
+        NULL
+};
+
+STDA_AssocMIStub(, Bench_SystemDevice, _BROKER, CMNoHook, assoc_handlers);
+
+/* The same association, with results returned as they are emitted */
+static struct std_assoc_stream system_to_device_stream = {
+        .assoc = {
+                .source_class = system_classes,
+                .source_prop = "GroupComponent",
+
+                .target_class = device_classes,
+                .target_prop = "PartComponent",
+
+                .assoc_class = sysdev_classes,
+
+                .handler = stda_stream_handler,
+                .make_ref = bench_make_ref,
+        },
+        .stream_handler = bench_assoc_stream_handler,
+};
+
+static struct std_assoc *assoc_stream_handlers[] = {
+        &other_to_system,
+        &device_to_system,
+        &system_to_device_stream.assoc,
+        NULL
+};
+
+STDA_AssocMIStub(, Bench_SystemDeviceStream, _BROKER, CMNoHook,
+                 assoc_stream_handlers);
+
+struct assoc_state {
+        struct pool pool;
+        CMPIAssociationMI *mi;
+        CMPIObjectPath *ref;
+        CMPIResult *results;
+};
+
+static int assoc_setup(struct bench_env *env)
+{
+        struct assoc_state *state;
+        struct pool *pool;
+
+        if (!pool_setup(env))
+                return 0;
+
+        pool = env->data;
+
+        state = calloc(1, sizeof(*state));
+        if (state == NULL)
+                return 0;
+
+        state->pool = *pool;
+        free(pool);
+        env->data = state;
+
+        assoc_pool = &state->pool.list;
+
+        state->mi = Bench_SystemDevice_Create_AssociationMI(env->broker,
+                                                            env->context,
+                                                            NULL);
+        state->ref = system_path(env->broker);
+        state->results = mock_result_new(env->broker);
+
+        return (state->mi != NULL) &&
+                (state->ref != NULL) &&
+                (state->results != NULL);
+}
+
+static int assoc_stream_setup(struct bench_env *env)
+{
+        struct assoc_state *state;
+
+        if (!assoc_setup(env))
+                return 0;
+
+        state = env->data;
+        state->mi = Bench_SystemDeviceStream_Create_AssociationMI(env->broker,
+                                                                  env->context,
+                                                                  NULL);
+
+        return state->mi != NULL;
+}
+
+static int check_returned(struct bench_env *env,
+                          CMPIStatus s,
+                          bool names)
+{
+        struct assoc_state *state = env->data;
+        struct mock_result_stats stats;
+
+        if (s.rc != CMPI_RC_OK)
+                return 0;
+
+        mock_result_get_stats(state->results, &stats);
+
+        return (names ? stats.names : stats.instances) > 0;
+}
+
+static int run_associators(struct bench_env *env)
+{
+        struct assoc_state *state = env->data;
+        CMPIStatus s;
+
+        s = state->mi->ft->associators(state->mi,
+                                       env->context,
+                                       state->results,
+                                       state->ref,
+                                       "CIM_SystemDevice",
+                                       "CIM_LogicalDevice",
+                                       NULL,
+                                       NULL,
+                                       NULL);
+
+        return check_returned(env, s, false);
+}
+
+static int run_associator_names(struct bench_env *env)
+{
+        struct assoc_state *state = env->data;
+        CMPIStatus s;
+
+        s = state->mi->ft->associatorNames(state->mi,
+                                           env->context,
+                                           state->results,
+                                           state->ref,
+                                           "CIM_SystemDevice",
+                                           "CIM_LogicalDevice",
+                                           NULL,
+                                           NULL);
+
+        return check_returned(env, s, true);
+}
+
+static int run_references(struct bench_env *env)
+{
+        struct assoc_state *state = env->data;
+        CMPIStatus s;
+
+        s = state->mi->ft->references(state->mi,
+                                      env->context,
+                                      state->results,
+                                      state->ref,
+                                      "CIM_SystemDevice",
+                                      NULL,
+                                      NULL);
+
+        return check_returned(env, s, false);
+}
+
+static int run_reference_names(struct bench_env *env)
+{
+        struct assoc_state *state = env->data;
+        CMPIStatus s;
+
+        s = state->mi->ft->referenceNames(state->mi,
+                                          env->context,
+                                          state->results,
+                                          state->ref,
+                                          "CIM_SystemDevice",
+                                          NULL);
+
+        return check_returned(env, s, true);
+}
+
+static void assoc_teardown(struct bench_env *env)
+{
+        struct assoc_state *state = env->data;
+
+        if (state == NULL)
+                return;
+
+        inst_list_free(&state->pool.list);
+        free(state);
+        assoc_pool = NULL;
+}
+
+/*
+ * std_invokemethod dispatch
+ */
+
+static CMPIStatus bench_method(CMPIMethodMI *self,
+                               const CMPIContext *context,
+                               const CMPIResult *results,
+                               const CMPIObjectPath *reference,
+                               const CMPIArgs *argsin,
+                               CMPIArgs *argsout)
+{
+        uint32_t rc = 0;
+
+        CMReturnData(results, (CMPIValue *)&rc, CMPI_uint32);
+
+        return (CMPIStatus){CMPI_RC_OK, NULL};
+}
+
+static struct method_handler bench_args_method = {
+        .name = "BenchArgs",
+        .handler = bench_method,
+        .args = {{"StrArg", CMPI_string, false},
+                 {"U16Arg", CMPI_uint16, false},
+                 {"RefArg", CMPI_ref, false},
+                 {"Missing", CMPI_string, true},
+                 ARG_END
+        }
+};
+
+static struct method_handler bench_ei_method = {
+        .name = "BenchEI",
+        .handler = bench_method,
+        .args = {{"InstArg", CMPI_instance, false},
+                 ARG_END
+        }
+};
+
+static struct method_handler *method_handlers[] = {
+        &bench_args_method,
+        &bench_ei_method,
+        NULL
+};
+
+STDIM_MethodMIStub(, Bench_Method, _BROKER, CMNoHook, method_handlers);
+
+struct method_state {
+        CMPIMethodMI *mi;
+        CMPIObjectPath *ref;
+        CMPIResult *results;
+        CMPIArgs *argsin;
+        const char *method;
+        char *xml;
+};
+
+static int method_setup(struct bench_env *env)
+{
+        struct method_state *state;
+        CMPIObjectPath *ref;
+        uint16_t u16 = 16;
+        unsigned long i;
+        char name[32];
+
+        state = calloc(1, sizeof(*state));
+        if (state == NULL)
+                return 0;
+
+        env->data = state;
+
+        state->mi = Bench_Method_Create_MethodMI(env->broker,
+                                                 env->context,
+                                                 NULL);
+        state->ref = system_path(env->broker);
+        state->results = mock_result_new(env->broker);
+        state->argsin = CMNewArgs(env->broker, NULL);
+        state->method = "BenchArgs";
+
+        ref = system_path(env->broker);
+        if ((state->mi == NULL) || (state->ref == NULL) ||
+            (state->results == NULL) || (state->argsin == NULL) ||
+            (ref == NULL))
+                return 0;
+
+        for (i = 0; i < env->props; i++) {
+                snprintf(name, sizeof(name), "Arg%lu", i);
+                CMAddArg(state->argsin, name,
+                         (CMPIValue *)"value", CMPI_chars);
+        }
+
+        CMAddArg(state->argsin, "StrArg", (CMPIValue *)"value", CMPI_chars);
+        CMAddArg(state->argsin, "U16Arg", (CMPIValue *)&u16, CMPI_uint16);
+        CMAddArg(state->argsin, "RefArg", (CMPIValue *)&ref, CMPI_ref);
+
+        return 1;
+}
+
+static int method_ei_setup(struct bench_env *env)
+{
+        struct method_state *state;
+
+        if (!method_setup(env))
+                return 0;
+
+        state = env->data;
+        state->method = "BenchEI";
+        state->argsin = CMNewArgs(env->broker, NULL);
+        state->xml = make_ei_xml(env->props);
+        if ((state->argsin == NULL) || (state->xml == NULL))
+                return 0;
+
+        CMAddArg(state->argsin, "InstArg",
+                 (CMPIValue *)state->xml, CMPI_chars);
+
+        return 1;
+}
+
+static int run_invokemethod(struct bench_env *env)
+{
+        struct method_state *state = env->data;
+        CMPIArgs *argsout;
+        CMPIStatus s;
+
+        argsout = CMNewArgs(env->broker, NULL);
+
+        s = state->mi->ft->invokeMethod(state->mi,
+                                        env->context,
+                                        state->results,
+                                        state->ref,
+                                        state->method,
+                                        state->argsin,
+                                        argsout);
+
+        return s.rc == CMPI_RC_OK;
+}
+
+static void method_teardown(struct bench_env *env)
+{
+        struct method_state *state = env->data;
+
+        if (state == NULL)
+                return;
+
+        free(state->xml);
+        free(state);
+}
+
+/*
+ * Indication delivery
+ */
+
+static struct std_ind_filter bench_filter = {
+        .ind_name = "Bench_Indication",
+        .active = true,
+};
+
+static struct std_ind_filter other_filter = {
+        .ind_name = "Bench_OtherIndication",
+        .active = false,
+};
+
+static struct std_ind_filter *bench_filters[] = {
+        &other_filter,
+        &bench_filter,
+        NULL
+};
+
+struct deliver_state {
+        struct std_indication_ctx ctx;
+        struct ind_args args;
+        CMPIInstance *ind;
+};
+
+static int deliver_setup(struct bench_env *env)
+{
+        struct deliver_state *state;
+        CMPIObjectPath *op;
+
+        state = calloc(1, sizeof(*state));
+        if (state == NULL)
+                return 0;
+
+        env->data = state;
+
+        state->ctx.brkr = env->broker;
+        state->ctx.filters = bench_filters;
+        state->ctx.enabled = true;
+
+        state->args.context = (CMPIContext *)env->context;
+        state->args.ns = BENCH_NS;
+        state->args.classname = "Bench_Indication";
+        state->args._ctx = &state->ctx;
+
+        op = CMNewObjectPath(env->broker, BENCH_NS,
+                             "Bench_Indication", NULL);
+        if (op == NULL)
+                return 0;
+
+        state->ind = CMNewInstance(env->broker, op, NULL);
+        if (state->ind == NULL)
+                return 0;
+
+        set_filler_props(state->ind, env->props);
+
+        return 1;
+}
+
+static int run_deliver(struct bench_env *env)
+{
+        struct deliver_state *state = env->data;
+        CMPIStatus s;
+
+        s = stdi_deliver(env->broker, env->context, &state->args, state->ind);
+
+        return s.rc == CMPI_RC_OK;
+}
+
+static void free_state_teardown(struct bench_env *env)
+{
+        free(env->data);
+}
+
+static struct bench_case cases[] = {
+        {"inst_list_add", BENCH_SCALE_INSTANCES,
+         pool_setup, run_inst_list_add, pool_teardown},
+        {"inst_list_add_many", BENCH_SCALE_INSTANCES,
+         pool_setup, run_inst_list_add_many, pool_teardown},
+        {"inst_chunk_list_add", BENCH_SCALE_INSTANCES,
+         pool_setup, run_inst_chunk_list_add, pool_teardown},
+        {"inst_list_dedup", BENCH_SCALE_INSTANCES,
+         pool_setup, run_inst_list_dedup, pool_teardown},
+
+        {"cu_get_str_prop", BENCH_SCALE_PROPS,
+         pool_setup, run_get_str_prop, pool_teardown},
+        {"cu_get_u16_prop", BENCH_SCALE_PROPS,
+         pool_setup, run_get_u16_prop, pool_teardown},
+        {"cu_get_u32_prop", BENCH_SCALE_PROPS,
+         pool_setup, run_get_u32_prop, pool_teardown},
+        {"cu_get_u64_prop", BENCH_SCALE_PROPS,
+         pool_setup, run_get_u64_prop, pool_teardown},
+        {"cu_get_bool_prop", BENCH_SCALE_PROPS,
+         pool_setup, run_get_bool_prop, pool_teardown},
+        {"cu_get_array_prop", BENCH_SCALE_PROPS,
+         pool_setup, run_get_array_prop, pool_teardown},
+
+        {"cu_get_str_arg", BENCH_SCALE_PROPS,
+         args_setup, run_get_str_arg, NULL},
+        {"cu_get_u16_arg", BENCH_SCALE_PROPS,
+         args_setup, run_get_u16_arg, NULL},
+        {"cu_get_ref_arg", BENCH_SCALE_PROPS,
+         args_setup, run_get_ref_arg, NULL},
+        {"cu_get_inst_arg", BENCH_SCALE_PROPS,
+         args_setup, run_get_inst_arg, NULL},
+        {"cu_get_array_arg", BENCH_SCALE_PROPS,
+         args_setup, run_get_array_arg, NULL},
+
+        {"cu_compare_ref", BENCH_SCALE_PROPS,
+         pool_setup, run_compare_ref, pool_teardown},
+        {"cu_dup_instance", BENCH_SCALE_PROPS,
+         pool_setup, run_dup_instance, pool_teardown},
+        {"cu_merge_instances", BENCH_SCALE_PROPS,
+         pool_setup, run_merge_instances, pool_teardown},
+
+        {"cu_parse_embedded_instance/xml", BENCH_SCALE_PROPS,
+         ei_xml_setup, run_parse_ei, free_data_teardown},
+#ifdef HAVE_EOPARSER
+        {"cu_parse_embedded_instance/mof", BENCH_SCALE_PROPS,
+         ei_mof_setup, run_parse_ei, free_data_teardown},
+#endif
+
+        {"stda_Associators", BENCH_SCALE_INSTANCES,
+         assoc_setup, run_associators, assoc_teardown},
+        {"stda_AssociatorNames", BENCH_SCALE_INSTANCES,
+         assoc_setup, run_associator_names, assoc_teardown},
+        {"stda_References", BENCH_SCALE_INSTANCES,
+         assoc_setup, run_references, assoc_teardown},
+        {"stda_ReferenceNames", BENCH_SCALE_INSTANCES,
+         assoc_setup, run_reference_names, assoc_teardown},
+        {"stda_Associators/stream", BENCH_SCALE_INSTANCES,
+         assoc_stream_setup, run_associators, assoc_teardown},
+        {"stda_AssociatorNames/stream", BENCH_SCALE_INSTANCES,
+         assoc_stream_setup, run_associator_names, assoc_teardown},
+        {"stda_References/stream", BENCH_SCALE_INSTANCES,
+         assoc_stream_setup, run_references, assoc_teardown},
+        {"stda_ReferenceNames/stream", BENCH_SCALE_INSTANCES,
+         assoc_stream_setup, run_reference_names, assoc_teardown},
+
+        {"std_invokemethod", BENCH_SCALE_PROPS,
+         method_setup, run_invokemethod, method_teardown},
+        {"std_invokemethod/ei", BENCH_SCALE_PROPS,
+         method_ei_setup, run_invokemethod, method_teardown},
+
+        {"stdi_deliver", BENCH_SCALE_PROPS,
+         deliver_setup, run_deliver, free_state_teardown},
+
+        BENCH_END
+};
+
+int main(int argc, char **argv)
+{
+        struct bench_opts opts;
+        CMPIBroker *broker;
+        CMPIContext *context;
+        int failed;
+
+        if (!bench_parse_args(&opts, argc, argv))
+                return 2;
+
+        cu_mem_count_libxml2();
+
+        broker = mock_broker_new();
+        if ((broker == NULL) || !add_classes(broker)) {
+                fprintf(stderr, "Unable to create mock broker\n");
+                return 1;
+        }
+
+        context = mock_context_new(broker);
+
+        failed = bench_run(&opts, cases, broker, context);
+
+        mock_release_objects();
+        mock_broker_free(broker);
+
+        return failed ? 1 : 0;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
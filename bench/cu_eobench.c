@@ -0,0 +1,667 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+/*
+ * Parse the embedded instances of a corpus with the CIM-XML and MOF
+ * parsers and report the throughput and memory use of each.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+#include "cu_mem.h"
+
+#include "mock/mock_broker.h"
+#include "bench.h"
+
+#define EO_NS "root/eobench"
+
+#define MAX_FILES 64
+
+/* Keep parsing until this many instances have been timed */
+#define MIN_ITERS 10
+
+struct eo_file {
+        char *path;
+        char name[64];
+        const char *parser;
+        char *data;
+        size_t len;
+        unsigned int props;
+        const char *note;
+
+        unsigned long iters;
+        uint64_t ns;
+        unsigned long allocs;
+        long peak_kb;
+        long growth_kb;
+        long lib_peak;
+};
+
+/* Sent from the child that timed a file back to the parent */
+struct eo_sample {
+        unsigned long iters;
+        uint64_t ns;
+        unsigned long allocs;
+        long warm_kb;
+        long lib_peak;
+        int ok;
+};
+
+struct eo_opts {
+        const char *dir;
+        char *files[MAX_FILES];
+        int num_files;
+        unsigned long min_time_ms;
+        enum bench_format format;
+        const char *filter;
+        const char *output;
+};
+
+static const CMPIBroker *_BROKER;
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "Usage: %s [-d DIR] [-t MS] [-f text|csv|json] [-o FILE]\n"
+                "       [-b STRING] [FILE...]\n"
+                "\n"
+                "  -d DIR     Corpus directory (default corpus)\n"
+                "  -t MS      Time spent parsing each file (default 1000)\n"
+                "  -f FORMAT  Output format (default text)\n"
+                "  -o FILE    Write results to FILE\n"
+                "  -b STRING  Only parse files whose name contains STRING\n"
+                "\n"
+                "Files ending in .xml hold a CIM-XML instance, files ending\n"
+                "in .mof the same instance in MOF.  Both are parsed with\n"
+                "cu_parse_embedded_instance().\n",
+                prog);
+}
+
+static int parse_args(struct eo_opts *opts, int argc, char **argv)
+{
+        int c;
+
+        opts->dir = "corpus";
+        opts->min_time_ms = 1000;
+        opts->format = BENCH_FMT_TEXT;
+
+        while ((c = getopt(argc, argv, "d:t:f:o:b:h")) != -1) {
+                switch (c) {
+                case 'd':
+                        opts->dir = optarg;
+                        break;
+                case 't':
+                        opts->min_time_ms = strtoul(optarg, NULL, 10);
+                        break;
+                case 'f':
+                        if (strcmp(optarg, "text") == 0)
+                                opts->format = BENCH_FMT_TEXT;
+                        else if (strcmp(optarg, "csv") == 0)
+                                opts->format = BENCH_FMT_CSV;
+                        else if (strcmp(optarg, "json") == 0)
+                                opts->format = BENCH_FMT_JSON;
+                        else
+                                goto err;
+                        break;
+                case 'o':
+                        opts->output = optarg;
+                        break;
+                case 'b':
+                        opts->filter = optarg;
+                        break;
+                default:
+                        goto err;
+                }
+        }
+
+        for (; optind < argc; optind++) {
+                if (opts->num_files == MAX_FILES)
+                        goto err;
+                opts->files[opts->num_files++] = argv[optind];
+        }
+
+        return 1;
+ err:
+        usage(argv[0]);
+        return 0;
+}
+
+/*
+ * Corpus
+ */
+
+static const char *parser_of(const char *path)
+{
+        const char *ext = strrchr(path, '.');
+
+        if (ext == NULL)
+                return NULL;
+        else if (strcmp(ext, ".xml") == 0)
+                return "xml";
+        else if (strcmp(ext, ".mof") == 0)
+                return "mof";
+        else
+                return NULL;
+}
+
+static int is_corpus_file(const struct dirent *ent)
+{
+        return parser_of(ent->d_name) != NULL;
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+        FILE *fp;
+        char *data = NULL;
+        long size;
+
+        fp = fopen(path, "r");
+        if (fp == NULL)
+                return NULL;
+
+        if ((fseek(fp, 0, SEEK_END) != 0) ||
+            ((size = ftell(fp)) < 0) ||
+            (fseek(fp, 0, SEEK_SET) != 0))
+                goto out;
+
+        data = malloc(size + 1);
+        if (data == NULL)
+                goto out;
+
+        if (fread(data, 1, size, fp) != (size_t)size) {
+                free(data);
+                data = NULL;
+                goto out;
+        }
+
+        data[size] = '\0';
+        *len = size;
+ out:
+        fclose(fp);
+
+        return data;
+}
+
+static int add_file(struct eo_file *files,
+                    int *count,
+                    char *path,
+                    const char *filter)
+{
+        struct eo_file *f = &files[*count];
+        const char *base;
+        const char *ext;
+
+        base = strrchr(path, '/');
+        base = (base == NULL) ? path : base + 1;
+
+        if ((filter != NULL) && (strstr(base, filter) == NULL)) {
+                free(path);
+                return 1;
+        }
+
+        if (*count == MAX_FILES) {
+                fprintf(stderr, "Too many files, the limit is %i\n",
+                        MAX_FILES);
+                return 0;
+        }
+
+        f->parser = parser_of(base);
+        if (f->parser == NULL) {
+                fprintf(stderr, "%s: not a .xml or .mof file\n", path);
+                return 0;
+        }
+
+        ext = strrchr(base, '.');
+        snprintf(f->name, sizeof(f->name), "%.*s", (int)(ext - base), base);
+
+        f->path = path;
+        f->data = read_file(path, &f->len);
+        if (f->data == NULL) {
+                perror(path);
+                return 0;
+        }
+
+        (*count)++;
+
+        return 1;
+}
+
+static int load_corpus(const struct eo_opts *opts,
+                       struct eo_file *files,
+                       int *count)
+{
+        struct dirent **ents;
+        char *path;
+        int num;
+        int ret = 1;
+        int i;
+
+        for (i = 0; i < opts->num_files; i++) {
+                path = strdup(opts->files[i]);
+                if ((path == NULL) ||
+                    !add_file(files, count, path, opts->filter))
+                        return 0;
+        }
+
+        if (opts->num_files > 0)
+                return 1;
+
+        num = scandir(opts->dir, &ents, is_corpus_file, alphasort);
+        if (num < 0) {
+                perror(opts->dir);
+                return 0;
+        }
+
+        for (i = 0; i < num; i++) {
+                if (ret && (asprintf(&path, "%s/%s",
+                                     opts->dir, ents[i]->d_name) != -1))
+                        ret = add_file(files, count, path, opts->filter);
+                free(ents[i]);
+        }
+
+        free(ents);
+
+        return ret;
+}
+
+/*
+ * Parse a file once, outside of any timing, to find out whether it
+ * can be parsed at all and how many properties each parser found
+ */
+static int check_file(struct eo_file *f)
+{
+        const void *mark = mock_objects_mark();
+        CMPIInstance *inst = NULL;
+        int ret;
+
+        ret = cu_parse_embedded_instance(f->data, _BROKER, EO_NS, &inst);
+        if ((ret == 0) && (inst == NULL) && STREQ(f->parser, "mof")) {
+                f->note = "MOF parser not built";
+                goto out;
+        } else if ((ret != 0) || (inst == NULL)) {
+                f->note = "parse failed";
+                goto out;
+        }
+
+        f->props = CMGetPropertyCount(inst, NULL);
+ out:
+        mock_release_objects_since(mark);
+
+        return f->note == NULL;
+}
+
+/*
+ * Timing
+ */
+
+/* The library's accounted bytes, now and at their peak */
+static void lib_mem(long *bytes, long *peak)
+{
+        struct cu_mem_usage usage;
+        int i;
+
+        *bytes = 0;
+        *peak = 0;
+
+        for (i = 0; i < CU_MEM_SUBSYSTEMS; i++) {
+                cu_mem_get(i, &usage);
+                *bytes += usage.bytes;
+                *peak += usage.peak_bytes;
+        }
+}
+
+static void parse_loop(const struct eo_file *f,
+                       unsigned long min_time_ms,
+                       struct eo_sample *sample)
+{
+        uint64_t min_ns = (uint64_t)min_time_ms * 1000000;
+        unsigned long count0, count1;
+        unsigned long mock0, mock1;
+        unsigned long bytes;
+        CMPIInstance *inst;
+        const void *mark;
+        struct rusage ru;
+        uint64_t start;
+        long lib_base;
+        long lib_peak;
+        int ret;
+
+        memset(sample, 0, sizeof(*sample));
+
+        /* Fault in the parser's code and data before taking the mark */
+        mark = mock_objects_mark();
+        inst = NULL;
+        ret = cu_parse_embedded_instance(f->data, _BROKER, EO_NS, &inst);
+        mock_release_objects_since(mark);
+        if ((ret != 0) || (inst == NULL))
+                return;
+
+        getrusage(RUSAGE_SELF, &ru);
+        sample->warm_kb = ru.ru_maxrss;
+
+        cu_mem_reset_peak();
+        lib_mem(&lib_base, &lib_peak);
+
+        while ((sample->ns < min_ns) || (sample->iters < MIN_ITERS)) {
+                mark = mock_objects_mark();
+                inst = NULL;
+
+                bench_alloc_stats(&count0, &bytes);
+                mock_get_alloc_stats(&mock0, &bytes);
+                start = bench_now_ns();
+
+                ret = cu_parse_embedded_instance(f->data, _BROKER,
+                                                 EO_NS, &inst);
+
+                sample->ns += bench_now_ns() - start;
+                bench_alloc_stats(&count1, &bytes);
+                mock_get_alloc_stats(&mock1, &bytes);
+
+                mock_release_objects_since(mark);
+
+                if ((ret != 0) || (inst == NULL))
+                        return;
+
+                /* The broker's allocations are the CIMOM's, not ours */
+                sample->allocs += (count1 - count0) - (mock1 - mock0);
+                sample->iters++;
+        }
+
+        lib_mem(&lib_base, &lib_peak);
+        sample->lib_peak = lib_peak - lib_base;
+        sample->ok = 1;
+}
+
+/*
+ * Time f in a child process, so that its peak RSS can be told apart
+ * from the parent's and from the other files'
+ */
+static int in_child(const struct eo_file *f,
+                    unsigned long min_time_ms,
+                    struct eo_sample *sample,
+                    long *peak_kb)
+{
+        struct rusage ru;
+        pid_t pid;
+        int fds[2];
+        int status;
+        ssize_t ret;
+
+        memset(sample, 0, sizeof(*sample));
+
+        if (pipe(fds) != 0) {
+                perror("pipe");
+                return 0;
+        }
+
+        pid = fork();
+        if (pid < 0) {
+                perror("fork");
+                return 0;
+        } else if (pid == 0) {
+                close(fds[0]);
+                parse_loop(f, min_time_ms, sample);
+                ret = write(fds[1], sample, sizeof(*sample));
+                _exit(ret == sizeof(*sample) ? 0 : 1);
+        }
+
+        close(fds[1]);
+        ret = read(fds[0], sample, sizeof(*sample));
+        close(fds[0]);
+
+        if (wait4(pid, &status, 0, &ru) != pid) {
+                perror("wait4");
+                return 0;
+        }
+
+        *peak_kb = ru.ru_maxrss;
+
+        return (ret == sizeof(*sample)) &&
+                WIFEXITED(status) && (WEXITSTATUS(status) == 0) &&
+                sample->ok;
+}
+
+static void time_file(struct eo_file *f, unsigned long min_time_ms)
+{
+        struct eo_sample sample;
+
+        if (!in_child(f, min_time_ms, &sample, &f->peak_kb)) {
+                f->note = "parse failed";
+                return;
+        }
+
+        f->iters = sample.iters;
+        f->ns = sample.ns;
+        f->allocs = sample.allocs;
+        f->growth_kb = f->peak_kb - sample.warm_kb;
+        f->lib_peak = sample.lib_peak;
+}
+
+/*
+ * Output
+ */
+
+static double inst_s(const struct eo_file *f)
+{
+        return f->ns ? f->iters * 1e9 / f->ns : 0;
+}
+
+static double mb_s(const struct eo_file *f)
+{
+        return f->ns ? (double)f->len * f->iters * 1e3 / f->ns : 0;
+}
+
+static void print_header(FILE *out, enum bench_format format)
+{
+        if (format == BENCH_FMT_TEXT)
+                fprintf(out,
+                        "%-12s %6s %7s %5s %10s %8s %8s %9s %9s %9s  %s\n",
+                        "corpus", "parser", "bytes", "props",
+                        "inst/s", "MB/s", "allocs", "lib bytes",
+                        "peak KiB", "grown KiB", "note");
+        else if (format == BENCH_FMT_CSV)
+                fprintf(out, "corpus,parser,bytes,props,inst_s,mb_s,"
+                        "allocs_inst,lib_peak_bytes,peak_rss_kb,"
+                        "rss_growth_kb,note\n");
+        else
+                fprintf(out, "{\"results\": [");
+}
+
+static void print_file(FILE *out,
+                       enum bench_format format,
+                       const struct eo_file *f,
+                       int first)
+{
+        double allocs = f->iters ? (double)f->allocs / f->iters : 0;
+        const char *note = f->note ? f->note : "";
+
+        if (format == BENCH_FMT_TEXT) {
+                fprintf(out,
+                        "%-12s %6s %7zu %5u %10.0f %8.2f %8.1f %9ld %9ld "
+                        "%9ld  %s\n",
+                        f->name, f->parser, f->len, f->props, inst_s(f),
+                        mb_s(f), allocs, f->lib_peak, f->peak_kb,
+                        f->growth_kb, note);
+        } else if (format == BENCH_FMT_CSV) {
+                fprintf(out, "%s,%s,%zu,%u,%.1f,%.3f,%.1f,%ld,%ld,%ld,%s\n",
+                        f->name, f->parser, f->len, f->props, inst_s(f),
+                        mb_s(f), allocs, f->lib_peak, f->peak_kb,
+                        f->growth_kb, note);
+        } else {
+                fprintf(out,
+                        "%s\n  {\"corpus\": \"%s\", \"parser\": \"%s\", "
+                        "\"bytes\": %zu, \"props\": %u, "
+                        "\"inst_s\": %.1f, \"mb_s\": %.3f, "
+                        "\"allocs_inst\": %.1f, \"lib_peak_bytes\": %ld, "
+                        "\"peak_rss_kb\": %ld, "
+                        "\"rss_growth_kb\": %ld, \"note\": \"%s\"}",
+                        first ? "" : ",",
+                        f->name, f->parser, f->len, f->props, inst_s(f),
+                        mb_s(f), allocs, f->lib_peak, f->peak_kb,
+                        f->growth_kb, note);
+        }
+
+        fflush(out);
+}
+
+/*
+ * Compare the two parsers on every corpus entry both of them parsed
+ */
+static void print_footer(FILE *out,
+                         enum bench_format format,
+                         const struct eo_file *files,
+                         int count)
+{
+        const struct eo_file *xml;
+        const struct eo_file *mof;
+        int header = 0;
+        int i;
+        int j;
+
+        if (format == BENCH_FMT_JSON) {
+                fprintf(out, "\n]}\n");
+                return;
+        }
+
+        if (format != BENCH_FMT_TEXT)
+                return;
+
+        for (i = 0; i < count; i++) {
+                if (!STREQ(files[i].parser, "xml") || (files[i].iters == 0))
+                        continue;
+
+                xml = &files[i];
+                mof = NULL;
+                for (j = 0; j < count; j++) {
+                        if (STREQ(files[j].parser, "mof") &&
+                            STREQ(files[j].name, xml->name) &&
+                            (files[j].iters > 0))
+                                mof = &files[j];
+                }
+
+                if (mof == NULL)
+                        continue;
+
+                if (!header)
+                        fprintf(out, "\n%-12s %14s\n",
+                                "corpus", "mof/xml inst/s");
+                header = 1;
+
+                fprintf(out, "%-12s %13.2fx  %s\n",
+                        xml->name, inst_s(mof) / inst_s(xml),
+                        mof->props != xml->props ?
+                        "parsers disagree on the property count" : "");
+        }
+}
+
+int main(int argc, char **argv)
+{
+        struct eo_opts opts;
+        struct eo_file files[MAX_FILES];
+        CMPIBroker *broker;
+        FILE *out = stdout;
+        int count = 0;
+        int failed = 0;
+        int i;
+
+        memset(&opts, 0, sizeof(opts));
+        memset(files, 0, sizeof(files));
+
+        if (!parse_args(&opts, argc, argv))
+                return 2;
+
+        cu_mem_count_libxml2();
+
+        broker = mock_broker_new();
+        if (broker == NULL) {
+                fprintf(stderr, "Unable to create mock broker\n");
+                return 1;
+        }
+
+        _BROKER = broker;
+
+        if (!load_corpus(&opts, files, &count))
+                return 1;
+
+        if (count == 0) {
+                fprintf(stderr, "No .xml or .mof files to parse\n");
+                return 1;
+        }
+
+        for (i = 0; i < count; i++) {
+                if (!check_file(&files[i]) &&
+                    !STREQ(files[i].note, "MOF parser not built"))
+                        failed++;
+        }
+
+        if (opts.output != NULL) {
+                out = fopen(opts.output, "w");
+                if (out == NULL) {
+                        perror(opts.output);
+                        return 1;
+                }
+        }
+
+        print_header(out, opts.format);
+
+        for (i = 0; i < count; i++) {
+                if (files[i].note == NULL) {
+                        time_file(&files[i], opts.min_time_ms);
+                        if (files[i].note != NULL)
+                                failed++;
+                }
+
+                print_file(out, opts.format, &files[i], i == 0);
+        }
+
+        print_footer(out, opts.format, files, count);
+
+        if (out != stdout)
+                fclose(out);
+
+        for (i = 0; i < count; i++) {
+                free(files[i].path);
+                free(files[i].data);
+        }
+
+        mock_release_objects();
+        mock_broker_free(broker);
+
+        return failed ? 1 : 0;
+}
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
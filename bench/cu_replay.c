@@ -0,0 +1,1388 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+/*
+ * Replay MI calls recorded with CU_RECORD (see cu_record.h) through a
+ * provider's MIs, against the mock broker and as fast as possible.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <time.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+
+#include "mock/mock_broker.h"
+
+#define MAX_NAMES  8
+#define MAX_MIS    (MAX_NAMES * 3)
+#define MAX_FIELDS 16
+#define MAX_STATS  256
+
+enum entry {
+        E_ASSOCIATORS,
+        E_ASSOCIATOR_NAMES,
+        E_REFERENCES,
+        E_REFERENCE_NAMES,
+        E_INVOKE_METHOD,
+        E_ACTIVATE_FILTER,
+        E_DEACTIVATE_FILTER,
+        E_ENABLE_INDICATIONS,
+        E_DISABLE_INDICATIONS,
+        E_MAX,
+};
+
+static const char *entry_names[E_MAX] = {
+        "Associators",
+        "AssociatorNames",
+        "References",
+        "ReferenceNames",
+        "InvokeMethod",
+        "ActivateFilter",
+        "DeActivateFilter",
+        "EnableIndications",
+        "DisableIndications",
+};
+
+/* Number of fields, including the four common ones, of each entry */
+static const int entry_fields[E_MAX] = {10, 10, 8, 8, 7, 6, 6, 4, 4};
+
+enum mi_kind {
+        MI_ASSOCIATION,
+        MI_METHOD,
+        MI_INDICATION,
+};
+
+struct mi {
+        const char *name;
+        enum mi_kind kind;
+        void *mi;
+};
+
+struct call {
+        enum entry entry;
+        struct mi *mi;
+        CMPIrc rc;
+        uint64_t rec_ns;
+        char *line;
+        char *fields[MAX_FIELDS];
+        struct stat_row *stat;
+};
+
+struct answer {
+        char *cn;
+        char *type;
+        int result;
+};
+
+struct stat_row {
+        enum entry entry;
+        const char *mi_name;
+        unsigned long calls;
+        unsigned long mismatches;
+        uint64_t rec_ns;
+        uint64_t replay_ns;
+};
+
+enum replay_format {
+        FMT_TEXT,
+        FMT_CSV,
+        FMT_JSON,
+};
+
+struct replay {
+        const CMPIBroker *broker;
+        const char *names[MAX_NAMES];
+        int num_names;
+        struct mi mis[MAX_MIS];
+        int num_mis;
+        struct call *calls;
+        unsigned long num_calls;
+        struct answer *answers;
+        unsigned long num_answers;
+        unsigned long answer_mask;
+        struct stat_row stats[MAX_STATS];
+        int num_stats;
+        unsigned long skipped;
+        unsigned long repeat;
+        enum replay_format format;
+        const char *output;
+        const char *classes;
+};
+
+/*
+ * Typed values, as written by record_util.c
+ */
+
+struct parser {
+        const CMPIBroker *broker;
+        const char *pos;
+        int failed;
+        char **strings;
+        int num_strings;
+        int max_strings;
+};
+
+static void *parse_fail(struct parser *p)
+{
+        p->failed = 1;
+        return NULL;
+}
+
+static char *keep_string(struct parser *p, char *str)
+{
+        char **tmp;
+
+        if (p->num_strings == p->max_strings) {
+                p->max_strings = p->max_strings ? p->max_strings * 2 : 16;
+                tmp = realloc(p->strings,
+                              p->max_strings * sizeof(*p->strings));
+                if (tmp == NULL) {
+                        free(str);
+                        return parse_fail(p);
+                }
+                p->strings = tmp;
+        }
+
+        p->strings[p->num_strings++] = str;
+
+        return str;
+}
+
+static void parser_free(struct parser *p)
+{
+        int i;
+
+        for (i = 0; i < p->num_strings; i++)
+                free(p->strings[i]);
+
+        free(p->strings);
+        p->strings = NULL;
+        p->num_strings = p->max_strings = 0;
+}
+
+static int expect(struct parser *p, char c)
+{
+        if (*p->pos != c) {
+                p->failed = 1;
+                return 0;
+        }
+
+        p->pos++;
+
+        return 1;
+}
+
+/*
+ * Parse "text", or ~ for NULL.  The result lives until parser_free().
+ */
+static char *parse_quoted(struct parser *p)
+{
+        char *str;
+        char *out;
+
+        if (*p->pos == '~') {
+                p->pos++;
+                return NULL;
+        }
+
+        if (!expect(p, '"'))
+                return NULL;
+
+        str = malloc(strlen(p->pos) + 1);
+        if (str == NULL)
+                return parse_fail(p);
+
+        out = str;
+        while ((*p->pos != '"') && (*p->pos != '\0')) {
+                if ((*p->pos == '\\') && (p->pos[1] != '\0')) {
+                        p->pos++;
+                        if (*p->pos == 't')
+                                *out++ = '\t';
+                        else if (*p->pos == 'n')
+                                *out++ = '\n';
+                        else
+                                *out++ = *p->pos;
+                } else {
+                        *out++ = *p->pos;
+                }
+                p->pos++;
+        }
+        *out = '\0';
+
+        if (!expect(p, '"')) {
+                free(str);
+                return NULL;
+        }
+
+        return keep_string(p, str);
+}
+
+static int parse_value(struct parser *p, CMPIValue *val, CMPIType *type);
+
+/*
+ * CMPI_chars values are passed as the string itself
+ */
+static CMPIValue *value_arg(CMPIValue *val, CMPIType type)
+{
+        if (type == CMPI_chars)
+                return (CMPIValue *)val->chars;
+
+        return val;
+}
+
+/*
+ * Parse "name"=value pairs up to the closing brace and hand each
+ * non-NULL one to fn
+ */
+static void parse_pairs(struct parser *p,
+                        void (*fn)(void *obj,
+                                   const char *name,
+                                   CMPIValue *val,
+                                   CMPIType type),
+                        void *obj)
+{
+        CMPIValue val;
+        CMPIType type;
+        char *name;
+
+        if (!expect(p, '{'))
+                return;
+
+        while (!p->failed && (*p->pos != '}')) {
+                name = parse_quoted(p);
+                if ((name == NULL) || !expect(p, '='))
+                        break;
+
+                if (parse_value(p, &val, &type) && (type != CMPI_null))
+                        fn(obj, name, value_arg(&val, type), type);
+
+                if (*p->pos == ',')
+                        p->pos++;
+        }
+
+        expect(p, '}');
+}
+
+static void add_key(void *obj, const char *name, CMPIValue *val, CMPIType type)
+{
+        CMAddKey((CMPIObjectPath *)obj, name, val, type);
+}
+
+static void set_prop(void *obj, const char *name, CMPIValue *val, CMPIType type)
+{
+        CMSetProperty((CMPIInstance *)obj, name, val, type);
+}
+
+static void add_arg(void *obj, const char *name, CMPIValue *val, CMPIType type)
+{
+        CMAddArg((CMPIArgs *)obj, name, val, type);
+}
+
+static CMPIObjectPath *parse_path_name(struct parser *p)
+{
+        CMPIObjectPath *op;
+        char *ns;
+        char *cn;
+
+        ns = parse_quoted(p);
+        if (!expect(p, ','))
+                return NULL;
+        cn = parse_quoted(p);
+        if (p->failed || (cn == NULL))
+                return parse_fail(p);
+
+        op = CMNewObjectPath(p->broker, ns, cn, NULL);
+        if (op == NULL)
+                return parse_fail(p);
+
+        return op;
+}
+
+/* P"ns","cn"{keys} */
+static CMPIObjectPath *parse_path(struct parser *p)
+{
+        CMPIObjectPath *op;
+
+        if (*p->pos == '~') {
+                p->pos++;
+                return NULL;
+        }
+
+        if (!expect(p, 'P'))
+                return NULL;
+
+        op = parse_path_name(p);
+        if (op == NULL)
+                return NULL;
+
+        parse_pairs(p, add_key, op);
+
+        return op;
+}
+
+/* I"ns","cn"{properties} */
+static CMPIInstance *parse_inst(struct parser *p)
+{
+        CMPIObjectPath *op;
+        CMPIInstance *inst;
+
+        if (!expect(p, 'I'))
+                return NULL;
+
+        op = parse_path_name(p);
+        if (op == NULL)
+                return NULL;
+
+        inst = CMNewInstance(p->broker, op, NULL);
+        if (inst == NULL)
+                return parse_fail(p);
+
+        parse_pairs(p, set_prop, inst);
+
+        return inst;
+}
+
+/* A<type>[value,...] */
+static CMPIArray *parse_array(struct parser *p, CMPIType *type)
+{
+        CMPIArray *array;
+        CMPIValue *vals = NULL;
+        CMPIType *types = NULL;
+        CMPICount count = 0;
+        CMPICount size = 0;
+        CMPICount i;
+        char *end;
+        void *tmp;
+
+        if (!expect(p, 'A'))
+                return NULL;
+
+        *type = strtoul(p->pos, &end, 10);
+        p->pos = end;
+        if (!(*type & CMPI_ARRAY) || !expect(p, '['))
+                return parse_fail(p);
+
+        while (!p->failed && (*p->pos != ']')) {
+                if (count == size) {
+                        size = size ? size * 2 : 8;
+                        tmp = realloc(vals, size * sizeof(*vals));
+                        if (tmp == NULL)
+                                break;
+                        vals = tmp;
+                        tmp = realloc(types, size * sizeof(*types));
+                        if (tmp == NULL)
+                                break;
+                        types = tmp;
+                }
+
+                if (!parse_value(p, &vals[count], &types[count]))
+                        break;
+                count++;
+
+                if (*p->pos == ',')
+                        p->pos++;
+        }
+
+        array = NULL;
+        if (expect(p, ']'))
+                array = CMNewArray(p->broker, count,
+                                   *type & ~CMPI_ARRAY, NULL);
+
+        for (i = 0; (array != NULL) && (i < count); i++) {
+                if (types[i] != CMPI_null)
+                        CMSetArrayElementAt(array, i,
+                                            value_arg(&vals[i], types[i]),
+                                            types[i]);
+        }
+
+        free(vals);
+        free(types);
+
+        if (array == NULL)
+                return parse_fail(p);
+
+        return array;
+}
+
+static int parse_number(struct parser *p,
+                        CMPIValue *val,
+                        CMPIType *type)
+{
+        static const struct {
+                const char *prefix;
+                CMPIType type;
+        } types[] = {
+                {"u8:", CMPI_uint8},
+                {"u16:", CMPI_uint16},
+                {"u32:", CMPI_uint32},
+                {"u64:", CMPI_uint64},
+                {"s8:", CMPI_sint8},
+                {"s16:", CMPI_sint16},
+                {"s32:", CMPI_sint32},
+                {"s64:", CMPI_sint64},
+                {"r32:", CMPI_real32},
+                {"r64:", CMPI_real64},
+                {"c16:", CMPI_char16},
+        };
+        unsigned long long u;
+        long long s;
+        double d;
+        char *end;
+        unsigned int i;
+        size_t len;
+
+        for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+                len = strlen(types[i].prefix);
+                if (strncmp(p->pos, types[i].prefix, len) == 0)
+                        break;
+        }
+
+        if (i == sizeof(types) / sizeof(types[0]))
+                return 0;
+
+        p->pos += len;
+        *type = types[i].type;
+
+        switch (*type) {
+        case CMPI_real32:
+        case CMPI_real64:
+                d = strtod(p->pos, &end);
+                if (*type == CMPI_real32)
+                        val->real32 = d;
+                else
+                        val->real64 = d;
+                break;
+        case CMPI_sint8:
+        case CMPI_sint16:
+        case CMPI_sint32:
+        case CMPI_sint64:
+                s = strtoll(p->pos, &end, 10);
+                if (*type == CMPI_sint8)
+                        val->sint8 = s;
+                else if (*type == CMPI_sint16)
+                        val->sint16 = s;
+                else if (*type == CMPI_sint32)
+                        val->sint32 = s;
+                else
+                        val->sint64 = s;
+                break;
+        default:
+                u = strtoull(p->pos, &end, 10);
+                if (*type == CMPI_uint8)
+                        val->uint8 = u;
+                else if (*type == CMPI_uint16)
+                        val->uint16 = u;
+                else if (*type == CMPI_uint32)
+                        val->uint32 = u;
+                else if (*type == CMPI_char16)
+                        val->char16 = u;
+                else
+                        val->uint64 = u;
+        }
+
+        if (end == p->pos)
+                return 0;
+
+        p->pos = end;
+
+        return 1;
+}
+
+/*
+ * Parse one value.  NULL, and values that could not be recorded, come
+ * back as CMPI_null.  Strings are returned as CMPI_chars.
+ */
+static int parse_value(struct parser *p, CMPIValue *val, CMPIType *type)
+{
+        memset(val, 0, sizeof(*val));
+        *type = CMPI_null;
+
+        switch (*p->pos) {
+        case '~':
+        case '?':
+                p->pos++;
+                break;
+        case '"':
+                val->chars = parse_quoted(p);
+                *type = CMPI_chars;
+                break;
+        case 'b':
+                p->pos++;
+                val->boolean = (*p->pos == '1');
+                if ((*p->pos != '0') && (*p->pos != '1'))
+                        p->failed = 1;
+                p->pos++;
+                *type = CMPI_boolean;
+                break;
+        case 'd':
+                /* The mock broker has no dateTime support */
+                p->pos++;
+                parse_quoted(p);
+                break;
+        case 'P':
+                val->ref = parse_path(p);
+                *type = CMPI_ref;
+                break;
+        case 'I':
+                val->inst = parse_inst(p);
+                *type = CMPI_instance;
+                break;
+        case 'A':
+                val->array = parse_array(p, type);
+                break;
+        default:
+                if (!parse_number(p, val, type))
+                        p->failed = 1;
+        }
+
+        return !p->failed;
+}
+
+static CMPIArgs *parse_args(struct parser *p)
+{
+        CMPIArgs *args;
+
+        args = CMNewArgs(p->broker, NULL);
+        if (args == NULL)
+                return parse_fail(p);
+
+        parse_pairs(p, add_arg, args);
+
+        return args;
+}
+
+/*
+ * Parse an array of strings into a NULL-terminated list, as passed
+ * for a property list
+ */
+static const char **parse_string_list(struct parser *p)
+{
+        const char **list = NULL;
+        const char **tmp;
+        char *end;
+        int count = 0;
+
+        if (*p->pos == '~') {
+                p->pos++;
+                return NULL;
+        }
+
+        if (!expect(p, 'A'))
+                return NULL;
+
+        strtoul(p->pos, &end, 10);
+        p->pos = end;
+        if (!expect(p, '['))
+                return NULL;
+
+        while (!p->failed) {
+                tmp = realloc(list, (count + 2) * sizeof(*list));
+                if (tmp == NULL)
+                        break;
+                list = tmp;
+                list[count] = NULL;
+
+                if (*p->pos == ']')
+                        break;
+
+                list[count++] = parse_quoted(p);
+                list[count] = NULL;
+
+                if (*p->pos == ',')
+                        p->pos++;
+        }
+
+        expect(p, ']');
+
+        keep_string(p, (char *)list);
+
+        return list;
+}
+
+static char *field_str(struct parser *p, const char *field)
+{
+        p->pos = field;
+
+        return parse_quoted(p);
+}
+
+static CMPIObjectPath *field_path(struct parser *p, const char *field)
+{
+        p->pos = field;
+
+        return parse_path(p);
+}
+
+/*
+ * Trace loading
+ */
+
+static uint64_t hash_str(uint64_t hash, const char *str)
+{
+        for (; *str != '\0'; str++)
+                hash = (hash ^ (unsigned char)*str) * 1099511628211ULL;
+
+        return hash;
+}
+
+static unsigned long answer_slot(const struct replay *r,
+                                 const char *cn,
+                                 const char *type)
+{
+        uint64_t hash;
+
+        hash = hash_str(14695981039346656037ULL, cn);
+        hash = hash_str(hash ^ '.', type);
+
+        return hash & r->answer_mask;
+}
+
+static int recorded_is_a(const CMPIBroker *broker,
+                         const char *cn,
+                         const char *type,
+                         void *data)
+{
+        const struct replay *r = data;
+        const struct answer *a;
+        unsigned long i;
+
+        if (r->answers == NULL)
+                return -1;
+
+        for (i = answer_slot(r, cn, type); ; i = (i + 1) & r->answer_mask) {
+                a = &r->answers[i];
+                if (a->cn == NULL)
+                        return -1;
+                if ((strcasecmp(a->cn, cn) == 0) &&
+                    (strcasecmp(a->type, type) == 0))
+                        return a->result;
+        }
+}
+
+/*
+ * Put the recorded CMClassPathIsA() answers in a hash table that is
+ * at most half full
+ */
+static int index_answers(struct replay *r, struct answer *list)
+{
+        unsigned long size = 16;
+        unsigned long i;
+        unsigned long slot;
+
+        while (size < r->num_answers * 2)
+                size *= 2;
+
+        r->answers = calloc(size, sizeof(*r->answers));
+        if (r->answers == NULL)
+                return 0;
+
+        r->answer_mask = size - 1;
+
+        for (i = 0; i < r->num_answers; i++) {
+                slot = answer_slot(r, list[i].cn, list[i].type);
+                while (r->answers[slot].cn != NULL)
+                        slot = (slot + 1) & r->answer_mask;
+                r->answers[slot] = list[i];
+        }
+
+        return 1;
+}
+
+static struct mi *find_mi(struct replay *r, const char *name, enum entry e)
+{
+        enum mi_kind kind;
+        int i;
+
+        if (e <= E_REFERENCE_NAMES)
+                kind = MI_ASSOCIATION;
+        else if (e == E_INVOKE_METHOD)
+                kind = MI_METHOD;
+        else
+                kind = MI_INDICATION;
+
+        for (i = 0; i < r->num_mis; i++) {
+                if ((r->mis[i].kind == kind) &&
+                    (strcmp(r->mis[i].name, name) == 0))
+                        return &r->mis[i];
+        }
+
+        return NULL;
+}
+
+static struct stat_row *find_stat(struct replay *r,
+                                  enum entry e,
+                                  const char *mi_name)
+{
+        struct stat_row *row;
+        int i;
+
+        for (i = 0; i < r->num_stats; i++) {
+                row = &r->stats[i];
+                if ((row->entry == e) && (strcmp(row->mi_name, mi_name) == 0))
+                        return row;
+        }
+
+        if (r->num_stats == MAX_STATS)
+                return NULL;
+
+        row = &r->stats[r->num_stats++];
+        row->entry = e;
+        row->mi_name = mi_name;
+
+        return row;
+}
+
+static int split_fields(char *line, char **fields)
+{
+        int count = 0;
+        char *p;
+
+        line[strcspn(line, "\n")] = '\0';
+
+        fields[count++] = line;
+        for (p = line; *p != '\0'; p++) {
+                if (*p != '\t')
+                        continue;
+                if (count == MAX_FIELDS)
+                        return -1;
+                *p = '\0';
+                fields[count++] = p + 1;
+        }
+
+        return count;
+}
+
+static int load_answer(struct parser *p,
+                       char **fields,
+                       int count,
+                       struct answer *a)
+{
+        char *cn;
+        char *type;
+
+        if (count != 4)
+                return 0;
+
+        cn = field_str(p, fields[1]);
+        type = field_str(p, fields[2]);
+        if (p->failed || (cn == NULL) || (type == NULL))
+                return 0;
+
+        a->cn = strdup(cn);
+        a->type = strdup(type);
+        a->result = (strcmp(fields[3], "b1") == 0);
+
+        return (a->cn != NULL) && (a->type != NULL);
+}
+
+static int load_trace(struct replay *r, const char *path)
+{
+        struct parser p;
+        struct answer *answers = NULL;
+        unsigned long max_answers = 0;
+        unsigned long max_calls = 0;
+        unsigned long lineno = 0;
+        struct call *c;
+        char *line = NULL;
+        size_t len = 0;
+        const char *mi_name;
+        char *fields[MAX_FIELDS];
+        int count;
+        int e;
+        FILE *fp;
+        void *tmp;
+
+        fp = fopen(path, "r");
+        if (fp == NULL) {
+                perror(path);
+                return 0;
+        }
+
+        memset(&p, 0, sizeof(p));
+
+        while (getline(&line, &len, fp) != -1) {
+                lineno++;
+
+                if ((line[0] == '#') || (line[0] == '\n'))
+                        continue;
+
+                count = split_fields(line, fields);
+
+                if (strcmp(fields[0], "ClassPathIsA") == 0) {
+                        if (r->num_answers == max_answers) {
+                                max_answers = max_answers ? max_answers * 2 : 64;
+                                tmp = realloc(answers,
+                                              max_answers * sizeof(*answers));
+                                if (tmp == NULL)
+                                        goto err;
+                                answers = tmp;
+                        }
+
+                        if (!load_answer(&p, fields, count,
+                                         &answers[r->num_answers]))
+                                goto bad;
+                        r->num_answers++;
+                        parser_free(&p);
+                        continue;
+                }
+
+                for (e = 0; e < E_MAX; e++) {
+                        if (strcmp(fields[0], entry_names[e]) == 0)
+                                break;
+                }
+
+                if ((e == E_MAX) || (count != entry_fields[e]))
+                        goto bad;
+
+                if (r->num_calls == max_calls) {
+                        max_calls = max_calls ? max_calls * 2 : 256;
+                        tmp = realloc(r->calls, max_calls * sizeof(*r->calls));
+                        if (tmp == NULL)
+                                goto err;
+                        r->calls = tmp;
+                }
+
+                c = &r->calls[r->num_calls];
+                memset(c, 0, sizeof(*c));
+
+                /* The fields point into the line, so keep it */
+                c->line = line;
+                memcpy(c->fields, fields, count * sizeof(*fields));
+                line = NULL;
+                len = 0;
+
+                c->entry = e;
+                c->rc = strtol(c->fields[2], NULL, 10);
+                c->rec_ns = strtoull(c->fields[3], NULL, 10);
+
+                mi_name = field_str(&p, c->fields[1]);
+                if (p.failed || (mi_name == NULL)) {
+                        free(c->line);
+                        goto bad;
+                }
+
+                c->mi = find_mi(r, mi_name, e);
+                if (c->mi == NULL) {
+                        fprintf(stderr, "%s:%lu: no loaded MI named %s\n",
+                                path, lineno, mi_name);
+                        free(c->line);
+                        r->skipped++;
+                        parser_free(&p);
+                        continue;
+                }
+
+                c->stat = find_stat(r, e, c->mi->name);
+                if (c->stat == NULL)
+                        goto err;
+
+                parser_free(&p);
+                r->num_calls++;
+        }
+
+        free(line);
+        fclose(fp);
+
+        if (!index_answers(r, answers))
+                return 0;
+
+        free(answers);
+
+        return 1;
+ bad:
+        fprintf(stderr, "%s:%lu: malformed record\n", path, lineno);
+ err:
+        parser_free(&p);
+        free(line);
+        free(answers);
+        fclose(fp);
+        return 0;
+}
+
+/*
+ * Provider setup
+ */
+
+static int add_mi(struct replay *r, void *mi, const char *name, enum mi_kind kind)
+{
+        if ((mi == NULL) || (r->num_mis == MAX_MIS))
+                return 0;
+
+        r->mis[r->num_mis].name = name;
+        r->mis[r->num_mis].kind = kind;
+        r->mis[r->num_mis].mi = mi;
+        r->num_mis++;
+
+        return 1;
+}
+
+static void *find_symbol(const char *name, const char *type)
+{
+        char sym[256];
+
+        snprintf(sym, sizeof(sym), "%s_Create_%sMI", name, type);
+
+        return dlsym(RTLD_DEFAULT, sym);
+}
+
+typedef CMPIAssociationMI *(*create_assoc_t)(const CMPIBroker *,
+                                             const CMPIContext *,
+                                             CMPIStatus *);
+typedef CMPIMethodMI *(*create_method_t)(const CMPIBroker *,
+                                         const CMPIContext *,
+                                         CMPIStatus *);
+typedef CMPIIndicationMI *(*create_ind_t)(const CMPIBroker *,
+                                          const CMPIContext *,
+                                          CMPIStatus *);
+
+/*
+ * Create every MI the named providers export.  Records name the MI
+ * they were made through by its miName, which is what the MIs are
+ * looked up by.
+ */
+static int load_mis(struct replay *r, const CMPIContext *context)
+{
+        create_assoc_t create_assoc;
+        create_method_t create_method;
+        create_ind_t create_ind;
+        CMPIAssociationMI *assoc;
+        CMPIMethodMI *method;
+        CMPIIndicationMI *ind;
+        int found;
+        int i;
+
+        for (i = 0; i < r->num_names; i++) {
+                found = 0;
+
+                create_assoc = find_symbol(r->names[i], "Association");
+                if (create_assoc != NULL) {
+                        assoc = create_assoc(r->broker, context, NULL);
+                        found += add_mi(r, assoc, assoc->ft->miName,
+                                        MI_ASSOCIATION);
+                }
+
+                create_method = find_symbol(r->names[i], "Method");
+                if (create_method != NULL) {
+                        method = create_method(r->broker, context, NULL);
+                        found += add_mi(r, method, method->ft->miName,
+                                        MI_METHOD);
+                }
+
+                create_ind = find_symbol(r->names[i], "Indication");
+                if (create_ind != NULL) {
+                        ind = create_ind(r->broker, context, NULL);
+                        found += add_mi(r, ind, ind->ft->miName,
+                                        MI_INDICATION);
+                }
+
+                if (!found) {
+                        fprintf(stderr, "No MIs exported by `%s'\n",
+                                r->names[i]);
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+
+/*
+ * Replay
+ */
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/*
+ * Rebuild the arguments of a call, then make it.  Only the MI call
+ * itself is timed.
+ */
+static CMPIStatus replay_call(struct replay *r,
+                              const CMPIContext *context,
+                              struct call *c,
+                              uint64_t *elapsed)
+{
+        CMPIStatus s = {CMPI_RC_ERR_FAILED, NULL};
+        struct parser p;
+        CMPIAssociationMI *ami = c->mi->mi;
+        CMPIMethodMI *mmi = c->mi->mi;
+        CMPIIndicationMI *imi = c->mi->mi;
+        CMPIResult *results;
+        CMPIArgs *argsin = NULL;
+        CMPIArgs *argsout;
+        CMPIObjectPath *ref;
+        const char *str[4] = {NULL, NULL, NULL, NULL};
+        const char **props = NULL;
+        bool flag = false;
+        uint64_t start;
+        int i;
+
+        memset(&p, 0, sizeof(p));
+        p.broker = r->broker;
+
+        results = mock_result_new(r->broker);
+        argsout = CMNewArgs(r->broker, NULL);
+        ref = NULL;
+        if (entry_fields[c->entry] > 4)
+                ref = field_path(&p, c->fields[4]);
+
+        switch (c->entry) {
+        case E_ASSOCIATORS:
+        case E_ASSOCIATOR_NAMES:
+                for (i = 0; i < 4; i++)
+                        str[i] = field_str(&p, c->fields[5 + i]);
+                p.pos = c->fields[9];
+                props = parse_string_list(&p);
+                break;
+        case E_REFERENCES:
+        case E_REFERENCE_NAMES:
+                for (i = 0; i < 2; i++)
+                        str[i] = field_str(&p, c->fields[5 + i]);
+                p.pos = c->fields[7];
+                props = parse_string_list(&p);
+                break;
+        case E_INVOKE_METHOD:
+                str[0] = field_str(&p, c->fields[5]);
+                p.pos = c->fields[6];
+                argsin = parse_args(&p);
+                break;
+        case E_ACTIVATE_FILTER:
+        case E_DEACTIVATE_FILTER:
+                flag = (strcmp(c->fields[5], "b1") == 0);
+                if (ref == NULL)
+                        p.failed = 1;
+                break;
+        default:
+                break;
+        }
+
+        if (p.failed || (results == NULL) || (argsout == NULL)) {
+                parser_free(&p);
+                s.rc = CMPI_RC_ERR_INVALID_PARAMETER;
+                *elapsed = 0;
+                return s;
+        }
+
+        start = now_ns();
+
+        switch (c->entry) {
+        case E_ASSOCIATORS:
+                s = ami->ft->associators(ami, context, results, ref,
+                                         str[0], str[1], str[2], str[3],
+                                         props);
+                break;
+        case E_ASSOCIATOR_NAMES:
+                s = ami->ft->associatorNames(ami, context, results, ref,
+                                             str[0], str[1], str[2], str[3]);
+                break;
+        case E_REFERENCES:
+                s = ami->ft->references(ami, context, results, ref,
+                                        str[0], str[1], props);
+                break;
+        case E_REFERENCE_NAMES:
+                s = ami->ft->referenceNames(ami, context, results, ref,
+                                            str[0], str[1]);
+                break;
+        case E_INVOKE_METHOD:
+                s = mmi->ft->invokeMethod(mmi, context, results, ref,
+                                          str[0], argsin, argsout);
+                break;
+        case E_ACTIVATE_FILTER:
+                s = imi->ft->activateFilter(imi, context, NULL,
+                                            CLASSNAME(ref), ref, flag);
+                break;
+        case E_DEACTIVATE_FILTER:
+                s = imi->ft->deActivateFilter(imi, context, NULL,
+                                              CLASSNAME(ref), ref, flag);
+                break;
+        case E_ENABLE_INDICATIONS:
+                imi->ft->enableIndications(imi, context);
+                s.rc = CMPI_RC_OK;
+                break;
+        case E_DISABLE_INDICATIONS:
+                imi->ft->disableIndications(imi, context);
+                s.rc = CMPI_RC_OK;
+                break;
+        default:
+                break;
+        }
+
+        *elapsed = now_ns() - start;
+
+        parser_free(&p);
+
+        return s;
+}
+
+static uint64_t replay_all(struct replay *r, const CMPIContext *context)
+{
+        struct call *c;
+        const void *mark;
+        CMPIStatus s;
+        uint64_t elapsed;
+        uint64_t total = 0;
+        unsigned long n;
+        unsigned long i;
+
+        for (n = 0; n < r->repeat; n++) {
+                for (i = 0; i < r->num_calls; i++) {
+                        c = &r->calls[i];
+                        mark = mock_objects_mark();
+
+                        s = replay_call(r, context, c, &elapsed);
+
+                        c->stat->calls++;
+                        c->stat->rec_ns += c->rec_ns;
+                        c->stat->replay_ns += elapsed;
+                        if (s.rc != c->rc)
+                                c->stat->mismatches++;
+                        total += elapsed;
+
+                        mock_release_objects_since(mark);
+                }
+        }
+
+        return total;
+}
+
+/*
+ * Output
+ */
+
+static void print_results(FILE *out,
+                          const struct replay *r,
+                          uint64_t total_ns)
+{
+        const struct stat_row *row;
+        unsigned long calls = 0;
+        double rec_us;
+        double replay_us;
+        int i;
+
+        if (r->format == FMT_TEXT)
+                fprintf(out, "%-20s %-32s %10s %14s %14s %10s\n",
+                        "entry", "mi", "calls", "recorded us", "replay us",
+                        "rc diffs");
+        else if (r->format == FMT_CSV)
+                fprintf(out, "entry,mi,calls,recorded_us,replay_us,"
+                        "rc_mismatches\n");
+        else
+                fprintf(out, "{\"results\": [");
+
+        for (i = 0; i < r->num_stats; i++) {
+                row = &r->stats[i];
+                if (row->calls == 0)
+                        continue;
+
+                calls += row->calls;
+                rec_us = row->rec_ns / 1e3 / row->calls;
+                replay_us = row->replay_ns / 1e3 / row->calls;
+
+                if (r->format == FMT_TEXT)
+                        fprintf(out, "%-20s %-32s %10lu %14.2f %14.2f %10lu\n",
+                                entry_names[row->entry], row->mi_name,
+                                row->calls, rec_us, replay_us,
+                                row->mismatches);
+                else if (r->format == FMT_CSV)
+                        fprintf(out, "%s,%s,%lu,%.3f,%.3f,%lu\n",
+                                entry_names[row->entry], row->mi_name,
+                                row->calls, rec_us, replay_us,
+                                row->mismatches);
+                else
+                        fprintf(out,
+                                "%s\n  {\"entry\": \"%s\", \"mi\": \"%s\", "
+                                "\"calls\": %lu, \"recorded_us\": %.3f, "
+                                "\"replay_us\": %.3f, "
+                                "\"rc_mismatches\": %lu}",
+                                (calls == row->calls) ? "" : ",",
+                                entry_names[row->entry], row->mi_name,
+                                row->calls, rec_us, replay_us,
+                                row->mismatches);
+        }
+
+        if (r->format == FMT_JSON)
+                fprintf(out, "\n]}\n");
+        else if (r->format == FMT_TEXT)
+                fprintf(out, "\n%lu calls in %.3f ms (%.0f calls/s), "
+                        "%lu records skipped\n",
+                        calls, total_ns / 1e6,
+                        total_ns ? calls / (total_ns / 1e9) : 0.0,
+                        r->skipped);
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "Usage: %s -m MODULE -P NAMES [-c FILE] [-n COUNT]\n"
+                "       [-f text|csv|json] [-o FILE] TRACE\n"
+                "\n"
+                "  -m MODULE  Provider library to load (may be repeated)\n"
+                "  -P NAMES   Provider names, as in NAME_Create_MethodMI\n"
+                "  -c FILE    Class hierarchy for the mock broker, for\n"
+                "             questions the trace has no answer to\n"
+                "  -n COUNT   Replay the trace COUNT times (default 1)\n"
+                "  -f FORMAT  Output format (default text)\n"
+                "  -o FILE    Write results to FILE\n"
+                "\n"
+                "TRACE is a file written by a provider run with\n"
+                "CU_RECORD set.\n",
+                prog);
+}
+
+static int parse_cmdline(struct replay *r, int argc, char **argv)
+{
+        char *name;
+        char *save = NULL;
+        int c;
+
+        r->repeat = 1;
+        r->format = FMT_TEXT;
+
+        while ((c = getopt(argc, argv, "m:P:c:n:f:o:h")) != -1) {
+                switch (c) {
+                case 'm':
+                        if (dlopen(optarg, RTLD_NOW | RTLD_GLOBAL) == NULL) {
+                                fprintf(stderr, "%s\n", dlerror());
+                                return 0;
+                        }
+                        break;
+                case 'P':
+                        for (name = strtok_r(optarg, ",", &save);
+                             name != NULL;
+                             name = strtok_r(NULL, ",", &save)) {
+                                if (r->num_names == MAX_NAMES)
+                                        goto err;
+                                r->names[r->num_names++] = name;
+                        }
+                        break;
+                case 'c':
+                        r->classes = optarg;
+                        break;
+                case 'n':
+                        r->repeat = strtoul(optarg, NULL, 10);
+                        break;
+                case 'f':
+                        if (strcmp(optarg, "text") == 0)
+                                r->format = FMT_TEXT;
+                        else if (strcmp(optarg, "csv") == 0)
+                                r->format = FMT_CSV;
+                        else if (strcmp(optarg, "json") == 0)
+                                r->format = FMT_JSON;
+                        else
+                                goto err;
+                        break;
+                case 'o':
+                        r->output = optarg;
+                        break;
+                default:
+                        goto err;
+                }
+        }
+
+        if ((optind == argc - 1) && (r->num_names > 0) && (r->repeat > 0))
+                return 1;
+ err:
+        usage(argv[0]);
+        return 0;
+}
+
+int main(int argc, char **argv)
+{
+        struct replay r;
+        CMPIBroker *broker;
+        CMPIContext *context;
+        FILE *out = stdout;
+        uint64_t total;
+        unsigned long i;
+
+        memset(&r, 0, sizeof(r));
+
+        if (!parse_cmdline(&r, argc, argv))
+                return 2;
+
+        broker = mock_broker_new();
+        if (broker == NULL) {
+                fprintf(stderr, "Unable to create mock broker\n");
+                return 1;
+        }
+
+        r.broker = broker;
+
+        if ((r.classes != NULL) &&
+            (mock_broker_load_classes(broker, r.classes) < 0)) {
+                fprintf(stderr, "Unable to load %s\n", r.classes);
+                return 1;
+        }
+
+        context = mock_context_new(broker);
+
+        if (!load_mis(&r, context) || !load_trace(&r, argv[optind]))
+                return 1;
+
+        mock_broker_set_is_a(broker, recorded_is_a, &r);
+
+        if (r.output != NULL) {
+                out = fopen(r.output, "w");
+                if (out == NULL) {
+                        perror(r.output);
+                        return 1;
+                }
+        }
+
+        total = replay_all(&r, context);
+
+        print_results(out, &r, total);
+
+        if (out != stdout)
+                fclose(out);
+
+        for (i = 0; i < r.num_calls; i++)
+                free(r.calls[i].line);
+        free(r.calls);
+        for (i = 0; i <= r.answer_mask; i++) {
+                free(r.answers[i].cn);
+                free(r.answers[i].type);
+        }
+        free(r.answers);
+
+        mock_release_objects();
+        mock_broker_free(broker);
+
+        return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
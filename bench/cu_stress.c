@@ -0,0 +1,1109 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+/*
+ * Drive a provider's MIs from many threads at once, the way a CIMOM's
+ * thread pool does, and report how throughput scales with the number
+ * of threads.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+
+#include "mock/mock_broker.h"
+
+#define MAX_NAMES    8
+#define MAX_ARGS     16
+#define MAX_STEPS    16
+#define MAX_THREADS  1024
+
+/*
+ * A step whose per-thread throughput falls below this fraction of the
+ * first step's is flagged.  If the threads were mostly on a CPU while
+ * it happened they were fighting over shared memory; if they were not,
+ * they were sleeping on a lock.
+ */
+#define MIN_EFFICIENCY 0.75
+#define MIN_CPU        0.75
+
+enum stress_op {
+        OP_ASSOCIATORS,
+        OP_ASSOCIATOR_NAMES,
+        OP_REFERENCES,
+        OP_REFERENCE_NAMES,
+        OP_INVOKE,
+        OP_RAISE,
+        OP_FILTER,
+        OP_MAX,
+};
+
+static const char *op_names[OP_MAX] = {
+        "associators",
+        "associatornames",
+        "references",
+        "referencenames",
+        "invoke",
+        "raise",
+        "filter",
+};
+
+enum stress_format {
+        FMT_TEXT,
+        FMT_CSV,
+        FMT_JSON,
+};
+
+struct stress_opts {
+        const char *names[MAX_NAMES];
+        int num_names;
+        const char *classes;
+        const char *assoc_ref;
+        const char *assoc_class;
+        const char *result_class;
+        const char *method_ref;
+        const char *method;
+        const char *args[MAX_ARGS];
+        int num_args;
+        const char *ind_ref;
+        const char *filter_ref;
+        unsigned int weights[OP_MAX];
+        int mix_given;
+        unsigned long threads[MAX_STEPS];
+        int num_steps;
+        unsigned long duration_ms;
+        enum stress_format format;
+        const char *output;
+};
+
+struct stress {
+        struct stress_opts opts;
+        CMPIBroker *broker;
+        CMPIAssociationMI *assoc_mi;
+        CMPIMethodMI *method_mi;
+        CMPIMethodMI *ind_method_mi;
+        CMPIIndicationMI *ind_mi;
+        unsigned int total_weight;
+        pthread_barrier_t barrier;
+        int stop;
+};
+
+/*
+ * Per-thread state, padded so that the counters of different threads
+ * do not share a cache line
+ */
+struct worker {
+        struct stress *st;
+        pthread_t thread;
+        uint32_t seed;
+        int ready;
+        unsigned long ops[OP_MAX];
+        unsigned long failures[OP_MAX];
+        CMPIrc last_rc[OP_MAX];
+        char last_msg[OP_MAX][80];
+        uint64_t cpu_ns;
+        long vcsw;
+} __attribute__((aligned(64)));
+
+struct step_result {
+        unsigned long threads;
+        unsigned long ops;
+        unsigned long failures;
+        double wall_s;
+        double cpu_s;
+        double ops_s;
+        double speedup;
+        double efficiency;
+        double cpu;
+        double vcsw_kop;
+        char note[64];
+};
+
+static uint64_t now_ns(clockid_t clock)
+{
+        struct timespec ts;
+
+        clock_gettime(clock, &ts);
+
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static long voluntary_switches(void)
+{
+#ifdef RUSAGE_THREAD
+        struct rusage ru;
+
+        if (getrusage(RUSAGE_THREAD, &ru) == 0)
+                return ru.ru_nvcsw;
+#endif
+        return 0;
+}
+
+/*
+ * Option parsing
+ */
+
+static int parse_threads(const char *str, struct stress_opts *opts)
+{
+        char *end;
+        unsigned long val;
+
+        opts->num_steps = 0;
+
+        while (*str != '\0') {
+                if (opts->num_steps == MAX_STEPS)
+                        return 0;
+
+                val = strtoul(str, &end, 10);
+                if ((end == str) || (val == 0) || (val > MAX_THREADS))
+                        return 0;
+
+                opts->threads[opts->num_steps++] = val;
+
+                if (*end == ',')
+                        end++;
+                else if (*end != '\0')
+                        return 0;
+
+                str = end;
+        }
+
+        return opts->num_steps > 0;
+}
+
+static int parse_names(char *str, struct stress_opts *opts)
+{
+        char *name;
+        char *save = NULL;
+
+        for (name = strtok_r(str, ",", &save);
+             name != NULL;
+             name = strtok_r(NULL, ",", &save)) {
+                if (opts->num_names == MAX_NAMES)
+                        return 0;
+                opts->names[opts->num_names++] = name;
+        }
+
+        return opts->num_names > 0;
+}
+
+static int parse_mix(char *str, struct stress_opts *opts)
+{
+        char *item;
+        char *save = NULL;
+        char *val;
+        int i;
+
+        memset(opts->weights, 0, sizeof(opts->weights));
+
+        for (item = strtok_r(str, ",", &save);
+             item != NULL;
+             item = strtok_r(NULL, ",", &save)) {
+                val = strchr(item, '=');
+                if (val != NULL)
+                        *val++ = '\0';
+
+                for (i = 0; i < OP_MAX; i++) {
+                        if (strcmp(item, op_names[i]) == 0)
+                                break;
+                }
+
+                if (i == OP_MAX) {
+                        fprintf(stderr, "Unknown operation `%s'\n", item);
+                        return 0;
+                }
+
+                opts->weights[i] = (val != NULL) ? strtoul(val, NULL, 10) : 1;
+        }
+
+        opts->mix_given = 1;
+
+        return 1;
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "Usage: %s -m MODULE -P NAMES [-c FILE] [-r PATH] [-a CLASS]\n"
+                "       [-R CLASS] [-i PATH] [-M METHOD] [-A NAME=VALUE]...\n"
+                "       [-e PATH] [-F PATH] [-x MIX] [-T LIST] [-t MS]\n"
+                "       [-f text|csv|json] [-o FILE]\n"
+                "\n"
+                "  -m MODULE  Provider library to load (may be repeated)\n"
+                "  -P NAMES   Provider names, as in NAME_Create_MethodMI\n"
+                "  -c FILE    Class hierarchy for the mock broker\n"
+                "  -r PATH    Source object for association requests\n"
+                "  -a CLASS   assocClass for association requests\n"
+                "  -R CLASS   resultClass for Associators(Names)\n"
+                "  -i PATH    Object to invoke -M on (default -r)\n"
+                "  -M METHOD  Method for `invoke'\n"
+                "  -A ARG     String argument for `invoke' (may be repeated)\n"
+                "  -e PATH    Indication class for `raise'\n"
+                "  -F PATH    Indication class whose filter `filter' toggles\n"
+                "  -x MIX     Operation weights, e.g. associators=4,invoke=1\n"
+                "  -T LIST    Thread counts (default 1,2,4,8,16,32,64)\n"
+                "  -t MS      Time spent at each thread count (default 1000)\n"
+                "  -f FORMAT  Output format (default text)\n"
+                "  -o FILE    Write results to FILE\n"
+                "\n"
+                "Operations: associators, associatornames, references,\n"
+                "referencenames, invoke, raise and filter.  The default\n"
+                "mix weighs every operation that has its options set\n"
+                "equally.  Paths have the form\n"
+                "namespace:ClassName.Key=\"value\".\n",
+                prog);
+}
+
+static int parse_args(struct stress_opts *opts, int argc, char **argv)
+{
+        int c;
+        void *handle;
+
+        memset(opts, 0, sizeof(*opts));
+
+        parse_threads("1,2,4,8,16,32,64", opts);
+        opts->duration_ms = 1000;
+        opts->format = FMT_TEXT;
+
+        while ((c = getopt(argc, argv, "m:P:c:r:a:R:i:M:A:e:F:x:T:t:f:o:h"))
+               != -1) {
+                switch (c) {
+                case 'm':
+                        handle = dlopen(optarg, RTLD_NOW | RTLD_GLOBAL);
+                        if (handle == NULL) {
+                                fprintf(stderr, "%s\n", dlerror());
+                                return 0;
+                        }
+                        break;
+                case 'P':
+                        if (!parse_names(optarg, opts))
+                                goto err;
+                        break;
+                case 'c':
+                        opts->classes = optarg;
+                        break;
+                case 'r':
+                        opts->assoc_ref = optarg;
+                        break;
+                case 'a':
+                        opts->assoc_class = optarg;
+                        break;
+                case 'R':
+                        opts->result_class = optarg;
+                        break;
+                case 'i':
+                        opts->method_ref = optarg;
+                        break;
+                case 'M':
+                        opts->method = optarg;
+                        break;
+                case 'A':
+                        if ((opts->num_args == MAX_ARGS) ||
+                            (strchr(optarg, '=') == NULL))
+                                goto err;
+                        opts->args[opts->num_args++] = optarg;
+                        break;
+                case 'e':
+                        opts->ind_ref = optarg;
+                        break;
+                case 'F':
+                        opts->filter_ref = optarg;
+                        break;
+                case 'x':
+                        if (!parse_mix(optarg, opts))
+                                goto err;
+                        break;
+                case 'T':
+                        if (!parse_threads(optarg, opts))
+                                goto err;
+                        break;
+                case 't':
+                        opts->duration_ms = strtoul(optarg, NULL, 10);
+                        break;
+                case 'f':
+                        if (strcmp(optarg, "text") == 0)
+                                opts->format = FMT_TEXT;
+                        else if (strcmp(optarg, "csv") == 0)
+                                opts->format = FMT_CSV;
+                        else if (strcmp(optarg, "json") == 0)
+                                opts->format = FMT_JSON;
+                        else
+                                goto err;
+                        break;
+                case 'o':
+                        opts->output = optarg;
+                        break;
+                default:
+                        goto err;
+                }
+        }
+
+        if (opts->method_ref == NULL)
+                opts->method_ref = opts->assoc_ref;
+
+        if ((optind == argc) && (opts->num_names > 0))
+                return 1;
+ err:
+        usage(argv[0]);
+        return 0;
+}
+
+/*
+ * Provider setup
+ */
+
+static void *find_symbol(const char *name, const char *type)
+{
+        char sym[256];
+
+        snprintf(sym, sizeof(sym), "%s_Create_%sMI", name, type);
+
+        return dlsym(RTLD_DEFAULT, sym);
+}
+
+typedef CMPIAssociationMI *(*create_assoc_t)(const CMPIBroker *,
+                                             const CMPIContext *,
+                                             CMPIStatus *);
+typedef CMPIMethodMI *(*create_method_t)(const CMPIBroker *,
+                                         const CMPIContext *,
+                                         CMPIStatus *);
+typedef CMPIIndicationMI *(*create_ind_t)(const CMPIBroker *,
+                                          const CMPIContext *,
+                                          CMPIStatus *);
+
+/*
+ * Create the MIs of the named providers.  A provider built with
+ * STDI_IndicationMIStub exports a method MI too; that one is used to
+ * raise indications, and the method MI of any other provider is used
+ * for `invoke'.
+ */
+static int load_mis(struct stress *st, const CMPIContext *context)
+{
+        create_assoc_t create_assoc;
+        create_method_t create_method;
+        create_ind_t create_ind;
+        int i;
+
+        for (i = 0; i < st->opts.num_names; i++) {
+                const char *name = st->opts.names[i];
+                int found = 0;
+
+                create_assoc = find_symbol(name, "Association");
+                create_method = find_symbol(name, "Method");
+                create_ind = find_symbol(name, "Indication");
+
+                if ((create_assoc != NULL) && (st->assoc_mi == NULL)) {
+                        st->assoc_mi = create_assoc(st->broker, context, NULL);
+                        found = 1;
+                }
+
+                if ((create_ind != NULL) && (st->ind_mi == NULL)) {
+                        st->ind_mi = create_ind(st->broker, context, NULL);
+                        if (create_method != NULL)
+                                st->ind_method_mi = create_method(st->broker,
+                                                                  context,
+                                                                  NULL);
+                        found = 1;
+                } else if ((create_method != NULL) &&
+                           (st->method_mi == NULL)) {
+                        st->method_mi = create_method(st->broker,
+                                                      context,
+                                                      NULL);
+                        found = 1;
+                }
+
+                if (!found) {
+                        fprintf(stderr, "No new MIs exported by `%s'\n", name);
+                        return 0;
+                }
+        }
+
+        return 1;
+}
+
+/*
+ * Check that each operation of the mix can be run, or pick the default
+ * mix
+ */
+static int check_mix(struct stress *st)
+{
+        struct stress_opts *opts = &st->opts;
+        int usable[OP_MAX];
+        int i;
+
+        usable[OP_ASSOCIATORS] = (st->assoc_mi != NULL) &&
+                (opts->assoc_ref != NULL);
+        usable[OP_ASSOCIATOR_NAMES] = usable[OP_ASSOCIATORS];
+        usable[OP_REFERENCES] = usable[OP_ASSOCIATORS];
+        usable[OP_REFERENCE_NAMES] = usable[OP_ASSOCIATORS];
+        usable[OP_INVOKE] = (st->method_mi != NULL) &&
+                (opts->method_ref != NULL) && (opts->method != NULL);
+        usable[OP_RAISE] = (st->ind_method_mi != NULL) &&
+                (opts->ind_ref != NULL);
+        usable[OP_FILTER] = (st->ind_mi != NULL) &&
+                (opts->filter_ref != NULL);
+
+        st->total_weight = 0;
+
+        for (i = 0; i < OP_MAX; i++) {
+                if (!opts->mix_given)
+                        opts->weights[i] = usable[i];
+                else if ((opts->weights[i] > 0) && !usable[i]) {
+                        fprintf(stderr,
+                                "Operation `%s' needs a provider or option "
+                                "that was not given\n", op_names[i]);
+                        return 0;
+                }
+
+                st->total_weight += opts->weights[i];
+        }
+
+        if (st->total_weight == 0) {
+                fprintf(stderr, "Nothing to run\n");
+                return 0;
+        }
+
+        return 1;
+}
+
+/*
+ * Turn indications on and activate the filter for the class raised by
+ * `raise', as a CIMOM does when a subscription is created
+ */
+static int enable_indications(struct stress *st, const CMPIContext *context)
+{
+        CMPIObjectPath *op;
+        CMPIStatus s;
+
+        if ((st->ind_mi == NULL) || (st->opts.ind_ref == NULL))
+                return 1;
+
+        op = mock_path_parse(st->broker, st->opts.ind_ref);
+        if (op == NULL) {
+                fprintf(stderr, "Invalid path `%s'\n", st->opts.ind_ref);
+                return 0;
+        }
+
+        st->ind_mi->ft->enableIndications(st->ind_mi, context);
+
+        s = st->ind_mi->ft->activateFilter(st->ind_mi, context, NULL,
+                                           CLASSNAME(op), op, true);
+        if (s.rc != CMPI_RC_OK) {
+                fprintf(stderr, "Unable to activate filter for %s\n",
+                        CLASSNAME(op));
+                return 0;
+        }
+
+        return 1;
+}
+
+/*
+ * Worker threads
+ */
+
+struct request_data {
+        const CMPIContext *context;
+        CMPIObjectPath *assoc_ref;
+        CMPIObjectPath *method_ref;
+        CMPIArgs *argsin;
+        CMPIObjectPath *ind_ref;
+        CMPIObjectPath *filter_ref;
+};
+
+static CMPIObjectPath *parse_path(const CMPIBroker *broker, const char *str)
+{
+        if (str == NULL)
+                return NULL;
+
+        return mock_path_parse(broker, str);
+}
+
+/*
+ * Build the per-thread request objects, as a CIMOM would for each
+ * request it dispatches
+ */
+static int request_setup(struct stress *st, struct request_data *req)
+{
+        const CMPIBroker *broker = st->broker;
+        struct stress_opts *opts = &st->opts;
+        char name[64];
+        const char *val;
+        int i;
+
+        req->context = mock_context_new(broker);
+        req->assoc_ref = parse_path(broker, opts->assoc_ref);
+        req->method_ref = parse_path(broker, opts->method_ref);
+        req->ind_ref = parse_path(broker, opts->ind_ref);
+        req->filter_ref = parse_path(broker, opts->filter_ref);
+        req->argsin = CMNewArgs(broker, NULL);
+
+        if ((req->context == NULL) || (req->argsin == NULL) ||
+            ((opts->assoc_ref != NULL) && (req->assoc_ref == NULL)) ||
+            ((opts->method_ref != NULL) && (req->method_ref == NULL)) ||
+            ((opts->ind_ref != NULL) && (req->ind_ref == NULL)) ||
+            ((opts->filter_ref != NULL) && (req->filter_ref == NULL)))
+                return 0;
+
+        for (i = 0; i < opts->num_args; i++) {
+                val = strchr(opts->args[i], '=');
+                snprintf(name, sizeof(name), "%.*s",
+                         (int)(val - opts->args[i]), opts->args[i]);
+                CMAddArg(req->argsin, name, (CMPIValue *)(val + 1),
+                         CMPI_chars);
+        }
+
+        return 1;
+}
+
+static enum stress_op pick_op(struct stress *st, struct worker *w)
+{
+        unsigned int r;
+        int i;
+
+        /* xorshift32 */
+        w->seed ^= w->seed << 13;
+        w->seed ^= w->seed >> 17;
+        w->seed ^= w->seed << 5;
+
+        r = w->seed % st->total_weight;
+
+        for (i = 0; i < OP_MAX - 1; i++) {
+                if (r < st->opts.weights[i])
+                        break;
+                r -= st->opts.weights[i];
+        }
+
+        return i;
+}
+
+static CMPIStatus run_op(struct stress *st,
+                         struct request_data *req,
+                         enum stress_op op)
+{
+        struct stress_opts *opts = &st->opts;
+        CMPIResult *results;
+        CMPIArgs *argsout;
+        CMPIArgs *ind_args;
+        CMPIInstance *ind;
+        CMPIStatus s = {CMPI_RC_ERR_FAILED, NULL};
+
+        results = mock_result_new(st->broker);
+        argsout = CMNewArgs(st->broker, NULL);
+        if ((results == NULL) || (argsout == NULL))
+                return s;
+
+        switch (op) {
+        case OP_ASSOCIATORS:
+                s = st->assoc_mi->ft->associators(st->assoc_mi,
+                                                  req->context,
+                                                  results,
+                                                  req->assoc_ref,
+                                                  opts->assoc_class,
+                                                  opts->result_class,
+                                                  NULL,
+                                                  NULL,
+                                                  NULL);
+                break;
+        case OP_ASSOCIATOR_NAMES:
+                s = st->assoc_mi->ft->associatorNames(st->assoc_mi,
+                                                      req->context,
+                                                      results,
+                                                      req->assoc_ref,
+                                                      opts->assoc_class,
+                                                      opts->result_class,
+                                                      NULL,
+                                                      NULL);
+                break;
+        case OP_REFERENCES:
+                s = st->assoc_mi->ft->references(st->assoc_mi,
+                                                 req->context,
+                                                 results,
+                                                 req->assoc_ref,
+                                                 opts->assoc_class,
+                                                 NULL,
+                                                 NULL);
+                break;
+        case OP_REFERENCE_NAMES:
+                s = st->assoc_mi->ft->referenceNames(st->assoc_mi,
+                                                     req->context,
+                                                     results,
+                                                     req->assoc_ref,
+                                                     opts->assoc_class,
+                                                     NULL);
+                break;
+        case OP_INVOKE:
+                s = st->method_mi->ft->invokeMethod(st->method_mi,
+                                                    req->context,
+                                                    results,
+                                                    req->method_ref,
+                                                    opts->method,
+                                                    req->argsin,
+                                                    argsout);
+                break;
+        case OP_RAISE:
+                /* The provider sets the path of the indication */
+                ind = CMNewInstance(st->broker, req->ind_ref, NULL);
+                ind_args = CMNewArgs(st->broker, NULL);
+                if ((ind == NULL) || (ind_args == NULL))
+                        break;
+
+                CMAddArg(ind_args, "TheIndication",
+                         (CMPIValue *)&ind, CMPI_instance);
+
+                s = st->ind_method_mi->ft->invokeMethod(st->ind_method_mi,
+                                                        req->context,
+                                                        results,
+                                                        req->ind_ref,
+                                                        "RaiseIndication",
+                                                        ind_args,
+                                                        argsout);
+                break;
+        case OP_FILTER:
+                s = st->ind_mi->ft->activateFilter(st->ind_mi,
+                                                   req->context,
+                                                   NULL,
+                                                   CLASSNAME(req->filter_ref),
+                                                   req->filter_ref,
+                                                   false);
+                if (s.rc != CMPI_RC_OK)
+                        break;
+
+                s = st->ind_mi->ft->deActivateFilter(st->ind_mi,
+                                                     req->context,
+                                                     NULL,
+                                                     CLASSNAME(req->filter_ref),
+                                                     req->filter_ref,
+                                                     false);
+                break;
+        default:
+                break;
+        }
+
+        return s;
+}
+
+static void *worker_thread(void *arg)
+{
+        struct worker *w = arg;
+        struct stress *st = w->st;
+        struct request_data req;
+        const void *mark;
+        enum stress_op op;
+        CMPIStatus s;
+        uint64_t cpu_start;
+        long vcsw_start;
+
+        memset(&req, 0, sizeof(req));
+        w->ready = request_setup(st, &req);
+
+        pthread_barrier_wait(&st->barrier);
+
+        cpu_start = now_ns(CLOCK_THREAD_CPUTIME_ID);
+        vcsw_start = voluntary_switches();
+
+        while (w->ready && !__atomic_load_n(&st->stop, __ATOMIC_RELAXED)) {
+                op = pick_op(st, w);
+                mark = mock_objects_mark();
+
+                s = run_op(st, &req, op);
+
+                w->ops[op]++;
+                if (s.rc != CMPI_RC_OK) {
+                        w->failures[op]++;
+                        w->last_rc[op] = s.rc;
+                        snprintf(w->last_msg[op], sizeof(w->last_msg[op]),
+                                 "%s",
+                                 (s.msg != NULL) ? CMGetCharPtr(s.msg) : "");
+                }
+
+                mock_release_objects_since(mark);
+        }
+
+        w->cpu_ns = now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+        w->vcsw = voluntary_switches() - vcsw_start;
+
+        mock_release_objects();
+
+        return NULL;
+}
+
+/*
+ * Run the mix on nthreads threads for the configured time
+ */
+static int run_step(struct stress *st,
+                    struct worker *workers,
+                    unsigned long nthreads,
+                    unsigned long duration_ms,
+                    double *wall_s)
+{
+        struct timespec ts;
+        uint64_t start;
+        unsigned long i;
+        int ret = 1;
+
+        memset(workers, 0, sizeof(*workers) * nthreads);
+        __atomic_store_n(&st->stop, 0, __ATOMIC_RELAXED);
+
+        if (pthread_barrier_init(&st->barrier, NULL, nthreads + 1) != 0)
+                return 0;
+
+        for (i = 0; i < nthreads; i++) {
+                workers[i].st = st;
+                workers[i].seed = 2463534242U + i;
+                if (pthread_create(&workers[i].thread, NULL,
+                                   worker_thread, &workers[i]) != 0) {
+                        fprintf(stderr, "Unable to start thread %lu\n", i);
+                        exit(1);
+                }
+        }
+
+        pthread_barrier_wait(&st->barrier);
+        start = now_ns(CLOCK_MONOTONIC);
+
+        ts.tv_sec = duration_ms / 1000;
+        ts.tv_nsec = (duration_ms % 1000) * 1000000;
+        nanosleep(&ts, NULL);
+
+        __atomic_store_n(&st->stop, 1, __ATOMIC_RELAXED);
+
+        for (i = 0; i < nthreads; i++) {
+                pthread_join(workers[i].thread, NULL);
+                if (!workers[i].ready)
+                        ret = 0;
+        }
+
+        *wall_s = (now_ns(CLOCK_MONOTONIC) - start) / 1e9;
+
+        pthread_barrier_destroy(&st->barrier);
+
+        return ret;
+}
+
+static void summarize(struct worker *workers,
+                      unsigned long nthreads,
+                      double wall_s,
+                      struct step_result *res)
+{
+        unsigned long i;
+        long vcsw = 0;
+        int op;
+
+        memset(res, 0, sizeof(*res));
+
+        res->threads = nthreads;
+        res->wall_s = wall_s;
+
+        for (i = 0; i < nthreads; i++) {
+                for (op = 0; op < OP_MAX; op++) {
+                        res->ops += workers[i].ops[op];
+                        res->failures += workers[i].failures[op];
+                }
+                res->cpu_s += workers[i].cpu_ns / 1e9;
+                vcsw += workers[i].vcsw;
+        }
+
+        res->ops_s = res->ops / wall_s;
+        if (res->ops > 0)
+                res->vcsw_kop = vcsw * 1000.0 / res->ops;
+}
+
+/*
+ * Compare a step against the first one.  Efficiency and CPU use are
+ * measured per CPU the threads could have kept busy, so that running
+ * more threads than there are CPUs is not counted against the
+ * provider.
+ */
+static void rate(struct step_result *res,
+                 const struct step_result *base,
+                 unsigned long ncpu)
+{
+        unsigned long used = res->threads < ncpu ? res->threads : ncpu;
+        unsigned long base_used = base->threads < ncpu ? base->threads : ncpu;
+        const char *note = "";
+
+        res->cpu = res->cpu_s / (res->wall_s * used);
+        res->speedup = res->ops_s / base->ops_s;
+        res->efficiency = (res->ops_s / used) / (base->ops_s / base_used);
+
+        if (res->failures > 0)
+                note = "errors";
+        else if ((res->efficiency < MIN_EFFICIENCY) && (res->cpu < MIN_CPU))
+                note = "blocked";
+        else if (res->efficiency < MIN_EFFICIENCY)
+                note = "contended";
+
+        snprintf(res->note, sizeof(res->note), "%s%s%s",
+                 note,
+                 (*note != '\0') && (res->threads > ncpu) ? "," : "",
+                 res->threads > ncpu ? "oversubscribed" : "");
+}
+
+/*
+ * Output
+ */
+
+static void print_header(FILE *out,
+                         const struct stress *st,
+                         unsigned long ncpu)
+{
+        const struct stress_opts *opts = &st->opts;
+        int first = 1;
+        int i;
+
+        if (opts->format == FMT_TEXT) {
+                fprintf(out, "cpus: %lu, mix:", ncpu);
+                for (i = 0; i < OP_MAX; i++) {
+                        if (opts->weights[i] > 0)
+                                fprintf(out, " %s=%u",
+                                        op_names[i], opts->weights[i]);
+                }
+                fprintf(out, "\n\n%7s %10s %12s %8s %6s %6s %10s %9s  %s\n",
+                        "threads", "ops", "ops/s", "speedup", "eff",
+                        "cpu", "vcsw/kop", "failures", "note");
+        } else if (opts->format == FMT_CSV) {
+                fprintf(out,
+                        "threads,ops,ops_s,speedup,efficiency,cpu,"
+                        "vcsw_kop,failures,note\n");
+        } else {
+                fprintf(out, "{\"cpus\": %lu, \"mix\": {", ncpu);
+                for (i = 0; i < OP_MAX; i++) {
+                        if (opts->weights[i] == 0)
+                                continue;
+                        fprintf(out, "%s\"%s\": %u", first ? "" : ", ",
+                                op_names[i], opts->weights[i]);
+                        first = 0;
+                }
+                fprintf(out, "}, \"steps\": [");
+        }
+}
+
+static void print_step(FILE *out,
+                       enum stress_format format,
+                       const struct step_result *res,
+                       int first)
+{
+        if (format == FMT_TEXT) {
+                fprintf(out,
+                        "%7lu %10lu %12.0f %8.2f %6.2f %6.2f %10.2f %9lu  %s\n",
+                        res->threads, res->ops, res->ops_s, res->speedup,
+                        res->efficiency, res->cpu, res->vcsw_kop,
+                        res->failures, res->note);
+        } else if (format == FMT_CSV) {
+                fprintf(out, "%lu,%lu,%.1f,%.3f,%.3f,%.3f,%.3f,%lu,%s\n",
+                        res->threads, res->ops, res->ops_s, res->speedup,
+                        res->efficiency, res->cpu, res->vcsw_kop,
+                        res->failures, res->note);
+        } else {
+                fprintf(out,
+                        "%s\n  {\"threads\": %lu, \"ops\": %lu, "
+                        "\"ops_s\": %.1f, \"speedup\": %.3f, "
+                        "\"efficiency\": %.3f, \"cpu\": %.3f, "
+                        "\"vcsw_kop\": %.3f, \"failures\": %lu, "
+                        "\"note\": \"%s\"}",
+                        first ? "" : ",",
+                        res->threads, res->ops, res->ops_s, res->speedup,
+                        res->efficiency, res->cpu, res->vcsw_kop,
+                        res->failures, res->note);
+        }
+
+        fflush(out);
+}
+
+static void print_footer(FILE *out,
+                         enum stress_format format,
+                         const struct step_result *results,
+                         int count)
+{
+        const struct step_result *peak = &results[0];
+        int i;
+
+        if (format == FMT_JSON) {
+                fprintf(out, "\n]}\n");
+                return;
+        }
+
+        if (format != FMT_TEXT)
+                return;
+
+        for (i = 1; i < count; i++) {
+                if (results[i].ops_s > peak->ops_s)
+                        peak = &results[i];
+        }
+
+        fprintf(out, "\nThroughput peaks at %lu threads (%.0f ops/s)\n",
+                peak->threads, peak->ops_s);
+
+        for (i = 0; i < count; i++) {
+                if (strstr(results[i].note, "blocked") != NULL) {
+                        fprintf(out,
+                                "Threads spend time asleep from %lu threads "
+                                "on: look for a contended lock\n",
+                                results[i].threads);
+                        break;
+                } else if (strstr(results[i].note, "contended") != NULL) {
+                        fprintf(out,
+                                "Per-thread throughput drops from %lu "
+                                "threads while the CPUs stay busy: look "
+                                "for shared data written on every "
+                                "request\n",
+                                results[i].threads);
+                        break;
+                }
+        }
+}
+
+/*
+ * Report the last error of each operation that failed, so that a bad
+ * option is not mistaken for a scaling problem
+ */
+static void print_errors(struct worker *workers, unsigned long nthreads)
+{
+        unsigned long i;
+        unsigned long failures;
+        struct worker *last;
+        int op;
+
+        for (op = 0; op < OP_MAX; op++) {
+                failures = 0;
+                last = NULL;
+
+                for (i = 0; i < nthreads; i++) {
+                        if (workers[i].failures[op] == 0)
+                                continue;
+                        failures += workers[i].failures[op];
+                        last = &workers[i];
+                }
+
+                if (last != NULL)
+                        fprintf(stderr, "%s: %lu failures, rc %d: %s\n",
+                                op_names[op], failures,
+                                last->last_rc[op], last->last_msg[op]);
+        }
+}
+
+int main(int argc, char **argv)
+{
+        struct stress st;
+        struct step_result results[MAX_STEPS];
+        struct worker *workers;
+        CMPIContext *context;
+        unsigned long max_threads = 0;
+        unsigned long ncpu;
+        double wall_s;
+        FILE *out = stdout;
+        int i;
+
+        memset(&st, 0, sizeof(st));
+
+        if (!parse_args(&st.opts, argc, argv))
+                return 2;
+
+        st.broker = mock_broker_new();
+        if (st.broker == NULL) {
+                fprintf(stderr, "Unable to create mock broker\n");
+                return 1;
+        }
+
+        /* The broker's counters would be the hottest shared data */
+        mock_broker_set_counting(st.broker, 0);
+
+        if ((st.opts.classes != NULL) &&
+            (mock_broker_load_classes(st.broker, st.opts.classes) < 0)) {
+                fprintf(stderr, "Unable to load %s\n", st.opts.classes);
+                return 1;
+        }
+
+        context = mock_context_new(st.broker);
+
+        if (!load_mis(&st, context) ||
+            !check_mix(&st) ||
+            !enable_indications(&st, context))
+                return 1;
+
+        for (i = 0; i < st.opts.num_steps; i++) {
+                if (st.opts.threads[i] > max_threads)
+                        max_threads = st.opts.threads[i];
+        }
+
+        workers = calloc(max_threads, sizeof(*workers));
+        if (workers == NULL)
+                return 1;
+
+        if (st.opts.output != NULL) {
+                out = fopen(st.opts.output, "w");
+                if (out == NULL) {
+                        perror(st.opts.output);
+                        return 1;
+                }
+        }
+
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+        /* Warm up caches and lazily initialized state */
+        if (!run_step(&st, workers, 1, st.opts.duration_ms / 5, &wall_s)) {
+                fprintf(stderr, "Unable to set up requests\n");
+                return 1;
+        }
+
+        print_header(out, &st, ncpu);
+
+        for (i = 0; i < st.opts.num_steps; i++) {
+                if (!run_step(&st, workers, st.opts.threads[i],
+                              st.opts.duration_ms, &wall_s)) {
+                        fprintf(stderr, "Unable to set up requests\n");
+                        return 1;
+                }
+
+                summarize(workers, st.opts.threads[i], wall_s, &results[i]);
+                rate(&results[i], &results[0], ncpu);
+                print_step(out, st.opts.format, &results[i], i == 0);
+                print_errors(workers, st.opts.threads[i]);
+        }
+
+        print_footer(out, st.opts.format, results, st.opts.num_steps);
+
+        if (out != stdout)
+                fclose(out);
+
+        free(workers);
+        mock_release_objects();
+        mock_broker_free(st.broker);
+
+        return 0;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,82 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+/*
+ * The indication half of the cu_stress provider.  It is kept apart
+ * from stress_provider.c because the indication stub also defines a
+ * method MI.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+#include "std_indication.h"
+
+static const CMPIBroker *_BROKER;
+
+static CMPIStatus StressIndicationCleanup(CMPIIndicationMI *mi,
+                                          const CMPIContext *ctx,
+                                          CMPIBoolean terminating)
+{
+        CMReturn(CMPI_RC_OK);
+}
+
+static CMPIStatus StressAuthorizeFilter(CMPIIndicationMI *mi,
+                                        const CMPIContext *ctx,
+                                        const CMPISelectExp *se,
+                                        const char *ns,
+                                        const CMPIObjectPath *op,
+                                        const char *user)
+{
+        CMReturn(CMPI_RC_OK);
+}
+
+static CMPIStatus StressMustPoll(CMPIIndicationMI *mi,
+                                 const CMPIContext *ctx,
+                                 const CMPISelectExp *se,
+                                 const char *ns,
+                                 const CMPIObjectPath *op)
+{
+        RETURN_UNSUPPORTED();
+}
+
+DECLARE_FILTER(stress_filter, "Stress_Indication");
+DECLARE_FILTER(other_filter, "Stress_OtherIndication");
+
+static struct std_ind_filter *filters[] = {
+        &stress_filter,
+        &other_filter,
+        NULL
+};
+
+STDI_IndicationMIStub(Stress, Stress_Indication, _BROKER,
+                      CMNoHook, NULL, filters);
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
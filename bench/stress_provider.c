@@ -0,0 +1,199 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+/*
+ * A provider for cu_stress, built as a loadable module like any other
+ * CMPI provider.  It exports an association MI (Stress_SystemDevice)
+ * and a method MI (Stress_Method) built on the standard stubs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+#include "std_association.h"
+#include "std_invokemethod.h"
+
+/* Number of devices returned for each system */
+#define STRESS_DEVICES 16
+
+static const CMPIBroker *_BROKER;
+
+/*
+ * Stress_SystemDevice
+ */
+
+static CMPIInstance *make_device(const CMPIObjectPath *ref,
+                                 const char *sysname,
+                                 int id)
+{
+        CMPIObjectPath *op;
+        CMPIInstance *inst;
+        char devid[32];
+        uint16_t state = 2;
+
+        op = CMNewObjectPath(_BROKER, NAMESPACE(ref), "Stress_Device", NULL);
+        if (op == NULL)
+                return NULL;
+
+        inst = CMNewInstance(_BROKER, op, NULL);
+        if (inst == NULL)
+                return NULL;
+
+        snprintf(devid, sizeof(devid), "dev%d", id);
+
+        CMSetProperty(inst, "SystemName", (CMPIValue *)sysname, CMPI_chars);
+        CMSetProperty(inst, "DeviceID", (CMPIValue *)devid, CMPI_chars);
+        CMSetProperty(inst, "ElementName", (CMPIValue *)devid, CMPI_chars);
+        CMSetProperty(inst, "EnabledState", (CMPIValue *)&state, CMPI_uint16);
+
+        return inst;
+}
+
+static CMPIStatus system_to_device(const CMPIObjectPath *ref,
+                                   struct std_assoc_info *info,
+                                   struct inst_list *list)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+        CMPIInstance *inst;
+        const char *name;
+        int i;
+
+        if (cu_get_str_path(ref, "Name", &name) != CMPI_RC_OK) {
+                cu_statusf(_BROKER, &s,
+                           CMPI_RC_ERR_FAILED,
+                           "Missing key: Name");
+                return s;
+        }
+
+        for (i = 0; i < STRESS_DEVICES; i++) {
+                inst = make_device(ref, name, i);
+                if ((inst == NULL) || !inst_list_add(list, inst)) {
+                        cu_statusf(_BROKER, &s,
+                                   CMPI_RC_ERR_FAILED,
+                                   "Unable to create device");
+                        break;
+                }
+        }
+
+        return s;
+}
+
+static CMPIInstance *make_ref(const CMPIObjectPath *source_ref,
+                              const CMPIInstance *target_inst,
+                              struct std_assoc_info *info,
+                              struct std_assoc *assoc)
+{
+        CMPIObjectPath *op;
+        CMPIInstance *inst;
+
+        op = CMNewObjectPath(_BROKER, NAMESPACE(source_ref),
+                             "Stress_SystemDevice", NULL);
+        if (op == NULL)
+                return NULL;
+
+        inst = CMNewInstance(_BROKER, op, NULL);
+        if (inst == NULL)
+                return NULL;
+
+        set_reference(assoc, inst,
+                      source_ref,
+                      CMGetObjectPath(target_inst, NULL));
+
+        return inst;
+}
+
+static char *system_classes[] = {"Stress_System", NULL};
+static char *device_classes[] = {"Stress_Device", NULL};
+static char *assoc_classes[] = {"Stress_SystemDevice", NULL};
+
+static struct std_assoc system_to_device_assoc = {
+        .source_class = system_classes,
+        .source_prop = "GroupComponent",
+
+        .target_class = device_classes,
+        .target_prop = "PartComponent",
+
+        .assoc_class = assoc_classes,
+
+        .handler = system_to_device,
+        .make_ref = make_ref,
+};
+
+static struct std_assoc *assoc_handlers[] = {
+        &system_to_device_assoc,
+        NULL
+};
+
+STDA_AssocMIStub(, Stress_SystemDevice, _BROKER, CMNoHook, assoc_handlers);
+
+/*
+ * Stress_Method
+ */
+
+static CMPIStatus ping(CMPIMethodMI *self,
+                       const CMPIContext *context,
+                       const CMPIResult *results,
+                       const CMPIObjectPath *reference,
+                       const CMPIArgs *argsin,
+                       CMPIArgs *argsout)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+        const char *name;
+        uint32_t rc = 0;
+
+        if (cu_get_str_arg(argsin, "Name", &name) != CMPI_RC_OK) {
+                cu_statusf(_BROKER, &s,
+                           CMPI_RC_ERR_INVALID_PARAMETER,
+                           "Missing argument: Name");
+                return s;
+        }
+
+        CMAddArg(argsout, "Reply", (CMPIValue *)name, CMPI_chars);
+        CMReturnData(results, (CMPIValue *)&rc, CMPI_uint32);
+
+        return s;
+}
+
+static struct method_handler ping_method = {
+        .name = "Ping",
+        .handler = ping,
+        .args = {{"Name", CMPI_string, false},
+                 ARG_END
+        }
+};
+
+static struct method_handler *method_handlers[] = {
+        &ping_method,
+        NULL
+};
+
+STDIM_MethodMIStub(, Stress_Method, _BROKER, CMNoHook, method_handlers);
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,546 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#include "cu_binlog.h"
+
+/* Formats that can be given an id, a power of two */
+#define MAX_FORMATS 4096
+
+/* Longest argument signature, one character per argument or width */
+#define MAX_SIG 32
+
+/* Longer formats are sent as text, so F and M fit in CU_BINLOG_MIN_BUF */
+#define MAX_FORMAT_LEN 512
+
+struct format_entry {
+        const char *fmt;
+        uint32_t id;
+        bool ok;
+        char sig[MAX_SIG];
+};
+
+struct enc {
+        char *buf;
+        size_t len;
+        size_t size;
+};
+
+/*
+ * Open-addressed by the format's address.  Entries are filled under
+ * format_lock, fmt being stored last, and never emptied (until fork),
+ * so lookups take no lock.
+ */
+static struct format_entry formats[MAX_FORMATS];
+static struct format_entry *by_id[MAX_FORMATS + 1];
+static uint32_t next_id = 1;
+static pthread_mutex_t format_lock = PTHREAD_MUTEX_INITIALIZER;
+
+bool cu_binlog_next_conv(const char **fmt, struct cu_binlog_conv *conv)
+{
+        const char *p;
+        char mod = 0;
+
+        p = strchr(*fmt, '%');
+        if (p == NULL)
+                return false;
+
+        conv->start = p++;
+        conv->stars = 0;
+        conv->kind = '?';
+
+        if (*p == '%') {
+                conv->kind = '%';
+                p++;
+                goto out;
+        }
+
+        p += strspn(p, "-+ #0'");
+
+        if (*p == '*') {
+                conv->stars++;
+                p++;
+        } else {
+                p += strspn(p, "0123456789");
+                if (*p == '$')
+                        goto out;
+        }
+
+        if (*p == '.') {
+                p++;
+                if (*p == '*') {
+                        conv->stars++;
+                        p++;
+                } else {
+                        p += strspn(p, "0123456789");
+                }
+        }
+
+        if (*p == 'h') {
+                mod = 'h';
+                if (*++p == 'h')
+                        p++;
+        } else if (*p == 'l') {
+                mod = 'l';
+                if (*++p == 'l') {
+                        mod = 'q';
+                        p++;
+                }
+        } else if ((*p != '\0') && (strchr("Lqjzt", *p) != NULL)) {
+                mod = *p++;
+        }
+
+        switch (*p) {
+        case 'c':
+                if (mod == 'l')
+                        break;
+                /* fall through */
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+                if ((mod == 0) || (mod == 'h'))
+                        conv->kind = 'i';
+                else if (mod == 'L')
+                        conv->kind = 'q';
+                else
+                        conv->kind = mod;
+                break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+                conv->kind = (mod == 'L') ? 'D' : 'd';
+                break;
+        case 's':
+                if (mod == 0)
+                        conv->kind = 's';
+                break;
+        case 'p':
+        case 'm':
+                if (mod == 0)
+                        conv->kind = *p;
+                break;
+        }
+
+        if (*p != '\0')
+                p++;
+ out:
+        conv->end = p;
+        *fmt = p;
+
+        return true;
+}
+
+static bool make_sig(const char *fmt, char *sig)
+{
+        struct cu_binlog_conv conv;
+        int len = 0;
+        int i;
+
+        if (strlen(fmt) > MAX_FORMAT_LEN)
+                return false;
+
+        while (cu_binlog_next_conv(&fmt, &conv)) {
+                if (conv.kind == '%')
+                        continue;
+
+                if ((conv.kind == '?') || (len + conv.stars + 1 >= MAX_SIG))
+                        return false;
+
+                for (i = 0; i < conv.stars; i++)
+                        sig[len++] = '*';
+                sig[len++] = conv.kind;
+        }
+
+        sig[len] = '\0';
+
+        return true;
+}
+
+static uint32_t hash_ptr(const void *ptr)
+{
+        uint64_t h = (uintptr_t)ptr;
+
+        h *= 0x9e3779b97f4a7c15ULL;
+
+        return h >> 32;
+}
+
+/*
+ * Find the entry for fmt, adding it if this is the first time it is
+ * logged.  Returns NULL if fmt cannot be given an id.
+ */
+static struct format_entry *find_format(const char *fmt, bool *is_new)
+{
+        struct format_entry *entry;
+        const char *cur;
+        uint32_t hash = hash_ptr(fmt);
+        Dl_info info;
+        int n;
+
+        for (n = 0; n < MAX_FORMATS; n++) {
+                entry = &formats[(hash + n) & (MAX_FORMATS - 1)];
+                cur = __atomic_load_n(&entry->fmt, __ATOMIC_ACQUIRE);
+                if (cur == fmt)
+                        return entry;
+                if (cur == NULL)
+                        break;
+        }
+
+        /* A format built at run time may not be there next time */
+        if ((n == MAX_FORMATS) || (dladdr(fmt, &info) == 0))
+                return NULL;
+
+        pthread_mutex_lock(&format_lock);
+
+        for (; n < MAX_FORMATS; n++) {
+                entry = &formats[(hash + n) & (MAX_FORMATS - 1)];
+                if (entry->fmt == fmt)
+                        goto out;
+
+                if (entry->fmt == NULL) {
+                        entry->id = next_id;
+                        entry->ok = make_sig(fmt, entry->sig);
+                        by_id[entry->id] = entry;
+                        __atomic_store_n(&entry->fmt, fmt, __ATOMIC_RELEASE);
+                        __atomic_store_n(&next_id, entry->id + 1,
+                                         __ATOMIC_RELEASE);
+                        *is_new = true;
+                        goto out;
+                }
+        }
+
+        entry = NULL;
+ out:
+        pthread_mutex_unlock(&format_lock);
+
+        return entry;
+}
+
+void cu_binlog_reset(void)
+{
+        memset(formats, 0, sizeof(formats));
+        memset(by_id, 0, sizeof(by_id));
+        next_id = 1;
+}
+
+uint32_t cu_binlog_formats(void)
+{
+        return __atomic_load_n(&next_id, __ATOMIC_ACQUIRE) - 1;
+}
+
+static void put(struct enc *enc, const void *data, size_t len)
+{
+        memcpy(enc->buf + enc->len, data, len);
+        enc->len += len;
+}
+
+static void put32(struct enc *enc, uint32_t val)
+{
+        put(enc, &val, sizeof(val));
+}
+
+static void put64(struct enc *enc, uint64_t val)
+{
+        put(enc, &val, sizeof(val));
+}
+
+static void put_ns(struct enc *enc, const struct timespec *ts)
+{
+        put64(enc, ((uint64_t)ts->tv_sec * 1000000000ULL) + ts->tv_nsec);
+}
+
+static size_t begin(struct enc *enc, char type)
+{
+        size_t start = enc->len;
+
+        put32(enc, 0);
+        put(enc, &type, 1);
+
+        return start;
+}
+
+static void finish(struct enc *enc, size_t start)
+{
+        uint32_t len = enc->len - start;
+
+        memcpy(enc->buf + start, &len, sizeof(len));
+}
+
+size_t cu_binlog_session(char *buf)
+{
+        struct enc enc = {buf, 0, 32};
+        size_t start;
+
+        start = begin(&enc, CU_BINLOG_SESSION);
+        put32(&enc, CU_BINLOG_ORDER);
+        put32(&enc, CU_BINLOG_VERSION);
+        put32(&enc, getpid());
+        finish(&enc, start);
+
+        return enc.len;
+}
+
+size_t cu_binlog_batch(char *buf)
+{
+        struct enc enc = {buf, 0, 16};
+        size_t start;
+
+        start = begin(&enc, CU_BINLOG_BATCH);
+        put32(&enc, getpid());
+        finish(&enc, start);
+
+        return enc.len;
+}
+
+size_t cu_binlog_format(char *buf, size_t size, uint32_t id)
+{
+        struct enc enc = {buf, 0, size};
+        struct format_entry *entry;
+        size_t fmt_len;
+        size_t start;
+
+        if ((id == 0) || (id > cu_binlog_formats()))
+                return 0;
+
+        entry = by_id[id];
+        if ((entry == NULL) || !entry->ok)
+                return 0;
+
+        fmt_len = strlen(entry->fmt);
+        if (CU_BINLOG_HEADER + 4 + fmt_len > size)
+                return 0;
+
+        start = begin(&enc, CU_BINLOG_FORMAT);
+        put32(&enc, id);
+        put(&enc, entry->fmt, fmt_len);
+        finish(&enc, start);
+
+        return enc.len;
+}
+
+size_t cu_binlog_text(char *buf,
+                      size_t size,
+                      uint32_t tid,
+                      const struct timespec *real,
+                      const struct timespec *mono,
+                      const char *text)
+{
+        struct enc enc = {buf, 0, size};
+        size_t start;
+        size_t len = strlen(text);
+
+        if (len > size - (CU_BINLOG_HEADER + 20))
+                len = size - (CU_BINLOG_HEADER + 20);
+
+        start = begin(&enc, CU_BINLOG_TEXT);
+        put32(&enc, tid);
+        put_ns(&enc, real);
+        put_ns(&enc, mono);
+        put(&enc, text, len);
+        finish(&enc, start);
+
+        return enc.len;
+}
+
+static size_t fixed_size(char kind)
+{
+        switch (kind) {
+        case '*':
+        case 'i':
+        case 's':
+        case 'm':
+                return 4;
+        default:
+                return 8;
+        }
+}
+
+static void put_str(struct enc *enc, const char *str, size_t room)
+{
+        size_t len;
+
+        if (str == NULL) {
+                put32(enc, CU_BINLOG_NULL_STRING);
+                return;
+        }
+
+        len = strlen(str);
+        if (len > room)
+                len = room;
+
+        put32(enc, len);
+        put(enc, str, len);
+}
+
+static size_t encode_text(struct enc *enc,
+                          uint32_t tid,
+                          const struct timespec *real,
+                          const struct timespec *mono,
+                          const char *fmt,
+                          va_list ap)
+{
+        size_t start;
+        int len;
+
+        start = begin(enc, CU_BINLOG_TEXT);
+        put32(enc, tid);
+        put_ns(enc, real);
+        put_ns(enc, mono);
+
+        len = vsnprintf(enc->buf + enc->len, enc->size - enc->len, fmt, ap);
+        if (len > 0)
+                enc->len += ((size_t)len < enc->size - enc->len) ?
+                        (size_t)len : enc->size - enc->len - 1;
+
+        finish(enc, start);
+
+        return enc->len;
+}
+
+size_t cu_binlog_message(char *buf,
+                         size_t size,
+                         uint32_t tid,
+                         const struct timespec *real,
+                         const struct timespec *mono,
+                         int err,
+                         const char *fmt,
+                         va_list ap,
+                         size_t *format_len)
+{
+        struct enc enc = {buf, 0, size};
+        struct format_entry *entry;
+        char inline_sig[MAX_SIG];
+        char errbuf[128];
+        const char *sig;
+        const char *p;
+        bool is_new = false;
+        uint32_t id = 0;
+        size_t need = 0;
+        size_t fmt_len;
+        size_t start;
+
+        *format_len = 0;
+
+        entry = find_format(fmt, &is_new);
+        if (entry != NULL) {
+                if (!entry->ok)
+                        return encode_text(&enc, tid, real, mono, fmt, ap);
+                id = entry->id;
+                sig = entry->sig;
+        } else {
+                if (!make_sig(fmt, inline_sig))
+                        return encode_text(&enc, tid, real, mono, fmt, ap);
+                sig = inline_sig;
+        }
+
+        for (p = sig; *p != '\0'; p++)
+                need += fixed_size(*p);
+
+        if (is_new || (id == 0)) {
+                fmt_len = strlen(fmt);
+
+                start = begin(&enc, CU_BINLOG_FORMAT);
+                put32(&enc, id);
+                put(&enc, fmt, fmt_len);
+                finish(&enc, start);
+
+                if (id != 0)
+                        *format_len = enc.len;
+        }
+
+        start = begin(&enc, CU_BINLOG_MESSAGE);
+        put32(&enc, id);
+        put32(&enc, tid);
+        put_ns(&enc, real);
+        put_ns(&enc, mono);
+
+        for (p = sig; *p != '\0'; p++) {
+                need -= fixed_size(*p);
+
+                switch (*p) {
+                case '*':
+                case 'i':
+                        put32(&enc, va_arg(ap, int));
+                        break;
+                case 'l':
+                        put64(&enc, va_arg(ap, long));
+                        break;
+                case 'q':
+                        put64(&enc, va_arg(ap, long long));
+                        break;
+                case 'j':
+                        put64(&enc, va_arg(ap, intmax_t));
+                        break;
+                case 'z':
+                        put64(&enc, va_arg(ap, size_t));
+                        break;
+                case 't':
+                        put64(&enc, va_arg(ap, ptrdiff_t));
+                        break;
+                case 'p':
+                        put64(&enc, (uintptr_t)va_arg(ap, void *));
+                        break;
+                case 'd': {
+                        double val = va_arg(ap, double);
+                        put(&enc, &val, sizeof(val));
+                        break;
+                }
+                case 'D': {
+                        double val = va_arg(ap, long double);
+                        put(&enc, &val, sizeof(val));
+                        break;
+                }
+                case 's':
+                        put_str(&enc, va_arg(ap, const char *),
+                                size - enc.len - 4 - need);
+                        break;
+                case 'm':
+                        put_str(&enc, strerror_r(err, errbuf, sizeof(errbuf)),
+                                size - enc.len - 4 - need);
+                        break;
+                }
+        }
+
+        finish(&enc, start);
+
+        return enc.len;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,182 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_ARENA_H
+#define __CU_ARENA_H
+
+#include <stddef.h>
+#include <stdarg.h>
+
+#include "cu_mem.h"
+
+/*
+ * Request arenas
+ *
+ * An arena hands out memory by bumping a pointer through large blocks,
+ * and gives it all back at once when it ends.  The standard MIs
+ * (stda_*, _std_invokemethod and the stdi_* calls) begin one for each
+ * call, which becomes the calling thread's current arena until the call
+ * returns, and the library takes the temporary memory of the call from
+ * it: the association result lists, cu_statusf() messages and the
+ * buffers of the embedded instance parsers.  Each thread keeps a block
+ * from one call to the next, so a typical call does not call malloc()
+ * for any of these.
+ *
+ * Handlers can use the current arena too, through cu_tmp_alloc() and
+ * friends, for memory that is not needed after they return.  Nothing
+ * allocated from an arena may be kept after the call that began it.
+ * Memory from cu_tmp_alloc() carries a tag saying where it came from,
+ * so another thread can pass it to cu_tmp_realloc() or cu_tmp_free()
+ * while the call runs; it must not be given to the cu_arena_*() or
+ * cu_mem_*() calls.
+ * Arena blocks are counted by cu_mem.h as the "arena" subsystem.
+ */
+
+struct cu_arena_block;
+
+struct cu_arena {
+        struct cu_arena_block *blocks;  /* The newest first */
+        struct cu_arena *prev;          /* The thread's arena before */
+};
+
+/**
+ * Begin an arena and make it the calling thread's current arena.  No
+ * memory is allocated until it is used.
+ *
+ * @param arena The arena, usually on the stack
+ */
+void cu_arena_begin(struct cu_arena *arena);
+
+/**
+ * Free everything allocated from an arena, and make the arena that was
+ * current before cu_arena_begin() current again
+ *
+ * @param arena The arena, which must be the current one
+ */
+void cu_arena_end(struct cu_arena *arena);
+
+/**
+ * The calling thread's current arena
+ *
+ * @returns The arena, or NULL outside the standard MIs
+ */
+struct cu_arena *cu_arena_current(void);
+
+/**
+ * Allocate memory from an arena, aligned for any type
+ *
+ * @param arena The arena
+ * @param size The size in bytes
+ * @returns The memory, or NULL
+ */
+void *cu_arena_alloc(struct cu_arena *arena, size_t size);
+
+/**
+ * Resize memory from an arena.  The last allocation grows in place
+ * when there is room; anything else is copied.
+ *
+ * @param arena The arena
+ * @param ptr The memory, or NULL
+ * @param old_size The size it was allocated with
+ * @param size The new size in bytes
+ * @returns The memory, or NULL (ptr is then left alone)
+ */
+void *cu_arena_realloc(struct cu_arena *arena,
+                       void *ptr,
+                       size_t old_size,
+                       size_t size);
+
+/**
+ * Format a string into an arena, as vasprintf() does
+ *
+ * @param arena The arena
+ * @param fmt The format
+ * @param ap The arguments
+ * @returns The string, or NULL
+ */
+char *cu_arena_vasprintf(struct cu_arena *arena, const char *fmt, va_list ap);
+
+/**
+ * Free everything allocated from an arena, but keep it for reuse
+ *
+ * @param arena The arena
+ */
+void cu_arena_reset(struct cu_arena *arena);
+
+/**
+ * Find the arena that memory came from, among the calling thread's
+ * current arena and those it was begun inside of
+ *
+ * @param ptr The memory
+ * @returns The arena, or NULL if ptr did not come from one
+ */
+struct cu_arena *cu_arena_find(const void *ptr);
+
+/**
+ * Allocate temporary memory: from the current arena if there is one,
+ * else with cu_mem_alloc()
+ *
+ * @param sub The subsystem to count it against without an arena
+ * @param size The size in bytes
+ * @returns The memory, or NULL
+ */
+void *cu_tmp_alloc(enum cu_mem_subsystem sub, size_t size);
+
+/**
+ * Resize memory from cu_tmp_alloc(), or allocate it if ptr is NULL.
+ * Memory from another thread's arena is copied into temporary memory of
+ * the calling thread, and left to that arena.
+ *
+ * @param sub The subsystem it was counted against
+ * @param ptr The memory, or NULL
+ * @param old_size The size it was allocated with
+ * @param size The new size in bytes
+ * @returns The memory, or NULL (ptr is then left alone)
+ */
+void *cu_tmp_realloc(enum cu_mem_subsystem sub,
+                     void *ptr,
+                     size_t old_size,
+                     size_t size);
+
+/**
+ * Copy a string into temporary memory
+ *
+ * @param sub The subsystem to count it against without an arena
+ * @param str The string
+ * @returns The copy, or NULL
+ */
+char *cu_tmp_strdup(enum cu_mem_subsystem sub, const char *str);
+
+/**
+ * Free memory from cu_tmp_alloc().  Arena memory is left for the arena
+ * to free, whichever thread the arena belongs to.
+ *
+ * @param sub The subsystem it was counted against
+ * @param ptr The memory, or NULL
+ */
+void cu_tmp_free(enum cu_mem_subsystem sub, void *ptr);
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
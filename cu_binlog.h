@@ -0,0 +1,206 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_BINLOG_H
+#define __CU_BINLOG_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * Binary log records
+ *
+ * With CU_DEBUG_FORMAT=binary, debug_print() stores its arguments
+ * instead of formatting them, and tools/cu_logdecode turns the file
+ * back into the usual text.  Flight recorder dumps (see
+ * cu_flight_dump()) use the same records.  The file is a sequence of
+ * records in the writer's byte order, each starting with
+ *
+ *   u32 length (of the whole record)  u8 type
+ *
+ * followed by, for each type:
+ *
+ *   'H' session   u32 0x01020304  u32 CU_BINLOG_VERSION  u32 pid
+ *                 Written when a process starts logging.  Format ids
+ *                 are numbered from 1 again for that pid.
+ *   'B' batch     u32 pid
+ *                 Starts each write(); the records up to the next 'B'
+ *                 or 'H' come from that process.
+ *   'F' format    u32 id  format text (not NUL terminated)
+ *                 Written the first time a format is logged.  Records
+ *                 of other threads may use the id before it appears.
+ *                 Id 0 defines the format of the 'M' record after it.
+ *   'M' message   u32 id  u32 tid  u64 realtime_ns  u64 monotonic_ns
+ *                 then each argument in format order: 4 bytes for int
+ *                 sized integers and * widths, 8 for longer integers,
+ *                 pointers and doubles, and u32 length + bytes for
+ *                 strings (0xffffffff for NULL).
+ *   'T' text      u32 tid  u64 realtime_ns  u64 monotonic_ns  text
+ *                 A message whose format could not be encoded.
+ */
+
+#define CU_BINLOG_VERSION 1
+#define CU_BINLOG_ORDER 0x01020304
+
+#define CU_BINLOG_SESSION 'H'
+#define CU_BINLOG_BATCH   'B'
+#define CU_BINLOG_FORMAT  'F'
+#define CU_BINLOG_MESSAGE 'M'
+#define CU_BINLOG_TEXT    'T'
+
+/* Bytes before the type-specific part of a record */
+#define CU_BINLOG_HEADER 5
+
+#define CU_BINLOG_NULL_STRING 0xffffffffU
+
+/* Smallest buffer cu_binlog_message() can encode into */
+#define CU_BINLOG_MIN_BUF 1024
+
+/*
+ * One conversion in a printf format.  kind says how the argument is
+ * passed and stored:
+ *
+ *   i  int (d, i, o, u, x, X, c with no length or h, hh)
+ *   l  long         q  long long    j  intmax_t
+ *   z  size_t       t  ptrdiff_t    p  void *
+ *   d  double       D  long double (stored as a double)
+ *   s  string       m  %m, stored as the string for errno
+ *   %  a literal %, no argument
+ *   ?  anything else (%n, %ls, positional arguments...)
+ *
+ * stars is the number of * widths and precisions, each an int
+ * argument before the value.
+ */
+struct cu_binlog_conv {
+        const char *start;
+        const char *end;
+        int stars;
+        char kind;
+};
+
+/**
+ * Find the next conversion in a format
+ *
+ * @param fmt Where to start looking, updated to just past the
+ *            conversion
+ * @param conv The conversion found
+ * @returns false if there are no more conversions
+ */
+bool cu_binlog_next_conv(const char **fmt, struct cu_binlog_conv *conv);
+
+/**
+ * Encode a session record
+ *
+ * @param buf Where to write it, at least 32 bytes
+ * @returns The length of the record
+ */
+size_t cu_binlog_session(char *buf);
+
+/**
+ * Encode a batch record
+ *
+ * @param buf Where to write it, at least 16 bytes
+ * @returns The length of the record
+ */
+size_t cu_binlog_batch(char *buf);
+
+/**
+ * Encode a message, preceded by the definition of its format if this
+ * is the first time it is used.  Strings are cut short to fit.
+ *
+ * The definition is returned separately in *format_len so that it can
+ * be written at once: if the message itself is lost (its buffer was
+ * full), later messages with that format can still be decoded.
+ *
+ * @param buf Where to write it
+ * @param size The size of buf, at least CU_BINLOG_MIN_BUF bytes
+ * @param tid The thread ID to record
+ * @param real The CLOCK_REALTIME time of the message
+ * @param mono The CLOCK_MONOTONIC time of the message
+ * @param err The errno value for %m
+ * @param fmt The format.  Only formats in a loaded object (string
+ *            literals) get an id; others are sent with each message.
+ * @param ap The arguments
+ * @param format_len Set to the length of the format record at the
+ *                   start of buf, or 0
+ * @returns The length of the records, including the format record
+ */
+size_t cu_binlog_message(char *buf,
+                         size_t size,
+                         uint32_t tid,
+                         const struct timespec *real,
+                         const struct timespec *mono,
+                         int err,
+                         const char *fmt,
+                         va_list ap,
+                         size_t *format_len);
+
+/**
+ * Encode a text record.  Safe to call from a signal handler.
+ *
+ * @param buf Where to write it
+ * @param size The size of buf, at least 64 bytes.  Longer text is cut.
+ * @param tid The thread ID to record
+ * @param real The CLOCK_REALTIME time of the message
+ * @param mono The CLOCK_MONOTONIC time of the message
+ * @param text The text
+ * @returns The length of the record
+ */
+size_t cu_binlog_text(char *buf,
+                      size_t size,
+                      uint32_t tid,
+                      const struct timespec *real,
+                      const struct timespec *mono,
+                      const char *text);
+
+/**
+ * Get the number of formats given an id so far.  Ids run from 1 to
+ * this number.  Safe to call from a signal handler.
+ */
+uint32_t cu_binlog_formats(void);
+
+/**
+ * Encode the definition of a format again, for a reader that did not
+ * see the first one.  Safe to call from a signal handler.
+ *
+ * @param buf Where to write it
+ * @param size The size of buf
+ * @param id The format's id
+ * @returns The length of the record, or 0 if there is no such format,
+ *          it is never used in messages, or buf is too small
+ */
+size_t cu_binlog_format(char *buf, size_t size, uint32_t id);
+
+/**
+ * Forget the format ids, so that a new session defines them again.
+ * Called in the child after fork().
+ */
+void cu_binlog_reset(void);
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,81 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_FLIGHT_H
+#define __CU_FLIGHT_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+
+#include <cmpidt.h>
+
+/*
+ * Flight recorder
+ *
+ * When CU_DEBUG is not set but CU_FLIGHT_FILE is, debug_print() hands
+ * each message to the flight recorder, which keeps the last few KiB of
+ * them per thread as binary log records (see cu_binlog.h) without
+ * formatting them.  cu_flight_dump() appends what a thread recorded
+ * since its last dump to that file, which tools/cu_logdecode reads.
+ */
+
+/**
+ * Set up the recorder from CU_FLIGHT_FILE, CU_FLIGHT_SIZE,
+ * CU_FLIGHT_MAX_SIZE, CU_FLIGHT_SIGNALS and CU_FLIGHT_DUMP_SIGNAL.
+ * Called once, when the library is loaded.
+ *
+ * @returns true if messages should be passed to cu_flight_record()
+ */
+bool cu_flight_init(void);
+
+/**
+ * Record a message in the calling thread's ring
+ *
+ * @param fmt The format, as passed to debug_print()
+ * @param ap The arguments
+ */
+void cu_flight_record(const char *fmt, va_list ap);
+
+/**
+ * Dump the calling thread's ring after a provider's handler failed.
+ * Only CMPI_RC_ERR_FAILED, which clients can't cause by sending bad
+ * requests, leads to a dump, and at most one a second.
+ *
+ * @param rc What the handler returned
+ * @param reason Why, which is written after the messages
+ */
+void cu_flight_dump_failed(CMPIrc rc, const char *reason);
+
+/**
+ * Dump the ring of another thread, as cu_flight_dump() does for the
+ * calling thread's, and then the calling thread's own
+ *
+ * @param tid The thread's kernel thread ID
+ * @param reason Why, which is written after the messages
+ */
+void cu_flight_dump_thread(long tid, const char *reason);
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
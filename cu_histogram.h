@@ -0,0 +1,213 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_HISTOGRAM_H
+#define __CU_HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Latency histograms of MI calls
+ *
+ * The standard association, method and indication MIs record how long
+ * each call took, keyed by the MI's miName and by the operation:
+ * Associators, AssociatorNames, References, ReferenceNames, the method
+ * name for InvokeMethod, and RaiseIndication or TriggerIndications.
+ *
+ * The histograms are log-linear, like HdrHistogram: values below
+ * 2^CU_HISTOGRAM_SUB_BITS ns get a bucket each, and every power of two
+ * above that is split into 2^(CU_HISTOGRAM_SUB_BITS - 1) buckets, so a
+ * percentile is never off by more than 1/32 of its value.  Calls that
+ * take longer than 2^CU_HISTOGRAM_MAX_BITS ns are counted in the last
+ * bucket.
+ *
+ * Calls timed with cu_histogram_timer_start() also add up the CPU time
+ * the calling thread used (CLOCK_THREAD_CPUTIME_ID), so that a slow
+ * operation can be told apart as busy in the provider or the library
+ * (CPU close to wall time) or waiting on the broker or a hypervisor
+ * (CPU well below it).  The standard MIs time each call, and each call
+ * into an association or method handler as operation "OP handler".
+ *
+ * Recording is off by default.  Setting CU_HISTOGRAMS to "on" in the
+ * environment turns it on, and setting it to a file name (or "stderr")
+ * also writes cu_histogram_dump() there when the process exits.
+ */
+
+#define CU_HISTOGRAM_SUB_BITS 6
+#define CU_HISTOGRAM_MAX_BITS 36
+#define CU_HISTOGRAM_BUCKETS                                            \
+        ((CU_HISTOGRAM_MAX_BITS - CU_HISTOGRAM_SUB_BITS + 2) <<         \
+         (CU_HISTOGRAM_SUB_BITS - 1))
+
+/*
+ * A copy of one histogram.  mi_name and op stay valid for the life of
+ * the process.
+ */
+struct cu_histogram {
+        const char *mi_name;
+        const char *op;
+        uint64_t count;
+        uint64_t total_ns;
+        uint64_t min_ns;
+        uint64_t max_ns;
+        uint64_t cpu_count;
+        uint64_t cpu_ns;
+        uint64_t buckets[CU_HISTOGRAM_BUCKETS];
+};
+
+/* The start of a call timed in wall clock and thread CPU time */
+struct cu_histogram_timer {
+        uint64_t wall_ns;
+        uint64_t cpu_ns;
+};
+
+/**
+ * Get the start time of a call to record
+ *
+ * @returns A timestamp, or 0 if recording is disabled
+ */
+uint64_t cu_histogram_start(void);
+
+/**
+ * Record the time since cu_histogram_start() was called
+ *
+ * @param start The value returned by cu_histogram_start()
+ * @param mi_name The miName of the MI that was called
+ * @param op The operation
+ */
+void cu_histogram_end(uint64_t start, const char *mi_name, const char *op);
+
+/**
+ * Start timing a call, in wall clock and CPU time
+ *
+ * @returns The start times, zero if recording is disabled
+ */
+struct cu_histogram_timer cu_histogram_timer_start(void);
+
+/**
+ * Record the wall clock and CPU time since cu_histogram_timer_start()
+ *
+ * @param timer The timer passed to cu_histogram_timer_start(), on the
+ *              same thread
+ * @param mi_name The miName of the MI that was called
+ * @param op The operation
+ */
+void cu_histogram_timer_end(const struct cu_histogram_timer *timer,
+                            const char *mi_name,
+                            const char *op);
+
+/**
+ * Record one sample
+ *
+ * @param mi_name The miName of the MI that was called
+ * @param op The operation
+ * @param ns The time the call took
+ */
+void cu_histogram_record(const char *mi_name, const char *op, uint64_t ns);
+
+/**
+ * Record one sample with the CPU time it used
+ *
+ * @param mi_name The miName of the MI that was called
+ * @param op The operation
+ * @param ns The time the call took
+ * @param cpu_ns The CPU time the calling thread used meanwhile
+ */
+void cu_histogram_record_cpu(const char *mi_name,
+                             const char *op,
+                             uint64_t ns,
+                             uint64_t cpu_ns);
+
+/**
+ * Copy every histogram that has samples
+ *
+ * @param hists Set to a malloc()'d array of copies, to be released
+ *              with free()
+ * @param reset If true, zero each histogram as it is copied, so that
+ *              no sample is lost or counted twice between snapshots
+ * @returns The number of histograms copied, or -1 on error
+ */
+int cu_histogram_snapshot(struct cu_histogram **hists, bool reset);
+
+/**
+ * Get a percentile of a copied histogram
+ *
+ * @param hist The histogram
+ * @param pct The percentile, between 0 and 100
+ * @returns The highest value that falls in the same bucket as the
+ *          percentile, capped at the largest sample
+ */
+uint64_t cu_histogram_percentile(const struct cu_histogram *hist,
+                                 double pct);
+
+/**
+ * Get the share of a copied histogram's wall time spent on CPU
+ *
+ * @param hist The histogram
+ * @returns The mean CPU time over the mean wall time of the calls that
+ *          were timed with both, between 0 and 1, or 0 if none were
+ */
+double cu_histogram_cpu_share(const struct cu_histogram *hist);
+
+/**
+ * Get the range of values counted in a bucket
+ *
+ * @param index The bucket
+ * @param low Set to the lowest value in the bucket
+ * @param high Set to the highest value in the bucket
+ */
+void cu_histogram_bucket_range(int index, uint64_t *low, uint64_t *high);
+
+/**
+ * Zero all histograms
+ */
+void cu_histogram_reset(void);
+
+/**
+ * Write a table of all histograms with count, mean, p50, p90, p99,
+ * p99.9, max, and the mean CPU time and its share of the wall time
+ *
+ * @param out The stream to write to
+ */
+void cu_histogram_dump(FILE *out);
+
+/**
+ * Check whether calls are being recorded
+ *
+ * @returns true if enabled
+ */
+bool cu_histogram_enabled(void);
+
+/**
+ * Enable or disable recording
+ *
+ * @param enabled The new state
+ */
+void cu_histogram_set_enabled(bool enabled);
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,158 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_MEM_H
+#define __CU_MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Memory accounting
+ *
+ * The library counts the memory it allocates on the request path, by
+ * subsystem: the bytes held now, the most held at once since the last
+ * cu_mem_reset_peak(), and the number of allocations.  Sizes are what
+ * malloc_usable_size() reports, so they include malloc's rounding.
+ * The counts are exported with the other stats (cu_stats.h) as
+ * cu_mem_bytes, cu_mem_peak_bytes and cu_mem_allocations_total, each
+ * labeled with the subsystem.
+ *
+ * Memory from these calls is plain malloc() memory, but must be freed
+ * with cu_mem_free() (or handed back to the library) to be counted as
+ * freed.
+ */
+
+enum cu_mem_subsystem {
+        CU_MEM_INST_LIST,       /* inst_list arrays */
+        CU_MEM_INDICATION,      /* ind_args from stdi_new_ind_args() */
+        CU_MEM_STATUS,          /* cu_statusf() messages */
+        CU_MEM_EI_XML,          /* CIM-XML embedded instance parsing */
+        CU_MEM_EI_MOF,          /* MOF embedded instance parsing */
+        CU_MEM_LIBXML2,         /* libxml2 documents built by the library */
+        CU_MEM_ARENA,           /* Request arena blocks (cu_arena.h) */
+        CU_MEM_SUBSYSTEMS,
+};
+
+struct cu_mem_usage {
+        int64_t bytes;
+        int64_t peak_bytes;
+        uint64_t allocs;
+};
+
+/**
+ * Allocate memory
+ *
+ * @param sub The subsystem to count it against
+ * @param size The size in bytes
+ * @returns The memory, or NULL
+ */
+void *cu_mem_alloc(enum cu_mem_subsystem sub, size_t size);
+
+/**
+ * Resize memory from cu_mem_alloc(), or allocate it if ptr is NULL
+ *
+ * @param sub The subsystem it was counted against
+ * @param ptr The memory, or NULL
+ * @param size The new size in bytes
+ * @returns The memory, or NULL (ptr is then left alone)
+ */
+void *cu_mem_realloc(enum cu_mem_subsystem sub, void *ptr, size_t size);
+
+/**
+ * Copy a string
+ *
+ * @param sub The subsystem to count it against
+ * @param str The string
+ * @returns The copy, or NULL
+ */
+char *cu_mem_strdup(enum cu_mem_subsystem sub, const char *str);
+
+/**
+ * Count memory that something else allocated with malloc(), such as
+ * vasprintf(), so that cu_mem_free() can be used on it
+ *
+ * @param sub The subsystem to count it against
+ * @param ptr The memory, or NULL
+ */
+void cu_mem_track(enum cu_mem_subsystem sub, void *ptr);
+
+/**
+ * Free memory counted against a subsystem
+ *
+ * @param sub The subsystem it was counted against
+ * @param ptr The memory, or NULL
+ */
+void cu_mem_free(enum cu_mem_subsystem sub, void *ptr);
+
+/**
+ * Count a batch of allocations and frees that the caller tallied
+ * itself, for code too hot to count each one as it goes
+ *
+ * @param sub The subsystem
+ * @param bytes The change in bytes held over the batch
+ * @param peak The most bytes held above the start of the batch
+ * @param allocs The number of allocations
+ */
+void cu_mem_count(enum cu_mem_subsystem sub,
+                  int64_t bytes,
+                  int64_t peak,
+                  uint64_t allocs);
+
+/**
+ * Read the counts of a subsystem
+ *
+ * @param sub The subsystem
+ * @param usage Filled in with the counts
+ */
+void cu_mem_get(enum cu_mem_subsystem sub, struct cu_mem_usage *usage);
+
+/**
+ * The name of a subsystem, as used in the stats label
+ *
+ * @param sub The subsystem
+ * @returns The name, e.g. "inst_list"
+ */
+const char *cu_mem_name(enum cu_mem_subsystem sub);
+
+/**
+ * Start measuring peaks again from the bytes held now
+ */
+void cu_mem_reset_peak(void);
+
+/**
+ * Count what libxml2 allocates for the library's embedded instance
+ * parsing as CU_MEM_LIBXML2.  This replaces libxml2's allocation
+ * functions for the whole process, for good, and keeps the library
+ * loaded, so it is only done when CU_STATS is set or a program asks
+ * for it.  Call it before other threads use libxml2.
+ *
+ * @returns true if libxml2's allocations are counted
+ */
+bool cu_mem_count_libxml2(void);
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
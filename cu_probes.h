@@ -0,0 +1,85 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_PROBES_H
+#define __CU_PROBES_H
+
+/*
+ * USDT probes
+ *
+ * Configuring with --enable-probes compiles SystemTap/USDT probes into
+ * the library under the provider name "libcmpiutil", for use with
+ * bpftrace, perf or stap.  Each probe has a semaphore, and its
+ * arguments are only evaluated while a tracer is attached, so probes
+ * that need an up-call for an argument cost nothing otherwise.
+ *
+ * CU_PROBE_DEFINE() must appear once, at file scope, in the file that
+ * fires the probe.
+ */
+
+#ifdef WITH_SDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define CU_PROBE_SEMAPHORE(name) libcmpiutil_##name##_semaphore
+
+#define CU_PROBE_DEFINE(name)                                           \
+        volatile unsigned short CU_PROBE_SEMAPHORE(name)                \
+        __attribute__((visibility("hidden"), section(".probes")))
+
+#define CU_PROBE_ENABLED(name)                                          \
+        __builtin_expect(CU_PROBE_SEMAPHORE(name), 0)
+
+#define CU_PROBE2(name, a, b)                                           \
+        do {                                                            \
+                if (CU_PROBE_ENABLED(name))                             \
+                        DTRACE_PROBE2(libcmpiutil, name, a, b);         \
+        } while (0)
+
+#define CU_PROBE3(name, a, b, c)                                        \
+        do {                                                            \
+                if (CU_PROBE_ENABLED(name))                             \
+                        DTRACE_PROBE3(libcmpiutil, name, a, b, c);      \
+        } while (0)
+
+#define CU_PROBE4(name, a, b, c, d)                                     \
+        do {                                                            \
+                if (CU_PROBE_ENABLED(name))                             \
+                        DTRACE_PROBE4(libcmpiutil, name, a, b, c, d);   \
+        } while (0)
+
+#else
+
+#define CU_PROBE_DEFINE(name) struct __cu_probe_##name
+#define CU_PROBE_ENABLED(name) 0
+#define CU_PROBE2(name, a, b) do { } while (0)
+#define CU_PROBE3(name, a, b, c) do { } while (0)
+#define CU_PROBE4(name, a, b, c, d) do { } while (0)
+
+#endif
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
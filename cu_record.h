@@ -0,0 +1,118 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_RECORD_H
+#define __CU_RECORD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+
+/*
+ * Recording of MI calls
+ *
+ * When CU_RECORD names a file, every MI call that enters the library
+ * is appended to it as one line, along with the broker answers the
+ * library used to serve it, so that bench/cu_replay can repeat the
+ * calls against the mock broker.  Each line holds tab-separated
+ * fields:
+ *
+ *   entry  "miName"  rc  elapsed_ns  arguments...
+ *
+ * Arguments are written as typed values:
+ *
+ *   ~                 NULL
+ *   "text"            string, with \\, \", \t and \n escaped
+ *   b0 b1             boolean
+ *   u8:N ... s64:N    integers
+ *   r32:N r64:N       reals
+ *   c16:N             char16
+ *   d"text"           dateTime, in CMPI string format
+ *   P"ns","cn"{...}   object path, keys as "name"=value
+ *   I"ns","cn"{...}   instance, properties as "name"=value
+ *   A<type>[v,...]    array, type being the CMPIType of the array
+ *   ?                 a value that cannot be recorded
+ */
+
+#define CU_RECORD_VERSION 1
+
+/**
+ * Get the start time of a call to record
+ *
+ * @returns A timestamp, or 0 if recording is disabled
+ */
+uint64_t cu_record_start(void);
+
+void cu_record_assoc(uint64_t start,
+                     const char *entry,
+                     const char *mi_name,
+                     CMPIStatus s,
+                     const CMPIObjectPath *ref,
+                     const char *assoc_class,
+                     const char *result_class,
+                     const char *role,
+                     const char *result_role,
+                     const char **properties);
+
+void cu_record_references(uint64_t start,
+                          const char *entry,
+                          const char *mi_name,
+                          CMPIStatus s,
+                          const CMPIObjectPath *ref,
+                          const char *result_class,
+                          const char *role,
+                          const char **properties);
+
+void cu_record_method(uint64_t start,
+                      const char *mi_name,
+                      CMPIStatus s,
+                      const CMPIObjectPath *ref,
+                      const char *method,
+                      const CMPIArgs *argsin);
+
+void cu_record_filter(uint64_t start,
+                      const char *entry,
+                      const char *mi_name,
+                      CMPIStatus s,
+                      const CMPIObjectPath *op,
+                      bool flag);
+
+void cu_record_indications(uint64_t start,
+                           const char *entry,
+                           const char *mi_name);
+
+/**
+ * Record the answer to a CMClassPathIsA() up-call.  Each distinct
+ * question is only recorded once.
+ */
+void cu_record_is_a(const CMPIObjectPath *op,
+                    const char *type,
+                    bool result);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,149 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_SINK_H
+#define __CU_SINK_H
+
+#include <stdbool.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+
+/*
+ * Result sinks
+ *
+ * A sink takes instances one at a time, as a provider produces them.
+ * It can keep them (in an inst_list or an inst_chunk_list), hand them
+ * straight to the broker, or be a stage that drops or replaces each
+ * instance before passing it on to the next sink.  A provider that
+ * emits into a sink which returns to the broker holds no more than the
+ * instance it is working on, and the client starts receiving results
+ * as soon as the first one is emitted.
+ *
+ * The sinks are set up by the cu_sink_init_*() calls below and allocate
+ * nothing, so they can live on the stack.  For a sink of your own, set
+ * emit (and whichever of the other fields it uses) and leave count at 0.
+ */
+
+struct inst_list;
+struct inst_chunk_list;
+struct cu_result_sink;
+
+typedef CMPIStatus (*cu_sink_emit_t)(struct cu_result_sink *sink,
+                                     CMPIInstance *inst);
+
+/* Returns true to pass inst on to the next sink */
+typedef bool (*cu_sink_filter_t)(const CMPIInstance *inst, void *data);
+
+/* Returns the instance to pass on instead of inst, or NULL to drop it */
+typedef CMPIInstance *(*cu_sink_map_t)(CMPIInstance *inst, void *data);
+
+struct cu_result_sink {
+        cu_sink_emit_t emit;
+        void *target;                   /* The list or CMPIResult */
+        struct cu_result_sink *next;    /* For stages */
+        cu_sink_filter_t filter;
+        cu_sink_map_t map;
+        void *data;                     /* For filter and map */
+        unsigned long count;            /* Instances taken so far */
+};
+
+/**
+ * Emit an instance into a sink
+ *
+ * @param sink The sink
+ * @param inst The instance
+ * @returns The status of the sink, which the caller should stop
+ *          emitting on and return if it is not CMPI_RC_OK
+ */
+CMPIStatus cu_sink_emit(struct cu_result_sink *sink, CMPIInstance *inst);
+
+/**
+ * Set up a sink that adds each instance to a list
+ *
+ * @param sink The sink
+ * @param list An initialized list
+ */
+void cu_sink_init_list(struct cu_result_sink *sink, struct inst_list *list);
+
+/**
+ * Set up a sink that adds each instance to a chunked list
+ *
+ * @param sink The sink
+ * @param list An initialized list
+ */
+void cu_sink_init_chunks(struct cu_result_sink *sink,
+                         struct inst_chunk_list *list);
+
+/**
+ * Set up a sink that returns each instance to the broker with
+ * CMReturnInstance()
+ *
+ * @param sink The sink
+ * @param results The results of the MI call
+ */
+void cu_sink_init_instances(struct cu_result_sink *sink,
+                            const CMPIResult *results);
+
+/**
+ * Set up a sink that returns the object path of each instance to the
+ * broker with CMReturnObjectPath(), as cu_return_instance_name() does
+ *
+ * @param sink The sink
+ * @param results The results of the MI call
+ */
+void cu_sink_init_names(struct cu_result_sink *sink,
+                        const CMPIResult *results);
+
+/**
+ * Set up a stage that passes on only the instances a function accepts
+ *
+ * @param sink The sink
+ * @param next The sink to pass them on to
+ * @param filter The function
+ * @param data Passed to filter
+ */
+void cu_sink_init_filter(struct cu_result_sink *sink,
+                         struct cu_result_sink *next,
+                         cu_sink_filter_t filter,
+                         void *data);
+
+/**
+ * Set up a stage that passes on what a function makes of each
+ * instance, such as a projection onto some of its properties or an
+ * association instance that refers to it
+ *
+ * @param sink The sink
+ * @param next The sink to pass them on to
+ * @param map The function
+ * @param data Passed to map
+ */
+void cu_sink_init_map(struct cu_result_sink *sink,
+                      struct cu_result_sink *next,
+                      cu_sink_map_t map,
+                      void *data);
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,165 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_STATS_H
+#define __CU_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Statistics registry
+ *
+ * Counters and gauges defined with CU_STAT() or CU_STAT_LABELED()
+ * register themselves when the library or provider module defining
+ * them is loaded, and unregister when it is unloaded.  The registry,
+ * along with the MI latency histograms (cu_histogram.h), can be written
+ * as JSON or in the Prometheus text format at any time.
+ *
+ * Setting CU_STATS in the CIMOM's environment exports it while the
+ * provider runs:
+ *
+ *   CU_STATS=unix:/run/cu-stats.sock
+ *       Listen on a unix socket.  A client that connects may send
+ *       "json" or "prometheus" (the default) and gets the registry in
+ *       that format.  For example:
+ *       echo json | socat - UNIX-CONNECT:/run/cu-stats.sock
+ *       An old socket of the same user at the path is replaced; anything
+ *       else there is left alone and nothing is exported.
+ *
+ *   CU_STATS=/var/lib/node_exporter/cu.prom
+ *       Rewrite the file every CU_STATS_INTERVAL seconds (default 10)
+ *       and at exit, as JSON if the name ends in .json.
+ *
+ * A %p in the path is replaced by the process ID, for CIMOMs that run
+ * providers in several processes.
+ */
+
+enum cu_stat_type {
+        CU_STAT_COUNTER,
+        CU_STAT_GAUGE,
+};
+
+enum cu_stats_format {
+        CU_STATS_PROMETHEUS,
+        CU_STATS_JSON,
+};
+
+/*
+ * A registered value.  Stats with the same name must have the same
+ * type and help, and differ in their label.
+ */
+struct cu_stat {
+        const char *name;
+        const char *help;
+        enum cu_stat_type type;
+        const char *label_name;
+        const char *label_value;
+        int64_t value;
+        struct cu_stat *next;
+};
+
+#define CU_STAT_LABELED(var, type, name, lname, lvalue, help)           \
+        struct cu_stat var = {name, help, type, lname, lvalue, 0, NULL}; \
+        static void var##_register(void) __attribute__((constructor));  \
+        static void var##_register(void)                                \
+        {                                                               \
+                cu_stat_register(&var);                                 \
+        }                                                               \
+        static void var##_unregister(void) __attribute__((destructor)); \
+        static void var##_unregister(void)                              \
+        {                                                               \
+                cu_stat_unregister(&var);                               \
+        }
+
+/**
+ * Define a stat and register it at load time.  May be preceded by
+ * static.
+ *
+ * @param var The variable to define
+ * @param type CU_STAT_COUNTER or CU_STAT_GAUGE
+ * @param name The exported name, e.g. "cu_inst_list_grow_total"
+ * @param help A one-line description
+ */
+#define CU_STAT(var, type, name, help)                                  \
+        CU_STAT_LABELED(var, type, name, NULL, NULL, help)
+
+/**
+ * Add a stat to the registry.  CU_STAT() does this for you.
+ *
+ * @param stat The stat, which must stay valid until unregistered
+ */
+void cu_stat_register(struct cu_stat *stat);
+
+/**
+ * Remove a stat from the registry
+ *
+ * @param stat The stat
+ */
+void cu_stat_unregister(struct cu_stat *stat);
+
+/**
+ * Add to a counter or gauge
+ *
+ * @param stat The stat
+ * @param delta The amount to add, which may be negative for gauges
+ */
+void cu_stat_add(struct cu_stat *stat, int64_t delta);
+
+/**
+ * Set a gauge
+ *
+ * @param stat The stat
+ * @param value The new value
+ */
+void cu_stat_set(struct cu_stat *stat, int64_t value);
+
+/**
+ * Read a stat
+ *
+ * @param stat The stat
+ * @returns The current value
+ */
+int64_t cu_stat_get(const struct cu_stat *stat);
+
+/**
+ * Write every registered stat and the MI latency histograms
+ *
+ * @param out The stream to write to
+ * @param format CU_STATS_PROMETHEUS or CU_STATS_JSON
+ */
+void cu_stats_write(FILE *out, enum cu_stats_format format);
+
+/**
+ * Write the stats to a file, replacing it atomically
+ *
+ * @param path The file to write
+ * @param format CU_STATS_PROMETHEUS or CU_STATS_JSON
+ * @returns 0 on success, -1 on error with errno set
+ */
+int cu_stats_write_file(const char *path, enum cu_stats_format format);
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,112 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_TRACE_H
+#define __CU_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Span tracing
+ *
+ * A span covers one phase of a call: it has a name, the thread it ran
+ * on, a start time, a duration and a few attributes.  The standard
+ * MIs open spans around their phases (handler lookup, the handler
+ * call, make_ref, filter_results and returning the results for
+ * associations; argument validation, embedded instance parsing and
+ * the handler for methods) and providers can open their own inside
+ * their handlers.  Spans on the same thread nest by time.
+ *
+ * When CU_TRACE_FILE names a file, each span is written to it as a
+ * Chrome trace event when it ends, which chrome://tracing and
+ * ui.perfetto.dev can open.  A %p in the name is replaced by the
+ * process ID.  Without CU_TRACE_FILE, cu_span_begin() only checks a
+ * flag and the rest of the calls return at once.
+ */
+
+#define CU_SPAN_MAX_ATTRS 8
+
+struct cu_span_attr {
+        const char *key;
+        bool is_str;
+        const char *str;
+        int64_t num;
+};
+
+struct cu_span {
+        const char *name;
+        uint64_t start;
+        int attr_count;
+        struct cu_span_attr attrs[CU_SPAN_MAX_ATTRS];
+};
+
+/**
+ * Check whether spans are being written
+ *
+ * @returns true if CU_TRACE_FILE was opened
+ */
+bool cu_trace_enabled(void);
+
+/**
+ * Start a span
+ *
+ * @param span The span, usually on the caller's stack
+ * @param name The name of the phase, which must stay valid until
+ *             cu_span_end() is called
+ */
+void cu_span_begin(struct cu_span *span, const char *name);
+
+/**
+ * Attach a string attribute to a span
+ *
+ * Attributes past CU_SPAN_MAX_ATTRS are dropped.
+ *
+ * @param span The span
+ * @param key The attribute name
+ * @param value The value (NULL is written as null).  Like key, it must
+ *              stay valid until cu_span_end() is called.
+ */
+void cu_span_str(struct cu_span *span, const char *key, const char *value);
+
+/**
+ * Attach an integer attribute to a span
+ *
+ * @param span The span
+ * @param key The attribute name, which must stay valid until
+ *            cu_span_end() is called
+ * @param value The value
+ */
+void cu_span_int(struct cu_span *span, const char *key, int64_t value);
+
+/**
+ * End a span and write it out
+ *
+ * @param span The span passed to cu_span_begin()
+ */
+void cu_span_end(struct cu_span *span);
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_UPCALL_H
+#define __CU_UPCALL_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+
+/*
+ * Broker up-call accounting
+ *
+ * Configuring with --enable-upcall-stats builds it in.  When enabled,
+ * cu_upcall_broker() returns a copy of the broker whose function tables
+ * count and time every broker up-call, keyed by the called function and
+ * by the library function that made the call.  Date-time, message,
+ * logging and memory functions are forwarded to the CIMOM's broker
+ * without being counted.  Instances, object paths and the other objects
+ * the CIMOM hands back are left as they are, so calls through their own
+ * function tables (CMSetProperty() and friends) are not counted.
+ *
+ * Accounting is enabled by setting CU_UPCALL_STATS in the environment
+ * to a file name (or "stderr"), where the table is written at exit.
+ * When disabled, or not built in, cu_upcall_broker() returns its
+ * argument unchanged and nothing is interposed.
+ */
+
+/**
+ * Wrap a broker for up-call accounting.  The MI stubs do this for
+ * the broker they are created with.
+ *
+ * @param broker The broker passed in by the CIMOM
+ * @returns A wrapping broker if accounting is enabled, else broker
+ */
+const CMPIBroker *cu_upcall_broker(const CMPIBroker *broker);
+
+/**
+ * Check whether up-call accounting is enabled
+ *
+ * @returns true if enabled
+ */
+bool cu_upcall_enabled(void);
+
+/**
+ * Enable or disable up-call accounting.  Only brokers wrapped while
+ * accounting is enabled are counted.
+ *
+ * @param enabled The new state
+ */
+void cu_upcall_set_enabled(bool enabled);
+
+/**
+ * Write the up-call table, busiest first
+ *
+ * @param out The stream to write to
+ */
+void cu_upcall_dump(FILE *out);
+
+/**
+ * Zero all up-call counters
+ */
+void cu_upcall_reset(void);
+
+/*
+ * Attribute up-calls made until the end of the enclosing function to
+ * that function.  Must be placed last among the function's
+ * declarations.  Without --enable-upcall-stats it is empty.
+ */
+#ifdef WITH_UPCALL_STATS
+
+/* The place an up-call was made from */
+struct cu_upcall_site {
+        const char *file;
+        const char *func;
+        int active;
+};
+
+struct cu_upcall_site cu_upcall_site_enter(const char *file,
+                                           const char *func);
+
+void cu_upcall_site_leave(struct cu_upcall_site *prev);
+
+#define CU_UPCALL_SITE()                                                \
+        struct cu_upcall_site __cu_upcall_prev                          \
+                __attribute__((cleanup(cu_upcall_site_leave))) =        \
+                cu_upcall_site_enter(__FILE__, __func__)
+
+#else
+
+#define CU_UPCALL_SITE()
+
+#endif
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
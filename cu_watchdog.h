@@ -0,0 +1,67 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_WATCHDOG_H
+#define __CU_WATCHDOG_H
+
+#include <cmpidt.h>
+#include <cmpift.h>
+
+/*
+ * Slow handler watchdog
+ *
+ * When CU_WATCHDOG_MS is set, the standard MIs register each call into
+ * an association or method handler, and a watchdog thread looks for
+ * calls running longer than that many milliseconds.  For each one it
+ * logs (at warning level) the provider, operation, class and reference,
+ * and, if CU_WATCHDOG_SIGNAL names a signal the CIMOM does not handle,
+ * the stack of the stuck thread, which it gets by sending it that signal.
+ */
+
+struct cu_watch;
+
+/**
+ * Register a handler call
+ *
+ * @param mi_name The provider's miName, which must stay valid until
+ *                cu_watch_end()
+ * @param op The operation or method name, likewise
+ * @param ref The object path the call is for, likewise
+ * @returns A handle for cu_watch_end(), or NULL if the watchdog is off
+ *          or tracking too many calls
+ */
+struct cu_watch *cu_watch_begin(const char *mi_name,
+                                const char *op,
+                                const CMPIObjectPath *ref);
+
+/**
+ * Unregister a handler call, on the thread that registered it
+ *
+ * @param watch The handle from cu_watch_begin(), may be NULL
+ */
+void cu_watch_end(struct cu_watch *watch);
+
+#endif
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
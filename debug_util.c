@@ -20,56 +20,1016 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
 #include <pthread.h>
-#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <time.h>
 
 #include "libcmpiutil.h"
+#include "cu_stats.h"
+#include "cu_binlog.h"
+#include "cu_flight.h"
+
+/* Per-thread buffer size in KiB, unless CU_DEBUG_BUFFER says otherwise */
+#define DEFAULT_RING_KB 64
+
+/* How often the writer looks at the buffers when nobody wakes it */
+#define FLUSH_MS 100
+
+/* Messages longer than this are formatted on the heap */
+#define STACK_LINE 1024
+
+/* Longest header format_header() writes */
+#define HEADER_MAX 96
+
+/* Most the writer collects before calling write() */
+#define BATCH_SIZE 65536
+
+/* Old logs kept with CU_DEBUG_MAX_SIZE, unless CU_DEBUG_ROTATE says */
+#define DEFAULT_GENERATIONS 3
+
+enum log_policy {
+        LOG_SYNC,
+        LOG_BLOCK,
+        LOG_DROP,
+};
+
+/*
+ * Each thread that logs gets a ring of messages, each stored as its
+ * length followed by the text.  Only the owning thread moves head and
+ * only the holder of ring_lock moves tail, so adding a message takes
+ * no lock unless the ring is full.
+ */
+struct log_ring {
+        char *data;
+        size_t size;
+        size_t head;
+        size_t tail;
+        bool dead;
+        struct log_ring *next;
+};
+
+/* The second a thread last formatted, and the text up to it */
+struct date_cache {
+        time_t sec;
+        size_t len;
+        char text[32];
+};
+
+int cu_log_levels[CU_LOG_CATEGORIES];
+
+static const char *category_names[CU_LOG_CATEGORIES] = {
+        "other", "assoc", "indication", "method", "parser", "instance",
+        "args",
+};
+
+static const char *level_names[] = {
+        "off", "error", "warning", "info", "debug", "trace",
+};
 
-static int log_init = 0;
 static FILE *log = NULL;
+static char *log_path = NULL;
+static bool binary = false;
+static bool flight = false;
+static enum log_policy policy = LOG_BLOCK;
+static size_t ring_size = DEFAULT_RING_KB * 1024;
 
-void debug_print(char *fmt, ...)
+static struct log_ring *rings = NULL;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static __thread struct log_ring *my_ring = NULL;
+
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+static bool writer_started = false;
+static bool writer_stop = false;
+
+static __thread struct date_cache date_cache = {-1, 0, ""};
+static __thread long thread_tid = 0;
+
+static unsigned long dropped = 0;
+static unsigned long dropped_reported = 0;
+
+static uint64_t max_size = 0;
+static uint64_t log_size = 0;
+static int generations = DEFAULT_GENERATIONS;
+static pthread_mutex_t rotate_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static CU_STAT(dropped_stat, CU_STAT_COUNTER,
+               "cu_log_dropped_total",
+               "Log messages dropped because a thread's buffer was full");
+
+static long get_tid(void)
+{
+        if (thread_tid == 0)
+                thread_tid = syscall(SYS_gettid);
+
+        return thread_tid;
+}
+
+static void ring_read(struct log_ring *ring, size_t pos, void *dst, size_t len)
+{
+        size_t off = pos & (ring->size - 1);
+        size_t first = ring->size - off;
+
+        if (first > len)
+                first = len;
+
+        memcpy(dst, ring->data + off, first);
+        memcpy((char *)dst + first, ring->data, len - first);
+}
+
+static void ring_write(struct log_ring *ring,
+                       size_t pos,
+                       const void *src,
+                       size_t len)
+{
+        size_t off = pos & (ring->size - 1);
+        size_t first = ring->size - off;
+
+        if (first > len)
+                first = len;
+
+        memcpy(ring->data + off, src, first);
+        memcpy(ring->data, (const char *)src + first, len - first);
+}
+
+static size_t fd_write(int fd, const char *data, size_t len)
+{
+        size_t done = 0;
+        ssize_t ret;
+
+        while (done < len) {
+                ret = write(fd, data + done, len - done);
+                if (ret < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        break;
+                }
+
+                done += ret;
+        }
+
+        return done;
+}
+
+/*
+ * Start a binary log file with a session record and the formats
+ * defined so far, which are in the file rotated away.
+ */
+static size_t binary_start(int fd, uint32_t from)
+{
+        char rec[1024];
+        uint32_t count = cu_binlog_formats();
+        size_t size = 0;
+        size_t len;
+        uint32_t id;
+
+        if (from == 0) {
+                len = cu_binlog_session(rec);
+                size += fd_write(fd, rec, len);
+        }
+
+        len = cu_binlog_batch(rec);
+        size += fd_write(fd, rec, len);
+
+        for (id = from + 1; id <= count; id++) {
+                len = cu_binlog_format(rec, sizeof(rec), id);
+                if (len > 0)
+                        size += fd_write(fd, rec, len);
+        }
+
+        return size;
+}
+
+/* Shift log.N-1 to log.N ... log to log.1 */
+static void shift_logs(void)
+{
+        char old[PATH_MAX];
+        char new[PATH_MAX];
+        int i;
+
+        for (i = generations; i > 0; i--) {
+                if (i == 1)
+                        snprintf(old, sizeof(old), "%s", log_path);
+                else
+                        snprintf(old, sizeof(old), "%s.%d", log_path, i - 1);
+                snprintf(new, sizeof(new), "%s.%d", log_path, i);
+
+                rename(old, new);
+        }
+}
+
+/*
+ * Move the log aside and carry on in a new file.  The new file is
+ * swapped in under the old descriptor with dup2(), so that threads
+ * writing meanwhile reach one file or the other.  Another process
+ * logging to the same file may have rotated it already, in which case
+ * this one only follows.
+ */
+static void rotate(void)
+{
+        struct stat fd_st;
+        struct stat path_st;
+        uint32_t formats = 0;
+        size_t size = 0;
+        int fd;
+
+        if ((fstat(fileno(log), &fd_st) == 0) &&
+            (stat(log_path, &path_st) == 0) &&
+            (fd_st.st_dev == path_st.st_dev) &&
+            (fd_st.st_ino == path_st.st_ino)) {
+                if (generations > 0)
+                        shift_logs();
+                else
+                        unlink(log_path);
+        }
+
+        fd = open(log_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+        if (fd < 0) {
+                __atomic_store_n(&log_size, 0, __ATOMIC_RELAXED);
+                return;
+        }
+
+        if (binary) {
+                formats = cu_binlog_formats();
+                size = binary_start(fd, 0);
+        }
+
+        fflush(log);
+        dup2(fd, fileno(log));
+        close(fd);
+
+        /* Formats first used while the file was being set up */
+        if (binary && (cu_binlog_formats() != formats))
+                size += binary_start(fileno(log), formats);
+
+        __atomic_store_n(&log_size, size, __ATOMIC_RELAXED);
+}
+
+/* Count what was written, and rotate when CU_DEBUG_MAX_SIZE is reached */
+static void log_wrote(size_t len)
+{
+        if ((max_size == 0) ||
+            (__atomic_add_fetch(&log_size, len, __ATOMIC_RELAXED) < max_size))
+                return;
+
+        /* Whoever gets here first rotates, the rest keep writing */
+        if (pthread_mutex_trylock(&rotate_lock) != 0)
+                return;
+
+        if (__atomic_load_n(&log_size, __ATOMIC_RELAXED) >= max_size)
+                rotate();
+
+        pthread_mutex_unlock(&rotate_lock);
+}
+
+static void batch_write(const char *batch, size_t len)
+{
+        log_wrote(fd_write(fileno(log), batch, len));
+}
+
+/* Write binary records at once, after a batch record */
+static void write_direct(const char *data, size_t len)
+{
+        char batch[16];
+        struct iovec iov[2];
+        ssize_t ret;
+
+        iov[0].iov_base = batch;
+        iov[0].iov_len = cu_binlog_batch(batch);
+        iov[1].iov_base = (char *)data;
+        iov[1].iov_len = len;
+
+        ret = writev(fileno(log), iov, 2);
+        if (ret > 0)
+                log_wrote(ret);
+}
+
+/* Write a line at once, for CU_DEBUG_POLICY=sync */
+static void write_line(const char *line, size_t len)
 {
-        char *log_file = NULL;
-        pthread_t id;
-        struct timeval tv;
-        struct timezone tz;
-        time_t timep;
-        struct tm *p;
+        log_wrote(fwrite(line, 1, len, log));
+}
 
+static size_t binary_note(char *buf, size_t size, const char *fmt, ...)
+{
+        struct timespec real;
+        struct timespec mono;
+        size_t format_len;
+        size_t len;
         va_list ap;
 
+        clock_gettime(CLOCK_REALTIME, &real);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+
         va_start(ap, fmt);
+        len = cu_binlog_message(buf, size, get_tid(), &real, &mono, 0,
+                                fmt, ap, &format_len);
+        va_end(ap);
+
+        return len;
+}
+
+/*
+ * Write out everything in the rings and free those of threads that
+ * have exited.  Called with ring_lock held.
+ */
+static void drain(void)
+{
+        static char batch[BATCH_SIZE];
+        struct log_ring **prev;
+        struct log_ring *ring;
+        size_t base = 0;
+        size_t len;
+        size_t head;
+        uint32_t msg_len;
+        unsigned long lost;
 
-        if (log_init == 0) {
-                log_file = getenv("CU_DEBUG");
-                if (log_file) {
-                        if (STREQ(log_file, "stdout")) {
-                                log = stdout;
-                        } else {
-                                log = fopen(log_file, "a");
-                                setlinebuf(log);
+        if (binary)
+                base = cu_binlog_batch(batch);
+        len = base;
+
+        prev = &rings;
+        while ((ring = *prev) != NULL) {
+                head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+                while (ring->tail != head) {
+                        ring_read(ring, ring->tail, &msg_len, sizeof(msg_len));
+                        if (len + msg_len > sizeof(batch)) {
+                                batch_write(batch, len);
+                                len = base;
                         }
+
+                        ring_read(ring, ring->tail + sizeof(msg_len),
+                                  batch + len, msg_len);
+                        len += msg_len;
+
+                        __atomic_store_n(&ring->tail,
+                                         ring->tail + sizeof(msg_len) + msg_len,
+                                         __ATOMIC_RELEASE);
+                }
+
+                if (__atomic_load_n(&ring->dead, __ATOMIC_ACQUIRE) &&
+                    (ring->tail == ring->head)) {
+                        *prev = ring->next;
+                        free(ring->data);
+                        free(ring);
+                        continue;
+                }
+
+                prev = &ring->next;
+        }
+
+        lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+        if ((lost != dropped_reported) &&
+            (len + CU_BINLOG_MIN_BUF < sizeof(batch))) {
+                if (binary)
+                        len += binary_note(batch + len, sizeof(batch) - len,
+                                           "libcmpiutil: %lu log message(s) "
+                                           "dropped\n",
+                                           lost - dropped_reported);
+                else
+                        len += snprintf(batch + len, sizeof(batch) - len,
+                                        "libcmpiutil: %lu log message(s) "
+                                        "dropped\n",
+                                        lost - dropped_reported);
+                dropped_reported = lost;
+        }
+
+        if (len > base)
+                batch_write(batch, len);
+}
+
+static void *writer_thread(void *arg)
+{
+        struct timespec ts;
+        sigset_t mask;
+        bool stop = false;
+
+        /* Leave the CIMOM's signals to its own threads */
+        sigfillset(&mask);
+        pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+        while (!stop) {
+                pthread_mutex_lock(&wake_lock);
+                if (!writer_stop) {
+                        clock_gettime(CLOCK_REALTIME, &ts);
+                        ts.tv_nsec += FLUSH_MS * 1000000L;
+                        if (ts.tv_nsec >= 1000000000L) {
+                                ts.tv_sec++;
+                                ts.tv_nsec -= 1000000000L;
+                        }
+                        pthread_cond_timedwait(&wake_cond, &wake_lock, &ts);
+                }
+                stop = writer_stop;
+                pthread_mutex_unlock(&wake_lock);
+
+                pthread_mutex_lock(&ring_lock);
+                drain();
+                pthread_mutex_unlock(&ring_lock);
+        }
+
+        return NULL;
+}
+
+static void start_writer(void)
+{
+        if (__atomic_load_n(&writer_started, __ATOMIC_ACQUIRE))
+                return;
+
+        pthread_mutex_lock(&wake_lock);
+
+        if (!writer_started && !writer_stop) {
+                if (pthread_create(&writer, NULL, writer_thread, NULL) != 0)
+                        policy = LOG_SYNC;
+                else
+                        __atomic_store_n(&writer_started, true,
+                                         __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_unlock(&wake_lock);
+}
+
+static void ring_release(void *data)
+{
+        struct log_ring *ring = data;
+
+        __atomic_store_n(&ring->dead, true, __ATOMIC_RELEASE);
+}
+
+static struct log_ring *new_ring(void)
+{
+        struct log_ring *ring;
+
+        ring = calloc(1, sizeof(*ring));
+        if (ring == NULL)
+                return NULL;
+
+        ring->data = malloc(ring_size);
+        if (ring->data == NULL) {
+                free(ring);
+                return NULL;
+        }
+        ring->size = ring_size;
+
+        pthread_mutex_lock(&ring_lock);
+        ring->next = rings;
+        rings = ring;
+        pthread_mutex_unlock(&ring_lock);
+
+        pthread_setspecific(ring_key, ring);
+        my_ring = ring;
+
+        return ring;
+}
+
+static void log_drop(void)
+{
+        __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+        cu_stat_add(&dropped_stat, 1);
+}
+
+static void log_put(const char *line, size_t len)
+{
+        struct log_ring *ring = my_ring;
+        uint32_t msg_len;
+        size_t need;
+        size_t used;
+
+        if (ring == NULL) {
+                ring = new_ring();
+                if (ring == NULL) {
+                        log_drop();
+                        return;
+                }
+        }
+
+        start_writer();
+        if (policy == LOG_SYNC) {
+                if (binary)
+                        write_direct(line, len);
+                else
+                        write_line(line, len);
+                return;
+        }
+
+        /* Cut very long messages to what the ring and a batch can hold */
+        if (len > ring->size / 2)
+                len = ring->size / 2;
+        if (len > BATCH_SIZE)
+                len = BATCH_SIZE;
+
+        msg_len = len;
+        need = sizeof(msg_len) + len;
+
+        for (;;) {
+                used = ring->head - __atomic_load_n(&ring->tail,
+                                                    __ATOMIC_ACQUIRE);
+                if (used + need <= ring->size)
+                        break;
+
+                if (policy == LOG_DROP) {
+                        log_drop();
+                        return;
+                }
+
+                pthread_mutex_lock(&ring_lock);
+                drain();
+                pthread_mutex_unlock(&ring_lock);
+        }
+
+        ring_write(ring, ring->head, &msg_len, sizeof(msg_len));
+        ring_write(ring, ring->head + sizeof(msg_len), line, len);
+        __atomic_store_n(&ring->head, ring->head + need, __ATOMIC_RELEASE);
+
+        if (used + need > ring->size / 2)
+                pthread_cond_signal(&wake_cond);
+}
+
+/* Write value as exactly width decimal digits */
+static char *put_fixed(char *p, unsigned long value, int width)
+{
+        int i;
+
+        for (i = width - 1; i >= 0; i--) {
+                p[i] = '0' + (value % 10);
+                value /= 10;
+        }
+
+        return p + width;
+}
+
+static char *put_ulong(char *p, unsigned long value)
+{
+        char tmp[24];
+        int n = 0;
+
+        do {
+                tmp[n++] = '0' + (value % 10);
+                value /= 10;
+        } while (value != 0);
+
+        while (n > 0)
+                *p++ = tmp[--n];
+
+        return p;
+}
+
+static char *put_str(char *p, const char *str, size_t len)
+{
+        memcpy(p, str, len);
+
+        return p + len;
+}
+
+/*
+ * Start every line with the wall clock time, CLOCK_MONOTONIC for
+ * measuring intervals between lines, and the kernel thread ID:
+ *
+ *   [2008-01-31 12:34:56.123456] [3456.789012] [1234]:
+ *
+ * The date and time up to the second are formatted once a second per
+ * thread, so localtime_r() is rarely called.  buf must have room for
+ * HEADER_MAX bytes.
+ */
+static size_t format_header(char *buf)
+{
+        struct date_cache *cache = &date_cache;
+        struct timespec real;
+        struct timespec mono;
+        struct tm tm;
+        char *p = buf;
+
+        clock_gettime(CLOCK_REALTIME, &real);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+
+        if (real.tv_sec != cache->sec) {
+                localtime_r(&real.tv_sec, &tm);
+                cache->len = strftime(cache->text, sizeof(cache->text),
+                                      "[%Y-%m-%d %H:%M:%S.", &tm);
+                cache->sec = real.tv_sec;
+        }
+
+        p = put_str(p, cache->text, cache->len);
+        p = put_fixed(p, real.tv_nsec / 1000, 6);
+        p = put_str(p, "] [", 3);
+        p = put_ulong(p, mono.tv_sec);
+        p = put_str(p, ".", 1);
+        p = put_fixed(p, mono.tv_nsec / 1000, 6);
+        p = put_str(p, "] [", 3);
+        p = put_ulong(p, get_tid());
+        p = put_str(p, "]: ", 3);
+        *p = '\0';
+
+        return p - buf;
+}
+
+/*
+ * Store the format's id and the raw arguments, leaving the formatting
+ * to tools/cu_logdecode.  A format used for the first time is defined
+ * in the file at once, ahead of the messages that use it.
+ */
+static void binary_print(const char *fmt, va_list ap)
+{
+        char buf[HEADER_MAX + STACK_LINE];
+        struct timespec real;
+        struct timespec mono;
+        size_t format_len;
+        size_t len;
+        int err = errno;
+
+        clock_gettime(CLOCK_REALTIME, &real);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+
+        len = cu_binlog_message(buf, sizeof(buf), get_tid(), &real, &mono,
+                                err, fmt, ap, &format_len);
+
+        if (format_len > 0)
+                write_direct(buf, format_len);
+
+        if (policy == LOG_SYNC)
+                write_direct(buf + format_len, len - format_len);
+        else
+                log_put(buf + format_len, len - format_len);
+}
+
+void debug_print(char *fmt, ...)
+{
+        char stack[HEADER_MAX + STACK_LINE];
+        char *line = stack;
+        va_list ap;
+        size_t prefix;
+        int len;
+
+        if (log == NULL) {
+                if (flight) {
+                        va_start(ap, fmt);
+                        cu_flight_record(fmt, ap);
+                        va_end(ap);
                 }
-                log_init = 1;
+                return;
         }
 
-        if (log != NULL) {
-                gettimeofday(&tv, &tz);
-                time(&timep);
-                p=localtime(&timep);
-                id = pthread_self();
-                fprintf(log, "[%d-%02d-%02d %02d:%02d:%02d.%06d] [%ld]: ",
-                (1900+p->tm_year), (1+p->tm_mon), p->tm_mday, p->tm_hour,
-                p->tm_min, p->tm_sec, (int)tv.tv_usec, id);
-                vfprintf(log, fmt, ap);
+        if (binary) {
+                va_start(ap, fmt);
+                binary_print(fmt, ap);
+                va_end(ap);
+                return;
         }
 
+        prefix = format_header(stack);
+
+        va_start(ap, fmt);
+        len = vsnprintf(stack + prefix, sizeof(stack) - prefix, fmt, ap);
         va_end(ap);
+
+        if (len < 0)
+                return;
+
+        if (prefix + len >= sizeof(stack)) {
+                line = malloc(prefix + len + 1);
+                if (line != NULL) {
+                        memcpy(line, stack, prefix);
+                        va_start(ap, fmt);
+                        vsnprintf(line + prefix, len + 1, fmt, ap);
+                        va_end(ap);
+                } else {
+                        line = stack;
+                        len = sizeof(stack) - prefix - 1;
+                }
+        }
+
+        if (policy == LOG_SYNC)
+                write_line(line, prefix + len);
+        else
+                log_put(line, prefix + len);
+
+        if (line != stack)
+                free(line);
+}
+
+static int find_name(const char **names, int count,
+                     const char *str, size_t len)
+{
+        int i;
+
+        for (i = 0; i < count; i++) {
+                if ((strlen(names[i]) == len) &&
+                    (strncasecmp(names[i], str, len) == 0))
+                        return i;
+        }
+
+        return -1;
+}
+
+static int parse_level(const char *str, size_t len)
+{
+        size_t i;
+        int level = 0;
+
+        if (len == 0)
+                return -1;
+
+        for (i = 0; i < len; i++) {
+                if ((str[i] < '0') || (str[i] > '9'))
+                        return find_name(level_names, CU_LOG_TRACE + 1,
+                                         str, len);
+
+                if (level < CU_LOG_TRACE)
+                        level = (level * 10) + (str[i] - '0');
+        }
+
+        return (level > CU_LOG_TRACE) ? CU_LOG_TRACE : level;
+}
+
+static void trim(const char **start, const char **end)
+{
+        while ((*start < *end) && ((**start == ' ') || (**start == '\t')))
+                (*start)++;
+
+        while ((*end > *start) && (strchr(" \t\r\n", (*end)[-1]) != NULL))
+                (*end)--;
+}
+
+int cu_log_set_levels(const char *spec)
+{
+        int levels[CU_LOG_CATEGORIES];
+        const char *item;
+        const char *end;
+        const char *eq;
+        const char *name_end;
+        int level;
+        int cat;
+        int i;
+
+        memcpy(levels, cu_log_levels, sizeof(levels));
+
+        for (item = spec; *item != '\0'; item = end + (*end == ',')) {
+                end = item + strcspn(item, ",");
+                eq = memchr(item, '=', end - item);
+
+                if (eq == NULL) {
+                        name_end = end;
+                        trim(&item, &name_end);
+                        if (item == name_end)
+                                continue;
+
+                        level = parse_level(item, name_end - item);
+                        if (level < 0)
+                                return -1;
+
+                        for (i = 0; i < CU_LOG_CATEGORIES; i++)
+                                levels[i] = level;
+                } else {
+                        name_end = eq;
+                        trim(&item, &name_end);
+                        cat = find_name(category_names, CU_LOG_CATEGORIES,
+                                        item, name_end - item);
+
+                        item = eq + 1;
+                        name_end = end;
+                        trim(&item, &name_end);
+                        level = parse_level(item, name_end - item);
+
+                        if ((cat < 0) || (level < 0))
+                                return -1;
+
+                        levels[cat] = level;
+                }
+        }
+
+        for (i = 0; i < CU_LOG_CATEGORIES; i++)
+                __atomic_store_n(&cu_log_levels[i], levels[i],
+                                 __ATOMIC_RELAXED);
+
+        return 0;
+}
+
+int cu_log_get_levels(char *buf, size_t size)
+{
+        size_t len = 0;
+        int ret;
+        int i;
+
+        for (i = 1; i < CU_LOG_CATEGORIES; i++) {
+                if (cu_log_levels[i] != cu_log_levels[0])
+                        break;
+        }
+
+        if (i == CU_LOG_CATEGORIES)
+                return snprintf(buf, size, "%s",
+                                level_names[cu_log_levels[0]]);
+
+        for (i = 0; i < CU_LOG_CATEGORIES; i++) {
+                ret = snprintf((len < size) ? buf + len : NULL,
+                               (len < size) ? size - len : 0,
+                               "%s%s=%s", (i > 0) ? "," : "",
+                               category_names[i],
+                               level_names[cu_log_levels[i]]);
+                if (ret < 0)
+                        return ret;
+                len += ret;
+        }
+
+        return len;
+}
+
+static void log_prepare(void)
+{
+        pthread_mutex_lock(&wake_lock);
+        pthread_mutex_lock(&ring_lock);
+        pthread_mutex_lock(&rotate_lock);
+}
+
+static void log_parent(void)
+{
+        pthread_mutex_unlock(&rotate_lock);
+        pthread_mutex_unlock(&ring_lock);
+        pthread_mutex_unlock(&wake_lock);
+}
+
+/*
+ * The writer does not survive fork(), and the other threads' messages
+ * are the parent's to write.  Keep only the forking thread's ring.  A
+ * binary log starts a new session, with its own format ids.  wake_cond
+ * may still count the parent's writer as waiting, so it starts over
+ * along with wake_lock.
+ */
+static void log_child(void)
+{
+        struct log_ring *ring;
+        char session[32];
+
+        for (ring = rings; ring != NULL; ring = ring->next) {
+                if (ring != my_ring) {
+                        ring->tail = ring->head;
+                        ring->dead = true;
+                }
+        }
+
+        writer_started = false;
+
+        if (binary && (log != NULL)) {
+                cu_binlog_reset();
+                if (write(fileno(log), session, cu_binlog_session(session)) < 0)
+                        log = NULL;
+        }
+
+        pthread_mutex_unlock(&rotate_lock);
+        pthread_mutex_unlock(&ring_lock);
+
+        pthread_mutex_init(&wake_lock, NULL);
+        pthread_cond_init(&wake_cond, NULL);
+}
+
+/* A size in bytes, with an optional K, M or G suffix */
+static uint64_t parse_size(const char *str)
+{
+        uint64_t size;
+        char *end;
+
+        size = strtoull(str, &end, 10);
+
+        switch (*end) {
+        case 'k':
+        case 'K':
+                return size << 10;
+        case 'm':
+        case 'M':
+                return size << 20;
+        case 'g':
+        case 'G':
+                return size << 30;
+        default:
+                return size;
+        }
+}
+
+static void log_init(void) __attribute__((constructor));
+static void log_init(void)
+{
+        struct stat st;
+        char *log_file;
+        char *val;
+        size_t size;
+
+        log_file = getenv("CU_DEBUG");
+        if (log_file == NULL) {
+                flight = cu_flight_init();
+                if (!flight)
+                        return;
+
+                val = getenv("CU_FLIGHT_LEVEL");
+                if ((val == NULL) || (cu_log_set_levels(val) != 0))
+                        cu_log_set_levels("warning");
+                return;
+        }
+
+        val = getenv("CU_DEBUG_POLICY");
+        if (val != NULL) {
+                if (STREQC(val, "sync"))
+                        policy = LOG_SYNC;
+                else if (STREQC(val, "drop"))
+                        policy = LOG_DROP;
+        }
+
+        val = getenv("CU_DEBUG_BUFFER");
+        if ((val != NULL) && (atoi(val) > 0)) {
+                size = 4096;
+                while ((size < (size_t)atoi(val) * 1024) && (size < (1 << 30)))
+                        size *= 2;
+                ring_size = size;
+        }
+
+        val = getenv("CU_DEBUG_FORMAT");
+        binary = (val != NULL) && STREQC(val, "binary");
+
+        if ((policy != LOG_SYNC) &&
+            (pthread_key_create(&ring_key, ring_release) != 0))
+                policy = LOG_SYNC;
+
+        if (pthread_atfork(log_prepare, log_parent, log_child) != 0)
+                return;
+
+        if (STREQ(log_file, "stdout")) {
+                log = stdout;
+        } else {
+                log = fopen(log_file, "a");
+                if (log == NULL)
+                        return;
+                setlinebuf(log);
+
+                val = getenv("CU_DEBUG_MAX_SIZE");
+                if (val != NULL)
+                        max_size = parse_size(val);
+
+                val = getenv("CU_DEBUG_ROTATE");
+                if ((val != NULL) && (atoi(val) >= 0))
+                        generations = atoi(val);
+
+                log_path = strdup(log_file);
+                if (log_path == NULL)
+                        max_size = 0;
+
+                if (fstat(fileno(log), &st) == 0)
+                        log_size = st.st_size;
+        }
+
+        if (binary) {
+                char session[32];
+
+                if (write(fileno(log), session,
+                          cu_binlog_session(session)) < 0)
+                        log = NULL;
+        }
+
+        cu_log_set_levels("debug");
+
+        val = getenv("CU_DEBUG_LEVEL");
+        if ((val != NULL) && (cu_log_set_levels(val) != 0))
+                CU_DEBUG("Ignoring invalid CU_DEBUG_LEVEL `%s'", val);
+}
+
+/*
+ * Write what is left when the process exits or the library is
+ * unloaded.  Anything logged after this is written directly.
+ */
+static void log_cleanup(void) __attribute__((destructor));
+static void log_cleanup(void)
+{
+        bool started;
+
+        if ((log == NULL) || (policy == LOG_SYNC))
+                return;
+
+        pthread_mutex_lock(&wake_lock);
+        started = writer_started;
+        writer_stop = true;
+        pthread_cond_signal(&wake_cond);
+        pthread_mutex_unlock(&wake_lock);
+
+        if (started)
+                pthread_join(writer, NULL);
+
+        pthread_mutex_lock(&ring_lock);
+        policy = LOG_SYNC;
+        drain();
+        pthread_mutex_unlock(&ring_lock);
+
+        pthread_key_delete(ring_key);
 }
 
 /*
@@ -19,9 +19,12 @@
  * License along with this library; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
+#define CU_LOG_CATEGORY CU_LOG_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -30,9 +33,14 @@
 #include <cmpimacs.h>
 
 #include "libcmpiutil.h"
-#include "eo_util_parser.h"
+#include "cu_upcall.h"
+#include "cu_stats.h"
+#include "cu_probes.h"
 #include "eo_parser_xml.h"
 
+#ifdef HAVE_EOPARSER
+#include "eo_util_parser.h"
+
 #define TEMPLATE "/tmp/tmp_eo_parse.XXXXXX"
 
 void eo_parse_restart(FILE *);
@@ -63,7 +71,6 @@ static int write_temp(const char *eo)
         return fd;
 }
 
-#ifdef HAVE_EOPARSER
 static int parse_ei_mof(const CMPIBroker *broker,
                         const char *ns,
                         const char *eo,
@@ -78,30 +85,102 @@ static int parse_ei_mof(const CMPIBroker *broker,
                 return 0;
 
         fp = fdopen(fd, "r");
+        if (fp == NULL) {
+                close(fd);
+                return 0;
+        }
+
         eo_parse_restart(fp);
         ret = eo_parse_parseinstance(broker, instance, ns);
 
-        close(fd);
+        fclose(fp);
 
         return ret;
 }
 #endif
 
+CU_PROBE_DEFINE(eo__parse__entry);
+CU_PROBE_DEFINE(eo__parse__return);
+
+/* Number of properties parsed, for eo__parse__return */
+#define PROPS(ret, inst)                                                \
+        ((((ret) == 0) && (*(inst) != NULL)) ?                          \
+         CMGetPropertyCount(*(inst), NULL) : 0)
+
+static CU_STAT_LABELED(xml_stat, CU_STAT_COUNTER,
+                       "cu_eo_parse_total", "format", "xml",
+                       "Embedded instances parsed");
+static CU_STAT_LABELED(xml_bytes_stat, CU_STAT_COUNTER,
+                       "cu_eo_parse_bytes_total", "format", "xml",
+                       "Bytes of embedded instances parsed");
+static CU_STAT_LABELED(xml_err_stat, CU_STAT_COUNTER,
+                       "cu_eo_parse_errors_total", "format", "xml",
+                       "Embedded instances that failed to parse");
+
+#ifdef HAVE_EOPARSER
+static CU_STAT_LABELED(mof_stat, CU_STAT_COUNTER,
+                       "cu_eo_parse_total", "format", "mof",
+                       "Embedded instances parsed");
+static CU_STAT_LABELED(mof_bytes_stat, CU_STAT_COUNTER,
+                       "cu_eo_parse_bytes_total", "format", "mof",
+                       "Bytes of embedded instances parsed");
+static CU_STAT_LABELED(mof_err_stat, CU_STAT_COUNTER,
+                       "cu_eo_parse_errors_total", "format", "mof",
+                       "Embedded instances that failed to parse");
+#endif
+
+/*
+ * CIM-XML starts with markup, MOF with `instance of'.  Looking for
+ * `<instance' anywhere would hand a MOF instance with XML in one of its
+ * strings to the XML parser.
+ */
+static bool is_cimxml(const char *eo)
+{
+        while (isspace((unsigned char)*eo))
+                eo++;
+
+        return *eo == '<';
+}
+
 int cu_parse_embedded_instance(const char *eo,
                                const CMPIBroker *broker,
                                const char *ns,
                                CMPIInstance **instance)
 {
-        if (strcasestr(eo, "<instance")) {
+        int ret;
+
+        if (is_cimxml(eo)) {
                 CU_DEBUG("Parsing CIMXML-style EI");
-                return cu_parse_ei_xml(broker, ns, eo, instance);
+                CU_PROBE2(eo__parse__entry, "xml", strlen(eo));
+
+                ret = cu_parse_ei_xml(broker, ns, eo, instance);
+
+                CU_PROBE3(eo__parse__return, "xml", ret, PROPS(ret, instance));
+
+                cu_stat_add(&xml_stat, 1);
+                cu_stat_add(&xml_bytes_stat, strlen(eo));
+                if (ret != 0)
+                        cu_stat_add(&xml_err_stat, 1);
+
+                return ret;
         } else {
 #ifdef HAVE_EOPARSER
                 CU_DEBUG("Parsing MOF-style EI");
-                return parse_ei_mof(broker, ns, eo, instance);
+                CU_PROBE2(eo__parse__entry, "mof", strlen(eo));
+
+                ret = parse_ei_mof(broker, ns, eo, instance);
+
+                CU_PROBE3(eo__parse__return, "mof", ret, PROPS(ret, instance));
+
+                cu_stat_add(&mof_stat, 1);
+                cu_stat_add(&mof_bytes_stat, strlen(eo));
+                if (ret != 0)
+                        cu_stat_add(&mof_err_stat, 1);
+
+                return ret;
 #else
-                CU_DEBUG("EI parser did not see `<instance', "
-                         "assuming not CIMXML");
+                CU_DEBUG("EI does not start with `<' and the MOF "
+                         "parser is not built");
                 return 0;
 #endif
         }
@@ -114,6 +193,7 @@ static int _set_int_prop(CMPISint64 value,
 {
         CMPIStatus s;
         CMPIValue val;
+        CU_UPCALL_SITE();
 
         switch (type) {
         case CMPI_uint64:
@@ -185,6 +265,7 @@ inline CMPIStatus ins_chars_into_cmstr_arr(const CMPIBroker *broker,
 {
         CMPIString *cm_str;
         CMPIStatus s = {CMPI_RC_OK, NULL};
+        CU_UPCALL_SITE();
 
         cm_str = CMNewString(broker, str, &s);
         if (s.rc != CMPI_RC_OK || CMIsNullObject(cm_str)) {
@@ -19,11 +19,16 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
 
+#define CU_LOG_CATEGORY CU_LOG_PARSER
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <malloc.h>
 #include <string.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <dlfcn.h>
 
 #include <libxml/parser.h>
 #include <libxml/tree.h>
@@ -31,9 +36,128 @@
 #include <cmpimacs.h>
 
 #include "libcmpiutil.h"
+#include "cu_upcall.h"
+#include "cu_mem.h"
+#include "cu_arena.h"
 
 #include "eo_parser_xml.h"
 
+/*
+ * libxml2 allocates through function pointers, which are process-wide.
+ * When cu_mem_count_libxml2() replaces them, what a thread allocates
+ * while it is in cu_parse_ei_xml() is counted as CU_MEM_LIBXML2; all
+ * other calls go straight to malloc() and free().  A parse makes
+ * hundreds of allocations, so they are tallied per thread and counted
+ * once at the end.
+ */
+struct xml_tally {
+        bool on;
+        int64_t bytes;
+        int64_t peak;
+        uint64_t allocs;
+};
+
+static __thread struct xml_tally tally;
+static bool xml_wrapped = false;
+
+static void *xml_counted(void *ptr, size_t old_size)
+{
+        if ((ptr == NULL) || !tally.on)
+                return ptr;
+
+        tally.bytes += (int64_t)malloc_usable_size(ptr) - (int64_t)old_size;
+        tally.allocs++;
+        if (tally.bytes > tally.peak)
+                tally.peak = tally.bytes;
+
+        return ptr;
+}
+
+static void *xml_malloc(size_t size)
+{
+        return xml_counted(malloc(size), 0);
+}
+
+static void *xml_realloc(void *ptr, size_t size)
+{
+        size_t old_size = 0;
+        void *new;
+
+        if (tally.on && (ptr != NULL))
+                old_size = malloc_usable_size(ptr);
+
+        new = realloc(ptr, size);
+        if (new == NULL)
+                return NULL;
+
+        return xml_counted(new, old_size);
+}
+
+static void xml_free(void *ptr)
+{
+        if (tally.on && (ptr != NULL))
+                tally.bytes -= malloc_usable_size(ptr);
+
+        free(ptr);
+}
+
+static char *xml_strdup(const char *str)
+{
+        return xml_counted(strdup(str), 0);
+}
+
+/*
+ * Another thread may be in libxml2 at any time, so the wrappers are
+ * never taken out again, and the library is kept loaded for them.
+ */
+static bool pin_library(void)
+{
+        Dl_info info;
+
+        if ((dladdr((void *)xml_malloc, &info) == 0) ||
+            (info.dli_fname == NULL))
+                return false;
+
+        return dlopen(info.dli_fname,
+                      RTLD_NOW | RTLD_NOLOAD | RTLD_NODELETE) != NULL;
+}
+
+bool cu_mem_count_libxml2(void)
+{
+        xmlFreeFunc free_fn;
+        xmlMallocFunc malloc_fn;
+        xmlReallocFunc realloc_fn;
+        xmlStrdupFunc strdup_fn;
+
+        if (xml_wrapped)
+                return true;
+
+        /* Its own globals are not ours to count */
+        xmlInitParser();
+
+        if ((xmlMemGet(&free_fn, &malloc_fn, &realloc_fn, &strdup_fn) != 0) ||
+            (free_fn != free) || (malloc_fn != malloc) ||
+            (realloc_fn != realloc))
+                return false;
+
+        if (!pin_library())
+                return false;
+
+        if (xmlMemSetup(xml_free, xml_malloc, xml_realloc, xml_strdup) == 0)
+                xml_wrapped = true;
+
+        return xml_wrapped;
+}
+
+static void xml_mem_init(void) __attribute__((constructor));
+static void xml_mem_init(void)
+{
+        const char *val = getenv("CU_STATS");
+
+        if ((val != NULL) && (*val != '\0'))
+                cu_mem_count_libxml2();
+}
+
 static char *get_attr(xmlNode *node, const char *name)
 {
         return (char *)xmlGetProp(node, (xmlChar *)name);
@@ -51,6 +175,7 @@ static CMPIType parse_string_property(const CMPIBroker *broker,
 {
         CMPIString *str;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         str = CMNewString(broker, string, &s);
         if ((str == NULL) || (s.rc != CMPI_RC_OK))
@@ -191,7 +316,7 @@ static CMPIType get_node_value(const CMPIBroker *broker,
         content = get_content(node);
         CU_DEBUG("Node content: %s", content);
         type = get_property_value(broker, tstr, content, val);
-        free(content);
+        xmlFree(content);
  out:
         return type;
 }
@@ -208,6 +333,7 @@ static CMPIType parse_array(const CMPIBroker *broker,
         CMPIStatus s;
         CMPIType type = CMPI_null;
         int i;
+        CU_UPCALL_SITE();
 
         for (value = root->children; value; value = value->next) {
 
@@ -216,16 +342,19 @@ static CMPIType parse_array(const CMPIBroker *broker,
 
                 if (cur == size) {
                         CMPIValue *tmp;
+                        int newsize = (size == 0) ? 8 : size * 2;
 
-                        size *= 2;
-                        tmp = realloc(list, sizeof(CMPIValue) * size);
+                        tmp = cu_tmp_realloc(CU_MEM_EI_XML, list,
+                                             sizeof(CMPIValue) * size,
+                                             sizeof(CMPIValue) * newsize);
                         if (tmp == NULL) {
                                 CU_DEBUG("Failed to alloc %i",
-                                         sizeof(CMPIValue) * size);
+                                         sizeof(CMPIValue) * newsize);
                                 goto out;
                         }
 
                         list = tmp;
+                        size = newsize;
                 }
 
                 type = get_node_value(broker, value, tstr, &list[cur]);
@@ -237,8 +366,10 @@ static CMPIType parse_array(const CMPIBroker *broker,
                 }
         }
 
-        if (cur == 0)
-                return CMPI_null;
+        if (cur == 0) {
+                type = CMPI_null;
+                goto out;
+        }
 
         *array = CMNewArray(broker, cur, type, &s);
         if ((*array == NULL) || (s.rc != CMPI_RC_OK)) {
@@ -250,7 +381,7 @@ static CMPIType parse_array(const CMPIBroker *broker,
                 CMSetArrayElementAt((*array), i, &list[i], type);
 
  out:
-        free(list);
+        cu_tmp_free(CU_MEM_EI_XML, list);
 
         return type;
 }
@@ -265,6 +396,7 @@ static bool parse_array_property(const CMPIBroker *broker,
         xmlNode *val_arr;
         CMPIArray *array;
         CMPIType type;
+        CU_UPCALL_SITE();
 
         name = get_attr(node, "NAME");
         if (name == NULL) {
@@ -303,8 +435,8 @@ static bool parse_array_property(const CMPIBroker *broker,
         }
 
  out:
-        free(name);
-        free(tstr);
+        xmlFree(name);
+        xmlFree(tstr);
 
         return ret;
 }
@@ -318,6 +450,7 @@ static bool parse_property(const CMPIBroker *broker,
         CMPIValue value;
         CMPIType type = CMPI_null;
         xmlNode *ptr;
+        CU_UPCALL_SITE();
 
         name = get_attr(node, "NAME");
         if (name == NULL) {
@@ -341,8 +474,8 @@ static bool parse_property(const CMPIBroker *broker,
                 }
         }
  out:
-        free(name);
-        free(tstr);
+        xmlFree(name);
+        xmlFree(tstr);
 
         return type != CMPI_null;
 }
@@ -356,6 +489,7 @@ static CMPIStatus parse_instance(const CMPIBroker *broker,
         xmlNode *child;
         CMPIStatus s = {CMPI_RC_OK, NULL};
         CMPIObjectPath *op;
+        CU_UPCALL_SITE();
 
         if (root->type != XML_ELEMENT_NODE) {
                 CU_DEBUG("First node is not <INSTANCE>");
@@ -415,7 +549,7 @@ static CMPIStatus parse_instance(const CMPIBroker *broker,
         }
 
  out:
-        free(class);
+        xmlFree(class);
 
         return s;
 }
@@ -502,6 +636,9 @@ int cu_parse_ei_xml(const CMPIBroker *broker,
         xmlNode *root = NULL;
         int ret = 1;
         CMPIStatus s;
+        bool counting = tally.on;
+
+        tally.on = true;
 
         doc = xmlReadMemory(xml,
                             strlen(xml),
@@ -534,6 +671,13 @@ int cu_parse_ei_xml(const CMPIBroker *broker,
  out:
         xmlFreeDoc(doc);
 
+        if (!counting) {
+                tally.on = false;
+                cu_mem_count(CU_MEM_LIBXML2, tally.bytes, tally.peak,
+                             tally.allocs);
+                memset(&tally, 0, sizeof(tally));
+        }
+
         return ret;
 }
 
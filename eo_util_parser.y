@@ -16,6 +16,8 @@
 #include <cmpidt.h>
 #include <cmpift.h>
 
+#include "cu_mem.h"
+#include "cu_arena.h"
 #include "eo_parser_xml.h"
 
     /* specify prototypes to get rid of warnings */
@@ -87,7 +89,7 @@ instance:	/* empty */
 						   NULL);
 			if (*_INSTANCE == NULL)
 				return RC_INVALID_CLASS;
-			free($3);
+			cu_tmp_free(CU_MEM_EI_MOF, $3);
 			}
 		properties CLOSEBRACKET ';'
 			{
@@ -111,8 +113,8 @@ property:	PROPERTYNAME '=' STRING ';'
 				"\tvalue = %s\n",
 				$1, $3);
 			CMSetProperty(*_INSTANCE, $1, $3, CMPI_chars);
-			free($1);
-			free($3);
+			cu_tmp_free(CU_MEM_EI_MOF, $1);
+			cu_tmp_free(CU_MEM_EI_MOF, $3);
 			}
 
 	|	PROPERTYNAME '=' INTEGER ';'
@@ -121,7 +123,7 @@ property:	PROPERTYNAME '=' STRING ';'
                         CMPIType t = set_int_prop($3, $1, *_INSTANCE);
                         EOTRACE("\ttype = %d\n"
                                 "\tvalue = %lld\n", t, $3);
-                        free($1);
+                        cu_tmp_free(CU_MEM_EI_MOF, $1);
 			}
 
 	|	PROPERTYNAME '=' BOOLEAN ';'
@@ -131,7 +133,7 @@ property:	PROPERTYNAME '=' STRING ';'
 				"\tvalue = %d\n",
 				$1, $3);
 			CMSetProperty(*_INSTANCE, $1, &($3), CMPI_boolean);
-			free($1);
+			cu_tmp_free(CU_MEM_EI_MOF, $1);
 			}
         |       PROPERTYNAME '=' OPENBRACKET
                         {
@@ -148,7 +150,7 @@ property:	PROPERTYNAME '=' STRING ';'
 			{
 			EOTRACE("propertyname = %s\n"
 				"\ttype = NULL\n", $1);
-			free($1);
+			cu_tmp_free(CU_MEM_EI_MOF, $1);
 			}
 	;
 
@@ -160,9 +162,10 @@ arrayofstrings: STRING
                                 $1);
 
                         stringarraysize++;
-                        stringarray = (char **)realloc(stringarray,
-                                                       sizeof(char *) *
-                                                       stringarraysize);
+                        stringarray = cu_mem_realloc(CU_MEM_EI_MOF,
+                                                     stringarray,
+                                                     sizeof(char *) *
+                                                     stringarraysize);
                         stringarray[stringarraysize-1] = $1;
                         }
                 COMMA arrayofstrings
@@ -214,10 +217,10 @@ arrayofstrings: STRING
                                       CMPI_stringA);
 
                        str_arr_out:
-                        free(stringarraypropname);
+                        cu_tmp_free(CU_MEM_EI_MOF, stringarraypropname);
                         for (i = 0; i < stringarraysize - 1; i++)
-                                free(stringarray[i]);
-                        free($1);
+                                cu_tmp_free(CU_MEM_EI_MOF, stringarray[i]);
+                        cu_tmp_free(CU_MEM_EI_MOF, $1);
 
                         if (s.rc != CMPI_RC_OK) {
                                 return RC_ARR_CREAT_FAILED;
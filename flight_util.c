@@ -0,0 +1,809 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+
+#include "libcmpiutil.h"
+#include "cu_stats.h"
+#include "cu_binlog.h"
+#include "cu_flight.h"
+
+/* Per-thread ring size in KiB, unless CU_FLIGHT_SIZE says otherwise */
+#define DEFAULT_RING_KB 16
+
+/* Most the dump file grows to in KiB, unless CU_FLIGHT_MAX_SIZE says */
+#define DEFAULT_MAX_KB 1024
+
+/* Most written to the dump file at once */
+#define OUT_SIZE 65536
+
+/* Times a signal handler tries for the dump before giving up */
+#define SIGNAL_TRIES 1000
+
+/* Failed handlers dump no more often than this */
+#define FAILED_INTERVAL_NS 1000000000ULL
+
+/*
+ * The records a thread logged, oldest first from tail.  Only the owning
+ * thread writes to a ring.  Rings are never freed, since a signal
+ * handler may be reading one: when a thread exits its ring is marked
+ * unused, and the next new thread takes it over.
+ */
+struct flight_ring {
+        char *data;
+        size_t size;
+        size_t head;
+        size_t tail;
+        size_t dumped;
+        long tid;
+        bool in_use;
+        struct flight_ring *next;
+};
+
+static bool enabled = false;
+static size_t ring_size = DEFAULT_RING_KB * 1024;
+static char *file_template = NULL;
+static size_t max_size = DEFAULT_MAX_KB * 1024;
+static int dump_signal = 0;
+
+static struct flight_ring *rings = NULL;
+static pthread_key_t ring_key;
+static __thread struct flight_ring *my_ring = NULL;
+static __thread long thread_tid = 0;
+
+/* Whoever sets dumping owns the dump file and the buffers below */
+static bool dumping = false;
+static int dump_fd = -1;
+static size_t dump_size;
+static uint32_t dumped_formats = 0;
+static char *snap = NULL;
+static char out[OUT_SIZE];
+static size_t out_len;
+static size_t out_base;
+
+static CU_STAT(dump_stat, CU_STAT_COUNTER,
+               "cu_flight_dumps_total",
+               "Flight recorder dumps written");
+
+static CU_STAT(full_stat, CU_STAT_COUNTER,
+               "cu_flight_dumps_dropped_total",
+               "Flight recorder dumps dropped at CU_FLIGHT_MAX_SIZE");
+
+static CU_STAT(limited_stat, CU_STAT_COUNTER,
+               "cu_flight_dumps_limited_total",
+               "Failed handler dumps skipped by the rate limit");
+
+static CU_STAT(lost_stat, CU_STAT_COUNTER,
+               "cu_flight_lost_total",
+               "Messages too large for the flight recorder");
+
+static const struct {
+        const char *name;
+        int sig;
+} signals[] = {
+        {"HUP", SIGHUP}, {"INT", SIGINT}, {"QUIT", SIGQUIT},
+        {"ILL", SIGILL}, {"ABRT", SIGABRT}, {"BUS", SIGBUS},
+        {"FPE", SIGFPE}, {"USR1", SIGUSR1}, {"SEGV", SIGSEGV},
+        {"USR2", SIGUSR2}, {"TERM", SIGTERM},
+};
+
+static uint64_t last_failed_ns = 0;
+
+static struct sigaction old_actions[NSIG];
+static bool caught[NSIG];
+
+static long get_tid(void)
+{
+        if (thread_tid == 0)
+                thread_tid = syscall(SYS_gettid);
+
+        return thread_tid;
+}
+
+static void ring_read(struct flight_ring *ring,
+                      size_t pos,
+                      void *dst,
+                      size_t len)
+{
+        size_t off = pos & (ring->size - 1);
+        size_t first = ring->size - off;
+
+        if (first > len)
+                first = len;
+
+        memcpy(dst, ring->data + off, first);
+        memcpy((char *)dst + first, ring->data, len - first);
+}
+
+static void ring_write(struct flight_ring *ring,
+                       size_t pos,
+                       const void *src,
+                       size_t len)
+{
+        size_t off = pos & (ring->size - 1);
+        size_t first = ring->size - off;
+
+        if (first > len)
+                first = len;
+
+        memcpy(ring->data + off, src, first);
+        memcpy(ring->data, (const char *)src + first, len - first);
+}
+
+static void ring_release(void *data)
+{
+        struct flight_ring *ring = data;
+
+        __atomic_store_n(&ring->in_use, false, __ATOMIC_RELEASE);
+}
+
+static struct flight_ring *get_ring(void)
+{
+        struct flight_ring *ring;
+        bool unused;
+
+        for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+             ring != NULL;
+             ring = ring->next) {
+                unused = false;
+                if (__atomic_compare_exchange_n(&ring->in_use, &unused, true,
+                                                false, __ATOMIC_ACQUIRE,
+                                                __ATOMIC_RELAXED)) {
+                        ring->dumped = ring->head;
+                        goto out;
+                }
+        }
+
+        ring = calloc(1, sizeof(*ring));
+        if (ring == NULL)
+                return NULL;
+
+        ring->data = malloc(ring_size);
+        if (ring->data == NULL) {
+                free(ring);
+                return NULL;
+        }
+        ring->size = ring_size;
+        ring->in_use = true;
+
+        ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &ring->next, ring,
+                                            false, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED))
+                ;
+ out:
+        __atomic_store_n(&ring->tid, get_tid(), __ATOMIC_RELEASE);
+        pthread_setspecific(ring_key, ring);
+        my_ring = ring;
+
+        return ring;
+}
+
+/*
+ * Make room by moving tail past the oldest records, then copy the new
+ * ones in.  The new tail is published before the bytes it gives up
+ * are overwritten, so that a reader can tell what it copied was
+ * intact by checking tail afterwards.
+ */
+static void ring_put(struct flight_ring *ring, const char *rec, size_t len)
+{
+        size_t tail = ring->tail;
+        uint32_t rec_len;
+
+        if (len > ring->size / 4) {
+                cu_stat_add(&lost_stat, 1);
+                return;
+        }
+
+        while (ring->head + len - tail > ring->size) {
+                ring_read(ring, tail, &rec_len, sizeof(rec_len));
+                tail += rec_len;
+        }
+
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        ring_write(ring, ring->head, rec, len);
+        __atomic_store_n(&ring->head, ring->head + len, __ATOMIC_RELEASE);
+}
+
+void cu_flight_record(const char *fmt, va_list ap)
+{
+        struct flight_ring *ring = my_ring;
+        char buf[CU_BINLOG_MIN_BUF];
+        struct timespec real;
+        struct timespec mono;
+        size_t format_len;
+        size_t len;
+        int err = errno;
+
+        if (ring == NULL) {
+                ring = get_ring();
+                if (ring == NULL)
+                        return;
+        }
+
+        clock_gettime(CLOCK_REALTIME, &real);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+
+        len = cu_binlog_message(buf, sizeof(buf), get_tid(), &real, &mono,
+                                err, fmt, ap, &format_len);
+
+        /* A new format is written out with the next dump, not kept here */
+        ring_put(ring, buf + format_len, len - format_len);
+
+        errno = err;
+}
+
+/*
+ * Everything below runs in signal handlers too, so it sticks to
+ * write(), open() and plain memory.
+ */
+
+static bool dump_lock(bool in_signal)
+{
+        bool unlocked;
+        int tries;
+
+        for (tries = 0; ; tries++) {
+                unlocked = false;
+                if (__atomic_compare_exchange_n(&dumping, &unlocked, true,
+                                                false, __ATOMIC_ACQUIRE,
+                                                __ATOMIC_RELAXED))
+                        return true;
+
+                /* The holder may be the thread this handler interrupted */
+                if (in_signal && (tries == SIGNAL_TRIES))
+                        return false;
+
+                sched_yield();
+        }
+}
+
+static void dump_unlock(void)
+{
+        __atomic_store_n(&dumping, false, __ATOMIC_RELEASE);
+}
+
+static void full_write(int fd, const char *data, size_t len)
+{
+        ssize_t ret;
+
+        while (len > 0) {
+                ret = write(fd, data, len);
+                if (ret < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        break;
+                }
+
+                data += ret;
+                len -= ret;
+        }
+}
+
+static char *put_ulong(char *p, char *end, unsigned long value)
+{
+        char tmp[24];
+        int n = 0;
+
+        do {
+                tmp[n++] = '0' + (value % 10);
+                value /= 10;
+        } while (value != 0);
+
+        while ((n > 0) && (p < end))
+                *p++ = tmp[--n];
+
+        return p;
+}
+
+static char *put_str(char *p, char *end, const char *str)
+{
+        while ((*str != '\0') && (p < end))
+                *p++ = *str++;
+
+        return p;
+}
+
+/*
+ * Only a file the process created, or a regular one of its own that
+ * nothing else links to, is appended to, so that the dump cannot be
+ * steered into another file through a symlink or a hard link.
+ */
+static int open_file(const char *path)
+{
+        struct stat st;
+        int fd;
+
+        fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_NOFOLLOW |
+                  O_CLOEXEC, 0600);
+        if ((fd >= 0) || (errno != EEXIST))
+                return fd;
+
+        fd = open(path, O_WRONLY | O_APPEND | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0)
+                return -1;
+
+        if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) ||
+            (st.st_uid != geteuid()) || (st.st_nlink != 1)) {
+                close(fd);
+                return -1;
+        }
+
+        return fd;
+}
+
+/* The dump file, with %p replaced by the process ID */
+static bool open_dump(void)
+{
+        char session[32];
+        char path[PATH_MAX];
+        char *end = path + sizeof(path) - 1;
+        struct stat st;
+        const char *t;
+        char *p = path;
+        size_t len;
+
+        if (dump_fd >= 0)
+                return true;
+
+        for (t = file_template; (*t != '\0') && (p < end); t++) {
+                if ((t[0] == '%') && (t[1] == 'p')) {
+                        p = put_ulong(p, end, getpid());
+                        t++;
+                } else {
+                        *p++ = *t;
+                }
+        }
+        *p = '\0';
+
+        dump_fd = open_file(path);
+        if (dump_fd < 0)
+                return false;
+
+        dump_size = 0;
+        if (fstat(dump_fd, &st) == 0)
+                dump_size = st.st_size;
+
+        len = cu_binlog_session(session);
+        if (dump_size + len <= max_size) {
+                full_write(dump_fd, session, len);
+                dump_size += len;
+        }
+
+        return true;
+}
+
+/* What would take the file past max_size is left out */
+static void out_flush(void)
+{
+        if ((out_len > out_base) && (dump_size + out_len <= max_size)) {
+                full_write(dump_fd, out, out_len);
+                dump_size += out_len;
+        }
+
+        out_len = out_base;
+}
+
+/*
+ * Records go out in whole write()s that each start with a batch
+ * record, so that dumps of other processes sharing the file cannot
+ * split one.
+ */
+static void out_put(const char *rec, size_t len)
+{
+        if (out_len + len > sizeof(out))
+                out_flush();
+
+        memcpy(out + out_len, rec, len);
+        out_len += len;
+}
+
+static void out_formats(void)
+{
+        char rec[1024];
+        uint32_t count = cu_binlog_formats();
+        size_t len;
+
+        for (; dumped_formats < count; dumped_formats++) {
+                len = cu_binlog_format(rec, sizeof(rec), dumped_formats + 1);
+                if (len > 0)
+                        out_put(rec, len);
+        }
+}
+
+static void out_text(const char *text, long tid)
+{
+        char rec[512];
+        struct timespec real;
+        struct timespec mono;
+
+        clock_gettime(CLOCK_REALTIME, &real);
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+
+        out_put(rec, cu_binlog_text(rec, sizeof(rec), tid, &real, &mono,
+                                    text));
+}
+
+/*
+ * Copy out the records of a ring from from, which may be written to
+ * by its thread meanwhile.  Whatever tail moved past during the copy
+ * may have been overwritten, and is left out.
+ */
+static size_t out_ring(struct flight_ring *ring, size_t from)
+{
+        size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        size_t off = 0;
+        size_t len;
+        uint32_t rec_len;
+
+        if (from < tail)
+                from = tail;
+
+        ring_read(ring, from, snap, head - from);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        if (tail >= head)
+                return head;
+        if (tail > from) {
+                off = tail - from;
+                from = tail;
+        }
+
+        len = off + (head - from);
+        while (len - off >= CU_BINLOG_HEADER) {
+                memcpy(&rec_len, snap + off, sizeof(rec_len));
+                if ((rec_len < CU_BINLOG_HEADER) || (rec_len > len - off))
+                        break;
+
+                out_put(snap + off, rec_len);
+                off += rec_len;
+        }
+
+        return head;
+}
+
+static void dump(const char *reason, struct flight_ring *only, long tid)
+{
+        struct flight_ring *ring;
+        char text[256];
+        char *end = text + sizeof(text) - 1;
+        char *p;
+
+        if (!open_dump())
+                return;
+
+        if (dump_size >= max_size) {
+                cu_stat_add(&full_stat, 1);
+                return;
+        }
+
+        out_base = cu_binlog_batch(out);
+        out_len = out_base;
+
+        out_formats();
+
+        if (only != NULL) {
+                only->dumped = out_ring(only, only->dumped);
+        } else {
+                for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+                     ring != NULL;
+                     ring = ring->next)
+                        out_ring(ring, 0);
+        }
+
+        p = put_str(text, end, "libcmpiutil: flight recorder dump: ");
+        p = put_str(p, end, reason);
+        p = put_str(p, end, "\n");
+        *p = '\0';
+        out_text(text, tid);
+
+        out_flush();
+
+        cu_stat_add(&dump_stat, 1);
+}
+
+void cu_flight_dump(const char *reason)
+{
+        struct flight_ring *ring = my_ring;
+
+        if (!enabled || (ring == NULL))
+                return;
+
+        if (!dump_lock(false))
+                return;
+
+        dump(reason, ring, get_tid());
+
+        dump_unlock();
+}
+
+void cu_flight_dump_failed(CMPIrc rc, const char *reason)
+{
+        struct timespec ts;
+        uint64_t now;
+        uint64_t last;
+
+        if (!enabled || (my_ring == NULL) || (rc != CMPI_RC_ERR_FAILED))
+                return;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+
+        last = __atomic_load_n(&last_failed_ns, __ATOMIC_RELAXED);
+        if (((last != 0) && (now - last < FAILED_INTERVAL_NS)) ||
+            !__atomic_compare_exchange_n(&last_failed_ns, &last, now, false,
+                                         __ATOMIC_RELAXED,
+                                         __ATOMIC_RELAXED)) {
+                cu_stat_add(&limited_stat, 1);
+                return;
+        }
+
+        cu_flight_dump(reason);
+}
+
+void cu_flight_dump_thread(long tid, const char *reason)
+{
+        struct flight_ring *ring;
+
+        if (!enabled || !dump_lock(false))
+                return;
+
+        for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+             ring != NULL;
+             ring = ring->next) {
+                if (__atomic_load_n(&ring->in_use, __ATOMIC_ACQUIRE) &&
+                    (__atomic_load_n(&ring->tid, __ATOMIC_ACQUIRE) == tid)) {
+                        dump(reason, ring, tid);
+                        break;
+                }
+        }
+
+        /* Followed by what the caller logged about it */
+        if (my_ring != NULL)
+                dump(reason, my_ring, get_tid());
+
+        dump_unlock();
+}
+
+/* Whether a signal ends the process when nothing handles it */
+static bool default_terminates(int sig)
+{
+        return (sig != SIGCHLD) && (sig != SIGURG) && (sig != SIGWINCH) &&
+                (sig != SIGCONT) && (sig != SIGSTOP) && (sig != SIGTSTP) &&
+                (sig != SIGTTIN) && (sig != SIGTTOU);
+}
+
+static void flight_signal(int sig, siginfo_t *info, void *context)
+{
+        struct sigaction *old = &old_actions[sig];
+        char reason[32] = "signal ";
+        char *end;
+        int err = errno;
+
+        end = put_ulong(reason + 7, reason + sizeof(reason) - 1, sig);
+        *end = '\0';
+
+        if (dump_lock(true)) {
+                dump(reason, NULL, syscall(SYS_gettid));
+                dump_unlock();
+        }
+
+        errno = err;
+
+        if (old->sa_flags & SA_SIGINFO) {
+                old->sa_sigaction(sig, info, context);
+        } else if (old->sa_handler == SIG_DFL) {
+                /* Let the signal do what it would have done */
+                if ((sig != dump_signal) && default_terminates(sig)) {
+                        sigaction(sig, old, NULL);
+                        raise(sig);
+                }
+        } else if (old->sa_handler != SIG_IGN) {
+                old->sa_handler(sig);
+        }
+}
+
+static int parse_signal(const char *str, size_t len)
+{
+        size_t i;
+
+        if ((len > 3) && (strncasecmp(str, "SIG", 3) == 0)) {
+                str += 3;
+                len -= 3;
+        }
+
+        if ((len > 0) && (strspn(str, "0123456789") >= len)) {
+                i = atoi(str);
+                return ((i > 0) && (i < NSIG)) ? (int)i : -1;
+        }
+
+        for (i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+                if ((strlen(signals[i].name) == len) &&
+                    (strncasecmp(signals[i].name, str, len) == 0))
+                        return signals[i].sig;
+        }
+
+        return -1;
+}
+
+static void catch_signal(int sig)
+{
+        struct sigaction act;
+
+        memset(&act, 0, sizeof(act));
+        act.sa_sigaction = flight_signal;
+        act.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
+        sigemptyset(&act.sa_mask);
+
+        if (sigaction(sig, &act, &old_actions[sig]) == 0)
+                caught[sig] = true;
+}
+
+static void catch_signals(const char *list)
+{
+        const char *item;
+        size_t len;
+        int sig;
+
+        for (item = list; *item != '\0'; item += len + (item[len] == ',')) {
+                len = strcspn(item, ",");
+                if (len == 0)
+                        continue;
+
+                sig = parse_signal(item, len);
+                if (sig < 0) {
+                        CU_DEBUG("Ignoring unknown signal `%.*s' in "
+                                 "CU_FLIGHT_SIGNALS", (int)len, item);
+                        continue;
+                }
+
+                if (sig != dump_signal)
+                        catch_signal(sig);
+        }
+}
+
+/*
+ * The child starts over: the other threads are gone, and the format
+ * ids its records refer to are about to be reset.
+ */
+static void flight_child(void)
+{
+        struct flight_ring *ring;
+
+        for (ring = rings; ring != NULL; ring = ring->next) {
+                ring->tail = ring->head;
+                ring->dumped = ring->head;
+                if (ring != my_ring)
+                        ring->in_use = false;
+        }
+
+        cu_binlog_reset();
+        dumped_formats = 0;
+        dumping = false;
+
+        if (dump_fd >= 0) {
+                close(dump_fd);
+                dump_fd = -1;
+        }
+}
+
+bool cu_flight_init(void)
+{
+        const char *val;
+        size_t size;
+
+        val = getenv("CU_FLIGHT_SIZE");
+        if (val != NULL) {
+                if (atoi(val) <= 0)
+                        return false;
+
+                size = 4096;
+                while ((size < (size_t)atoi(val) * 1024) && (size < (1 << 24)))
+                        size *= 2;
+                ring_size = size;
+        }
+
+        val = getenv("CU_FLIGHT_MAX_SIZE");
+        if ((val != NULL) && (atoi(val) > 0))
+                max_size = (size_t)atoi(val) * 1024;
+
+        /* Nothing is recorded unless there is somewhere to dump it */
+        val = getenv("CU_FLIGHT_FILE");
+        if ((val == NULL) || (*val == '\0'))
+                return false;
+
+        file_template = strdup(val);
+        snap = malloc(ring_size);
+        if ((file_template == NULL) || (snap == NULL))
+                return false;
+
+        if ((pthread_key_create(&ring_key, ring_release) != 0) ||
+            (pthread_atfork(NULL, NULL, flight_child) != 0))
+                return false;
+
+        val = getenv("CU_FLIGHT_DUMP_SIGNAL");
+        if (val != NULL) {
+                dump_signal = parse_signal(val, strlen(val));
+                if (dump_signal > 0)
+                        catch_signal(dump_signal);
+                else
+                        dump_signal = 0;
+        }
+
+        val = getenv("CU_FLIGHT_SIGNALS");
+        if (val != NULL)
+                catch_signals(val);
+
+        enabled = true;
+
+        return true;
+}
+
+/*
+ * Nothing of the recorder may be left behind when the library is
+ * unloaded: give the caught signals their old actions back, unless
+ * something else has replaced ours since.
+ */
+static void flight_cleanup(void) __attribute__((destructor));
+static void flight_cleanup(void)
+{
+        struct sigaction cur;
+        int sig;
+
+        for (sig = 1; sig < NSIG; sig++) {
+                if (!caught[sig])
+                        continue;
+
+                if ((sigaction(sig, NULL, &cur) == 0) &&
+                    (cur.sa_flags & SA_SIGINFO) &&
+                    (cur.sa_sigaction == flight_signal))
+                        sigaction(sig, &old_actions[sig], NULL);
+
+                caught[sig] = false;
+        }
+
+        if (enabled)
+                pthread_key_delete(ring_key);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
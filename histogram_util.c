@@ -0,0 +1,556 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "libcmpiutil.h"
+#include "cu_histogram.h"
+
+/* Distinct (miName, operation) pairs that can be recorded */
+#define MAX_HISTOGRAMS 256
+
+#define SUB_BITS CU_HISTOGRAM_SUB_BITS
+#define SUB_HALF (1 << (SUB_BITS - 1))
+
+struct histogram {
+        char *mi_name;
+        char *op;
+        uint32_t hash;
+        uint64_t total_ns;
+        uint64_t min_ns;
+        uint64_t max_ns;
+        uint64_t cpu_count;
+        uint64_t cpu_ns;
+        uint64_t buckets[CU_HISTOGRAM_BUCKETS];
+};
+
+/*
+ * Open-addressed by hash.  Slots are filled under table_lock and never
+ * emptied, so lookups can run without it.
+ */
+static struct histogram *table[MAX_HISTOGRAMS];
+static unsigned long dropped = 0;
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool histograms_on = false;
+static char *dump_path = NULL;
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static uint64_t cpu_now_ns(void)
+{
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+                return 0;
+
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t ns)
+{
+        int msb;
+        int shift;
+
+        if (ns < (1 << SUB_BITS))
+                return ns;
+
+        msb = 63 - __builtin_clzll(ns);
+        if (msb >= CU_HISTOGRAM_MAX_BITS)
+                return CU_HISTOGRAM_BUCKETS - 1;
+
+        /* Keep the SUB_BITS most significant bits */
+        shift = msb - SUB_BITS + 1;
+
+        return ((msb - SUB_BITS + 1) << (SUB_BITS - 1)) + (ns >> shift);
+}
+
+void cu_histogram_bucket_range(int index, uint64_t *low, uint64_t *high)
+{
+        int shift;
+        uint64_t mant;
+
+        if (index < (1 << SUB_BITS)) {
+                *low = *high = index;
+                return;
+        }
+
+        shift = (index >> (SUB_BITS - 1)) - 1;
+        mant = (index & (SUB_HALF - 1)) + SUB_HALF;
+
+        *low = mant << shift;
+        *high = ((mant + 1) << shift) - 1;
+}
+
+static uint32_t key_hash(const char *mi_name, const char *op)
+{
+        uint32_t h = 2166136261U;
+        const char *p;
+
+        for (p = mi_name; *p != '\0'; p++)
+                h = (h ^ (unsigned char)*p) * 16777619U;
+
+        h = (h ^ '/') * 16777619U;
+
+        for (p = op; *p != '\0'; p++)
+                h = (h ^ (unsigned char)*p) * 16777619U;
+
+        return h;
+}
+
+static bool key_match(const struct histogram *hist,
+                      uint32_t hash,
+                      const char *mi_name,
+                      const char *op)
+{
+        return (hist->hash == hash) &&
+                STREQ(hist->mi_name, mi_name) &&
+                STREQ(hist->op, op);
+}
+
+static struct histogram *new_histogram(uint32_t hash,
+                                       const char *mi_name,
+                                       const char *op)
+{
+        struct histogram *hist;
+
+        hist = calloc(1, sizeof(*hist));
+        if (hist == NULL)
+                return NULL;
+
+        hist->mi_name = strdup(mi_name);
+        hist->op = strdup(op);
+        if ((hist->mi_name == NULL) || (hist->op == NULL)) {
+                free(hist->mi_name);
+                free(hist->op);
+                free(hist);
+                return NULL;
+        }
+
+        hist->hash = hash;
+        hist->min_ns = UINT64_MAX;
+
+        return hist;
+}
+
+static struct histogram *find_histogram(const char *mi_name, const char *op)
+{
+        struct histogram *hist;
+        uint32_t hash;
+        unsigned int start;
+        unsigned int i;
+
+        hash = key_hash(mi_name, op);
+        start = hash & (MAX_HISTOGRAMS - 1);
+
+        i = start;
+        do {
+                hist = __atomic_load_n(&table[i], __ATOMIC_ACQUIRE);
+                if (hist == NULL)
+                        break;
+                else if (key_match(hist, hash, mi_name, op))
+                        return hist;
+
+                i = (i + 1) & (MAX_HISTOGRAMS - 1);
+        } while (i != start);
+
+        pthread_mutex_lock(&table_lock);
+
+        /* Look again, another thread may have added it */
+        hist = NULL;
+        i = start;
+        do {
+                if (table[i] == NULL) {
+                        hist = new_histogram(hash, mi_name, op);
+                        if (hist != NULL)
+                                __atomic_store_n(&table[i], hist,
+                                                 __ATOMIC_RELEASE);
+                        break;
+                } else if (key_match(table[i], hash, mi_name, op)) {
+                        hist = table[i];
+                        break;
+                }
+
+                i = (i + 1) & (MAX_HISTOGRAMS - 1);
+        } while (i != start);
+
+        pthread_mutex_unlock(&table_lock);
+
+        return hist;
+}
+
+static struct histogram *record(const char *mi_name,
+                                const char *op,
+                                uint64_t ns)
+{
+        struct histogram *hist;
+        uint64_t cur;
+
+        if ((mi_name == NULL) || (op == NULL))
+                return NULL;
+
+        hist = find_histogram(mi_name, op);
+        if (hist == NULL) {
+                __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+                return NULL;
+        }
+
+        __atomic_fetch_add(&hist->buckets[bucket_of(ns)], 1,
+                           __ATOMIC_RELAXED);
+        __atomic_fetch_add(&hist->total_ns, ns, __ATOMIC_RELAXED);
+
+        cur = __atomic_load_n(&hist->max_ns, __ATOMIC_RELAXED);
+        while ((ns > cur) &&
+               !__atomic_compare_exchange_n(&hist->max_ns, &cur, ns, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                ;
+
+        cur = __atomic_load_n(&hist->min_ns, __ATOMIC_RELAXED);
+        while ((ns < cur) &&
+               !__atomic_compare_exchange_n(&hist->min_ns, &cur, ns, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                ;
+
+        return hist;
+}
+
+void cu_histogram_record(const char *mi_name, const char *op, uint64_t ns)
+{
+        record(mi_name, op, ns);
+}
+
+void cu_histogram_record_cpu(const char *mi_name,
+                             const char *op,
+                             uint64_t ns,
+                             uint64_t cpu_ns)
+{
+        struct histogram *hist;
+
+        hist = record(mi_name, op, ns);
+        if (hist == NULL)
+                return;
+
+        __atomic_fetch_add(&hist->cpu_count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&hist->cpu_ns, cpu_ns, __ATOMIC_RELAXED);
+}
+
+uint64_t cu_histogram_start(void)
+{
+        if (!histograms_on)
+                return 0;
+
+        return now_ns();
+}
+
+void cu_histogram_end(uint64_t start, const char *mi_name, const char *op)
+{
+        if (start == 0)
+                return;
+
+        cu_histogram_record(mi_name, op, now_ns() - start);
+}
+
+struct cu_histogram_timer cu_histogram_timer_start(void)
+{
+        struct cu_histogram_timer timer = {0, 0};
+
+        if (!histograms_on)
+                return timer;
+
+        timer.cpu_ns = cpu_now_ns();
+        timer.wall_ns = now_ns();
+
+        return timer;
+}
+
+void cu_histogram_timer_end(const struct cu_histogram_timer *timer,
+                            const char *mi_name,
+                            const char *op)
+{
+        uint64_t wall;
+        uint64_t cpu;
+
+        if (timer->wall_ns == 0)
+                return;
+
+        wall = now_ns() - timer->wall_ns;
+        cpu = cpu_now_ns() - timer->cpu_ns;
+
+        /* The CPU clock is coarser, and may read a little over */
+        if (cpu > wall)
+                cpu = wall;
+
+        cu_histogram_record_cpu(mi_name, op, wall, cpu);
+}
+
+static uint64_t take(uint64_t *val, uint64_t zero, bool reset)
+{
+        if (reset)
+                return __atomic_exchange_n(val, zero, __ATOMIC_RELAXED);
+        else
+                return __atomic_load_n(val, __ATOMIC_RELAXED);
+}
+
+static void copy_histogram(struct histogram *hist,
+                           struct cu_histogram *copy,
+                           bool reset)
+{
+        int i;
+
+        copy->mi_name = hist->mi_name;
+        copy->op = hist->op;
+        copy->count = 0;
+
+        for (i = 0; i < CU_HISTOGRAM_BUCKETS; i++) {
+                copy->buckets[i] = take(&hist->buckets[i], 0, reset);
+                copy->count += copy->buckets[i];
+        }
+
+        copy->total_ns = take(&hist->total_ns, 0, reset);
+        copy->min_ns = take(&hist->min_ns, UINT64_MAX, reset);
+        copy->max_ns = take(&hist->max_ns, 0, reset);
+        copy->cpu_count = take(&hist->cpu_count, 0, reset);
+        copy->cpu_ns = take(&hist->cpu_ns, 0, reset);
+
+        /* A sample recorded while we copied may be half in the copy */
+        if (copy->min_ns > copy->max_ns)
+                copy->min_ns = copy->max_ns;
+}
+
+int cu_histogram_snapshot(struct cu_histogram **hists, bool reset)
+{
+        struct cu_histogram *copies;
+        struct histogram *hist;
+        int count = 0;
+        int i;
+
+        copies = malloc(MAX_HISTOGRAMS * sizeof(*copies));
+        if (copies == NULL)
+                return -1;
+
+        for (i = 0; i < MAX_HISTOGRAMS; i++) {
+                hist = __atomic_load_n(&table[i], __ATOMIC_ACQUIRE);
+                if (hist == NULL)
+                        continue;
+
+                copy_histogram(hist, &copies[count], reset);
+                if (copies[count].count > 0)
+                        count++;
+        }
+
+        *hists = copies;
+
+        return count;
+}
+
+uint64_t cu_histogram_percentile(const struct cu_histogram *hist,
+                                 double pct)
+{
+        uint64_t rank;
+        uint64_t seen = 0;
+        uint64_t low;
+        uint64_t high;
+        int i;
+
+        if (hist->count == 0)
+                return 0;
+
+        rank = (uint64_t)(pct / 100.0 * hist->count + 0.5);
+        if (rank < 1)
+                rank = 1;
+        else if (rank > hist->count)
+                rank = hist->count;
+
+        for (i = 0; i < CU_HISTOGRAM_BUCKETS; i++) {
+                seen += hist->buckets[i];
+                if (seen >= rank)
+                        break;
+        }
+
+        /* The last bucket also holds everything longer */
+        if (i == CU_HISTOGRAM_BUCKETS - 1)
+                return hist->max_ns;
+
+        cu_histogram_bucket_range(i, &low, &high);
+
+        return high < hist->max_ns ? high : hist->max_ns;
+}
+
+double cu_histogram_cpu_share(const struct cu_histogram *hist)
+{
+        if ((hist->cpu_count == 0) || (hist->total_ns == 0))
+                return 0;
+
+        return ((double)hist->cpu_ns / hist->cpu_count) /
+                ((double)hist->total_ns / hist->count);
+}
+
+void cu_histogram_reset(void)
+{
+        struct histogram *hist;
+        int i;
+        int j;
+
+        for (i = 0; i < MAX_HISTOGRAMS; i++) {
+                hist = __atomic_load_n(&table[i], __ATOMIC_ACQUIRE);
+                if (hist == NULL)
+                        continue;
+
+                for (j = 0; j < CU_HISTOGRAM_BUCKETS; j++)
+                        __atomic_store_n(&hist->buckets[j], 0,
+                                         __ATOMIC_RELAXED);
+
+                __atomic_store_n(&hist->total_ns, 0, __ATOMIC_RELAXED);
+                __atomic_store_n(&hist->min_ns, UINT64_MAX, __ATOMIC_RELAXED);
+                __atomic_store_n(&hist->max_ns, 0, __ATOMIC_RELAXED);
+                __atomic_store_n(&hist->cpu_count, 0, __ATOMIC_RELAXED);
+                __atomic_store_n(&hist->cpu_ns, 0, __ATOMIC_RELAXED);
+        }
+
+        dropped = 0;
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+        const struct cu_histogram *x = a;
+        const struct cu_histogram *y = b;
+        int ret;
+
+        ret = strcmp(x->mi_name, y->mi_name);
+        if (ret == 0)
+                ret = strcmp(x->op, y->op);
+
+        return ret;
+}
+
+void cu_histogram_dump(FILE *out)
+{
+        struct cu_histogram *hists;
+        struct cu_histogram *h;
+        int count;
+        int i;
+
+        count = cu_histogram_snapshot(&hists, false);
+        if (count < 0)
+                return;
+
+        qsort(hists, count, sizeof(*hists), cmp_key);
+
+        fprintf(out, "%-32s %-24s %10s %10s %10s %10s %10s %10s %10s "
+                "%10s %6s\n",
+                "mi", "operation", "calls", "mean_us", "p50_us",
+                "p90_us", "p99_us", "p99.9_us", "max_us", "cpu_us", "cpu%");
+
+        for (i = 0; i < count; i++) {
+                h = &hists[i];
+
+                fprintf(out,
+                        "%-32s %-24s %10llu %10.1f %10.1f %10.1f "
+                        "%10.1f %10.1f %10.1f",
+                        h->mi_name, h->op,
+                        (unsigned long long)h->count,
+                        (double)h->total_ns / h->count / 1000.0,
+                        cu_histogram_percentile(h, 50) / 1000.0,
+                        cu_histogram_percentile(h, 90) / 1000.0,
+                        cu_histogram_percentile(h, 99) / 1000.0,
+                        cu_histogram_percentile(h, 99.9) / 1000.0,
+                        h->max_ns / 1000.0);
+
+                if (h->cpu_count > 0)
+                        fprintf(out, " %10.1f %6.1f\n",
+                                (double)h->cpu_ns / h->cpu_count / 1000.0,
+                                cu_histogram_cpu_share(h) * 100.0);
+                else
+                        fprintf(out, " %10s %6s\n", "-", "-");
+        }
+
+        if (dropped)
+                fprintf(out, "\n%lu calls not recorded (table full)\n",
+                        dropped);
+
+        free(hists);
+}
+
+bool cu_histogram_enabled(void)
+{
+        return histograms_on;
+}
+
+void cu_histogram_set_enabled(bool enabled)
+{
+        histograms_on = enabled;
+}
+
+static void dump_at_exit(void)
+{
+        FILE *out;
+
+        if (strcmp(dump_path, "stderr") == 0) {
+                cu_histogram_dump(stderr);
+                return;
+        }
+
+        out = fopen(dump_path, "a");
+        if (out == NULL) {
+                CU_DEBUG("Unable to open %s for histograms", dump_path);
+                return;
+        }
+
+        cu_histogram_dump(out);
+        fclose(out);
+}
+
+static void histogram_init(void) __attribute__((constructor));
+static void histogram_init(void)
+{
+        const char *val;
+
+        val = getenv("CU_HISTOGRAMS");
+        if ((val == NULL) || (*val == '\0') || STREQ(val, "off"))
+                return;
+
+        histograms_on = true;
+        if (STREQ(val, "on"))
+                return;
+
+        dump_path = strdup(val);
+        if (dump_path != NULL)
+                atexit(dump_at_exit);
+}
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -18,24 +18,141 @@
  * License along with this library; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
+#define CU_LOG_CATEGORY CU_LOG_INSTANCE
+
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <malloc.h>
 
 #include "libcmpiutil.h"
+#include "cu_stats.h"
+#include "cu_mem.h"
+#include "cu_arena.h"
+
+static CU_STAT(grow_stat, CU_STAT_COUNTER, "cu_inst_list_grow_total",
+               "Times an inst_list was reallocated to grow");
+
+/* The smallest array a list gets, including the NULL terminator */
+#define MIN_SLOTS 16
+
+/* A list from inst_list_init_tmp() that grows past this leaves its arena */
+#define ARENA_LIST_MAX (64 * 1024)
+
+/*
+ * A list from inst_list_init_tmp() is marked by having an array and a
+ * max of 0, so that any thread can tell it apart.  Its array is in an
+ * arena, with the number of slots kept in the slot in front of it.
+ */
+static bool is_tmp(const struct inst_list *list)
+{
+        return (list->list != NULL) && (list->max == 0);
+}
 
-static int resize(struct inst_list *list, int newmax)
+static unsigned int capacity(const struct inst_list *list)
+{
+        if (is_tmp(list))
+                return (unsigned int)(uintptr_t)list->list[-1];
+
+        return list->max;
+}
+
+/*
+ * A list from inst_list_init_tmp() grows in its arena until it gets
+ * large, when copies left behind in the arena would cost more than
+ * realloc() does.  Only the thread the arena belongs to can find it;
+ * on any other thread the list moves out at once.
+ */
+static CMPIInstance **tmp_resize(struct inst_list *list, unsigned int newmax)
+{
+        struct cu_arena *arena;
+        CMPIInstance **base;
+        size_t old_size;
+
+        arena = cu_arena_find(list->list);
+        if ((arena == NULL) ||
+            (newmax >= ARENA_LIST_MAX / sizeof(CMPIInstance *)))
+                return NULL;
+
+        old_size = (capacity(list) + 1) * sizeof(CMPIInstance *);
+
+        base = cu_arena_realloc(arena, list->list - 1, old_size,
+                                (newmax + 1) * sizeof(CMPIInstance *));
+        if (base == NULL)
+                return NULL;
+
+        base[0] = (CMPIInstance *)(uintptr_t)newmax;
+
+        return base + 1;
+}
+
+/*
+ * The array always has room for a NULL after the last instance, which
+ * callers use to find the end of the list.  Slots past it are left as
+ * they are.
+ */
+static int resize(struct inst_list *list, unsigned int newmax)
 {
         CMPIInstance **newlist;
-        int i;
 
-        newlist = realloc(list->list, newmax * sizeof(CMPIInstance *));
-        if (!newlist)
+        if (newmax > SIZE_MAX / sizeof(CMPIInstance *))
                 return 0;
 
+        if (!is_tmp(list)) {
+                newlist = cu_mem_realloc(CU_MEM_INST_LIST, list->list,
+                                         newmax * sizeof(CMPIInstance *));
+                if (newlist == NULL)
+                        return 0;
+
+                list->max = newmax;
+                goto out;
+        }
+
+        newlist = tmp_resize(list, newmax);
+        if (newlist != NULL)
+                goto out;
+
+        newlist = cu_mem_alloc(CU_MEM_INST_LIST,
+                               newmax * sizeof(CMPIInstance *));
+        if (newlist == NULL)
+                return 0;
+
+        memcpy(newlist, list->list, list->cur * sizeof(CMPIInstance *));
         list->max = newmax;
+ out:
         list->list = newlist;
+        list->list[list->cur] = NULL;
 
-        for (i = list->cur; i < list->max; i++)
-                list->list[i] = NULL;
+        return 1;
+}
+
+/* Make room for count more instances, doubling the array as needed */
+static int grow(struct inst_list *list, unsigned int count)
+{
+        unsigned int need;
+        unsigned int newmax;
+
+        if (count >= UINT_MAX - list->cur)
+                return 0;
+
+        need = list->cur + count + 1;
+        if (need <= capacity(list))
+                return 1;
+
+        newmax = capacity(list) < MIN_SLOTS ? MIN_SLOTS : capacity(list);
+        while (newmax < need) {
+                if (newmax > UINT_MAX / 2) {
+                        newmax = need;
+                        break;
+                }
+                newmax *= 2;
+        }
+
+        if (!resize(list, newmax))
+                return 0;
+
+        cu_stat_add(&grow_stat, 1);
 
         return 1;
 }
@@ -46,26 +163,232 @@ void inst_list_init(struct inst_list *list)
         list->cur = list->max = 0;
 }
 
+int inst_list_init_tmp(struct inst_list *list, unsigned int count)
+{
+        struct cu_arena *arena = cu_arena_current();
+        CMPIInstance **base;
+        unsigned int max;
+
+        inst_list_init(list);
+
+        if ((arena == NULL) ||
+            (count >= ARENA_LIST_MAX / sizeof(CMPIInstance *) - 1))
+                return inst_list_reserve(list, count);
+
+        max = (count < MIN_SLOTS) ? MIN_SLOTS : count + 1;
+
+        base = cu_arena_alloc(arena, (max + 1) * sizeof(CMPIInstance *));
+        if (base == NULL)
+                return 0;
+
+        base[0] = (CMPIInstance *)(uintptr_t)max;
+        list->list = base + 1;
+        list->list[0] = NULL;
+
+        return 1;
+}
+
 void inst_list_free(struct inst_list *list)
 {
-        free(list->list);
+        if (!is_tmp(list))
+                cu_mem_free(CU_MEM_INST_LIST, list->list);
+
         inst_list_init(list);
 }
 
 int inst_list_add(struct inst_list *list, CMPIInstance *inst)
 {
-        if ((list->cur + 1) >= list->max) {
-                int ret;
+        if (!grow(list, 1))
+                return 0;
+
+        list->list[list->cur] = inst;
+
+        list->cur++;
+        list->list[list->cur] = NULL;
+
+        return 1;
+}
+
+int inst_list_reserve(struct inst_list *list, unsigned int count)
+{
+        if (count == 0)
+                return 1;
+
+        return grow(list, count);
+}
+
+int inst_list_add_many(struct inst_list *list,
+                       CMPIInstance **insts,
+                       unsigned int count)
+{
+        if (count == 0)
+                return 1;
+
+        if (!grow(list, count))
+                return 0;
+
+        memcpy(&list->list[list->cur], insts, count * sizeof(*insts));
+
+        list->cur += count;
+        list->list[list->cur] = NULL;
+
+        return 1;
+}
+
+int inst_list_shrink(struct inst_list *list)
+{
+        if (list->list == NULL)
+                return 1;
+
+        if (list->cur == 0) {
+                inst_list_free(list);
+                return 1;
+        }
+
+        if ((list->cur + 1 == list->max) || is_tmp(list))
+                return 1;
+
+        return resize(list, list->cur + 1);
+}
+
+CMPIInstance **inst_list_steal(struct inst_list *list, unsigned int *count)
+{
+        CMPIInstance **insts = list->list;
 
-                ret = resize(list, list->max + 10);
+        if (count != NULL)
+                *count = list->cur;
+
+        /* Whoever takes it frees it with free(), out of our sight */
+        if (is_tmp(list)) {
+                insts = malloc((list->cur + 1) * sizeof(*insts));
+                if (insts == NULL)
+                        return NULL;
+
+                memcpy(insts, list->list, (list->cur + 1) * sizeof(*insts));
+        } else if (insts != NULL) {
+                cu_mem_count(CU_MEM_INST_LIST,
+                             -(int64_t)malloc_usable_size(insts), 0, 0);
+        }
+
+        inst_list_init(list);
+
+        return insts;
+}
+
+/*
+ * Chunked lists.  The first block is small, for the common short
+ * result, and the rest are CHUNK_SLOTS long.
+ */
+
+#define FIRST_CHUNK_SLOTS 16
+#define CHUNK_SLOTS 256
+
+struct inst_chunk {
+        struct inst_chunk *next;
+        unsigned int cur;
+        unsigned int max;
+        CMPIInstance *insts[];
+};
+
+void inst_chunk_list_init(struct inst_chunk_list *list)
+{
+        list->head = list->tail = NULL;
+        list->count = 0;
+}
+
+void inst_chunk_list_free(struct inst_chunk_list *list)
+{
+        struct inst_chunk *chunk;
+        struct inst_chunk *next;
 
-                if (!ret)
+        for (chunk = list->head; chunk != NULL; chunk = next) {
+                next = chunk->next;
+                cu_mem_free(CU_MEM_INST_LIST, chunk);
+        }
+
+        inst_chunk_list_init(list);
+}
+
+int inst_chunk_list_add(struct inst_chunk_list *list, CMPIInstance *inst)
+{
+        struct inst_chunk *chunk = list->tail;
+        unsigned int slots;
+
+        if ((chunk == NULL) || (chunk->cur == chunk->max)) {
+                slots = chunk == NULL ? FIRST_CHUNK_SLOTS : CHUNK_SLOTS;
+
+                chunk = cu_mem_alloc(CU_MEM_INST_LIST,
+                                     sizeof(*chunk) +
+                                     slots * sizeof(CMPIInstance *));
+                if (chunk == NULL)
                         return 0;
+
+                chunk->next = NULL;
+                chunk->cur = 0;
+                chunk->max = slots;
+
+                if (list->tail == NULL)
+                        list->head = chunk;
+                else
+                        list->tail->next = chunk;
+                list->tail = chunk;
         }
 
-        list->list[list->cur] = inst;
+        chunk->insts[chunk->cur++] = inst;
+        list->count++;
 
-        list->cur++;
+        return 1;
+}
+
+void inst_chunk_iter_init(struct inst_chunk_iter *iter,
+                          const struct inst_chunk_list *list)
+{
+        iter->list = list;
+        iter->chunk = NULL;
+        iter->pos = 0;
+}
+
+/* The iterator stays on the last block, to see what is added to it */
+CMPIInstance *inst_chunk_iter_next(struct inst_chunk_iter *iter)
+{
+        if (iter->chunk == NULL) {
+                iter->chunk = iter->list->head;
+                if (iter->chunk == NULL)
+                        return NULL;
+        }
+
+        while (iter->pos == iter->chunk->cur) {
+                if (iter->chunk->next == NULL)
+                        return NULL;
+
+                iter->chunk = iter->chunk->next;
+                iter->pos = 0;
+        }
+
+        return iter->chunk->insts[iter->pos++];
+}
+
+int inst_list_add_chunks(struct inst_list *list,
+                         const struct inst_chunk_list *chunks)
+{
+        const struct inst_chunk *chunk;
+
+        if (chunks->count == 0)
+                return 1;
+
+        if (chunks->count >= UINT_MAX)
+                return 0;
+
+        if (!grow(list, chunks->count))
+                return 0;
+
+        for (chunk = chunks->head; chunk != NULL; chunk = chunk->next) {
+                memcpy(&list->list[list->cur], chunk->insts,
+                       chunk->cur * sizeof(CMPIInstance *));
+                list->cur += chunk->cur;
+        }
+
+        list->list[list->cur] = NULL;
 
         return 1;
 }
@@ -18,16 +18,29 @@
  * License along with this library; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
+#define CU_LOG_CATEGORY CU_LOG_INSTANCE
+
+#include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <ctype.h>
 
 #include <cmpimacs.h>
 
 #include "libcmpiutil.h"
+#include "cu_upcall.h"
+#include "cu_stats.h"
+#include "cu_arena.h"
+
+static CU_STAT(dedup_stat, CU_STAT_COUNTER, "cu_inst_list_dedup_total",
+               "Duplicate instances removed by inst_list_dedup()");
 
 unsigned int cu_return_instances(const CMPIResult *results,
                                  const struct inst_list *list)
 {
         unsigned int i;
+        CU_UPCALL_SITE();
 
         if (list == NULL)
                 return 0;
@@ -44,6 +57,7 @@ bool cu_return_instance_name(const CMPIResult *results,
 {
         CMPIObjectPath *op;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         op = CMGetObjectPath(inst, &s);
         if ((s.rc != CMPI_RC_OK) || CMIsNullObject(op))
@@ -68,6 +82,364 @@ unsigned int cu_return_instance_names(const CMPIResult *results,
         return i;
 }
 
+unsigned long cu_return_chunk_instances(const CMPIResult *results,
+                                        const struct inst_chunk_list *list)
+{
+        struct inst_chunk_iter iter;
+        CMPIInstance *inst;
+        unsigned long count = 0;
+        CU_UPCALL_SITE();
+
+        if (list == NULL)
+                return 0;
+
+        inst_chunk_iter_init(&iter, list);
+        while ((inst = inst_chunk_iter_next(&iter)) != NULL) {
+                CMReturnInstance(results, inst);
+                count++;
+        }
+
+        return count;
+}
+
+unsigned long cu_return_chunk_names(const CMPIResult *results,
+                                   const struct inst_chunk_list *list)
+{
+        struct inst_chunk_iter iter;
+        CMPIInstance *inst;
+        unsigned long count = 0;
+
+        if (list == NULL)
+                return 0;
+
+        inst_chunk_iter_init(&iter, list);
+        while ((inst = inst_chunk_iter_next(&iter)) != NULL) {
+                cu_return_instance_name(results, inst);
+                count++;
+        }
+
+        return count;
+}
+
+/*
+ * Deduplication.  Each instance's object path is written out in a
+ * canonical form, namespace:class.key=value,... with the names in lower
+ * case and the keys sorted by name, and the forms are kept one after
+ * the other in a single buffer, hashed by their offsets.
+ */
+
+/* More keys than this and the path is not compared */
+#define DEDUP_MAX_KEYS 32
+
+struct canon {
+        char *buf;
+        size_t len;
+        size_t size;
+};
+
+struct dedup_slot {
+        uint32_t off;
+        uint32_t len;           /* 0 for an empty slot */
+        uint32_t hash;
+};
+
+static bool canon_add(struct canon *c, const char *str, size_t len)
+{
+        size_t size;
+        char *tmp;
+
+        if (c->len + len + 1 > c->size) {
+                size = (c->size == 0) ? 256 : c->size;
+                while (size < c->len + len + 1)
+                        size *= 2;
+
+                tmp = cu_tmp_realloc(CU_MEM_INST_LIST, c->buf,
+                                     c->size, size);
+                if (tmp == NULL)
+                        return false;
+
+                c->buf = tmp;
+                c->size = size;
+        }
+
+        memcpy(c->buf + c->len, str, len);
+        c->len += len;
+
+        return true;
+}
+
+static bool canon_str(struct canon *c, const char *str)
+{
+        return canon_add(c, str, strlen(str));
+}
+
+static bool canon_name(struct canon *c, const char *str)
+{
+        size_t start = c->len;
+        size_t i;
+
+        if (!canon_str(c, str))
+                return false;
+
+        for (i = start; i < c->len; i++)
+                c->buf[i] = tolower((unsigned char)c->buf[i]);
+
+        return true;
+}
+
+static bool canon_quoted(struct canon *c, const char *str)
+{
+        const char *p = str;
+        size_t n;
+
+        if (str == NULL)
+                return false;
+
+        if (!canon_add(c, "\"", 1))
+                return false;
+
+        /* Escape quotes and backslashes, copying the runs between them */
+        for (;;) {
+                n = strcspn(p, "\"\\");
+                if (!canon_add(c, p, n))
+                        return false;
+
+                p += n;
+                if (*p == '\0')
+                        break;
+
+                if (!canon_add(c, "\\", 1) || !canon_add(c, p, 1))
+                        return false;
+                p++;
+        }
+
+        return canon_add(c, "\"", 1);
+}
+
+static bool canon_path(struct canon *c, const CMPIObjectPath *op);
+
+static bool canon_data(struct canon *c, const CMPIData *data)
+{
+        char num[32];
+        CU_UPCALL_SITE();
+
+        if (data->state & CMPI_nullValue)
+                return canon_str(c, "NULL");
+
+        switch (data->type) {
+        case CMPI_string:
+                return canon_quoted(c, CMGetCharPtr(data->value.string));
+        case CMPI_chars:
+                return canon_quoted(c, data->value.chars);
+        case CMPI_dateTime:
+                return canon_quoted(c,
+                                    CMGetCharPtr(CMGetStringFormat(
+                                            data->value.dateTime, NULL)));
+        case CMPI_boolean:
+                return canon_str(c, data->value.boolean ? "TRUE" : "FALSE");
+        case CMPI_uint8:
+                snprintf(num, sizeof(num), "%u", data->value.uint8);
+                break;
+        case CMPI_uint16:
+        case CMPI_char16:
+                snprintf(num, sizeof(num), "%u", data->value.uint16);
+                break;
+        case CMPI_uint32:
+                snprintf(num, sizeof(num), "%u", data->value.uint32);
+                break;
+        case CMPI_uint64:
+                snprintf(num, sizeof(num), "%llu",
+                         (unsigned long long)data->value.uint64);
+                break;
+        case CMPI_sint8:
+                snprintf(num, sizeof(num), "%d", data->value.sint8);
+                break;
+        case CMPI_sint16:
+                snprintf(num, sizeof(num), "%d", data->value.sint16);
+                break;
+        case CMPI_sint32:
+                snprintf(num, sizeof(num), "%d", data->value.sint32);
+                break;
+        case CMPI_sint64:
+                snprintf(num, sizeof(num), "%lld",
+                         (long long)data->value.sint64);
+                break;
+        case CMPI_ref:
+                return canon_add(c, "{", 1) &&
+                        canon_path(c, data->value.ref) &&
+                        canon_add(c, "}", 1);
+        default:
+                CU_DEBUG("Unhandled key type %i", data->type);
+                return false;
+        }
+
+        return canon_str(c, num);
+}
+
+static bool canon_path(struct canon *c, const CMPIObjectPath *op)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+        CMPIString *names[DEDUP_MAX_KEYS];
+        CMPIData keys[DEDUP_MAX_KEYS];
+        unsigned int order[DEDUP_MAX_KEYS];
+        CMPIString *ns;
+        const char *str;
+        unsigned int count;
+        unsigned int i;
+        unsigned int j;
+        CU_UPCALL_SITE();
+
+        if (CMIsNullObject(op))
+                return false;
+
+        /*
+         * The namespace is part of the path: the same keys in two
+         * namespaces are two instances.  None counts as empty.
+         */
+        ns = CMGetNameSpace(op, NULL);
+        str = (ns != NULL) ? CMGetCharPtr(ns) : NULL;
+        if ((str != NULL) && !canon_name(c, str))
+                return false;
+
+        str = CMGetCharPtr(CMGetClassName(op, NULL));
+        if ((str == NULL) ||
+            !canon_add(c, ":", 1) ||
+            !canon_name(c, str) ||
+            !canon_add(c, ".", 1))
+                return false;
+
+        /* Without keys, paths say nothing about which instance it is */
+        count = CMGetKeyCount(op, &s);
+        if ((s.rc != CMPI_RC_OK) || (count == 0) || (count > DEDUP_MAX_KEYS))
+                return false;
+
+        /* Insertion sort, as there are only ever a few keys */
+        for (i = 0; i < count; i++) {
+                keys[i] = CMGetKeyAt(op, i, &names[i], &s);
+                if ((s.rc != CMPI_RC_OK) || (CMGetCharPtr(names[i]) == NULL))
+                        return false;
+
+                for (j = i; j > 0; j--) {
+                        if (strcasecmp(CMGetCharPtr(names[order[j - 1]]),
+                                       CMGetCharPtr(names[i])) <= 0)
+                                break;
+                        order[j] = order[j - 1];
+                }
+                order[j] = i;
+        }
+
+        for (i = 0; i < count; i++) {
+                if (((i > 0) && !canon_add(c, ",", 1)) ||
+                    !canon_name(c, CMGetCharPtr(names[order[i]])) ||
+                    !canon_add(c, "=", 1) ||
+                    !canon_data(c, &keys[order[i]]))
+                        return false;
+        }
+
+        return true;
+}
+
+/* FNV-1a */
+static uint32_t canon_hash(const char *str, size_t len)
+{
+        uint32_t hash = 2166136261u;
+        size_t i;
+
+        for (i = 0; i < len; i++) {
+                hash ^= (unsigned char)str[i];
+                hash *= 16777619u;
+        }
+
+        return hash;
+}
+
+/* Returns true if the form at off was already in the table */
+static bool dedup_insert(struct dedup_slot *table,
+                         unsigned int mask,
+                         const char *buf,
+                         size_t off,
+                         size_t len)
+{
+        uint32_t hash = canon_hash(buf + off, len);
+        unsigned int i;
+
+        for (i = hash & mask; table[i].len != 0; i = (i + 1) & mask) {
+                if ((table[i].hash == hash) &&
+                    (table[i].len == len) &&
+                    (memcmp(buf + table[i].off, buf + off, len) == 0))
+                        return true;
+        }
+
+        table[i].off = off;
+        table[i].len = len;
+        table[i].hash = hash;
+
+        return false;
+}
+
+int inst_list_dedup(struct inst_list *list)
+{
+        struct canon c = {NULL, 0, 0};
+        struct dedup_slot *table;
+        unsigned int size = 16;
+        unsigned int out = 0;
+        unsigned int i;
+        int removed;
+        CU_UPCALL_SITE();
+
+        if (list->cur < 2)
+                return 0;
+
+        if (list->cur > (UINT_MAX / 4))
+                return -1;
+
+        /* At most three quarters full */
+        while (size < (list->cur / 3) * 4 + 4)
+                size *= 2;
+
+        table = cu_tmp_alloc(CU_MEM_INST_LIST, size * sizeof(*table));
+        if (table == NULL)
+                return -1;
+
+        memset(table, 0, size * sizeof(*table));
+
+        for (i = 0; i < list->cur; i++) {
+                CMPIInstance *inst = list->list[i];
+                CMPIStatus s = {CMPI_RC_OK, NULL};
+                CMPIObjectPath *op;
+                size_t start = c.len;
+
+                /* Anything that cannot be written out is kept */
+                op = CMGetObjectPath(inst, &s);
+                if ((s.rc == CMPI_RC_OK) && canon_path(&c, op) &&
+                    (c.len <= UINT32_MAX)) {
+                        if (dedup_insert(table, size - 1, c.buf,
+                                         start, c.len - start)) {
+                                c.len = start;
+                                continue;
+                        }
+                } else {
+                        c.len = start;
+                }
+
+                list->list[out++] = inst;
+        }
+
+        removed = list->cur - out;
+        list->cur = out;
+        list->list[out] = NULL;
+
+        cu_tmp_free(CU_MEM_INST_LIST, table);
+        cu_tmp_free(CU_MEM_INST_LIST, c.buf);
+
+        if (removed > 0) {
+                cu_stat_add(&dedup_stat, removed);
+                CU_DEBUG("Removed %i duplicate instance(s)", removed);
+        }
+
+        return removed;
+}
+
 static bool _compare_data(const CMPIData *a, const CMPIData *b)
 {
         if (a->type != b->type)
@@ -92,6 +464,7 @@ static bool _compare_classname(const CMPIObjectPath *ref,
 {
         const char *ref_cn;
         const char *op_cn;
+        CU_UPCALL_SITE();
 
         ref_cn = CLASSNAME(ref);
         if (ref_cn == NULL)
@@ -112,6 +485,7 @@ const char *cu_compare_ref(const CMPIObjectPath *ref,
         const char *prop = NULL;
         int i;
         int count;
+        CU_UPCALL_SITE();
 
         op = CMGetObjectPath(inst, &s);
         if ((op == NULL) || (s.rc != CMPI_RC_OK))
@@ -180,6 +554,7 @@ CMPIStatus cu_copy_prop(const CMPIBroker *broker,
 {
         CMPIData data;
         CMPIStatus s = {CMPI_RC_OK, NULL};
+        CU_UPCALL_SITE();
 
         if (src_name == NULL) {
                 cu_statusf(broker, &s,
@@ -214,6 +589,7 @@ CMPIInstance *cu_dup_instance(const CMPIBroker *broker,
         CMPIData data;
         CMPIObjectPath *ref;
         CMPIInstance *dest = NULL;
+        CU_UPCALL_SITE();
 
         ref = CMGetObjectPath(src, NULL);
         if ((s->rc != CMPI_RC_OK) || CMIsNullObject(ref)) {
@@ -263,6 +639,7 @@ CMPIStatus cu_merge_instances(CMPIInstance *src,
         int prop_count;
         CMPIData data;
         CMPIStatus s = {CMPI_RC_OK, NULL};
+        CU_UPCALL_SITE();
 
         CU_DEBUG("Merging instances");
         prop_count = CMGetPropertyCount(src, &s);
@@ -299,6 +676,7 @@ const char *cu_classname_from_inst(CMPIInstance *inst)
         const char *ret = NULL;
 
         CMPIObjectPath *ref;
+        CU_UPCALL_SITE();
         ref = CMGetObjectPath(inst, NULL);
         if (CMIsNullObject(ref))
                 goto out;
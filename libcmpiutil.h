@@ -12,6 +12,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #include <cmpidt.h>
 
@@ -43,22 +44,117 @@
 #define _CU_STRINGIFY(x) #x
 #define CU_STRINGIFY(x) _CU_STRINGIFY(x)
 
+/**
+ * Log levels for CU_LOG().  CU_DEBUG() logs at CU_LOG_DEBUG.
+ */
+#define CU_LOG_ERROR   1
+#define CU_LOG_WARNING 2
+#define CU_LOG_INFO    3
+#define CU_LOG_DEBUG   4
+#define CU_LOG_TRACE   5
+
+/**
+ * The most verbose level compiled in.  CU_LOG() calls above it are
+ * dropped by the compiler, along with their arguments.  Define it
+ * before including this header to change it.
+ */
+#ifndef CU_LOG_LEVEL_MAX
+#define CU_LOG_LEVEL_MAX CU_LOG_TRACE
+#endif
+
+/**
+ * Log categories.  A source file picks its category by defining
+ * CU_LOG_CATEGORY before including this header; anything else,
+ * providers included, logs as CU_LOG_OTHER.
+ */
+enum cu_log_category {
+        CU_LOG_OTHER,
+        CU_LOG_ASSOC,
+        CU_LOG_INDICATION,
+        CU_LOG_METHOD,
+        CU_LOG_PARSER,
+        CU_LOG_INSTANCE,
+        CU_LOG_ARGS,
+        CU_LOG_CATEGORIES,
+};
+
+#ifndef CU_LOG_CATEGORY
+#define CU_LOG_CATEGORY CU_LOG_OTHER
+#endif
+
+/**
+ * The most verbose level logged for each category, or 0 if it is not
+ * logged at all.  Set from the CU_DEBUG and CU_DEBUG_LEVEL environment
+ * variables when the library is loaded, and by cu_log_set_levels().
+ */
+extern int cu_log_levels[CU_LOG_CATEGORIES];
+
 /**
  * Dispatch macro for debug_print, fills in the function name and line number
- * of caller.
+ * of caller.  Nothing is evaluated unless the level is being logged.
  */
-#define CU_DEBUG(fmt, args...) {                                        \
+#define CU_LOG(level, fmt, args...) do {                                \
+        if (((level) <= CU_LOG_LEVEL_MAX) &&                            \
+            __builtin_expect(cu_log_levels[CU_LOG_CATEGORY] >= (level), \
+                             0))                                        \
                 debug_print(__FILE__ "(" CU_STRINGIFY(__LINE__)"): "    \
-                            fmt "\n", ##args);}
+                            fmt "\n", ##args);                          \
+        } while (0)
+
+#define CU_DEBUG(fmt, args...) CU_LOG(CU_LOG_DEBUG, fmt, ##args)
 
 /**
  * Helper for DEBUG macro.  Checks environmental variable CU_DEBUG and:
- *     If unset, does nothing.
+ *     If unset, keeps the message in the flight recorder if
+ *     CU_FLIGHT_FILE is set (see cu_flight_dump()).
  *     If set to "stdout", acts as fprintf to stdout.
  *     If set to anything else, uses value as name of log file to fprintf to.
+ *
+ * CU_DEBUG_LEVEL sets the levels, as for cu_log_set_levels().  It
+ * defaults to debug for every category.
  */
 void debug_print(char *fmt, ...);
 
+/**
+ * Change the log levels while running.  Without CU_DEBUG, this sets
+ * what the flight recorder keeps.
+ *
+ * @param spec A comma-separated list of LEVEL, which applies to every
+ *             category, and CATEGORY=LEVEL items, applied in order.
+ *             Categories are other, assoc, indication, method, parser,
+ *             instance and args; levels are off, error, warning, info,
+ *             debug, trace or a number.  For example:
+ *             "error,indication=trace"
+ * @returns 0 on success, -1 if spec is invalid (nothing is changed)
+ */
+int cu_log_set_levels(const char *spec);
+
+/**
+ * Describe the current log levels
+ *
+ * @param buf Where to write them, in the form cu_log_set_levels() takes
+ * @param size The size of buf
+ * @returns The length of the description, as snprintf() does
+ */
+int cu_log_get_levels(char *buf, size_t size);
+
+/**
+ * Dump the flight recorder for the calling thread
+ *
+ * With CU_FLIGHT_FILE set and CU_DEBUG not, the messages that would
+ * have been logged at CU_FLIGHT_LEVEL (warning by default) are kept
+ * per thread, the last CU_FLIGHT_SIZE KiB (16 by default) of them.
+ * This appends those logged since the thread's last dump, and the
+ * reason, to CU_FLIGHT_FILE (%p in it being the process ID) for
+ * tools/cu_logdecode to read, until the file reaches
+ * CU_FLIGHT_MAX_SIZE KiB (1024 by default).  The standard MIs dump,
+ * at most once a second, when a handler returns CMPI_RC_ERR_FAILED.
+ * Does nothing otherwise.
+ *
+ * @param reason Why, which is written after the messages
+ */
+void cu_flight_dump(const char *reason);
+
 /**
  * Copies a property from one CMPIInstance to another.  If dest_name is NULL,
  * it is assumed to be the same as src_name.
@@ -219,6 +315,29 @@ bool cu_return_instance_name(const CMPIResult *results,
 unsigned int cu_return_instance_names(const CMPIResult *results,
                                       const struct inst_list *list);
 
+/* Forward declaration */
+struct inst_chunk_list;
+
+/**
+ * Return the instances of a chunked list
+ *
+ * @param results The result list to populate
+ * @param list A list of instances to return
+ * @returns The number of instances returned
+ */
+unsigned long cu_return_chunk_instances(const CMPIResult *results,
+                                        const struct inst_chunk_list *list);
+
+/**
+ * Return the object paths of the instances of a chunked list
+ *
+ * @param results The result list to populate
+ * @param list A list of instances whose names should be returned
+ * @returns The number of instance names returned
+ */
+unsigned long cu_return_chunk_names(const CMPIResult *results,
+                                   const struct inst_chunk_list *list);
+
 /**
  * Get an array property of an instance
  *
@@ -371,7 +490,9 @@ int cu_statusf(const CMPIBroker *broker,
                char *fmt, ...);
 
 /**
- * Growable instance list
+ * Growable instance list.  list[cur] is NULL whenever list is not
+ * NULL, so the instances can also be walked up to the NULL.  The array
+ * doubles in size when it fills up.
  */
 struct inst_list {
         CMPIInstance **list;
@@ -386,6 +507,21 @@ struct inst_list {
  */
 void inst_list_init(struct inst_list *list);
 
+/**
+ * Initialize an instance list whose array comes from the calling
+ * thread's request arena (see cu_arena.h), with room for count
+ * instances.  The list must not be used after the MI call returns;
+ * inst_list_free() on it gives nothing back until then.  Outside an
+ * arena, it is inst_list_init() and inst_list_reserve().  Other
+ * threads may use the list too: when one of them grows it, the array
+ * is copied out of the arena.  Such a list has max set to 0.
+ *
+ * @param list A pointer to the list structure to initialize
+ * @param count The number of instances about to be added
+ * @returns nonzero on success, zero on failure
+ */
+int inst_list_init_tmp(struct inst_list *list, unsigned int count);
+
 /**
  * Clean up an instance list
  * After calling this on a list, inst_list_init() must be called again
@@ -404,6 +540,148 @@ void inst_list_free(struct inst_list *list);
  */
 int inst_list_add(struct inst_list *list, CMPIInstance *inst);
 
+/**
+ * Make room in a list for more instances, so that adding them does
+ * not reallocate it
+ *
+ * @param list A pointer to the list
+ * @param count The number of instances about to be added
+ * @returns nonzero on success, zero on failure
+ */
+int inst_list_reserve(struct inst_list *list, unsigned int count);
+
+/**
+ * Add several instances to a list
+ *
+ * @param list A pointer to the list to add the instances to
+ * @param insts The instances
+ * @param count The number of instances in insts
+ * @returns nonzero on success, zero on failure (the list is then
+ *          unchanged)
+ */
+int inst_list_add_many(struct inst_list *list,
+                       CMPIInstance **insts,
+                       unsigned int count);
+
+/**
+ * Release the unused part of a list's array, or all of it if the list
+ * is empty
+ *
+ * @param list A pointer to the list
+ * @returns nonzero on success, zero on failure (the list is then
+ *          unchanged)
+ */
+int inst_list_shrink(struct inst_list *list);
+
+/**
+ * Take the array out of a list, leaving the list empty
+ *
+ * @param list A pointer to the list
+ * @param count Set to the number of instances, if not NULL
+ * @returns The NULL-terminated array of instances, which the caller
+ *          must free(), or NULL if the list never held any (or, for a
+ *          list from inst_list_init_tmp(), it could not be copied)
+ */
+CMPIInstance **inst_list_steal(struct inst_list *list, unsigned int *count);
+
+/**
+ * Remove instances whose object path is the same as that of an earlier
+ * one in the list, keeping the order of the rest.  Paths are compared
+ * by namespace, class and keys, ignoring the case of the names and the
+ * order of the keys, so the same keys in two namespaces are kept apart.
+ * An instance whose path cannot be read, has no keys, or has a key of
+ * a type that cannot be compared, is kept.
+ *
+ * @param list A pointer to the list
+ * @returns The number of instances removed, or -1 on failure (the
+ *          list is then left as it was)
+ */
+int inst_list_dedup(struct inst_list *list);
+
+/**
+ * Instance list made of blocks that are linked together rather than
+ * reallocated, so adding is O(1) and never copies.  For very large
+ * result sets; walk it with struct inst_chunk_iter.
+ */
+struct inst_chunk;
+
+struct inst_chunk_list {
+        struct inst_chunk *head;
+        struct inst_chunk *tail;
+        unsigned long count;
+};
+
+/**
+ * Define a pre-initialized inst_chunk_list
+ *
+ * @param x The variable name for the list.
+ */
+#define DECLARE_INST_CHUNK_LIST(x)                                      \
+        struct inst_chunk_list x = {NULL, NULL, 0};
+
+/**
+ * Initialize a chunked instance list
+ *
+ * @param list A pointer to the list structure to initialize
+ */
+void inst_chunk_list_init(struct inst_chunk_list *list);
+
+/**
+ * Clean up a chunked instance list, leaving it empty and ready for
+ * re-use
+ *
+ * @param list A pointer to the list structure to clean up
+ */
+void inst_chunk_list_free(struct inst_chunk_list *list);
+
+/**
+ * Add an instance to a chunked list
+ *
+ * @param list A pointer to the list to add the instance to
+ * @param inst A pointer to the instance to be added
+ * @returns nonzero on success, zero on failure
+ */
+int inst_chunk_list_add(struct inst_chunk_list *list, CMPIInstance *inst);
+
+/**
+ * A position in a chunked list.  Adding to the list while walking it
+ * is allowed; the new instances are walked too.
+ */
+struct inst_chunk_iter {
+        const struct inst_chunk_list *list;
+        const struct inst_chunk *chunk;
+        unsigned int pos;
+};
+
+/**
+ * Start walking a chunked list at its first instance
+ *
+ * @param iter The iterator to set up
+ * @param list The list
+ */
+void inst_chunk_iter_init(struct inst_chunk_iter *iter,
+                          const struct inst_chunk_list *list);
+
+/**
+ * Step to the next instance of a chunked list
+ *
+ * @param iter The iterator
+ * @returns The instance, or NULL at the end of the list
+ */
+CMPIInstance *inst_chunk_iter_next(struct inst_chunk_iter *iter);
+
+/**
+ * Append the instances of a chunked list to an inst_list with a single
+ * allocation, e.g. to hand them back from an association handler
+ *
+ * @param list A pointer to the list to add the instances to
+ * @param chunks The chunked list, which is left alone
+ * @returns nonzero on success, zero on failure (the list is then
+ *          unchanged)
+ */
+int inst_list_add_chunks(struct inst_list *list,
+                         const struct inst_chunk_list *chunks);
+
 /**
  * Define a pre-initialized inst_list
  *
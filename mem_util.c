@@ -0,0 +1,183 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <malloc.h>
+
+#include "cu_stats.h"
+#include "cu_mem.h"
+
+#define MEM_STATS(var, label)                                           \
+        static CU_STAT_LABELED(var##_bytes, CU_STAT_GAUGE,              \
+                               "cu_mem_bytes", "subsystem", label,      \
+                               "Bytes allocated by the library");       \
+        static CU_STAT_LABELED(var##_peak, CU_STAT_GAUGE,               \
+                               "cu_mem_peak_bytes", "subsystem", label, \
+                               "Most bytes allocated by the library "   \
+                               "at once");                              \
+        static CU_STAT_LABELED(var##_allocs, CU_STAT_COUNTER,           \
+                               "cu_mem_allocations_total",              \
+                               "subsystem", label,                      \
+                               "Allocations made by the library")
+
+MEM_STATS(inst_list, "inst_list");
+MEM_STATS(indication, "indication");
+MEM_STATS(status, "status");
+MEM_STATS(ei_xml, "ei_xml");
+MEM_STATS(ei_mof, "ei_mof");
+MEM_STATS(libxml2, "libxml2");
+MEM_STATS(arena, "arena");
+
+/* The stats hold the counts, so there is nothing else to keep in step */
+static const struct {
+        struct cu_stat *bytes;
+        struct cu_stat *peak;
+        struct cu_stat *allocs;
+} subsystems[CU_MEM_SUBSYSTEMS] = {
+        [CU_MEM_INST_LIST] = {&inst_list_bytes, &inst_list_peak,
+                              &inst_list_allocs},
+        [CU_MEM_INDICATION] = {&indication_bytes, &indication_peak,
+                               &indication_allocs},
+        [CU_MEM_STATUS] = {&status_bytes, &status_peak, &status_allocs},
+        [CU_MEM_EI_XML] = {&ei_xml_bytes, &ei_xml_peak, &ei_xml_allocs},
+        [CU_MEM_EI_MOF] = {&ei_mof_bytes, &ei_mof_peak, &ei_mof_allocs},
+        [CU_MEM_LIBXML2] = {&libxml2_bytes, &libxml2_peak,
+                            &libxml2_allocs},
+        [CU_MEM_ARENA] = {&arena_bytes, &arena_peak, &arena_allocs},
+};
+
+static void raise_peak(enum cu_mem_subsystem sub, int64_t bytes)
+{
+        struct cu_stat *peak = subsystems[sub].peak;
+        int64_t old;
+
+        old = __atomic_load_n(&peak->value, __ATOMIC_RELAXED);
+        while ((bytes > old) &&
+               !__atomic_compare_exchange_n(&peak->value, &old, bytes,
+                                            true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                ;
+}
+
+static void count(enum cu_mem_subsystem sub, int64_t delta, int allocs)
+{
+        int64_t bytes;
+
+        bytes = __atomic_add_fetch(&subsystems[sub].bytes->value, delta,
+                                   __ATOMIC_RELAXED);
+
+        if (allocs != 0)
+                cu_stat_add(subsystems[sub].allocs, allocs);
+
+        raise_peak(sub, bytes);
+}
+
+void *cu_mem_alloc(enum cu_mem_subsystem sub, size_t size)
+{
+        void *ptr;
+
+        ptr = malloc(size);
+        cu_mem_track(sub, ptr);
+
+        return ptr;
+}
+
+void *cu_mem_realloc(enum cu_mem_subsystem sub, void *ptr, size_t size)
+{
+        size_t old_size = 0;
+        void *new;
+
+        if (ptr != NULL)
+                old_size = malloc_usable_size(ptr);
+
+        new = realloc(ptr, size);
+        if (new == NULL)
+                return NULL;
+
+        count(sub, (int64_t)malloc_usable_size(new) - (int64_t)old_size, 1);
+
+        return new;
+}
+
+char *cu_mem_strdup(enum cu_mem_subsystem sub, const char *str)
+{
+        char *copy;
+
+        copy = strdup(str);
+        cu_mem_track(sub, copy);
+
+        return copy;
+}
+
+void cu_mem_track(enum cu_mem_subsystem sub, void *ptr)
+{
+        if (ptr != NULL)
+                count(sub, malloc_usable_size(ptr), 1);
+}
+
+void cu_mem_free(enum cu_mem_subsystem sub, void *ptr)
+{
+        if (ptr == NULL)
+                return;
+
+        count(sub, -(int64_t)malloc_usable_size(ptr), 0);
+        free(ptr);
+}
+
+void cu_mem_count(enum cu_mem_subsystem sub,
+                  int64_t bytes,
+                  int64_t peak,
+                  uint64_t allocs)
+{
+        raise_peak(sub, cu_stat_get(subsystems[sub].bytes) + peak);
+
+        cu_stat_add(subsystems[sub].bytes, bytes);
+        cu_stat_add(subsystems[sub].allocs, allocs);
+}
+
+void cu_mem_get(enum cu_mem_subsystem sub, struct cu_mem_usage *usage)
+{
+        usage->bytes = cu_stat_get(subsystems[sub].bytes);
+        usage->peak_bytes = cu_stat_get(subsystems[sub].peak);
+        usage->allocs = cu_stat_get(subsystems[sub].allocs);
+}
+
+const char *cu_mem_name(enum cu_mem_subsystem sub)
+{
+        return subsystems[sub].bytes->label_value;
+}
+
+void cu_mem_reset_peak(void)
+{
+        int i;
+
+        for (i = 0; i < CU_MEM_SUBSYSTEMS; i++)
+                cu_stat_set(subsystems[i].peak,
+                            cu_stat_get(subsystems[i].bytes));
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
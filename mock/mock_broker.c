@@ -0,0 +1,2109 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+#include "mock_broker.h"
+
+#define MAX_CLASS_DEPTH 64
+
+struct mock_obj {
+        struct mock_obj *next;
+        void (*destroy)(void *obj);
+};
+
+struct mock_prop {
+        char *name;
+        CMPIData data;
+};
+
+struct mock_props {
+        struct mock_prop *list;
+        CMPICount cur;
+        CMPICount max;
+};
+
+struct mock_class {
+        char *name;
+        char *parent;
+        char **keys;
+};
+
+struct mock_broker {
+        CMPIBroker broker;
+        struct mock_class *classes;
+        unsigned int class_count;
+        mock_invoke_fn invoke_fn;
+        void *invoke_data;
+        mock_deliver_fn deliver_fn;
+        void *deliver_data;
+        mock_is_a_fn is_a_fn;
+        void *is_a_data;
+        int counting;
+        struct mock_broker_stats stats;
+};
+
+struct mock_path {
+        CMPIObjectPath enc;
+        char *ns;
+        char *cn;
+        char *host;
+        struct mock_props keys;
+};
+
+struct mock_instance {
+        CMPIInstance enc;
+        const struct mock_broker *mb;
+        struct mock_path *path;
+        struct mock_props props;
+};
+
+struct mock_args {
+        CMPIArgs enc;
+        struct mock_props props;
+};
+
+struct mock_array {
+        CMPIArray enc;
+        CMPIType type;
+        CMPICount size;
+        CMPIData *elems;
+};
+
+struct mock_result {
+        CMPIResult enc;
+        struct mock_result_stats stats;
+};
+
+struct mock_context {
+        CMPIContext enc;
+        struct mock_props entries;
+};
+
+static __thread struct mock_obj *thread_objs = NULL;
+static __thread unsigned long thread_alloc_count = 0;
+static __thread unsigned long thread_alloc_bytes = 0;
+
+#define COUNT(mb, field)                                        \
+        do {                                                    \
+                if ((mb)->counting)                             \
+                        __sync_fetch_and_add(&(mb)->stats.field, 1); \
+        } while (0)
+
+static CMPIStatus ok_status = {CMPI_RC_OK, NULL};
+
+/*
+ * Allocations made on behalf of the broker are counted separately, so
+ * that a harness can tell them apart from the library's own.
+ */
+static void *mock_calloc(size_t nmemb, size_t size)
+{
+        thread_alloc_count++;
+        thread_alloc_bytes += nmemb * size;
+
+        return calloc(nmemb, size);
+}
+
+static void *mock_realloc(void *ptr, size_t size)
+{
+        thread_alloc_count++;
+        thread_alloc_bytes += size;
+
+        return realloc(ptr, size);
+}
+
+static char *mock_strdup(const char *str)
+{
+        thread_alloc_count++;
+        thread_alloc_bytes += strlen(str) + 1;
+
+        return strdup(str);
+}
+
+static char *mock_strndup(const char *str, size_t len)
+{
+        thread_alloc_count++;
+        thread_alloc_bytes += len + 1;
+
+        return strndup(str, len);
+}
+
+static void *mock_alloc(size_t size, void (*destroy)(void *obj))
+{
+        struct mock_obj *hdr;
+
+        hdr = mock_calloc(1, sizeof(*hdr) + size);
+        if (hdr == NULL)
+                return NULL;
+
+        hdr->destroy = destroy;
+        hdr->next = thread_objs;
+        thread_objs = hdr;
+
+        return hdr + 1;
+}
+
+const void *mock_objects_mark(void)
+{
+        return thread_objs;
+}
+
+unsigned long mock_release_objects_since(const void *mark)
+{
+        struct mock_obj *hdr;
+        unsigned long count = 0;
+
+        while ((thread_objs != NULL) && (thread_objs != mark)) {
+                hdr = thread_objs;
+                thread_objs = hdr->next;
+
+                if (hdr->destroy != NULL)
+                        hdr->destroy(hdr + 1);
+
+                free(hdr);
+                count++;
+        }
+
+        return count;
+}
+
+unsigned long mock_release_objects(void)
+{
+        return mock_release_objects_since(NULL);
+}
+
+void mock_get_alloc_stats(unsigned long *count, unsigned long *bytes)
+{
+        *count = thread_alloc_count;
+        *bytes = thread_alloc_bytes;
+}
+
+static CMPIStatus noop_release(void *obj)
+{
+        /* Freed in bulk by mock_release_objects() */
+        return ok_status;
+}
+
+/*
+ * CMPIString
+ */
+
+static CMPIStringFT string_ft;
+
+static void string_destroy(void *obj)
+{
+        CMPIString *str = obj;
+
+        free(str->hdl);
+}
+
+static CMPIString *new_string(const char *chars)
+{
+        CMPIString *str;
+
+        str = mock_alloc(sizeof(*str), string_destroy);
+        if (str == NULL)
+                return NULL;
+
+        str->ft = &string_ft;
+        if (chars != NULL)
+                str->hdl = mock_strdup(chars);
+
+        return str;
+}
+
+static CMPIStatus string_release(CMPIString *str)
+{
+        return noop_release(str);
+}
+
+static CMPIString *string_clone(const CMPIString *str, CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return new_string(str->hdl);
+}
+
+static char *string_get_char_ptr(const CMPIString *str, CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return str->hdl;
+}
+
+static CMPIStringFT string_ft = {
+        .ftVersion = CMPICurrentVersion,
+        .release = string_release,
+        .clone = string_clone,
+        .getCharPtr = string_get_char_ptr,
+};
+
+/*
+ * Property lists, shared by instances, object path keys, args and
+ * contexts.  Names are matched case-insensitively, as in CIM.
+ */
+
+static void copy_value(CMPIValue *dest, const CMPIValue *src, CMPIType type)
+{
+        /* Only read as much of the union as the caller provided */
+        switch (type) {
+        case CMPI_boolean:
+                dest->boolean = src->boolean;
+                break;
+        case CMPI_char16:
+                dest->char16 = src->char16;
+                break;
+        case CMPI_uint8:
+                dest->uint8 = src->uint8;
+                break;
+        case CMPI_sint8:
+                dest->sint8 = src->sint8;
+                break;
+        case CMPI_uint16:
+                dest->uint16 = src->uint16;
+                break;
+        case CMPI_sint16:
+                dest->sint16 = src->sint16;
+                break;
+        case CMPI_uint32:
+                dest->uint32 = src->uint32;
+                break;
+        case CMPI_sint32:
+                dest->sint32 = src->sint32;
+                break;
+        case CMPI_real32:
+                dest->real32 = src->real32;
+                break;
+        case CMPI_uint64:
+                dest->uint64 = src->uint64;
+                break;
+        case CMPI_sint64:
+                dest->sint64 = src->sint64;
+                break;
+        case CMPI_real64:
+                dest->real64 = src->real64;
+                break;
+        default:
+                /* Arrays and encapsulated types are all pointers */
+                dest->inst = src->inst;
+                break;
+        }
+}
+
+static CMPIData make_data(const CMPIValue *value, CMPIType type)
+{
+        CMPIData data;
+
+        memset(&data, 0, sizeof(data));
+        data.type = type;
+
+        if (value == NULL) {
+                data.state = CMPI_nullValue;
+                return data;
+        }
+
+        /* CMPI_chars values are passed as the string itself */
+        if (type == CMPI_chars) {
+                data.type = CMPI_string;
+                data.value.string = new_string((const char *)value);
+        } else if (type == CMPI_string) {
+                if (CMIsNullObject(value->string))
+                        data.state = CMPI_nullValue;
+                else
+                        data.value.string = new_string(value->string->hdl);
+        } else {
+                copy_value(&data.value, value, type);
+        }
+
+        return data;
+}
+
+static void props_free(struct mock_props *props)
+{
+        CMPICount i;
+
+        for (i = 0; i < props->cur; i++)
+                free(props->list[i].name);
+
+        free(props->list);
+        props->list = NULL;
+        props->cur = props->max = 0;
+}
+
+static struct mock_prop *props_find(const struct mock_props *props,
+                                    const char *name)
+{
+        CMPICount i;
+
+        if (name == NULL)
+                return NULL;
+
+        for (i = 0; i < props->cur; i++) {
+                if (STREQC(props->list[i].name, name))
+                        return &props->list[i];
+        }
+
+        return NULL;
+}
+
+static CMPIStatus props_set(struct mock_props *props,
+                            const char *name,
+                            CMPIData data)
+{
+        struct mock_prop *prop;
+
+        if (name == NULL)
+                return (CMPIStatus){CMPI_RC_ERR_INVALID_PARAMETER, NULL};
+
+        prop = props_find(props, name);
+        if (prop != NULL) {
+                prop->data = data;
+                return ok_status;
+        }
+
+        if (props->cur == props->max) {
+                struct mock_prop *tmp;
+                CMPICount newmax = props->max ? props->max * 2 : 8;
+
+                tmp = mock_realloc(props->list, newmax * sizeof(*tmp));
+                if (tmp == NULL)
+                        return (CMPIStatus){CMPI_RC_ERROR_SYSTEM, NULL};
+
+                props->list = tmp;
+                props->max = newmax;
+        }
+
+        prop = &props->list[props->cur];
+        prop->name = mock_strdup(name);
+        if (prop->name == NULL)
+                return (CMPIStatus){CMPI_RC_ERROR_SYSTEM, NULL};
+
+        prop->data = data;
+        props->cur++;
+
+        return ok_status;
+}
+
+static CMPIStatus props_copy(struct mock_props *dest,
+                             const struct mock_props *src)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+        CMPICount i;
+
+        for (i = 0; i < src->cur; i++) {
+                s = props_set(dest, src->list[i].name, src->list[i].data);
+                if (s.rc != CMPI_RC_OK)
+                        break;
+        }
+
+        return s;
+}
+
+static CMPIData props_get(const struct mock_props *props,
+                          const char *name,
+                          CMPIStatus *rc)
+{
+        struct mock_prop *prop;
+        CMPIData data;
+
+        prop = props_find(props, name);
+        if (prop == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERR_NO_SUCH_PROPERTY);
+                memset(&data, 0, sizeof(data));
+                data.state = CMPI_nullValue;
+                return data;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return prop->data;
+}
+
+static CMPIData props_get_at(const struct mock_props *props,
+                             CMPICount index,
+                             CMPIString **name,
+                             CMPIStatus *rc)
+{
+        struct mock_prop *prop;
+        CMPIData data;
+
+        if (index >= props->cur) {
+                CMSetStatus(rc, CMPI_RC_ERR_NO_SUCH_PROPERTY);
+                memset(&data, 0, sizeof(data));
+                data.state = CMPI_nullValue;
+                return data;
+        }
+
+        prop = &props->list[index];
+        if (name != NULL)
+                *name = new_string(prop->name);
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return prop->data;
+}
+
+/*
+ * Class table
+ */
+
+static struct mock_class *find_class(const struct mock_broker *mb,
+                                     const char *cn)
+{
+        unsigned int i;
+
+        if (cn == NULL)
+                return NULL;
+
+        for (i = 0; i < mb->class_count; i++) {
+                if (STREQC(mb->classes[i].name, cn))
+                        return &mb->classes[i];
+        }
+
+        return NULL;
+}
+
+static char **class_keys(const struct mock_broker *mb, const char *cn)
+{
+        struct mock_class *cls;
+        int depth;
+
+        for (depth = 0; depth < MAX_CLASS_DEPTH; depth++) {
+                cls = find_class(mb, cn);
+                if (cls == NULL)
+                        return NULL;
+
+                if (cls->keys != NULL)
+                        return cls->keys;
+
+                cn = cls->parent;
+        }
+
+        return NULL;
+}
+
+static void free_keys(char **keys)
+{
+        int i;
+
+        if (keys == NULL)
+                return;
+
+        for (i = 0; keys[i]; i++)
+                free(keys[i]);
+
+        free(keys);
+}
+
+static char **copy_keys(const char **keys)
+{
+        char **copy;
+        int count;
+        int i;
+
+        if (keys == NULL)
+                return NULL;
+
+        for (count = 0; keys[count]; count++)
+                ;
+
+        copy = calloc(count + 1, sizeof(char *));
+        if (copy == NULL)
+                return NULL;
+
+        for (i = 0; i < count; i++) {
+                copy[i] = strdup(keys[i]);
+                if (copy[i] == NULL) {
+                        free_keys(copy);
+                        return NULL;
+                }
+        }
+
+        return copy;
+}
+
+int mock_broker_add_class(CMPIBroker *broker,
+                          const char *cn,
+                          const char *parent,
+                          const char **keys)
+{
+        struct mock_broker *mb = broker->hdl;
+        struct mock_class *cls;
+
+        cls = find_class(mb, cn);
+        if (cls == NULL) {
+                struct mock_class *tmp;
+
+                tmp = realloc(mb->classes,
+                              (mb->class_count + 1) * sizeof(*tmp));
+                if (tmp == NULL)
+                        return 0;
+
+                mb->classes = tmp;
+                cls = &mb->classes[mb->class_count];
+                memset(cls, 0, sizeof(*cls));
+
+                cls->name = strdup(cn);
+                if (cls->name == NULL)
+                        return 0;
+
+                mb->class_count++;
+        }
+
+        free(cls->parent);
+        cls->parent = NULL;
+        if (parent != NULL) {
+                cls->parent = strdup(parent);
+                if (cls->parent == NULL)
+                        return 0;
+        }
+
+        free_keys(cls->keys);
+        cls->keys = NULL;
+        if (keys != NULL) {
+                cls->keys = copy_keys(keys);
+                if (cls->keys == NULL)
+                        return 0;
+        }
+
+        return 1;
+}
+
+static int load_class_line(CMPIBroker *broker, char *line)
+{
+        char *save = NULL;
+        char *name;
+        char *parent;
+        char *keystr;
+        const char *keys[32];
+        int count = 0;
+        int ret;
+
+        name = strtok_r(line, " \t\r\n", &save);
+        if ((name == NULL) || (*name == '#'))
+                return 0;
+
+        parent = strtok_r(NULL, " \t\r\n", &save);
+        if ((parent != NULL) && STREQ(parent, "-"))
+                parent = NULL;
+
+        keystr = strtok_r(NULL, " \t\r\n", &save);
+        if (keystr != NULL) {
+                char *ksave = NULL;
+                char *key;
+
+                for (key = strtok_r(keystr, ",", &ksave);
+                     key && (count < 31);
+                     key = strtok_r(NULL, ",", &ksave))
+                        keys[count++] = key;
+        }
+        keys[count] = NULL;
+
+        ret = mock_broker_add_class(broker,
+                                    name,
+                                    parent,
+                                    count ? keys : NULL);
+
+        return ret ? 1 : -1;
+}
+
+int mock_broker_load_classes(CMPIBroker *broker, const char *path)
+{
+        FILE *fp;
+        char *line = NULL;
+        size_t len = 0;
+        int count = 0;
+        int ret;
+
+        fp = fopen(path, "r");
+        if (fp == NULL)
+                return -1;
+
+        while (getline(&line, &len, fp) != -1) {
+                ret = load_class_line(broker, line);
+                if (ret < 0) {
+                        count = -1;
+                        break;
+                }
+
+                count += ret;
+        }
+
+        free(line);
+        fclose(fp);
+
+        return count;
+}
+
+/*
+ * CMPIObjectPath
+ */
+
+static CMPIObjectPathFT path_ft;
+
+static void path_destroy(void *obj)
+{
+        struct mock_path *path = obj;
+
+        free(path->ns);
+        free(path->cn);
+        free(path->host);
+        props_free(&path->keys);
+}
+
+static struct mock_path *new_path(const char *ns, const char *cn)
+{
+        struct mock_path *path;
+
+        path = mock_alloc(sizeof(*path), path_destroy);
+        if (path == NULL)
+                return NULL;
+
+        path->enc.hdl = path;
+        path->enc.ft = &path_ft;
+
+        if (ns != NULL)
+                path->ns = mock_strdup(ns);
+        if (cn != NULL)
+                path->cn = mock_strdup(cn);
+
+        return path;
+}
+
+static struct mock_path *clone_path(const struct mock_path *src)
+{
+        struct mock_path *path;
+
+        path = new_path(src->ns, src->cn);
+        if (path == NULL)
+                return NULL;
+
+        if (src->host != NULL)
+                path->host = mock_strdup(src->host);
+
+        if (props_copy(&path->keys, &src->keys).rc != CMPI_RC_OK)
+                return NULL;
+
+        return path;
+}
+
+static CMPIStatus set_chars(char **field, const char *value)
+{
+        char *tmp = NULL;
+
+        if (value != NULL) {
+                tmp = mock_strdup(value);
+                if (tmp == NULL)
+                        return (CMPIStatus){CMPI_RC_ERROR_SYSTEM, NULL};
+        }
+
+        free(*field);
+        *field = tmp;
+
+        return ok_status;
+}
+
+static CMPIStatus path_release(CMPIObjectPath *op)
+{
+        return noop_release(op);
+}
+
+static CMPIObjectPath *path_clone(const CMPIObjectPath *op, CMPIStatus *rc)
+{
+        struct mock_path *path;
+
+        path = clone_path(op->hdl);
+        if (path == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &path->enc;
+}
+
+static CMPIStatus path_set_namespace(CMPIObjectPath *op, const char *ns)
+{
+        struct mock_path *path = op->hdl;
+
+        return set_chars(&path->ns, ns);
+}
+
+static CMPIString *path_get_namespace(const CMPIObjectPath *op,
+                                      CMPIStatus *rc)
+{
+        struct mock_path *path = op->hdl;
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return new_string(path->ns);
+}
+
+static CMPIStatus path_set_hostname(CMPIObjectPath *op, const char *hn)
+{
+        struct mock_path *path = op->hdl;
+
+        return set_chars(&path->host, hn);
+}
+
+static CMPIString *path_get_hostname(const CMPIObjectPath *op,
+                                     CMPIStatus *rc)
+{
+        struct mock_path *path = op->hdl;
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return new_string(path->host);
+}
+
+static CMPIStatus path_set_classname(CMPIObjectPath *op, const char *cn)
+{
+        struct mock_path *path = op->hdl;
+
+        return set_chars(&path->cn, cn);
+}
+
+static CMPIString *path_get_classname(const CMPIObjectPath *op,
+                                      CMPIStatus *rc)
+{
+        struct mock_path *path = op->hdl;
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return new_string(path->cn);
+}
+
+static CMPIStatus path_add_key(CMPIObjectPath *op,
+                               const char *name,
+                               const CMPIValue *value,
+                               const CMPIType type)
+{
+        struct mock_path *path = op->hdl;
+        CMPIData data;
+
+        data = make_data(value, type);
+        if (data.state != CMPI_nullValue)
+                data.state = CMPI_keyValue;
+
+        return props_set(&path->keys, name, data);
+}
+
+static CMPIData path_get_key(const CMPIObjectPath *op,
+                             const char *name,
+                             CMPIStatus *rc)
+{
+        struct mock_path *path = op->hdl;
+
+        return props_get(&path->keys, name, rc);
+}
+
+static CMPIData path_get_key_at(const CMPIObjectPath *op,
+                                CMPICount index,
+                                CMPIString **name,
+                                CMPIStatus *rc)
+{
+        struct mock_path *path = op->hdl;
+
+        return props_get_at(&path->keys, index, name, rc);
+}
+
+static CMPICount path_get_key_count(const CMPIObjectPath *op,
+                                    CMPIStatus *rc)
+{
+        struct mock_path *path = op->hdl;
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return path->keys.cur;
+}
+
+static CMPIStatus path_set_ns_from_path(CMPIObjectPath *op,
+                                        const CMPIObjectPath *src)
+{
+        struct mock_path *path = op->hdl;
+        struct mock_path *spath = src->hdl;
+
+        return set_chars(&path->ns, spath->ns);
+}
+
+static CMPIStatus path_set_host_ns_from_path(CMPIObjectPath *op,
+                                             const CMPIObjectPath *src)
+{
+        struct mock_path *path = op->hdl;
+        struct mock_path *spath = src->hdl;
+        CMPIStatus s;
+
+        s = set_chars(&path->host, spath->host);
+        if (s.rc != CMPI_RC_OK)
+                return s;
+
+        return set_chars(&path->ns, spath->ns);
+}
+
+static CMPIData path_get_qualifier(const CMPIObjectPath *op,
+                                   const char *qname,
+                                   CMPIStatus *rc)
+{
+        CMPIData data;
+
+        memset(&data, 0, sizeof(data));
+        data.state = CMPI_nullValue;
+        CMSetStatus(rc, CMPI_RC_ERR_NOT_SUPPORTED);
+
+        return data;
+}
+
+static void print_value(FILE *fp, const CMPIData *data)
+{
+        if (data->state == CMPI_nullValue) {
+                fprintf(fp, "NULL");
+                return;
+        }
+
+        switch (data->type) {
+        case CMPI_string:
+                fprintf(fp, "\"%s\"",
+                        data->value.string->hdl ?
+                        (char *)data->value.string->hdl : "");
+                break;
+        case CMPI_boolean:
+                fprintf(fp, "%s", data->value.boolean ? "true" : "false");
+                break;
+        case CMPI_uint8:
+                fprintf(fp, "%u", data->value.uint8);
+                break;
+        case CMPI_uint16:
+                fprintf(fp, "%u", data->value.uint16);
+                break;
+        case CMPI_uint32:
+                fprintf(fp, "%u", data->value.uint32);
+                break;
+        case CMPI_uint64:
+                fprintf(fp, "%llu", (unsigned long long)data->value.uint64);
+                break;
+        case CMPI_sint8:
+                fprintf(fp, "%d", data->value.sint8);
+                break;
+        case CMPI_sint16:
+                fprintf(fp, "%d", data->value.sint16);
+                break;
+        case CMPI_sint32:
+                fprintf(fp, "%d", data->value.sint32);
+                break;
+        case CMPI_sint64:
+                fprintf(fp, "%lld", (long long)data->value.sint64);
+                break;
+        default:
+                fprintf(fp, "<type 0x%x>", data->type);
+                break;
+        }
+}
+
+static CMPIString *path_to_string(const CMPIObjectPath *op, CMPIStatus *rc)
+{
+        struct mock_path *path = op->hdl;
+        CMPIString *str;
+        char *buf = NULL;
+        size_t len = 0;
+        FILE *fp;
+        CMPICount i;
+
+        fp = open_memstream(&buf, &len);
+        if (fp == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        if (path->ns != NULL)
+                fprintf(fp, "%s:", path->ns);
+
+        fprintf(fp, "%s", path->cn ? path->cn : "");
+
+        for (i = 0; i < path->keys.cur; i++) {
+                fprintf(fp, "%c%s=", i ? ',' : '.', path->keys.list[i].name);
+                print_value(fp, &path->keys.list[i].data);
+        }
+
+        fclose(fp);
+
+        str = new_string(buf);
+        free(buf);
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return str;
+}
+
+static CMPIObjectPathFT path_ft = {
+        .ftVersion = CMPICurrentVersion,
+        .release = path_release,
+        .clone = path_clone,
+        .setNameSpace = path_set_namespace,
+        .getNameSpace = path_get_namespace,
+        .setHostname = path_set_hostname,
+        .getHostname = path_get_hostname,
+        .setClassName = path_set_classname,
+        .getClassName = path_get_classname,
+        .addKey = path_add_key,
+        .getKey = path_get_key,
+        .getKeyAt = path_get_key_at,
+        .getKeyCount = path_get_key_count,
+        .setNameSpaceFromObjectPath = path_set_ns_from_path,
+        .setHostAndNameSpaceFromObjectPath = path_set_host_ns_from_path,
+        .getClassQualifier = path_get_qualifier,
+        .toString = path_to_string,
+};
+
+static const char *parse_key_value(const char *ptr,
+                                   CMPIValue *value,
+                                   CMPIType *type)
+{
+        const char *end;
+
+        if (*ptr == '"') {
+                end = strchr(ptr + 1, '"');
+                if (end == NULL)
+                        return NULL;
+
+                value->chars = mock_strndup(ptr + 1, end - ptr - 1);
+                *type = CMPI_chars;
+
+                return end + 1;
+        }
+
+        for (end = ptr; *end && (*end != ','); end++)
+                ;
+
+        if (STARTS_WITH(ptr, "true") && ((end - ptr) == 4)) {
+                value->boolean = 1;
+                *type = CMPI_boolean;
+        } else if (STARTS_WITH(ptr, "false") && ((end - ptr) == 5)) {
+                value->boolean = 0;
+                *type = CMPI_boolean;
+        } else if (*ptr == '-') {
+                value->sint64 = strtoll(ptr, NULL, 10);
+                *type = CMPI_sint64;
+        } else if (isdigit(*ptr)) {
+                value->uint64 = strtoull(ptr, NULL, 10);
+                *type = CMPI_uint64;
+        } else {
+                return NULL;
+        }
+
+        return end;
+}
+
+CMPIObjectPath *mock_path_parse(const CMPIBroker *broker, const char *str)
+{
+        struct mock_path *path;
+        const char *colon;
+        const char *dot;
+        const char *ptr;
+        char *ns = NULL;
+        char *cn = NULL;
+
+        dot = strchr(str, '.');
+        colon = strchr(str, ':');
+        if ((colon != NULL) && (dot != NULL) && (colon > dot))
+                colon = NULL;
+
+        if (colon != NULL) {
+                ns = mock_strndup(str, colon - str);
+                str = colon + 1;
+        }
+
+        if (dot != NULL)
+                cn = mock_strndup(str, dot - str);
+        else
+                cn = mock_strdup(str);
+
+        path = new_path(ns, cn);
+        free(ns);
+        free(cn);
+
+        if ((path == NULL) || (dot == NULL))
+                goto out;
+
+        ptr = dot + 1;
+        while (*ptr) {
+                const char *eq;
+                char *name;
+                CMPIValue value;
+                CMPIType type;
+
+                eq = strchr(ptr, '=');
+                if (eq == NULL)
+                        return NULL;
+
+                name = mock_strndup(ptr, eq - ptr);
+                ptr = parse_key_value(eq + 1, &value, &type);
+                if (ptr == NULL) {
+                        free(name);
+                        return NULL;
+                }
+
+                if (type == CMPI_chars) {
+                        path_add_key(&path->enc, name,
+                                     (CMPIValue *)value.chars, type);
+                        free(value.chars);
+                } else {
+                        path_add_key(&path->enc, name, &value, type);
+                }
+                free(name);
+
+                if (*ptr == ',')
+                        ptr++;
+                else if (*ptr != '\0')
+                        return NULL;
+        }
+
+ out:
+        return path ? &path->enc : NULL;
+}
+
+/*
+ * CMPIInstance
+ */
+
+static CMPIInstanceFT instance_ft;
+
+static void instance_destroy(void *obj)
+{
+        struct mock_instance *inst = obj;
+
+        props_free(&inst->props);
+}
+
+static struct mock_instance *new_instance(const struct mock_broker *mb,
+                                          const struct mock_path *path)
+{
+        struct mock_instance *inst;
+
+        inst = mock_alloc(sizeof(*inst), instance_destroy);
+        if (inst == NULL)
+                return NULL;
+
+        inst->enc.hdl = inst;
+        inst->enc.ft = &instance_ft;
+        inst->mb = mb;
+
+        inst->path = clone_path(path);
+        if (inst->path == NULL)
+                return NULL;
+
+        return inst;
+}
+
+static CMPIStatus instance_release(CMPIInstance *ci)
+{
+        return noop_release(ci);
+}
+
+static CMPIInstance *instance_clone(const CMPIInstance *ci, CMPIStatus *rc)
+{
+        struct mock_instance *src = ci->hdl;
+        struct mock_instance *inst;
+
+        inst = new_instance(src->mb, src->path);
+        if ((inst == NULL) ||
+            (props_copy(&inst->props, &src->props).rc != CMPI_RC_OK)) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &inst->enc;
+}
+
+static CMPIData instance_get_property(const CMPIInstance *ci,
+                                      const char *name,
+                                      CMPIStatus *rc)
+{
+        struct mock_instance *inst = ci->hdl;
+
+        return props_get(&inst->props, name, rc);
+}
+
+static CMPIData instance_get_property_at(const CMPIInstance *ci,
+                                         CMPICount index,
+                                         CMPIString **name,
+                                         CMPIStatus *rc)
+{
+        struct mock_instance *inst = ci->hdl;
+
+        return props_get_at(&inst->props, index, name, rc);
+}
+
+static CMPICount instance_get_property_count(const CMPIInstance *ci,
+                                             CMPIStatus *rc)
+{
+        struct mock_instance *inst = ci->hdl;
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return inst->props.cur;
+}
+
+static CMPIStatus instance_set_property(const CMPIInstance *ci,
+                                        const char *name,
+                                        const CMPIValue *value,
+                                        CMPIType type)
+{
+        struct mock_instance *inst = ci->hdl;
+
+        return props_set(&inst->props, name, make_data(value, type));
+}
+
+static CMPIObjectPath *instance_get_object_path(const CMPIInstance *ci,
+                                                CMPIStatus *rc)
+{
+        struct mock_instance *inst = ci->hdl;
+        struct mock_path *path;
+        char **keys;
+        int i;
+
+        path = clone_path(inst->path);
+        if (path == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        keys = class_keys(inst->mb, inst->path->cn);
+        for (i = 0; keys && keys[i]; i++) {
+                struct mock_prop *prop;
+                CMPIData data;
+
+                prop = props_find(&inst->props, keys[i]);
+                if ((prop == NULL) || (prop->data.state == CMPI_nullValue))
+                        continue;
+
+                data = prop->data;
+                data.state = CMPI_keyValue;
+                props_set(&path->keys, keys[i], data);
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &path->enc;
+}
+
+static CMPIStatus instance_set_property_filter(CMPIInstance *ci,
+                                               const char **props,
+                                               const char **keys)
+{
+        return ok_status;
+}
+
+static CMPIStatus instance_set_object_path(CMPIInstance *ci,
+                                           const CMPIObjectPath *op)
+{
+        struct mock_instance *inst = ci->hdl;
+        struct mock_path *path;
+
+        path = clone_path(op->hdl);
+        if (path == NULL)
+                return (CMPIStatus){CMPI_RC_ERROR_SYSTEM, NULL};
+
+        inst->path = path;
+
+        return ok_status;
+}
+
+static CMPIStatus instance_set_property_with_origin(const CMPIInstance *ci,
+                                                    const char *name,
+                                                    const CMPIValue *value,
+                                                    CMPIType type,
+                                                    const char *origin)
+{
+        return instance_set_property(ci, name, value, type);
+}
+
+static CMPIInstanceFT instance_ft = {
+        .ftVersion = CMPICurrentVersion,
+        .release = instance_release,
+        .clone = instance_clone,
+        .getProperty = instance_get_property,
+        .getPropertyAt = instance_get_property_at,
+        .getPropertyCount = instance_get_property_count,
+        .setProperty = instance_set_property,
+        .getObjectPath = instance_get_object_path,
+        .setPropertyFilter = instance_set_property_filter,
+        .setObjectPath = instance_set_object_path,
+        .setPropertyWithOrigin = instance_set_property_with_origin,
+};
+
+/*
+ * CMPIArgs
+ */
+
+static CMPIArgsFT args_ft;
+
+static void args_destroy(void *obj)
+{
+        struct mock_args *args = obj;
+
+        props_free(&args->props);
+}
+
+static struct mock_args *new_args(void)
+{
+        struct mock_args *args;
+
+        args = mock_alloc(sizeof(*args), args_destroy);
+        if (args == NULL)
+                return NULL;
+
+        args->enc.hdl = args;
+        args->enc.ft = &args_ft;
+
+        return args;
+}
+
+static CMPIStatus args_release(CMPIArgs *as)
+{
+        return noop_release(as);
+}
+
+static CMPIArgs *args_clone(const CMPIArgs *as, CMPIStatus *rc)
+{
+        struct mock_args *src = as->hdl;
+        struct mock_args *args;
+
+        args = new_args();
+        if ((args == NULL) ||
+            (props_copy(&args->props, &src->props).rc != CMPI_RC_OK)) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &args->enc;
+}
+
+static CMPIStatus args_add_arg(const CMPIArgs *as,
+                               const char *name,
+                               const CMPIValue *value,
+                               const CMPIType type)
+{
+        struct mock_args *args = as->hdl;
+
+        return props_set(&args->props, name, make_data(value, type));
+}
+
+static CMPIData args_get_arg(const CMPIArgs *as,
+                             const char *name,
+                             CMPIStatus *rc)
+{
+        struct mock_args *args = as->hdl;
+
+        return props_get(&args->props, name, rc);
+}
+
+static CMPIData args_get_arg_at(const CMPIArgs *as,
+                                CMPICount index,
+                                CMPIString **name,
+                                CMPIStatus *rc)
+{
+        struct mock_args *args = as->hdl;
+
+        return props_get_at(&args->props, index, name, rc);
+}
+
+static CMPICount args_get_arg_count(const CMPIArgs *as, CMPIStatus *rc)
+{
+        struct mock_args *args = as->hdl;
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return args->props.cur;
+}
+
+static CMPIArgsFT args_ft = {
+        .ftVersion = CMPICurrentVersion,
+        .release = args_release,
+        .clone = args_clone,
+        .addArg = args_add_arg,
+        .getArg = args_get_arg,
+        .getArgAt = args_get_arg_at,
+        .getArgCount = args_get_arg_count,
+};
+
+/*
+ * CMPIArray
+ */
+
+static CMPIArrayFT array_ft;
+
+static void array_destroy(void *obj)
+{
+        struct mock_array *array = obj;
+
+        free(array->elems);
+}
+
+static struct mock_array *new_array(CMPICount size, CMPIType type)
+{
+        struct mock_array *array;
+        CMPICount i;
+
+        array = mock_alloc(sizeof(*array), array_destroy);
+        if (array == NULL)
+                return NULL;
+
+        array->enc.hdl = array;
+        array->enc.ft = &array_ft;
+        array->type = (type == CMPI_chars) ? CMPI_string : type;
+        array->size = size;
+
+        array->elems = mock_calloc(size ? size : 1, sizeof(CMPIData));
+        if (array->elems == NULL)
+                return NULL;
+
+        for (i = 0; i < size; i++) {
+                array->elems[i].type = array->type;
+                array->elems[i].state = CMPI_nullValue;
+        }
+
+        return array;
+}
+
+static CMPIStatus array_release(CMPIArray *ar)
+{
+        return noop_release(ar);
+}
+
+static CMPIArray *array_clone(const CMPIArray *ar, CMPIStatus *rc)
+{
+        struct mock_array *src = ar->hdl;
+        struct mock_array *array;
+
+        array = new_array(src->size, src->type);
+        if (array == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        memcpy(array->elems, src->elems, src->size * sizeof(CMPIData));
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &array->enc;
+}
+
+static CMPICount array_get_size(const CMPIArray *ar, CMPIStatus *rc)
+{
+        struct mock_array *array = ar->hdl;
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return array->size;
+}
+
+static CMPIType array_get_simple_type(const CMPIArray *ar, CMPIStatus *rc)
+{
+        struct mock_array *array = ar->hdl;
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return array->type;
+}
+
+static CMPIData array_get_element_at(const CMPIArray *ar,
+                                     CMPICount index,
+                                     CMPIStatus *rc)
+{
+        struct mock_array *array = ar->hdl;
+        CMPIData data;
+
+        if (index >= array->size) {
+                CMSetStatus(rc, CMPI_RC_ERR_NO_SUCH_PROPERTY);
+                memset(&data, 0, sizeof(data));
+                data.state = CMPI_nullValue;
+                return data;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return array->elems[index];
+}
+
+static CMPIStatus array_set_element_at(CMPIArray *ar,
+                                       CMPICount index,
+                                       const CMPIValue *value,
+                                       CMPIType type)
+{
+        struct mock_array *array = ar->hdl;
+
+        if (index >= array->size)
+                return (CMPIStatus){CMPI_RC_ERR_NO_SUCH_PROPERTY, NULL};
+
+        array->elems[index] = make_data(value, type);
+
+        return ok_status;
+}
+
+static CMPIArrayFT array_ft = {
+        .ftVersion = CMPICurrentVersion,
+        .release = array_release,
+        .clone = array_clone,
+        .getSize = array_get_size,
+        .getSimpleType = array_get_simple_type,
+        .getElementAt = array_get_element_at,
+        .setElementAt = array_set_element_at,
+};
+
+/*
+ * CMPIResult
+ */
+
+static CMPIResultFT result_ft;
+
+static CMPIStatus result_release(CMPIResult *rslt)
+{
+        return noop_release(rslt);
+}
+
+static CMPIResult *result_clone(const CMPIResult *rslt, CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_ERR_NOT_SUPPORTED);
+
+        return NULL;
+}
+
+static CMPIStatus result_return_data(const CMPIResult *rslt,
+                                     const CMPIValue *value,
+                                     const CMPIType type)
+{
+        struct mock_result *result = rslt->hdl;
+
+        __sync_fetch_and_add(&result->stats.data, 1);
+
+        return ok_status;
+}
+
+static CMPIStatus result_return_instance(const CMPIResult *rslt,
+                                         const CMPIInstance *inst)
+{
+        struct mock_result *result = rslt->hdl;
+
+        __sync_fetch_and_add(&result->stats.instances, 1);
+
+        return ok_status;
+}
+
+static CMPIStatus result_return_object_path(const CMPIResult *rslt,
+                                            const CMPIObjectPath *ref)
+{
+        struct mock_result *result = rslt->hdl;
+
+        __sync_fetch_and_add(&result->stats.names, 1);
+
+        return ok_status;
+}
+
+static CMPIStatus result_return_done(const CMPIResult *rslt)
+{
+        struct mock_result *result = rslt->hdl;
+
+        __sync_fetch_and_add(&result->stats.done, 1);
+
+        return ok_status;
+}
+
+static CMPIResultFT result_ft = {
+        .ftVersion = CMPICurrentVersion,
+        .release = result_release,
+        .clone = result_clone,
+        .returnData = result_return_data,
+        .returnInstance = result_return_instance,
+        .returnObjectPath = result_return_object_path,
+        .returnDone = result_return_done,
+};
+
+CMPIResult *mock_result_new(const CMPIBroker *broker)
+{
+        struct mock_result *result;
+
+        result = mock_alloc(sizeof(*result), NULL);
+        if (result == NULL)
+                return NULL;
+
+        result->enc.hdl = result;
+        result->enc.ft = &result_ft;
+
+        return &result->enc;
+}
+
+void mock_result_get_stats(const CMPIResult *results,
+                           struct mock_result_stats *stats)
+{
+        struct mock_result *result = results->hdl;
+
+        *stats = result->stats;
+}
+
+/*
+ * CMPIContext
+ */
+
+static CMPIContextFT context_ft;
+
+static void context_destroy(void *obj)
+{
+        struct mock_context *ctx = obj;
+
+        props_free(&ctx->entries);
+}
+
+static struct mock_context *new_context(void)
+{
+        struct mock_context *ctx;
+
+        ctx = mock_alloc(sizeof(*ctx), context_destroy);
+        if (ctx == NULL)
+                return NULL;
+
+        ctx->enc.hdl = ctx;
+        ctx->enc.ft = &context_ft;
+
+        return ctx;
+}
+
+static CMPIStatus context_release(CMPIContext *cc)
+{
+        return noop_release(cc);
+}
+
+static CMPIContext *context_clone(const CMPIContext *cc, CMPIStatus *rc)
+{
+        struct mock_context *src = cc->hdl;
+        struct mock_context *ctx;
+
+        ctx = new_context();
+        if ((ctx == NULL) ||
+            (props_copy(&ctx->entries, &src->entries).rc != CMPI_RC_OK)) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &ctx->enc;
+}
+
+static CMPIData context_get_entry(const CMPIContext *cc,
+                                  const char *name,
+                                  CMPIStatus *rc)
+{
+        struct mock_context *ctx = cc->hdl;
+
+        return props_get(&ctx->entries, name, rc);
+}
+
+static CMPIData context_get_entry_at(const CMPIContext *cc,
+                                     CMPICount index,
+                                     CMPIString **name,
+                                     CMPIStatus *rc)
+{
+        struct mock_context *ctx = cc->hdl;
+
+        return props_get_at(&ctx->entries, index, name, rc);
+}
+
+static CMPICount context_get_entry_count(const CMPIContext *cc,
+                                         CMPIStatus *rc)
+{
+        struct mock_context *ctx = cc->hdl;
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return ctx->entries.cur;
+}
+
+static CMPIStatus context_add_entry(const CMPIContext *cc,
+                                    const char *name,
+                                    const CMPIValue *value,
+                                    const CMPIType type)
+{
+        struct mock_context *ctx = cc->hdl;
+
+        return props_set(&ctx->entries, name, make_data(value, type));
+}
+
+static CMPIContextFT context_ft = {
+        .ftVersion = CMPICurrentVersion,
+        .release = context_release,
+        .clone = context_clone,
+        .getEntry = context_get_entry,
+        .getEntryAt = context_get_entry_at,
+        .getEntryCount = context_get_entry_count,
+        .addEntry = context_add_entry,
+};
+
+CMPIContext *mock_context_new(const CMPIBroker *broker)
+{
+        struct mock_context *ctx;
+
+        ctx = new_context();
+        if (ctx == NULL)
+                return NULL;
+
+        return &ctx->enc;
+}
+
+/*
+ * CMPIBrokerFT
+ */
+
+static CMPIContext *mb_prepare_attach_thread(const CMPIBroker *broker,
+                                             const CMPIContext *ctx)
+{
+        return context_clone(ctx, NULL);
+}
+
+static CMPIStatus mb_attach_thread(const CMPIBroker *broker,
+                                   const CMPIContext *ctx)
+{
+        return ok_status;
+}
+
+static CMPIStatus mb_detach_thread(const CMPIBroker *broker,
+                                   const CMPIContext *ctx)
+{
+        return ok_status;
+}
+
+static CMPIStatus mb_deliver_indication(const CMPIBroker *broker,
+                                        const CMPIContext *ctx,
+                                        const char *ns,
+                                        const CMPIInstance *ind)
+{
+        struct mock_broker *mb = broker->hdl;
+
+        COUNT(mb, deliver_indication);
+
+        if (mb->deliver_fn != NULL)
+                return mb->deliver_fn(broker, ctx, ns, ind, mb->deliver_data);
+
+        return ok_status;
+}
+
+static CMPIEnumeration *mb_enum_instance_names(const CMPIBroker *broker,
+                                               const CMPIContext *ctx,
+                                               const CMPIObjectPath *op,
+                                               CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_ERR_NOT_SUPPORTED);
+
+        return NULL;
+}
+
+static CMPIInstance *mb_get_instance(const CMPIBroker *broker,
+                                     const CMPIContext *ctx,
+                                     const CMPIObjectPath *op,
+                                     const char **properties,
+                                     CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_ERR_NOT_FOUND);
+
+        return NULL;
+}
+
+static CMPIEnumeration *mb_enum_instances(const CMPIBroker *broker,
+                                          const CMPIContext *ctx,
+                                          const CMPIObjectPath *op,
+                                          const char **properties,
+                                          CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_ERR_NOT_SUPPORTED);
+
+        return NULL;
+}
+
+static CMPIEnumeration *mb_associators(const CMPIBroker *broker,
+                                       const CMPIContext *ctx,
+                                       const CMPIObjectPath *op,
+                                       const char *assocClass,
+                                       const char *resultClass,
+                                       const char *role,
+                                       const char *resultRole,
+                                       const char **properties,
+                                       CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_ERR_NOT_SUPPORTED);
+
+        return NULL;
+}
+
+static CMPIEnumeration *mb_associator_names(const CMPIBroker *broker,
+                                            const CMPIContext *ctx,
+                                            const CMPIObjectPath *op,
+                                            const char *assocClass,
+                                            const char *resultClass,
+                                            const char *role,
+                                            const char *resultRole,
+                                            CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_ERR_NOT_SUPPORTED);
+
+        return NULL;
+}
+
+static CMPIEnumeration *mb_references(const CMPIBroker *broker,
+                                      const CMPIContext *ctx,
+                                      const CMPIObjectPath *op,
+                                      const char *resultClass,
+                                      const char *role,
+                                      const char **properties,
+                                      CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_ERR_NOT_SUPPORTED);
+
+        return NULL;
+}
+
+static CMPIEnumeration *mb_reference_names(const CMPIBroker *broker,
+                                           const CMPIContext *ctx,
+                                           const CMPIObjectPath *op,
+                                           const char *resultClass,
+                                           const char *role,
+                                           CMPIStatus *rc)
+{
+        CMSetStatus(rc, CMPI_RC_ERR_NOT_SUPPORTED);
+
+        return NULL;
+}
+
+static CMPIData mb_invoke_method(const CMPIBroker *broker,
+                                 const CMPIContext *ctx,
+                                 const CMPIObjectPath *op,
+                                 const char *method,
+                                 const CMPIArgs *in,
+                                 CMPIArgs *out,
+                                 CMPIStatus *rc)
+{
+        struct mock_broker *mb = broker->hdl;
+        CMPIStatus s = {CMPI_RC_ERR_NOT_SUPPORTED, NULL};
+        CMPIData data;
+
+        COUNT(mb, invoke_method);
+
+        if (mb->invoke_fn != NULL)
+                s = mb->invoke_fn(broker, ctx, op, method, in, out,
+                                  mb->invoke_data);
+
+        if (rc != NULL)
+                *rc = s;
+
+        memset(&data, 0, sizeof(data));
+        data.state = CMPI_nullValue;
+
+        return data;
+}
+
+static CMPIBrokerFT broker_ft = {
+        .brokerCapabilities = 0,
+        .brokerVersion = CMPICurrentVersion,
+        .brokerName = "libcmpiutil-mock",
+        .prepareAttachThread = mb_prepare_attach_thread,
+        .attachThread = mb_attach_thread,
+        .detachThread = mb_detach_thread,
+        .deliverIndication = mb_deliver_indication,
+        .enumerateInstanceNames = mb_enum_instance_names,
+        .getInstance = mb_get_instance,
+        .enumerateInstances = mb_enum_instances,
+        .associators = mb_associators,
+        .associatorNames = mb_associator_names,
+        .references = mb_references,
+        .referenceNames = mb_reference_names,
+        .invokeMethod = mb_invoke_method,
+};
+
+/*
+ * CMPIBrokerEncFT
+ */
+
+static CMPIInstance *mb_new_instance(const CMPIBroker *broker,
+                                     const CMPIObjectPath *op,
+                                     CMPIStatus *rc)
+{
+        struct mock_broker *mb = broker->hdl;
+        struct mock_instance *inst;
+
+        COUNT(mb, new_instance);
+
+        if (CMIsNullObject(op)) {
+                CMSetStatus(rc, CMPI_RC_ERR_INVALID_PARAMETER);
+                return NULL;
+        }
+
+        inst = new_instance(mb, op->hdl);
+        if (inst == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &inst->enc;
+}
+
+static CMPIObjectPath *mb_new_object_path(const CMPIBroker *broker,
+                                          const char *ns,
+                                          const char *cn,
+                                          CMPIStatus *rc)
+{
+        struct mock_broker *mb = broker->hdl;
+        struct mock_path *path;
+
+        COUNT(mb, new_object_path);
+
+        path = new_path(ns, cn);
+        if (path == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &path->enc;
+}
+
+static CMPIArgs *mb_new_args(const CMPIBroker *broker, CMPIStatus *rc)
+{
+        struct mock_broker *mb = broker->hdl;
+        struct mock_args *args;
+
+        COUNT(mb, new_args);
+
+        args = new_args();
+        if (args == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &args->enc;
+}
+
+static CMPIString *mb_new_string(const CMPIBroker *broker,
+                                 const char *data,
+                                 CMPIStatus *rc)
+{
+        struct mock_broker *mb = broker->hdl;
+        CMPIString *str;
+
+        COUNT(mb, new_string);
+
+        str = new_string(data);
+        if (str == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return str;
+}
+
+static CMPIArray *mb_new_array(const CMPIBroker *broker,
+                               CMPICount max,
+                               CMPIType type,
+                               CMPIStatus *rc)
+{
+        struct mock_broker *mb = broker->hdl;
+        struct mock_array *array;
+
+        COUNT(mb, new_array);
+
+        array = new_array(max, type);
+        if (array == NULL) {
+                CMSetStatus(rc, CMPI_RC_ERROR_SYSTEM);
+                return NULL;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        return &array->enc;
+}
+
+static CMPIBoolean mb_class_path_is_a(const CMPIBroker *broker,
+                                      const CMPIObjectPath *op,
+                                      const char *type,
+                                      CMPIStatus *rc)
+{
+        struct mock_broker *mb = broker->hdl;
+        struct mock_path *path;
+        struct mock_class *cls;
+        const char *cn;
+        int depth;
+        int ret;
+
+        COUNT(mb, class_path_is_a);
+
+        if (CMIsNullObject(op) || (type == NULL)) {
+                CMSetStatus(rc, CMPI_RC_ERR_INVALID_PARAMETER);
+                return 0;
+        }
+
+        CMSetStatus(rc, CMPI_RC_OK);
+
+        path = op->hdl;
+        cn = path->cn;
+
+        if ((mb->is_a_fn != NULL) && (cn != NULL)) {
+                ret = mb->is_a_fn(broker, cn, type, mb->is_a_data);
+                if (ret >= 0)
+                        return ret;
+        }
+
+        for (depth = 0; cn && (depth < MAX_CLASS_DEPTH); depth++) {
+                if (STREQC(cn, type))
+                        return 1;
+
+                cls = find_class(mb, cn);
+                if (cls == NULL)
+                        break;
+
+                cn = cls->parent;
+        }
+
+        return 0;
+}
+
+static CMPIBrokerEncFT broker_enc_ft = {
+        .ftVersion = CMPICurrentVersion,
+        .newInstance = mb_new_instance,
+        .newObjectPath = mb_new_object_path,
+        .newArgs = mb_new_args,
+        .newString = mb_new_string,
+        .newArray = mb_new_array,
+        .classPathIsA = mb_class_path_is_a,
+};
+
+/*
+ * Broker management
+ */
+
+CMPIBroker *mock_broker_new(void)
+{
+        struct mock_broker *mb;
+
+        mb = calloc(1, sizeof(*mb));
+        if (mb == NULL)
+                return NULL;
+
+        mb->broker.hdl = mb;
+        mb->broker.bft = &broker_ft;
+        mb->broker.eft = &broker_enc_ft;
+        mb->counting = 1;
+
+        return &mb->broker;
+}
+
+void mock_broker_free(CMPIBroker *broker)
+{
+        struct mock_broker *mb;
+        unsigned int i;
+
+        if (broker == NULL)
+                return;
+
+        mb = broker->hdl;
+
+        for (i = 0; i < mb->class_count; i++) {
+                free(mb->classes[i].name);
+                free(mb->classes[i].parent);
+                free_keys(mb->classes[i].keys);
+        }
+
+        free(mb->classes);
+        free(mb);
+}
+
+void mock_broker_set_invoke(CMPIBroker *broker,
+                            mock_invoke_fn fn,
+                            void *data)
+{
+        struct mock_broker *mb = broker->hdl;
+
+        mb->invoke_fn = fn;
+        mb->invoke_data = data;
+}
+
+void mock_broker_set_is_a(CMPIBroker *broker,
+                          mock_is_a_fn fn,
+                          void *data)
+{
+        struct mock_broker *mb = broker->hdl;
+
+        mb->is_a_fn = fn;
+        mb->is_a_data = data;
+}
+
+void mock_broker_set_deliver(CMPIBroker *broker,
+                             mock_deliver_fn fn,
+                             void *data)
+{
+        struct mock_broker *mb = broker->hdl;
+
+        mb->deliver_fn = fn;
+        mb->deliver_data = data;
+}
+
+void mock_broker_get_stats(const CMPIBroker *broker,
+                           struct mock_broker_stats *stats)
+{
+        struct mock_broker *mb = broker->hdl;
+
+        *stats = mb->stats;
+}
+
+void mock_broker_reset_stats(CMPIBroker *broker)
+{
+        struct mock_broker *mb = broker->hdl;
+
+        memset(&mb->stats, 0, sizeof(mb->stats));
+}
+
+void mock_broker_set_counting(CMPIBroker *broker, int enabled)
+{
+        struct mock_broker *mb = broker->hdl;
+
+        mb->counting = enabled;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,276 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __MOCK_BROKER_H
+#define __MOCK_BROKER_H
+
+#include <cmpidt.h>
+#include <cmpift.h>
+
+/*
+ * An in-process CMPI broker for driving libcmpiutil without a CIMOM.
+ *
+ * All encapsulated objects (strings, paths, instances, args, arrays,
+ * results and contexts) are owned by the thread that created them and
+ * live until that thread calls mock_release_objects(), much like a
+ * CIMOM frees everything at the end of a request.  CMRelease() on a
+ * mock object is accepted but deferred until then.
+ *
+ * The class table is not locked: populate it before the broker is
+ * shared between threads.
+ */
+
+/*
+ * Invoked for CBInvokeMethod() up-calls, so that a harness can route
+ * them back into a provider's method MI.
+ */
+typedef CMPIStatus (*mock_invoke_fn)(const CMPIBroker *broker,
+                                     const CMPIContext *context,
+                                     const CMPIObjectPath *ref,
+                                     const char *method,
+                                     const CMPIArgs *argsin,
+                                     CMPIArgs *argsout,
+                                     void *data);
+
+/*
+ * Invoked for CBDeliverIndication() up-calls.
+ */
+typedef CMPIStatus (*mock_deliver_fn)(const CMPIBroker *broker,
+                                      const CMPIContext *context,
+                                      const char *ns,
+                                      const CMPIInstance *ind,
+                                      void *data);
+
+/*
+ * Consulted by CMClassPathIsA() before the class table, so that a
+ * harness can answer from elsewhere.  Returns 1 or 0 for a known
+ * answer, or -1 to fall back to the class table.
+ */
+typedef int (*mock_is_a_fn)(const CMPIBroker *broker,
+                            const char *cn,
+                            const char *type,
+                            void *data);
+
+/*
+ * Number of up-calls seen by a mock broker, per entry point
+ */
+struct mock_broker_stats {
+        unsigned long class_path_is_a;
+        unsigned long new_instance;
+        unsigned long new_object_path;
+        unsigned long new_args;
+        unsigned long new_string;
+        unsigned long new_array;
+        unsigned long deliver_indication;
+        unsigned long invoke_method;
+};
+
+/*
+ * Number of objects handed to a mock result
+ */
+struct mock_result_stats {
+        unsigned long instances;
+        unsigned long names;
+        unsigned long data;
+        unsigned long done;
+};
+
+/**
+ * Create a mock broker with an empty class table
+ *
+ * @returns A new broker, or NULL on allocation failure
+ */
+CMPIBroker *mock_broker_new(void);
+
+/**
+ * Free a mock broker and its class table
+ *
+ * @param broker A broker returned by mock_broker_new()
+ */
+void mock_broker_free(CMPIBroker *broker);
+
+/**
+ * Register a class in the broker's hierarchy
+ *
+ * @param broker The mock broker
+ * @param cn The class name
+ * @param parent The superclass name, or NULL for a root class
+ * @param keys A NULL-terminated list of key property names, or NULL.
+ *             These are copied into the object path returned by
+ *             CMGetObjectPath() on instances of the class.
+ * @returns nonzero on success, zero on failure
+ */
+int mock_broker_add_class(CMPIBroker *broker,
+                          const char *cn,
+                          const char *parent,
+                          const char **keys);
+
+/**
+ * Load a class hierarchy from a file.  Each line has the form
+ *
+ *     ClassName [ParentName|-] [Key1,Key2,...]
+ *
+ * Blank lines and lines starting with '#' are ignored.
+ *
+ * @param broker The mock broker
+ * @param path The file to read
+ * @returns The number of classes loaded, or -1 on error
+ */
+int mock_broker_load_classes(CMPIBroker *broker, const char *path);
+
+/**
+ * Route CBInvokeMethod() up-calls to a function
+ *
+ * @param broker The mock broker
+ * @param fn The function to call, or NULL to return CMPI_RC_ERR_NOT_SUPPORTED
+ * @param data Passed through to fn
+ */
+void mock_broker_set_invoke(CMPIBroker *broker,
+                            mock_invoke_fn fn,
+                            void *data);
+
+/**
+ * Route CBDeliverIndication() up-calls to a function
+ *
+ * @param broker The mock broker
+ * @param fn The function to call, or NULL to just count the indication
+ * @param data Passed through to fn
+ */
+void mock_broker_set_deliver(CMPIBroker *broker,
+                             mock_deliver_fn fn,
+                             void *data);
+
+/**
+ * Answer CMClassPathIsA() up-calls with a function
+ *
+ * @param broker The mock broker
+ * @param fn The function to call, or NULL to only use the class table
+ * @param data Passed through to fn
+ */
+void mock_broker_set_is_a(CMPIBroker *broker,
+                          mock_is_a_fn fn,
+                          void *data);
+
+/**
+ * Get the up-call counters of a mock broker
+ *
+ * @param broker The mock broker
+ * @param stats The structure to fill in
+ */
+void mock_broker_get_stats(const CMPIBroker *broker,
+                           struct mock_broker_stats *stats);
+
+/**
+ * Zero the up-call counters of a mock broker
+ *
+ * @param broker The mock broker
+ */
+void mock_broker_reset_stats(CMPIBroker *broker);
+
+/**
+ * Enable or disable the up-call counters of a mock broker.  They are
+ * enabled by default; a multi-threaded harness should disable them,
+ * since every thread would update the same cache lines.
+ *
+ * @param broker The mock broker
+ * @param enabled Nonzero to count up-calls
+ */
+void mock_broker_set_counting(CMPIBroker *broker, int enabled);
+
+/**
+ * Create an empty invocation context
+ *
+ * @param broker The mock broker
+ * @returns A new context owned by the calling thread
+ */
+CMPIContext *mock_context_new(const CMPIBroker *broker);
+
+/**
+ * Create a result sink that counts what is returned to it
+ *
+ * @param broker The mock broker
+ * @returns A new result owned by the calling thread
+ */
+CMPIResult *mock_result_new(const CMPIBroker *broker);
+
+/**
+ * Get the counters of a mock result
+ *
+ * @param results A result returned by mock_result_new()
+ * @param stats The structure to fill in
+ */
+void mock_result_get_stats(const CMPIResult *results,
+                           struct mock_result_stats *stats);
+
+/**
+ * Parse an object path of the form
+ *
+ *     namespace:ClassName.Key1="string",Key2=42,Key3=true
+ *
+ * The namespace and key list are optional.
+ *
+ * @param broker The mock broker
+ * @param str The path to parse
+ * @returns A new object path, or NULL if str is malformed
+ */
+CMPIObjectPath *mock_path_parse(const CMPIBroker *broker, const char *str);
+
+/**
+ * Free every object created by the calling thread through any mock
+ * broker.  Pointers to those objects must not be used afterwards.
+ *
+ * @returns The number of objects freed
+ */
+unsigned long mock_release_objects(void);
+
+/**
+ * Remember which objects the calling thread owns right now
+ *
+ * @returns A mark to pass to mock_release_objects_since()
+ */
+const void *mock_objects_mark(void);
+
+/**
+ * Free the objects created by the calling thread since a mark was
+ * taken, leaving older objects alone
+ *
+ * @param mark A value returned by mock_objects_mark() on this thread
+ * @returns The number of objects freed
+ */
+unsigned long mock_release_objects_since(const void *mark);
+
+/**
+ * Get the number of heap allocations, and the bytes requested, made by
+ * mock brokers on the calling thread.  These are the allocations a
+ * CIMOM would make on behalf of a provider.
+ *
+ * @param count Set to the number of allocations
+ * @param bytes Set to the number of bytes requested
+ */
+void mock_get_alloc_stats(unsigned long *count, unsigned long *bytes);
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,647 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+#include "cu_record.h"
+
+/* Nesting limit for embedded instances and references */
+#define MAX_DEPTH   8
+
+/* Number of distinct CMClassPathIsA() answers remembered */
+#define MAX_ANSWERS 4096
+
+struct rec_buf {
+        char *data;
+        size_t len;
+        size_t size;
+        bool failed;
+};
+
+static FILE *record_file = NULL;
+
+static pthread_mutex_t answer_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t answers[MAX_ANSWERS];
+static unsigned int answer_count = 0;
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void buf_add(struct rec_buf *buf, const char *str, size_t len)
+{
+        char *tmp;
+        size_t size;
+
+        if (buf->failed)
+                return;
+
+        if (buf->len + len + 1 > buf->size) {
+                size = buf->size ? buf->size * 2 : 256;
+                while (size < buf->len + len + 1)
+                        size *= 2;
+
+                tmp = realloc(buf->data, size);
+                if (tmp == NULL) {
+                        buf->failed = true;
+                        return;
+                }
+
+                buf->data = tmp;
+                buf->size = size;
+        }
+
+        memcpy(buf->data + buf->len, str, len);
+        buf->len += len;
+        buf->data[buf->len] = '\0';
+}
+
+static void buf_str(struct rec_buf *buf, const char *str)
+{
+        buf_add(buf, str, strlen(str));
+}
+
+static void buf_printf(struct rec_buf *buf, const char *fmt, ...)
+{
+        char tmp[64];
+        va_list ap;
+        int len;
+
+        va_start(ap, fmt);
+        len = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+        va_end(ap);
+
+        if ((len < 0) || (len >= (int)sizeof(tmp)))
+                buf->failed = true;
+        else
+                buf_add(buf, tmp, len);
+}
+
+static void buf_quote(struct rec_buf *buf, const char *str)
+{
+        const char *p;
+
+        if (str == NULL) {
+                buf_str(buf, "~");
+                return;
+        }
+
+        buf_str(buf, "\"");
+
+        for (p = str; *p != '\0'; p++) {
+                switch (*p) {
+                case '\\':
+                        buf_str(buf, "\\\\");
+                        break;
+                case '"':
+                        buf_str(buf, "\\\"");
+                        break;
+                case '\t':
+                        buf_str(buf, "\\t");
+                        break;
+                case '\n':
+                        buf_str(buf, "\\n");
+                        break;
+                default:
+                        buf_add(buf, p, 1);
+                }
+        }
+
+        buf_str(buf, "\"");
+}
+
+static void put_data(struct rec_buf *buf, const CMPIData *data, int depth);
+
+static void put_path_name(struct rec_buf *buf, const CMPIObjectPath *op)
+{
+        CMPIString *ns;
+        CMPIString *cn;
+
+        ns = CMGetNameSpace(op, NULL);
+        cn = CMGetClassName(op, NULL);
+
+        buf_quote(buf, ns != NULL ? CMGetCharPtr(ns) : NULL);
+        buf_str(buf, ",");
+        buf_quote(buf, cn != NULL ? CMGetCharPtr(cn) : NULL);
+}
+
+static void put_path(struct rec_buf *buf,
+                     const CMPIObjectPath *op,
+                     int depth)
+{
+        CMPIString *name;
+        CMPIData data;
+        CMPIStatus s;
+        unsigned int count;
+        unsigned int i;
+        const char *sep = "";
+
+        if (CMIsNullObject(op)) {
+                buf_str(buf, "~");
+                return;
+        }
+
+        buf_str(buf, "P");
+        put_path_name(buf, op);
+        buf_str(buf, "{");
+
+        count = CMGetKeyCount(op, NULL);
+        for (i = 0; i < count; i++) {
+                data = CMGetKeyAt(op, i, &name, &s);
+                if ((s.rc != CMPI_RC_OK) || (name == NULL))
+                        continue;
+
+                buf_str(buf, sep);
+                sep = ",";
+                buf_quote(buf, CMGetCharPtr(name));
+                buf_str(buf, "=");
+                put_data(buf, &data, depth + 1);
+        }
+
+        buf_str(buf, "}");
+}
+
+static void put_inst(struct rec_buf *buf,
+                     const CMPIInstance *inst,
+                     int depth)
+{
+        CMPIObjectPath *op;
+        CMPIString *name;
+        CMPIData data;
+        CMPIStatus s;
+        unsigned int count;
+        unsigned int i;
+        const char *sep = "";
+
+        op = CMGetObjectPath(inst, NULL);
+        if (CMIsNullObject(op)) {
+                buf_str(buf, "?");
+                return;
+        }
+
+        buf_str(buf, "I");
+        put_path_name(buf, op);
+        buf_str(buf, "{");
+
+        count = CMGetPropertyCount(inst, NULL);
+        for (i = 0; i < count; i++) {
+                data = CMGetPropertyAt(inst, i, &name, &s);
+                if ((s.rc != CMPI_RC_OK) || (name == NULL))
+                        continue;
+
+                buf_str(buf, sep);
+                sep = ",";
+                buf_quote(buf, CMGetCharPtr(name));
+                buf_str(buf, "=");
+                put_data(buf, &data, depth + 1);
+        }
+
+        buf_str(buf, "}");
+}
+
+static void put_array(struct rec_buf *buf,
+                      const CMPIData *data,
+                      int depth)
+{
+        CMPIData elem;
+        CMPIStatus s;
+        CMPICount count;
+        CMPICount i;
+
+        buf_printf(buf, "A%u[", (unsigned int)data->type);
+
+        count = CMGetArrayCount(data->value.array, NULL);
+        for (i = 0; i < count; i++) {
+                elem = CMGetArrayElementAt(data->value.array, i, &s);
+                if (s.rc != CMPI_RC_OK)
+                        elem.state = CMPI_nullValue;
+
+                if (i > 0)
+                        buf_str(buf, ",");
+                put_data(buf, &elem, depth + 1);
+        }
+
+        buf_str(buf, "]");
+}
+
+static void put_data(struct rec_buf *buf, const CMPIData *data, int depth)
+{
+        CMPIString *str;
+
+        if ((data->state & CMPI_nullValue) || (depth > MAX_DEPTH)) {
+                buf_str(buf, "~");
+                return;
+        }
+
+        if (data->type & CMPI_ARRAY) {
+                if (CMIsNullObject(data->value.array))
+                        buf_str(buf, "~");
+                else
+                        put_array(buf, data, depth);
+                return;
+        }
+
+        switch (data->type) {
+        case CMPI_string:
+                buf_quote(buf, CMGetCharPtr(data->value.string));
+                break;
+        case CMPI_chars:
+                buf_quote(buf, data->value.chars);
+                break;
+        case CMPI_boolean:
+                buf_str(buf, data->value.boolean ? "b1" : "b0");
+                break;
+        case CMPI_char16:
+                buf_printf(buf, "c16:%u", (unsigned int)data->value.char16);
+                break;
+        case CMPI_uint8:
+                buf_printf(buf, "u8:%u", (unsigned int)data->value.uint8);
+                break;
+        case CMPI_uint16:
+                buf_printf(buf, "u16:%u", (unsigned int)data->value.uint16);
+                break;
+        case CMPI_uint32:
+                buf_printf(buf, "u32:%" PRIu32, data->value.uint32);
+                break;
+        case CMPI_uint64:
+                buf_printf(buf, "u64:%" PRIu64, data->value.uint64);
+                break;
+        case CMPI_sint8:
+                buf_printf(buf, "s8:%d", (int)data->value.sint8);
+                break;
+        case CMPI_sint16:
+                buf_printf(buf, "s16:%d", (int)data->value.sint16);
+                break;
+        case CMPI_sint32:
+                buf_printf(buf, "s32:%" PRId32, data->value.sint32);
+                break;
+        case CMPI_sint64:
+                buf_printf(buf, "s64:%" PRId64, data->value.sint64);
+                break;
+        case CMPI_real32:
+                buf_printf(buf, "r32:%.9g", (double)data->value.real32);
+                break;
+        case CMPI_real64:
+                buf_printf(buf, "r64:%.17g", data->value.real64);
+                break;
+        case CMPI_dateTime:
+                str = NULL;
+                if (!CMIsNullObject(data->value.dateTime))
+                        str = CMGetStringFormat(data->value.dateTime, NULL);
+                if (str == NULL) {
+                        buf_str(buf, "~");
+                } else {
+                        buf_str(buf, "d");
+                        buf_quote(buf, CMGetCharPtr(str));
+                }
+                break;
+        case CMPI_ref:
+                put_path(buf, data->value.ref, depth);
+                break;
+        case CMPI_instance:
+                if (CMIsNullObject(data->value.inst))
+                        buf_str(buf, "~");
+                else
+                        put_inst(buf, data->value.inst, depth);
+                break;
+        default:
+                buf_str(buf, "?");
+        }
+}
+
+static void put_args(struct rec_buf *buf, const CMPIArgs *args)
+{
+        CMPIString *name;
+        CMPIData data;
+        CMPIStatus s;
+        unsigned int count;
+        unsigned int i;
+        const char *sep = "";
+
+        if (CMIsNullObject(args)) {
+                buf_str(buf, "~");
+                return;
+        }
+
+        buf_str(buf, "{");
+
+        count = CMGetArgCount(args, NULL);
+        for (i = 0; i < count; i++) {
+                data = CMGetArgAt(args, i, &name, &s);
+                if ((s.rc != CMPI_RC_OK) || (name == NULL))
+                        continue;
+
+                buf_str(buf, sep);
+                sep = ",";
+                buf_quote(buf, CMGetCharPtr(name));
+                buf_str(buf, "=");
+                put_data(buf, &data, 0);
+        }
+
+        buf_str(buf, "}");
+}
+
+static void put_list(struct rec_buf *buf, const char **list)
+{
+        int i;
+
+        if (list == NULL) {
+                buf_str(buf, "~");
+                return;
+        }
+
+        buf_printf(buf, "A%u[", (unsigned int)CMPI_stringA);
+
+        for (i = 0; list[i] != NULL; i++) {
+                if (i > 0)
+                        buf_str(buf, ",");
+                buf_quote(buf, list[i]);
+        }
+
+        buf_str(buf, "]");
+}
+
+static void field(struct rec_buf *buf)
+{
+        buf_str(buf, "\t");
+}
+
+static void begin(struct rec_buf *buf,
+                  uint64_t start,
+                  const char *entry,
+                  const char *mi_name,
+                  CMPIrc rc)
+{
+        memset(buf, 0, sizeof(*buf));
+
+        buf_str(buf, entry);
+        field(buf);
+        buf_quote(buf, mi_name);
+        buf_printf(buf, "\t%d\t%" PRIu64, (int)rc, now_ns() - start);
+}
+
+/*
+ * Write a record with a single call, so that records made by
+ * concurrent threads are not interleaved
+ */
+static void finish(struct rec_buf *buf)
+{
+        buf_str(buf, "\n");
+
+        if (!buf->failed)
+                fwrite(buf->data, 1, buf->len, record_file);
+        else
+                CU_DEBUG("Unable to format MI call record");
+
+        free(buf->data);
+}
+
+uint64_t cu_record_start(void)
+{
+        if (record_file == NULL)
+                return 0;
+
+        return now_ns();
+}
+
+void cu_record_assoc(uint64_t start,
+                     const char *entry,
+                     const char *mi_name,
+                     CMPIStatus s,
+                     const CMPIObjectPath *ref,
+                     const char *assoc_class,
+                     const char *result_class,
+                     const char *role,
+                     const char *result_role,
+                     const char **properties)
+{
+        struct rec_buf buf;
+
+        if ((record_file == NULL) || (start == 0))
+                return;
+
+        begin(&buf, start, entry, mi_name, s.rc);
+        field(&buf);
+        put_path(&buf, ref, 0);
+        field(&buf);
+        buf_quote(&buf, assoc_class);
+        field(&buf);
+        buf_quote(&buf, result_class);
+        field(&buf);
+        buf_quote(&buf, role);
+        field(&buf);
+        buf_quote(&buf, result_role);
+        field(&buf);
+        put_list(&buf, properties);
+        finish(&buf);
+}
+
+void cu_record_references(uint64_t start,
+                          const char *entry,
+                          const char *mi_name,
+                          CMPIStatus s,
+                          const CMPIObjectPath *ref,
+                          const char *result_class,
+                          const char *role,
+                          const char **properties)
+{
+        struct rec_buf buf;
+
+        if ((record_file == NULL) || (start == 0))
+                return;
+
+        begin(&buf, start, entry, mi_name, s.rc);
+        field(&buf);
+        put_path(&buf, ref, 0);
+        field(&buf);
+        buf_quote(&buf, result_class);
+        field(&buf);
+        buf_quote(&buf, role);
+        field(&buf);
+        put_list(&buf, properties);
+        finish(&buf);
+}
+
+void cu_record_method(uint64_t start,
+                      const char *mi_name,
+                      CMPIStatus s,
+                      const CMPIObjectPath *ref,
+                      const char *method,
+                      const CMPIArgs *argsin)
+{
+        struct rec_buf buf;
+
+        if ((record_file == NULL) || (start == 0))
+                return;
+
+        begin(&buf, start, "InvokeMethod", mi_name, s.rc);
+        field(&buf);
+        put_path(&buf, ref, 0);
+        field(&buf);
+        buf_quote(&buf, method);
+        field(&buf);
+        put_args(&buf, argsin);
+        finish(&buf);
+}
+
+void cu_record_filter(uint64_t start,
+                      const char *entry,
+                      const char *mi_name,
+                      CMPIStatus s,
+                      const CMPIObjectPath *op,
+                      bool flag)
+{
+        struct rec_buf buf;
+
+        if ((record_file == NULL) || (start == 0))
+                return;
+
+        begin(&buf, start, entry, mi_name, s.rc);
+        field(&buf);
+        put_path(&buf, op, 0);
+        field(&buf);
+        buf_str(&buf, flag ? "b1" : "b0");
+        finish(&buf);
+}
+
+void cu_record_indications(uint64_t start,
+                           const char *entry,
+                           const char *mi_name)
+{
+        struct rec_buf buf;
+
+        if ((record_file == NULL) || (start == 0))
+                return;
+
+        begin(&buf, start, entry, mi_name, CMPI_RC_OK);
+        finish(&buf);
+}
+
+static uint64_t hash_str(uint64_t hash, const char *str)
+{
+        for (; *str != '\0'; str++)
+                hash = (hash ^ (unsigned char)*str) * 1099511628211ULL;
+
+        return hash;
+}
+
+/*
+ * Check whether an answer was recorded before, remembering it if not.
+ * Answers are told apart by a hash of the question; once the table is
+ * full, further answers are recorded every time.
+ */
+static bool answer_seen(const char *cn, const char *type)
+{
+        uint64_t hash;
+        unsigned int i;
+        bool seen = false;
+
+        hash = hash_str(14695981039346656037ULL, cn);
+        hash = hash_str(hash ^ '.', type);
+
+        pthread_mutex_lock(&answer_lock);
+
+        for (i = 0; i < answer_count; i++) {
+                if (answers[i] == hash) {
+                        seen = true;
+                        break;
+                }
+        }
+
+        if (!seen && (answer_count < MAX_ANSWERS))
+                answers[answer_count++] = hash;
+
+        pthread_mutex_unlock(&answer_lock);
+
+        return seen;
+}
+
+void cu_record_is_a(const CMPIObjectPath *op,
+                    const char *type,
+                    bool result)
+{
+        struct rec_buf buf;
+        CMPIString *cn;
+
+        if ((record_file == NULL) || CMIsNullObject(op) || (type == NULL))
+                return;
+
+        cn = CMGetClassName(op, NULL);
+        if ((cn == NULL) || (CMGetCharPtr(cn) == NULL))
+                return;
+
+        if (answer_seen(CMGetCharPtr(cn), type))
+                return;
+
+        memset(&buf, 0, sizeof(buf));
+
+        buf_str(&buf, "ClassPathIsA\t");
+        buf_quote(&buf, CMGetCharPtr(cn));
+        field(&buf);
+        buf_quote(&buf, type);
+        field(&buf);
+        buf_str(&buf, result ? "b1" : "b0");
+        finish(&buf);
+}
+
+static void record_init(void) __attribute__((constructor));
+static void record_init(void)
+{
+        const char *path;
+
+        path = getenv("CU_RECORD");
+        if ((path == NULL) || (*path == '\0'))
+                return;
+
+        record_file = fopen(path, "a");
+        if (record_file == NULL) {
+                CU_DEBUG("Unable to open %s for recording", path);
+                return;
+        }
+
+        setlinebuf(record_file);
+
+        if (ftell(record_file) == 0)
+                fprintf(record_file, "#cu-record %d\n", CU_RECORD_VERSION);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,170 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#define CU_LOG_CATEGORY CU_LOG_INSTANCE
+
+#include <string.h>
+
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+#include "cu_upcall.h"
+#include "cu_sink.h"
+
+CMPIStatus cu_sink_emit(struct cu_result_sink *sink, CMPIInstance *inst)
+{
+        CMPIStatus s;
+
+        s = sink->emit(sink, inst);
+        if (s.rc == CMPI_RC_OK)
+                sink->count++;
+
+        return s;
+}
+
+static void sink_init(struct cu_result_sink *sink,
+                      cu_sink_emit_t emit,
+                      void *target)
+{
+        memset(sink, 0, sizeof(*sink));
+        sink->emit = emit;
+        sink->target = target;
+}
+
+static CMPIStatus list_emit(struct cu_result_sink *sink, CMPIInstance *inst)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+
+        if (!inst_list_add(sink->target, inst)) {
+                CU_DEBUG("Unable to add instance to list");
+                s.rc = CMPI_RC_ERR_FAILED;
+        }
+
+        return s;
+}
+
+void cu_sink_init_list(struct cu_result_sink *sink, struct inst_list *list)
+{
+        sink_init(sink, list_emit, list);
+}
+
+static CMPIStatus chunks_emit(struct cu_result_sink *sink,
+                              CMPIInstance *inst)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+
+        if (!inst_chunk_list_add(sink->target, inst)) {
+                CU_DEBUG("Unable to add instance to chunk list");
+                s.rc = CMPI_RC_ERR_FAILED;
+        }
+
+        return s;
+}
+
+void cu_sink_init_chunks(struct cu_result_sink *sink,
+                         struct inst_chunk_list *list)
+{
+        sink_init(sink, chunks_emit, list);
+}
+
+static CMPIStatus instances_emit(struct cu_result_sink *sink,
+                                 CMPIInstance *inst)
+{
+        const CMPIResult *results = sink->target;
+        CU_UPCALL_SITE();
+
+        return CMReturnInstance(results, inst);
+}
+
+void cu_sink_init_instances(struct cu_result_sink *sink,
+                            const CMPIResult *results)
+{
+        sink_init(sink, instances_emit, (void *)results);
+}
+
+static CMPIStatus names_emit(struct cu_result_sink *sink,
+                             CMPIInstance *inst)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+
+        /* Like cu_return_instance_names(), skip instances without a path */
+        if (!cu_return_instance_name(sink->target, inst))
+                CU_DEBUG("Unable to get object path of instance");
+
+        return s;
+}
+
+void cu_sink_init_names(struct cu_result_sink *sink,
+                        const CMPIResult *results)
+{
+        sink_init(sink, names_emit, (void *)results);
+}
+
+static CMPIStatus filter_emit(struct cu_result_sink *sink,
+                              CMPIInstance *inst)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+
+        if (sink->filter(inst, sink->data))
+                s = cu_sink_emit(sink->next, inst);
+
+        return s;
+}
+
+void cu_sink_init_filter(struct cu_result_sink *sink,
+                         struct cu_result_sink *next,
+                         cu_sink_filter_t filter,
+                         void *data)
+{
+        sink_init(sink, filter_emit, NULL);
+        sink->next = next;
+        sink->filter = filter;
+        sink->data = data;
+}
+
+static CMPIStatus map_emit(struct cu_result_sink *sink, CMPIInstance *inst)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+        CMPIInstance *out;
+
+        out = sink->map(inst, sink->data);
+        if (out != NULL)
+                s = cu_sink_emit(sink->next, out);
+
+        return s;
+}
+
+void cu_sink_init_map(struct cu_result_sink *sink,
+                      struct cu_result_sink *next,
+                      cu_sink_map_t map,
+                      void *data)
+{
+        sink_init(sink, map_emit, NULL);
+        sink->next = next;
+        sink->map = map;
+        sink->data = data;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
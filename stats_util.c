@@ -0,0 +1,687 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "libcmpiutil.h"
+#include "cu_histogram.h"
+#include "cu_stats.h"
+
+#define DEFAULT_INTERVAL 10
+
+/* How long a socket client has to say which format it wants */
+#define REQUEST_TIMEOUT_MS 100
+
+static struct cu_stat *registry = NULL;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *export_path = NULL;
+static enum cu_stats_format export_format = CU_STATS_PROMETHEUS;
+static unsigned int export_interval = DEFAULT_INTERVAL;
+static int listen_fd = -1;
+static bool export_socket = false;
+
+/* The export thread, stopped and joined when the library is unloaded */
+static pthread_t export_thread;
+static bool export_started = false;
+static bool export_stop = false;
+static pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t export_cond = PTHREAD_COND_INITIALIZER;
+
+void cu_stat_register(struct cu_stat *stat)
+{
+        pthread_mutex_lock(&registry_lock);
+        stat->next = registry;
+        registry = stat;
+        pthread_mutex_unlock(&registry_lock);
+}
+
+void cu_stat_unregister(struct cu_stat *stat)
+{
+        struct cu_stat **p;
+
+        pthread_mutex_lock(&registry_lock);
+
+        for (p = &registry; *p != NULL; p = &(*p)->next) {
+                if (*p == stat) {
+                        *p = stat->next;
+                        break;
+                }
+        }
+
+        pthread_mutex_unlock(&registry_lock);
+}
+
+void cu_stat_add(struct cu_stat *stat, int64_t delta)
+{
+        __atomic_fetch_add(&stat->value, delta, __ATOMIC_RELAXED);
+}
+
+void cu_stat_set(struct cu_stat *stat, int64_t value)
+{
+        __atomic_store_n(&stat->value, value, __ATOMIC_RELAXED);
+}
+
+int64_t cu_stat_get(const struct cu_stat *stat)
+{
+        return __atomic_load_n(&stat->value, __ATOMIC_RELAXED);
+}
+
+/*
+ * Output
+ */
+
+/* A stat copied out of the registry, so it is not written under lock */
+struct stat_copy {
+        const char *name;
+        const char *help;
+        enum cu_stat_type type;
+        const char *label_name;
+        const char *label_value;
+        int64_t value;
+};
+
+static int cmp_stat(const void *a, const void *b)
+{
+        const struct stat_copy *x = a;
+        const struct stat_copy *y = b;
+        int ret;
+
+        ret = strcmp(x->name, y->name);
+        if (ret != 0)
+                return ret;
+
+        return strcmp(x->label_value ? x->label_value : "",
+                      y->label_value ? y->label_value : "");
+}
+
+static int copy_registry(struct stat_copy **copies)
+{
+        struct cu_stat *stat;
+        int count = 0;
+        int i = 0;
+
+        pthread_mutex_lock(&registry_lock);
+
+        for (stat = registry; stat != NULL; stat = stat->next)
+                count++;
+
+        *copies = calloc(count + 1, sizeof(**copies));
+        if (*copies == NULL) {
+                pthread_mutex_unlock(&registry_lock);
+                return -1;
+        }
+
+        for (stat = registry; stat != NULL; stat = stat->next, i++) {
+                (*copies)[i].name = stat->name;
+                (*copies)[i].help = stat->help;
+                (*copies)[i].type = stat->type;
+                (*copies)[i].label_name = stat->label_name;
+                (*copies)[i].label_value = stat->label_value;
+                (*copies)[i].value = cu_stat_get(stat);
+        }
+
+        pthread_mutex_unlock(&registry_lock);
+
+        qsort(*copies, count, sizeof(**copies), cmp_stat);
+
+        return count;
+}
+
+/* Both formats escape \ " and newlines the same way */
+static void put_escaped(FILE *out, const char *str)
+{
+        for (; *str != '\0'; str++) {
+                if ((*str == '\\') || (*str == '"'))
+                        fprintf(out, "\\%c", *str);
+                else if (*str == '\n')
+                        fputs("\\n", out);
+                else
+                        fputc(*str, out);
+        }
+}
+
+static const char *type_name(enum cu_stat_type type)
+{
+        return type == CU_STAT_GAUGE ? "gauge" : "counter";
+}
+
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+#define NUM_QUANTILES (sizeof(quantiles) / sizeof(quantiles[0]))
+
+static void write_prometheus(FILE *out,
+                             const struct stat_copy *stats,
+                             int num_stats,
+                             const struct cu_histogram *hists,
+                             int num_hists)
+{
+        const struct stat_copy *st;
+        const struct cu_histogram *h;
+        unsigned int q;
+        int i;
+
+        for (i = 0; i < num_stats; i++) {
+                st = &stats[i];
+
+                if ((i == 0) || !STREQ(st->name, stats[i - 1].name)) {
+                        fprintf(out, "# HELP %s ", st->name);
+                        put_escaped(out, st->help);
+                        fprintf(out, "\n# TYPE %s %s\n",
+                                st->name, type_name(st->type));
+                }
+
+                fputs(st->name, out);
+                if (st->label_name != NULL) {
+                        fprintf(out, "{%s=\"", st->label_name);
+                        put_escaped(out, st->label_value);
+                        fputs("\"}", out);
+                }
+                fprintf(out, " %" PRId64 "\n", st->value);
+        }
+
+        if (num_hists <= 0)
+                return;
+
+        fprintf(out,
+                "# HELP cu_mi_latency_seconds Time spent in MI calls\n"
+                "# TYPE cu_mi_latency_seconds summary\n");
+
+        for (i = 0; i < num_hists; i++) {
+                h = &hists[i];
+
+                for (q = 0; q < NUM_QUANTILES; q++) {
+                        fputs("cu_mi_latency_seconds{mi=\"", out);
+                        put_escaped(out, h->mi_name);
+                        fputs("\",op=\"", out);
+                        put_escaped(out, h->op);
+                        fprintf(out, "\",quantile=\"%g\"} %.9f\n",
+                                quantiles[q],
+                                cu_histogram_percentile(h, quantiles[q] * 100)
+                                / 1e9);
+                }
+
+                fputs("cu_mi_latency_seconds_sum{mi=\"", out);
+                put_escaped(out, h->mi_name);
+                fputs("\",op=\"", out);
+                put_escaped(out, h->op);
+                fprintf(out, "\"} %.9f\n", h->total_ns / 1e9);
+
+                fputs("cu_mi_latency_seconds_count{mi=\"", out);
+                put_escaped(out, h->mi_name);
+                fputs("\",op=\"", out);
+                put_escaped(out, h->op);
+                fprintf(out, "\"} %" PRIu64 "\n", h->count);
+        }
+
+        fprintf(out,
+                "# HELP cu_mi_cpu_seconds Thread CPU time used by MI calls\n"
+                "# TYPE cu_mi_cpu_seconds summary\n");
+
+        for (i = 0; i < num_hists; i++) {
+                h = &hists[i];
+                if (h->cpu_count == 0)
+                        continue;
+
+                fputs("cu_mi_cpu_seconds_sum{mi=\"", out);
+                put_escaped(out, h->mi_name);
+                fputs("\",op=\"", out);
+                put_escaped(out, h->op);
+                fprintf(out, "\"} %.9f\n", h->cpu_ns / 1e9);
+
+                fputs("cu_mi_cpu_seconds_count{mi=\"", out);
+                put_escaped(out, h->mi_name);
+                fputs("\",op=\"", out);
+                put_escaped(out, h->op);
+                fprintf(out, "\"} %" PRIu64 "\n", h->cpu_count);
+        }
+}
+
+static void write_json(FILE *out,
+                       const struct stat_copy *stats,
+                       int num_stats,
+                       const struct cu_histogram *hists,
+                       int num_hists)
+{
+        const struct stat_copy *st;
+        const struct cu_histogram *h;
+        int i;
+
+        fprintf(out, "{\"pid\": %d, \"stats\": [", (int)getpid());
+
+        for (i = 0; i < num_stats; i++) {
+                st = &stats[i];
+
+                fprintf(out, "%s\n  {\"name\": \"", i ? "," : "");
+                put_escaped(out, st->name);
+                fprintf(out, "\", \"type\": \"%s\", ", type_name(st->type));
+                if (st->label_name != NULL) {
+                        fprintf(out, "\"labels\": {\"%s\": \"",
+                                st->label_name);
+                        put_escaped(out, st->label_value);
+                        fputs("\"}, ", out);
+                }
+                fprintf(out, "\"value\": %" PRId64 "}", st->value);
+        }
+
+        fprintf(out, "\n], \"latency\": [");
+
+        for (i = 0; i < num_hists; i++) {
+                h = &hists[i];
+
+                fprintf(out, "%s\n  {\"mi\": \"", i ? "," : "");
+                put_escaped(out, h->mi_name);
+                fputs("\", \"op\": \"", out);
+                put_escaped(out, h->op);
+                fprintf(out,
+                        "\", \"count\": %" PRIu64 ", \"sum_us\": %.3f, "
+                        "\"p50_us\": %.3f, \"p90_us\": %.3f, "
+                        "\"p99_us\": %.3f, \"p999_us\": %.3f, "
+                        "\"max_us\": %.3f, \"cpu_count\": %" PRIu64 ", "
+                        "\"cpu_sum_us\": %.3f}",
+                        h->count, h->total_ns / 1e3,
+                        cu_histogram_percentile(h, 50) / 1e3,
+                        cu_histogram_percentile(h, 90) / 1e3,
+                        cu_histogram_percentile(h, 99) / 1e3,
+                        cu_histogram_percentile(h, 99.9) / 1e3,
+                        h->max_ns / 1e3, h->cpu_count, h->cpu_ns / 1e3);
+        }
+
+        fprintf(out, "\n]}\n");
+}
+
+void cu_stats_write(FILE *out, enum cu_stats_format format)
+{
+        struct stat_copy *stats;
+        struct cu_histogram *hists = NULL;
+        int num_stats;
+        int num_hists;
+
+        num_stats = copy_registry(&stats);
+        if (num_stats < 0)
+                return;
+
+        num_hists = cu_histogram_snapshot(&hists, false);
+
+        if (format == CU_STATS_JSON)
+                write_json(out, stats, num_stats, hists, num_hists);
+        else
+                write_prometheus(out, stats, num_stats, hists, num_hists);
+
+        free(stats);
+        free(hists);
+}
+
+int cu_stats_write_file(const char *path, enum cu_stats_format format)
+{
+        char *tmp;
+        FILE *out;
+        int ret = -1;
+
+        if (asprintf(&tmp, "%s.%d.tmp", path, (int)getpid()) == -1)
+                return -1;
+
+        out = fopen(tmp, "w");
+        if (out == NULL)
+                goto out;
+
+        cu_stats_write(out, format);
+
+        if ((fclose(out) != 0) || (rename(tmp, path) != 0)) {
+                unlink(tmp);
+                goto out;
+        }
+
+        ret = 0;
+ out:
+        free(tmp);
+
+        return ret;
+}
+
+/*
+ * Export
+ */
+
+/*
+ * "log" reports the log levels and "log SPEC" changes them, as
+ * cu_log_set_levels() does.
+ */
+static void serve_log(FILE *out, const char *spec)
+{
+        char levels[256];
+
+        while (isspace((unsigned char)*spec))
+                spec++;
+
+        if ((*spec != '\0') && (cu_log_set_levels(spec) != 0)) {
+                fprintf(out, "invalid log levels\n");
+                return;
+        }
+
+        cu_log_get_levels(levels, sizeof(levels));
+        fprintf(out, "%s\n", levels);
+}
+
+static void serve_client(int fd)
+{
+        enum cu_stats_format format = CU_STATS_PROMETHEUS;
+        struct pollfd pfd = {fd, POLLIN, 0};
+        char req[256];
+        char *buf = NULL;
+        size_t len = 0;
+        size_t off;
+        ssize_t ret;
+        FILE *out;
+
+        req[0] = '\0';
+        if (poll(&pfd, 1, REQUEST_TIMEOUT_MS) == 1) {
+                ret = read(fd, req, sizeof(req) - 1);
+                if (ret > 0) {
+                        req[ret] = '\0';
+                        if (strncmp(req, "json", 4) == 0)
+                                format = CU_STATS_JSON;
+                }
+        }
+
+        /* Written in one go with MSG_NOSIGNAL, so a client that hangs
+         * up early cannot raise SIGPIPE in the CIMOM */
+        out = open_memstream(&buf, &len);
+        if (out == NULL)
+                return;
+
+        if ((strncmp(req, "log", 3) == 0) &&
+            ((req[3] == '\0') || isspace((unsigned char)req[3])))
+                serve_log(out, req + 3);
+        else
+                cu_stats_write(out, format);
+        fclose(out);
+
+        for (off = 0; off < len; off += ret) {
+                ret = send(fd, buf + off, len - off, MSG_NOSIGNAL);
+                if (ret <= 0)
+                        break;
+        }
+
+        free(buf);
+}
+
+static void *socket_thread(void *arg)
+{
+        int fd;
+
+        for (;;) {
+                fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+                if (__atomic_load_n(&export_stop, __ATOMIC_ACQUIRE)) {
+                        if (fd >= 0)
+                                close(fd);
+                        break;
+                }
+
+                if (fd < 0) {
+                        if ((errno == EINTR) || (errno == ECONNABORTED))
+                                continue;
+                        CU_DEBUG("Stats socket accept failed: %s",
+                                 strerror(errno));
+                        break;
+                }
+
+                serve_client(fd);
+                close(fd);
+        }
+
+        return NULL;
+}
+
+static void *file_thread(void *arg)
+{
+        struct timespec deadline;
+        bool stop = false;
+
+        while (!stop) {
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec += export_interval;
+
+                pthread_mutex_lock(&export_lock);
+                while (!export_stop &&
+                       (pthread_cond_timedwait(&export_cond, &export_lock,
+                                               &deadline) != ETIMEDOUT))
+                        ;
+                stop = export_stop;
+                pthread_mutex_unlock(&export_lock);
+
+                if (stop)
+                        break;
+
+                if (cu_stats_write_file(export_path, export_format) != 0)
+                        CU_DEBUG("Unable to write stats to %s: %s",
+                                 export_path, strerror(errno));
+        }
+
+        return NULL;
+}
+
+/*
+ * Stop the export thread, so that nothing else writes the file or uses
+ * the socket.  Waking accept() with shutdown() makes it return at once.
+ */
+static void export_stop_thread(void)
+{
+        if (!export_started)
+                return;
+
+        pthread_mutex_lock(&export_lock);
+        __atomic_store_n(&export_stop, true, __ATOMIC_RELEASE);
+        pthread_cond_signal(&export_cond);
+        pthread_mutex_unlock(&export_lock);
+
+        if (listen_fd >= 0)
+                shutdown(listen_fd, SHUT_RDWR);
+
+        pthread_join(export_thread, NULL);
+        export_started = false;
+
+        if (listen_fd >= 0) {
+                close(listen_fd);
+                listen_fd = -1;
+        }
+}
+
+/*
+ * The last write of the file, or the removal of the socket, once the
+ * thread has stopped.  Whether the exit handler or the destructor runs
+ * first depends on how the library was loaded, so both call this and
+ * the first one does it.
+ */
+static void export_finish(void)
+{
+        static bool finished = false;
+
+        if (__atomic_exchange_n(&finished, true, __ATOMIC_ACQ_REL))
+                return;
+
+        export_stop_thread();
+
+        if (export_socket)
+                unlink(export_path);
+        else
+                cu_stats_write_file(export_path, export_format);
+}
+
+static void export_at_exit(void)
+{
+        export_finish();
+}
+
+/*
+ * Only a socket of the CIMOM's user, left behind by an earlier run, is
+ * removed to make way for the new one
+ */
+static int remove_old_socket(const char *path)
+{
+        struct stat st;
+
+        if (lstat(path, &st) != 0)
+                return (errno == ENOENT) ? 0 : -1;
+
+        if (!S_ISSOCK(st.st_mode) || (st.st_uid != geteuid())) {
+                errno = EEXIST;
+                return -1;
+        }
+
+        return unlink(path);
+}
+
+static int open_socket(const char *path)
+{
+        struct sockaddr_un addr;
+        int fd;
+
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, path);
+
+        if (remove_old_socket(path) != 0)
+                return -1;
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return -1;
+
+        /* Only the CIMOM's user may read the stats or set log levels,
+         * and nobody can connect before listen() */
+        if ((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+            (chmod(path, 0600) != 0) ||
+            (listen(fd, 4) != 0)) {
+                close(fd);
+                return -1;
+        }
+
+        return fd;
+}
+
+/* Copy path, replacing each %p with the process ID */
+static char *expand_path(const char *path)
+{
+        char pid[16];
+        char *ret;
+        char *p;
+        size_t len;
+
+        snprintf(pid, sizeof(pid), "%d", (int)getpid());
+
+        ret = malloc(strlen(path) * (strlen(pid) + 1) + 1);
+        if (ret == NULL)
+                return NULL;
+
+        for (p = ret; *path != '\0'; path++) {
+                if ((path[0] == '%') && (path[1] == 'p')) {
+                        len = strlen(pid);
+                        memcpy(p, pid, len);
+                        p += len;
+                        path++;
+                } else {
+                        *p++ = *path;
+                }
+        }
+
+        *p = '\0';
+
+        return ret;
+}
+
+static void stats_init(void) __attribute__((constructor));
+static void stats_init(void)
+{
+        void *(*fn)(void *) = file_thread;
+        const char *val;
+        const char *path;
+        size_t len;
+
+        val = getenv("CU_STATS");
+        if ((val == NULL) || (*val == '\0'))
+                return;
+
+        path = (strncmp(val, "unix:", 5) == 0) ? val + 5 : val;
+
+        export_path = expand_path(path);
+        if (export_path == NULL)
+                return;
+
+        if (path != val) {
+                listen_fd = open_socket(export_path);
+                if (listen_fd < 0) {
+                        CU_DEBUG("Unable to listen on %s: %s",
+                                 export_path, strerror(errno));
+                        return;
+                }
+                fn = socket_thread;
+                export_socket = true;
+        } else {
+                len = strlen(export_path);
+                if ((len > 5) && STREQ(export_path + len - 5, ".json"))
+                        export_format = CU_STATS_JSON;
+
+                val = getenv("CU_STATS_INTERVAL");
+                if ((val != NULL) && (atoi(val) > 0))
+                        export_interval = atoi(val);
+        }
+
+        if (pthread_create(&export_thread, NULL, fn, NULL) != 0) {
+                CU_DEBUG("Unable to start the stats thread");
+                return;
+        }
+
+        export_started = true;
+        atexit(export_at_exit);
+}
+
+/* Stop the export thread before the library's code goes away */
+static void stats_cleanup(void) __attribute__((destructor));
+static void stats_cleanup(void)
+{
+        if (export_started)
+                export_finish();
+}
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -20,9 +20,20 @@
  * License along with this library; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
+#define CU_LOG_CATEGORY CU_LOG_ASSOC
+
 #include <string.h>
 
 #include "libcmpiutil.h"
+#include "cu_upcall.h"
+#include "cu_record.h"
+#include "cu_histogram.h"
+#include "cu_stats.h"
+#include "cu_probes.h"
+#include "cu_trace.h"
+#include "cu_watchdog.h"
+#include "cu_arena.h"
+#include "cu_flight.h"
 
 #include "std_association.h"
 
@@ -37,18 +48,34 @@ void set_reference(struct std_assoc *assoc,
                    const CMPIObjectPath *source,
                    const CMPIObjectPath *target)
 {
+        CU_UPCALL_SITE();
+
         CMSetProperty(inst, assoc->source_prop,
                       (CMPIValue *)&source, CMPI_ref);
         CMSetProperty(inst, assoc->target_prop,
                       (CMPIValue *)&target, CMPI_ref);
 }
 
+static bool class_path_is_a(const CMPIBroker *broker,
+                            const CMPIObjectPath *op,
+                            const char *type)
+{
+        bool ret;
+
+        ret = CMClassPathIsA(broker, op, type, NULL);
+        cu_record_is_a(op, type, ret);
+
+        return ret;
+}
+
 static bool match_op(const CMPIBroker *broker,
                      CMPIObjectPath *op,
                      const char *filter_class)
 {
+        CU_UPCALL_SITE();
+
         if ((filter_class == NULL) ||
-            CMClassPathIsA(broker, op, filter_class, NULL))
+            class_path_is_a(broker, op, filter_class))
                 return true;
         else
                 return false;
@@ -62,6 +89,7 @@ static bool match_class(const CMPIBroker *broker,
         CMPIObjectPath *rop;
         char *comp_class;
         int i;
+        CU_UPCALL_SITE();
 
         if (test_class == NULL)
                 return true;
@@ -73,7 +101,7 @@ static bool match_class(const CMPIBroker *broker,
                 comp_class = comp_class_list[i];
                 rop = CMNewObjectPath(broker, ns, comp_class, NULL);
 
-                if (CMClassPathIsA(broker, rop, test_class, NULL))
+                if (class_path_is_a(broker, rop, test_class))
                         return true;
         }
 
@@ -86,20 +114,35 @@ static bool match_source_class(const CMPIBroker *broker,
 {
         char *source_class;
         int i;
+        CU_UPCALL_SITE();
 
         for (i = 0; ptr->source_class[i]; i++) {
                 source_class = ptr->source_class[i];
 
-                if (CMClassPathIsA(broker,
-                                   ref,
-                                   source_class,
-                                   NULL))
+                if (class_path_is_a(broker, ref, source_class))
                         return true;
         }
 
         return false;
 }
 
+/* Get the path of a result, in the namespace of the request */
+static CMPIStatus result_path(CMPIInstance *inst,
+                              const char *ns,
+                              CMPIObjectPath **op)
+{
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+        CU_UPCALL_SITE();
+
+        *op = CMGetObjectPath(inst, &s);
+        if ((s.rc != CMPI_RC_OK) || CMIsNullObject(*op)) {
+                *op = NULL;
+                return s;
+        }
+
+        return CMSetNameSpace(*op, ns);
+}
+
 static CMPIStatus filter_results(struct inst_list *list,
                                  const char *ns,
                                  const char *filter_class,
@@ -111,15 +154,13 @@ static CMPIStatus filter_results(struct inst_list *list,
         int i;
 
         tmp_list = *list;
-        inst_list_init(list);
 
-        for (i = 0; tmp_list.list[i] != NULL; i++) {
-                op = CMGetObjectPath(tmp_list.list[i], &s);
-                if ((s.rc != CMPI_RC_OK) || CMIsNullObject(op))
-                          goto out;
+        /* If this fails, adding grows the list as usual */
+        inst_list_init_tmp(list, tmp_list.cur);
 
-                s = CMSetNameSpace(op, ns);
-                if (s.rc != CMPI_RC_OK)
+        for (i = 0; tmp_list.list[i] != NULL; i++) {
+                s = result_path(tmp_list.list[i], ns, &op);
+                if ((s.rc != CMPI_RC_OK) || (op == NULL))
                           goto out;
 
                 if (!match_op(broker, op, filter_class))
@@ -142,6 +183,7 @@ std_assoc_get_handler(const struct std_assoc_ctx *ctx,
         struct std_assoc *ptr = NULL;
         int i;
         bool rc;
+        CU_UPCALL_SITE();
 
         CU_DEBUG("Calling Provider: '%s'",
                  info->provider_name);
@@ -150,7 +192,7 @@ std_assoc_get_handler(const struct std_assoc_ctx *ctx,
                 ptr = ctx->handlers[i];
 
                 if (!match_source_class(ctx->brkr, ref, ptr)) {
-                        CU_DEBUG("Source class doesn't match");
+                        CU_LOG(CU_LOG_TRACE, "Source class doesn't match");
                         continue;
                 }
 
@@ -160,8 +202,8 @@ std_assoc_get_handler(const struct std_assoc_ctx *ctx,
                 }
 
                 if (info->assoc_class) {
-                        CU_DEBUG("Check client's assocClass: '%s'",
-                                 info->assoc_class);
+                        CU_LOG(CU_LOG_TRACE, "Check client's assocClass: '%s'",
+                                             info->assoc_class);
 
                         rc = match_class(ctx->brkr,
                                          NAMESPACE(ref),
@@ -172,12 +214,12 @@ std_assoc_get_handler(const struct std_assoc_ctx *ctx,
                                 CU_DEBUG("AssocClass not valid.");
                                 continue;
                         }
-                        CU_DEBUG("AssocClass valid.");
+                        CU_LOG(CU_LOG_TRACE, "AssocClass valid.");
                 }
 
                 if (info->result_class) {
-                        CU_DEBUG("Check client's resultClass: '%s'",
-                                 info->result_class);
+                        CU_LOG(CU_LOG_TRACE, "Check client's resultClass: '%s'",
+                                             info->result_class);
 
                         rc = match_class(ctx->brkr,
                                          NAMESPACE(ref),
@@ -188,29 +230,29 @@ std_assoc_get_handler(const struct std_assoc_ctx *ctx,
                                 CU_DEBUG("ResultClass not valid.");
                                 continue;
                         }
-                        CU_DEBUG("ResultClass valid.");
+                        CU_LOG(CU_LOG_TRACE, "ResultClass valid.");
                 }
 
                 if (info->role) {
-                        CU_DEBUG("Check client's role: '%s'",
-                                 info->role);
+                        CU_LOG(CU_LOG_TRACE, "Check client's role: '%s'",
+                                             info->role);
 
                         if (!STREQC(info->role, ptr->source_prop)) {
                                 CU_DEBUG("Invalid role");
                                 continue;
                         }
-                        CU_DEBUG("Role valid.");
+                        CU_LOG(CU_LOG_TRACE, "Role valid.");
                 }
 
                 if (info->result_role) {
-                        CU_DEBUG("Check client's resultRole: '%s'",
-                                 info->result_role);
+                        CU_LOG(CU_LOG_TRACE, "Check client's resultRole: '%s'",
+                                             info->result_role);
 
                         if (!STREQC(info->result_role, ptr->target_prop)) {
                                 CU_DEBUG("ResultRole not valid.");
                                 continue;
                         }
-                        CU_DEBUG("ResultRole valid.");
+                        CU_LOG(CU_LOG_TRACE, "ResultRole valid.");
                 }
 
                 goto out;
@@ -230,13 +272,18 @@ static CMPIStatus prepare_ref_return_list(struct std_assoc *handler,
 {
         CMPIStatus s = {CMPI_RC_OK, NULL};
         struct inst_list tmp_list;
+        struct cu_span span;
         int i;
+        CU_UPCALL_SITE();
 
         tmp_list = *list;
         if (tmp_list.list == NULL)
                 return s;
 
-        inst_list_init(list);
+        cu_span_begin(&span, "make_ref");
+        cu_span_int(&span, "in", tmp_list.cur);
+
+        inst_list_init_tmp(list, tmp_list.cur);
 
         for (i = 0; i < tmp_list.cur; i++) {
                 CMPIInstance *refinst;
@@ -249,6 +296,10 @@ static CMPIStatus prepare_ref_return_list(struct std_assoc *handler,
         }
 
         inst_list_free(&tmp_list);
+
+        cu_span_int(&span, "out", list->cur);
+        cu_span_end(&span);
+
         return s;
 }
 
@@ -258,15 +309,25 @@ static CMPIStatus prepare_assoc_return_list(const CMPIBroker *broker,
                                             struct inst_list *list)
 {
         CMPIStatus s = {CMPI_RC_OK, NULL};
+        struct cu_span span;
+        CU_UPCALL_SITE();
 
         if (list->list == NULL)
                 return s;
 
+        cu_span_begin(&span, "filter_results");
+        cu_span_str(&span, "resultClass", info->result_class);
+        cu_span_int(&span, "in", list->cur);
+
         s = filter_results(list,
                            NAMESPACE(ref),
                            info->result_class,
                            broker);
 
+        cu_span_int(&span, "out", list->cur);
+        cu_span_int(&span, "rc", s.rc);
+        cu_span_end(&span);
+
         if (s.rc != CMPI_RC_OK) {
                 CU_DEBUG("filter_results did not return CMPI_RC_OK.");
                 return s;
@@ -275,6 +336,93 @@ static CMPIStatus prepare_assoc_return_list(const CMPIBroker *broker,
         return s;
 }
 
+CMPIStatus stda_stream_handler(const CMPIObjectPath *ref,
+                               struct std_assoc_info *info,
+                               struct inst_list *list)
+{
+        CMPIStatus s = {CMPI_RC_ERR_FAILED, NULL};
+
+        return s;
+}
+
+/* The stream_handler of a std_assoc_stream, or NULL for a std_assoc */
+static assoc_stream_handler_t stream_handler(struct std_assoc *assoc)
+{
+        struct std_assoc_stream *stream;
+
+        if (assoc->handler != stda_stream_handler)
+                return NULL;
+
+        stream = (struct std_assoc_stream *)assoc;
+
+        return stream->stream_handler;
+}
+
+/* What the stages of a stream_handler's sink need to know */
+struct stream_ctx {
+        const CMPIBroker *broker;
+        struct std_assoc *handler;
+        struct std_assoc_info *info;
+        const CMPIObjectPath *ref;
+        const char *ns;
+};
+
+/* filter_results, one instance at a time */
+static CMPIStatus assoc_stage_emit(struct cu_result_sink *sink,
+                                   CMPIInstance *inst)
+{
+        struct stream_ctx *sctx = sink->data;
+        CMPIStatus s;
+        CMPIObjectPath *op;
+
+        s = result_path(inst, sctx->ns, &op);
+        if ((s.rc != CMPI_RC_OK) || (op == NULL))
+                return s;
+
+        if (!match_op(sctx->broker, op, sctx->info->result_class))
+                return s;
+
+        return cu_sink_emit(sink->next, inst);
+}
+
+/* prepare_ref_return_list, one instance at a time */
+static CMPIStatus ref_stage_emit(struct cu_result_sink *sink,
+                                 CMPIInstance *inst)
+{
+        struct stream_ctx *sctx = sink->data;
+        CMPIStatus s = {CMPI_RC_OK, NULL};
+        CMPIInstance *refinst;
+        CU_UPCALL_SITE();
+
+        refinst = sctx->handler->make_ref(sctx->ref, inst,
+                                          sctx->info, sctx->handler);
+        if (refinst == NULL)
+                return s;
+
+        return cu_sink_emit(sink->next, refinst);
+}
+
+/* Send a stream_handler's results through its stage to the broker */
+static struct cu_result_sink *stream_sink(struct stream_ctx *sctx,
+                                          struct cu_result_sink *stage,
+                                          struct cu_result_sink *ret,
+                                          const CMPIResult *results,
+                                          bool ref_rslt,
+                                          bool names_only)
+{
+        if (names_only)
+                cu_sink_init_names(ret, results);
+        else
+                cu_sink_init_instances(ret, results);
+
+        memset(stage, 0, sizeof(*stage));
+        stage->emit = ref_rslt ? ref_stage_emit : assoc_stage_emit;
+        stage->next = ret;
+        stage->data = sctx;
+
+        return stage;
+}
+
 static bool do_generic_assoc_call(struct std_assoc_info *info,
                                   struct std_assoc *handler)
 {
@@ -292,10 +440,93 @@ static bool do_generic_assoc_call(struct std_assoc_info *info,
         return true;
 }
 
+static const char *assoc_op(bool ref_rslt, bool names_only)
+{
+        if (ref_rslt)
+                return names_only ? "ReferenceNames" : "References";
+        else
+                return names_only ? "AssociatorNames" : "Associators";
+}
+
+/* The histogram of the handler calls made for an operation */
+static const char *handler_op(bool ref_rslt, bool names_only)
+{
+        if (ref_rslt)
+                return names_only ?
+                        "ReferenceNames handler" : "References handler";
+        else
+                return names_only ?
+                        "AssociatorNames handler" : "Associators handler";
+}
+
+CU_PROBE_DEFINE(assoc__entry);
+CU_PROBE_DEFINE(assoc__return);
+CU_PROBE_DEFINE(assoc__handler__entry);
+CU_PROBE_DEFINE(assoc__handler__return);
+
+static CU_STAT(handler_stat, CU_STAT_COUNTER,
+               "cu_assoc_handler_calls_total",
+               "Calls made to association handlers");
+static CU_STAT(handler_err_stat, CU_STAT_COUNTER,
+               "cu_assoc_handler_errors_total",
+               "Association handler calls that did not return CMPI_RC_OK");
+
+static CMPIStatus call_handler(struct std_assoc_info *info,
+                               const CMPIObjectPath *ref,
+                               struct std_assoc *handler,
+                               struct inst_list *list,
+                               struct cu_result_sink *sink,
+                               const char *op)
+{
+        CMPIStatus s;
+        struct cu_span span;
+        struct cu_histogram_timer timer;
+        struct cu_watch *watch;
+        unsigned long count;
+
+        CU_LOG(CU_LOG_TRACE, "Calling handler ...");
+        CU_PROBE3(assoc__handler__entry,
+                  info->provider_name, info->assoc_class, CLASSNAME(ref));
+
+        cu_span_begin(&span, "handler");
+        cu_span_str(&span, "assocClass", info->assoc_class);
+
+        timer = cu_histogram_timer_start();
+        watch = cu_watch_begin(info->provider_name, op, ref);
+
+        if (sink != NULL)
+                s = stream_handler(handler)(ref, info, sink);
+        else
+                s = handler->handler(ref, info, list);
+
+        cu_watch_end(watch);
+        cu_histogram_timer_end(&timer, info->provider_name, op);
+        cu_flight_dump_failed(s.rc, "association handler failed");
+
+        count = (sink != NULL) ? sink->count : list->cur;
+
+        cu_span_int(&span, "rc", s.rc);
+        cu_span_int(&span, "count", count);
+        cu_span_end(&span);
+
+        CU_PROBE4(assoc__handler__return,
+                  info->provider_name, info->assoc_class, s.rc, count);
+
+        cu_stat_add(&handler_stat, 1);
+        if (s.rc != CMPI_RC_OK) {
+                cu_stat_add(&handler_err_stat, 1);
+                CU_DEBUG("Handler did not return CMPI_RC_OK.");
+        }
+
+        return s;
+}
+
 static CMPIStatus handle_assoc(struct std_assoc_info *info,
                                const CMPIObjectPath *ref,
                                struct std_assoc *handler,
-                               struct inst_list *list)
+                               struct inst_list *list,
+                               struct cu_result_sink *sink,
+                               const char *op)
 {
         CMPIStatus s = {CMPI_RC_OK, NULL};
         int i;
@@ -304,22 +535,17 @@ static CMPIStatus handle_assoc(struct std_assoc_info *info,
                 for (i = 0; handler->assoc_class[i]; i++) {
                         info->assoc_class = handler->assoc_class[i];
 
-                        CU_DEBUG("Calling handler ...");
-                        s = handler->handler(ref, info, list);
-                        if (s.rc != CMPI_RC_OK) {
-                                CU_DEBUG("Handler did not return CMPI_RC_OK.");
+                        s = call_handler(info, ref, handler,
+                                         list, sink, op);
+                        if (s.rc != CMPI_RC_OK)
                                 goto out;
-                        }
                 }
         } else {
-                CU_DEBUG("Calling handler ...");
-                s = handler->handler(ref, info, list);
-                if (s.rc != CMPI_RC_OK) {
-                        CU_DEBUG("Handler did not return CMPI_RC_OK.");
+                s = call_handler(info, ref, handler, list, sink, op);
+                if (s.rc != CMPI_RC_OK)
                         goto out;
-                }
         }
-        CU_DEBUG("Handler returned CMPI_RC_OK.");
+        CU_LOG(CU_LOG_TRACE, "Handler returned CMPI_RC_OK.");
 
  out:
         return s;
@@ -335,36 +561,92 @@ static CMPIStatus do_assoc(struct std_assoc_ctx *ctx,
         CMPIStatus s = {CMPI_RC_OK, NULL};
         struct inst_list list;
         struct std_assoc *handler;
+        struct cu_result_sink *sink = NULL;
+        struct cu_result_sink stage;
+        struct cu_result_sink ret;
+        struct stream_ctx sctx;
+        struct cu_arena arena;
+        struct cu_span span;
+        struct cu_span phase;
+        unsigned long count;
+        bool multi;
         int i;
 
-        CU_DEBUG("Getting handler ...");
+        CU_PROBE4(assoc__entry, info->provider_name, CLASSNAME(ref),
+                  info->assoc_class, info->result_class);
+
+        cu_span_begin(&span, assoc_op(ref_rslt, names_only));
+        cu_span_str(&span, "mi", info->provider_name);
+        if (cu_trace_enabled())
+                cu_span_str(&span, "class", CLASSNAME(ref));
+        cu_span_str(&span, "assocClass", info->assoc_class);
+        cu_span_str(&span, "resultClass", info->result_class);
+
+        cu_arena_begin(&arena);
+        inst_list_init_tmp(&list, 0);
+
+        CU_LOG(CU_LOG_TRACE, "Getting handler ...");
+        cu_span_begin(&phase, "handler lookup");
         handler = std_assoc_get_handler(ctx, info, ref);
+        cu_span_int(&phase, "found", handler != NULL);
+        cu_span_end(&phase);
+
         if (handler == NULL) {
                 CU_DEBUG("No handler found.");
-                return s;
+                goto out;
         }
-        CU_DEBUG("Getting handler succeeded.");
+        CU_LOG(CU_LOG_TRACE, "Getting handler succeeded.");
 
-        inst_list_init(&list);
+        if (stream_handler(handler) != NULL) {
+                sctx.broker = ctx->brkr;
+                sctx.handler = handler;
+                sctx.info = info;
+                sctx.ref = ref;
+                sctx.ns = NAMESPACE(ref);
+
+                sink = stream_sink(&sctx, &stage, &ret,
+                                   results, ref_rslt, names_only);
+        }
+
+        multi = do_generic_assoc_call(info, handler) &&
+                (handler->assoc_class[0] != NULL) &&
+                (handler->assoc_class[1] != NULL);
 
         if (do_generic_assoc_call(info, handler)) {
                 for (i = 0; handler->assoc_class[i]; i++) {
                         info->assoc_class = handler->assoc_class[i];
 
-                        s = handle_assoc(info, ref, handler, &list);
+                        s = handle_assoc(info, ref, handler, &list, sink,
+                                         handler_op(ref_rslt, names_only));
                         if (s.rc != CMPI_RC_OK) {
                                 CU_DEBUG("Failed to handle association");
                                 goto out;
                         }
                 }
         } else {
-                s = handle_assoc(info, ref, handler, &list);
+                s = handle_assoc(info, ref, handler, &list, sink,
+                                 handler_op(ref_rslt, names_only));
                 if (s.rc != CMPI_RC_OK) {
                         CU_DEBUG("Failed to handle association");
                         goto out;
                 }
         }
 
+        /* A handler run for each assocClass can find a target twice */
+        if (multi && (list.cur > 1)) {
+                cu_span_begin(&phase, "dedup");
+                cu_span_int(&phase, "in", list.cur);
+                inst_list_dedup(&list);
+                cu_span_int(&phase, "out", list.cur);
+                cu_span_end(&phase);
+        }
+
+        /* The results went to the broker as the handler emitted them */
+        if (sink != NULL) {
+                CU_DEBUG("Returned %lu instance(s).", ret.count);
+                goto out;
+        }
+
         /* References and ReferenceNames */
         if (ref_rslt)
                 s = prepare_ref_return_list(handler,
@@ -385,13 +667,28 @@ static CMPIStatus do_assoc(struct std_assoc_ctx *ctx,
 
         CU_DEBUG("Returned %u instance(s).", list.cur);
 
+        cu_span_begin(&phase, "return");
+        cu_span_int(&phase, "count", list.cur);
+
         if (names_only)
                 cu_return_instance_names(results, &list);
         else
                 cu_return_instances(results, &list);
 
+        cu_span_end(&phase);
+
  out:
+        count = (sink != NULL) ? ret.count : list.cur;
+
+        CU_PROBE4(assoc__return,
+                  info->provider_name, CLASSNAME(ref), s.rc, count);
+
+        cu_span_int(&span, "rc", s.rc);
+        cu_span_int(&span, "count", count);
+        cu_span_end(&span);
+
         inst_list_free(&list);
+        cu_arena_end(&arena);
 
         return s;
 }
@@ -420,13 +717,24 @@ CMPIStatus stda_AssociatorNames(CMPIAssociationMI *self,
                 context,
                 self->ft->miName,
         };
+        CMPIStatus s;
+        uint64_t start = cu_record_start();
+        struct cu_histogram_timer timer = cu_histogram_timer_start();
 
-        return do_assoc(self->hdl,
-                        &info,
-                        results,
-                        reference,
-                        false,
-                        true);
+        s = do_assoc(self->hdl,
+                     &info,
+                     results,
+                     reference,
+                     false,
+                     true);
+
+        cu_histogram_timer_end(&timer, self->ft->miName, "AssociatorNames");
+
+        cu_record_assoc(start, "AssociatorNames", self->ft->miName, s,
+                        reference, assocClass, resultClass,
+                        role, resultRole, NULL);
+
+        return s;
 }
 
 CMPIStatus stda_Associators(CMPIAssociationMI *self,
@@ -448,13 +756,24 @@ CMPIStatus stda_Associators(CMPIAssociationMI *self,
                 context,
                 self->ft->miName,
         };
+        CMPIStatus s;
+        uint64_t start = cu_record_start();
+        struct cu_histogram_timer timer = cu_histogram_timer_start();
 
-        return do_assoc(self->hdl,
-                        &info,
-                        results,
-                        reference,
-                        false,
-                        false);
+        s = do_assoc(self->hdl,
+                     &info,
+                     results,
+                     reference,
+                     false,
+                     false);
+
+        cu_histogram_timer_end(&timer, self->ft->miName, "Associators");
+
+        cu_record_assoc(start, "Associators", self->ft->miName, s,
+                        reference, assocClass, resultClass,
+                        role, resultRole, properties);
+
+        return s;
 }
 
 CMPIStatus stda_ReferenceNames(CMPIAssociationMI *self,
@@ -473,13 +792,23 @@ CMPIStatus stda_ReferenceNames(CMPIAssociationMI *self,
                 context,
                 self->ft->miName,
         };
+        CMPIStatus s;
+        uint64_t start = cu_record_start();
+        struct cu_histogram_timer timer = cu_histogram_timer_start();
 
-        return do_assoc(self->hdl,
-                        &info,
-                        results,
-                        reference,
-                        true,
-                        true);
+        s = do_assoc(self->hdl,
+                     &info,
+                     results,
+                     reference,
+                     true,
+                     true);
+
+        cu_histogram_timer_end(&timer, self->ft->miName, "ReferenceNames");
+
+        cu_record_references(start, "ReferenceNames", self->ft->miName, s,
+                             reference, resultClass, role, NULL);
+
+        return s;
 }
 
 CMPIStatus stda_References(CMPIAssociationMI *self,
@@ -499,13 +828,23 @@ CMPIStatus stda_References(CMPIAssociationMI *self,
                 context,
                 self->ft->miName,
         };
+        CMPIStatus s;
+        uint64_t start = cu_record_start();
+        struct cu_histogram_timer timer = cu_histogram_timer_start();
 
-        return do_assoc(self->hdl,
-                        &info,
-                        results,
-                        reference,
-                        true,
-                        false);
+        s = do_assoc(self->hdl,
+                     &info,
+                     results,
+                     reference,
+                     true,
+                     false);
+
+        cu_histogram_timer_end(&timer, self->ft->miName, "References");
+
+        cu_record_references(start, "References", self->ft->miName, s,
+                             reference, resultClass, role, properties);
+
+        return s;
 }
 
 /*
@@ -25,6 +25,9 @@
 #include <cmpidt.h>
 #include <cmpift.h>
 
+#include "cu_upcall.h"
+#include "cu_sink.h"
+
 struct std_assoc;
 struct std_assoc_info;
 
@@ -32,6 +35,10 @@ typedef CMPIStatus (*assoc_handler_t)(const CMPIObjectPath *ref,
                                       struct std_assoc_info *info,
                                       struct inst_list *list);
 
+typedef CMPIStatus (*assoc_stream_handler_t)(const CMPIObjectPath *ref,
+                                             struct std_assoc_info *info,
+                                             struct cu_result_sink *sink);
+
 typedef CMPIInstance *(*make_ref_t)(const CMPIObjectPath *ref,
                                     const CMPIInstance *inst,
                                     struct std_assoc_info *info,
@@ -83,6 +90,31 @@ struct std_assoc {
         make_ref_t make_ref;
 };
 
+/*
+ * std_assoc_stream is a std_assoc whose handler emits the target
+ * instances into sink as it finds them instead of adding them to a
+ * list.  The sink filters them by resultClass (or turns them into
+ * association instances with make_ref) and returns them to the broker
+ * straight away, so they are never all held at once.  If the handler
+ * fails, the client may already have received some of them.
+ * Set assoc.handler to stda_stream_handler, and put &stream.assoc in
+ * the list of handlers registered with STDA_AssocMIStub.
+ */
+struct std_assoc_stream {
+        struct std_assoc assoc;
+        assoc_stream_handler_t stream_handler;
+};
+
+/**
+ * Marks the std_assoc of a std_assoc_stream.  The library calls the
+ * stream_handler instead, so this is never called by it.
+ *
+ * @returns CMPI_RC_ERR_FAILED
+ */
+CMPIStatus stda_stream_handler(const CMPIObjectPath *ref,
+                               struct std_assoc_info *info,
+                               struct inst_list *list);
+
 /*
  * The std_assoc_info is used to hold the query components of the query done
  * All members of this structure contain the corresonding formal CIM association
@@ -169,11 +201,11 @@ CMPIStatus stda_References(CMPIAssociationMI *self,
         {                                                               \
                 static CMPIAssociationMI mi;                            \
                 static struct std_assoc_ctx _ctx;                       \
-                _ctx.brkr = brkr;                                       \
+                _ctx.brkr = cu_upcall_broker(brkr);                     \
                 _ctx.handlers = (struct std_assoc **)funcs;             \
                 mi.hdl = (void *)&_ctx;                                 \
                 mi.ft = &pn##assocMIFT__;                               \
-                _broker = brkr;                                         \
+                _broker = _ctx.brkr;                                    \
                 hook;                                                   \
                 return &mi;                                             \
         }                                                               \
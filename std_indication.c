@@ -18,22 +18,136 @@
  * License along with this library; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
+#define CU_LOG_CATEGORY CU_LOG_INDICATION
+
 #include <string.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "libcmpiutil.h"
+#include "cu_upcall.h"
+#include "cu_record.h"
+#include "cu_histogram.h"
+#include "cu_stats.h"
+#include "cu_probes.h"
+#include "cu_mem.h"
+#include "cu_arena.h"
+#include "cu_flight.h"
 
 #define STREQ(a, b) (strcmp(a, b) == 0)
 #define STREQC(a, b) (strcasecmp(a, b) == 0)
 
 #include "std_indication.h"
 
+CU_PROBE_DEFINE(indication__raise);
+CU_PROBE_DEFINE(indication__deliver);
+
+static CU_STAT(delivered_stat, CU_STAT_COUNTER,
+               "cu_indications_delivered_total",
+               "Indications handed to the CIMOM for delivery");
+static CU_STAT_LABELED(disabled_stat, CU_STAT_COUNTER,
+                       "cu_indications_dropped_total", "reason", "disabled",
+                       "Indications not delivered");
+static CU_STAT_LABELED(failed_stat, CU_STAT_COUNTER,
+                       "cu_indications_dropped_total", "reason", "error",
+                       "Indications not delivered");
+static CU_STAT(filters_stat, CU_STAT_GAUGE,
+               "cu_indication_filters_active",
+               "Indication filters currently activated");
+
+static void count_delivery(bool enabled, CMPIStatus s)
+{
+        if (!enabled)
+                cu_stat_add(&disabled_stat, 1);
+        else if (s.rc != CMPI_RC_OK)
+                cu_stat_add(&failed_stat, 1);
+        else
+                cu_stat_add(&delivered_stat, 1);
+}
+
+/*
+ * The ind_args made by stdi_new_ind_args() and not yet freed, so that
+ * stdi_free_ind_args() can tell them from ones a provider allocated.
+ * A provider has a handful at most.
+ */
+struct counted_args {
+        struct ind_args args;
+        struct counted_args *next;
+};
+
+static struct counted_args *counted = NULL;
+static pthread_mutex_t counted_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct ind_args *stdi_new_ind_args(struct std_indication_ctx *ctx,
+                                   CMPIContext *context,
+                                   const char *ns,
+                                   const char *classname)
+{
+        struct counted_args *ca;
+
+        ca = cu_mem_alloc(CU_MEM_INDICATION, sizeof(*ca));
+        if (ca == NULL)
+                return NULL;
+
+        ca->args.context = context;
+        ca->args._ctx = ctx;
+        ca->args.ns = NULL;
+        ca->args.classname = NULL;
+
+        if (ns != NULL)
+                ca->args.ns = cu_mem_strdup(CU_MEM_INDICATION, ns);
+        if (classname != NULL)
+                ca->args.classname = cu_mem_strdup(CU_MEM_INDICATION,
+                                                   classname);
+
+        if (((ns != NULL) && (ca->args.ns == NULL)) ||
+            ((classname != NULL) && (ca->args.classname == NULL))) {
+                cu_mem_free(CU_MEM_INDICATION, ca->args.ns);
+                cu_mem_free(CU_MEM_INDICATION, ca->args.classname);
+                cu_mem_free(CU_MEM_INDICATION, ca);
+                return NULL;
+        }
+
+        pthread_mutex_lock(&counted_lock);
+        ca->next = counted;
+        counted = ca;
+        pthread_mutex_unlock(&counted_lock);
+
+        return &ca->args;
+}
+
+static bool uncount_args(struct ind_args *args)
+{
+        struct counted_args **ca;
+        bool found = false;
+
+        pthread_mutex_lock(&counted_lock);
+
+        for (ca = &counted; *ca != NULL; ca = &(*ca)->next) {
+                if (&(*ca)->args == args) {
+                        *ca = (*ca)->next;
+                        found = true;
+                        break;
+                }
+        }
+
+        pthread_mutex_unlock(&counted_lock);
+
+        return found;
+}
+
 void stdi_free_ind_args (struct ind_args **args)
 {
-        free((*args)->ns);
-        free((*args)->classname);
-        free(*args);
+        if (uncount_args(*args)) {
+                cu_mem_free(CU_MEM_INDICATION, (*args)->ns);
+                cu_mem_free(CU_MEM_INDICATION, (*args)->classname);
+                cu_mem_free(CU_MEM_INDICATION, *args);
+        } else {
+                free((*args)->ns);
+                free((*args)->classname);
+                free(*args);
+        }
         *args = NULL;
 }
 
@@ -62,6 +176,7 @@ static bool is_ind_enabled(struct std_indication_ctx *ctx,
 {
         bool ret = false;
         struct std_ind_filter *filter;
+        CU_UPCALL_SITE();
 
         if (!ctx->enabled) {
                 CU_DEBUG("Indications disabled for this provider");
@@ -87,10 +202,15 @@ static bool is_ind_enabled(struct std_indication_ctx *ctx,
 static CMPIStatus trigger(struct std_indication_ctx *ctx,
                           const CMPIContext *context)
 {
+        CMPIStatus s;
+
         if (ctx->handler == NULL || ctx->handler->trigger_fn == NULL)
                 return (CMPIStatus){CMPI_RC_OK, NULL};
 
-        return ctx->handler->trigger_fn(context);
+        s = ctx->handler->trigger_fn(context);
+        cu_flight_dump_failed(s.rc, "trigger handler failed");
+
+        return s;
 }
 
 static CMPIStatus default_raise(const CMPIBroker *broker,
@@ -99,6 +219,7 @@ static CMPIStatus default_raise(const CMPIBroker *broker,
                                 CMPIInstance *ind)
 {
         CMPIStatus s = {CMPI_RC_OK, NULL};
+        CU_UPCALL_SITE();
 
         s = CMSetObjectPath(ind, ref);
         if (s.rc != CMPI_RC_OK)
@@ -112,14 +233,16 @@ static CMPIStatus default_raise(const CMPIBroker *broker,
 }
 
 static CMPIStatus raise(struct std_indication_ctx *ctx,
+                        const char *mi_name,
                         const CMPIContext *context,
                         const CMPIArgs *argsin,
                         const CMPIObjectPath *ref)
 {
-        bool enabled;
+        bool enabled = false;
         CMPIInstance *inst;
         CMPIStatus s = {CMPI_RC_OK, NULL};
         const char *ind_name = NULL;
+        CU_UPCALL_SITE();
 
         CU_DEBUG("In raise");
         if (cu_get_inst_arg(argsin, "TheIndication", &inst) != CMPI_RC_OK) {
@@ -150,15 +273,22 @@ static CMPIStatus raise(struct std_indication_ctx *ctx,
                 goto out;
         }
 
-        if (!enabled)
+        if (!enabled) {
+                count_delivery(false, s);
                 goto out;
+        }
 
         if (ctx->handler == NULL || ctx->handler->raise_fn == NULL)
                 s = default_raise(ctx->brkr, context, ref, inst);
         else
                 s = ctx->handler->raise_fn(ctx->brkr, context, ref, inst);
 
+        cu_flight_dump_failed(s.rc, "raise handler failed");
+        count_delivery(true, s);
+
  out:
+        CU_PROBE4(indication__raise, mi_name, ind_name, enabled, s.rc);
+
         return s;
 }
 
@@ -167,9 +297,13 @@ CMPIStatus stdi_deliver(const CMPIBroker *broker,
                         struct ind_args *args,
                         CMPIInstance *ind)
 {
-        bool enabled;
+        bool enabled = false;
         const char *ind_name;
         CMPIStatus s = {CMPI_RC_OK, NULL};
+        struct cu_arena arena;
+        CU_UPCALL_SITE();
+
+        cu_arena_begin(&arena);
 
         ind_name = cu_classname_from_inst(ind);
         if (ind_name == NULL) {
@@ -201,7 +335,13 @@ CMPIStatus stdi_deliver(const CMPIBroker *broker,
                            CMPI_RC_ERR_METHOD_NOT_AVAILABLE,
                            "Indication not enabled");
 
+        count_delivery(enabled, s);
+
  out:
+        CU_PROBE4(indication__deliver, args->ns, ind_name, enabled, s.rc);
+
+        cu_arena_end(&arena);
+
         return s;
 }
 
@@ -211,6 +351,7 @@ CMPIStatus stdi_set_ind_filter_state(struct std_indication_ctx *ctx,
 {
         CMPIStatus s = {CMPI_RC_OK, NULL};
         struct std_ind_filter *filter;
+        CU_UPCALL_SITE();
 
         filter = get_ind_filter(ctx->filters, ind_name);
         if (filter == NULL) {
@@ -220,6 +361,9 @@ CMPIStatus stdi_set_ind_filter_state(struct std_indication_ctx *ctx,
                 goto out;
         }
 
+        if (filter->active != state)
+                cu_stat_add(&filters_stat, state ? 1 : -1);
+
         filter->active = state;
 
  out:
@@ -236,6 +380,8 @@ CMPIStatus stdi_activate_filter(CMPIIndicationMI* mi,
         CMPIStatus s = {CMPI_RC_OK, NULL};
         struct std_indication_ctx *_ctx;
         const char *cn = NULL;
+        uint64_t start = cu_record_start();
+        CU_UPCALL_SITE();
 
         _ctx = (struct std_indication_ctx *)mi->hdl;
         cn = CLASSNAME(op);
@@ -248,6 +394,9 @@ CMPIStatus stdi_activate_filter(CMPIIndicationMI* mi,
         }
 
  out:
+        cu_record_filter(start, "ActivateFilter", mi->ft->miName, s,
+                         op, first);
+
         return s;
 }
 
@@ -261,6 +410,8 @@ CMPIStatus stdi_deactivate_filter(CMPIIndicationMI* mi,
         CMPIStatus s = {CMPI_RC_OK, NULL};
         struct std_indication_ctx *_ctx;
         const char *cn = NULL;
+        uint64_t start = cu_record_start();
+        CU_UPCALL_SITE();
 
         _ctx = (struct std_indication_ctx *)mi->hdl;
         cn = CLASSNAME(op);
@@ -272,6 +423,9 @@ CMPIStatus stdi_deactivate_filter(CMPIIndicationMI* mi,
         }
 
  out:
+        cu_record_filter(start, "DeActivateFilter", mi->ft->miName, s,
+                         op, last);
+
         return s;
 }
 
@@ -284,6 +438,9 @@ _EI_RTYPE stdi_enable_indications (CMPIIndicationMI* mi,
         CU_DEBUG("%s: indications enabled", mi->ft->miName);
         _ctx->enabled = true;
 
+        cu_record_indications(cu_record_start(),
+                              "EnableIndications", mi->ft->miName);
+
         if (_ctx->handler != NULL && _ctx->handler->enable_fn != NULL)
                 return _ctx->handler->enable_fn(mi, ctx);
 
@@ -299,6 +456,9 @@ _EI_RTYPE stdi_disable_indications (CMPIIndicationMI* mi,
         CU_DEBUG("%s: indications disabled", mi->ft->miName);
         _ctx->enabled = false;
 
+        cu_record_indications(cu_record_start(),
+                              "DisableIndications", mi->ft->miName);
+
         if (_ctx->handler != NULL && _ctx->handler->disable_fn != NULL)
                 return _ctx->handler->disable_fn(mi, ctx);
 
@@ -315,17 +475,34 @@ CMPIStatus stdi_handler(CMPIMethodMI *self,
 {
         CMPIStatus s;
         struct std_indication_ctx *ctx = self->hdl;
+        uint64_t start = cu_record_start();
+        struct cu_histogram_timer timer = cu_histogram_timer_start();
+        const char *op = "(unknown method)";
+        struct cu_arena arena;
+        CU_UPCALL_SITE();
 
-        if (STREQC(methodname, "TriggerIndications"))
+        cu_arena_begin(&arena);
+
+        if (STREQC(methodname, "TriggerIndications")) {
+                op = "TriggerIndications";
                 s = trigger(ctx, context);
-        else if (STREQ(methodname, "RaiseIndication"))
-                s = raise(ctx, context, argsin, reference);
-        else
+        } else if (STREQ(methodname, "RaiseIndication")) {
+                op = "RaiseIndication";
+                s = raise(ctx, self->ft->miName, context, argsin, reference);
+        } else
                 cu_statusf(ctx->brkr, &s,
                            CMPI_RC_ERR_FAILED,
                            "Invalid method");
 
         CMReturnDone(results);
+
+        cu_histogram_timer_end(&timer, self->ft->miName, op);
+
+        cu_record_method(start, self->ft->miName, s,
+                         reference, methodname, argsin);
+
+        cu_arena_end(&arena);
+
         return s;
 }
 
@@ -346,6 +523,7 @@ CMPIStatus stdi_trigger_indication(const CMPIBroker *broker,
         const char *method = "TriggerIndications";
         CMPIArgs *in;
         CMPIArgs *out;
+        CU_UPCALL_SITE();
 
         in = CMNewArgs(broker, &s);
         if (s.rc != CMPI_RC_OK)
@@ -382,6 +560,7 @@ CMPIStatus stdi_raise_indication(const CMPIBroker *broker,
         const char *method = "RaiseIndication";
         CMPIArgs *argsin;
         CMPIArgs *argsout;
+        CU_UPCALL_SITE();
 
         op = CMNewObjectPath(broker, ns, type, &s);
         if ((op == NULL) || (s.rc != CMPI_RC_OK)) {
@@ -26,6 +26,8 @@
 #include <cmpidt.h>
 #include <cmpift.h>
 
+#include "cu_upcall.h"
+
 #ifdef CMPI_EI_VOID
 # define _EI_RTYPE void
 # define _EI_RET() return
@@ -89,6 +91,16 @@ struct ind_args {
         struct std_indication_ctx *_ctx;
 };
 
+/*
+ * ind_args made by stdi_new_ind_args() are counted as CU_MEM_INDICATION
+ * (cu_mem.h); stdi_free_ind_args() frees those and ones the provider
+ * allocated itself.
+ */
+struct ind_args *stdi_new_ind_args(struct std_indication_ctx *ctx,
+                                   CMPIContext *context,
+                                   const char *ns,
+                                   const char *classname);
+
 void stdi_free_ind_args (struct ind_args **args);
 
 CMPIStatus stdi_trigger_indication(const CMPIBroker *broker,
@@ -182,8 +194,8 @@ CMPIStatus stdi_set_ind_filter_state(struct std_indication_ctx *ctx,
                         &pn##_ctx,                                      \
                         &indMIFT__,                                     \
                 };                                                      \
-                pn##_ctx.brkr = brkr;                                   \
-                _broker = brkr;                                         \
+                pn##_ctx.brkr = cu_upcall_broker(brkr);                 \
+                _broker = pn##_ctx.brkr;                                \
                 hook;                                                   \
                 return &mi;                                             \
         }                                                               \
@@ -207,8 +219,8 @@ CMPIStatus stdi_set_ind_filter_state(struct std_indication_ctx *ctx,
                         &pn##_ctx,                                      \
                         &methMIFT__,                                    \
                 };                                                      \
-                pn##_ctx.brkr = brkr;                                   \
-                _broker = brkr;                                         \
+                pn##_ctx.brkr = cu_upcall_broker(brkr);                 \
+                _broker = pn##_ctx.brkr;                                \
                 hook;                                                   \
                 return &mi;                                             \
         }
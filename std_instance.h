@@ -23,6 +23,8 @@
 #ifndef __STD_INSTANCE_H
 #define __STD_INSTANCE_H
 
+#include "cu_upcall.h"
+
 /**
  * Generates the function table and initialization stub for an
  * instance provider.
@@ -64,7 +66,7 @@
                         NULL,                                           \
                         &instMIFT__,                                    \
                 };                                                      \
-                broker=brkr;                                            \
+                broker = cu_upcall_broker(brkr);                        \
                 hook;                                                   \
                 return &mi;                                             \
         }
@@ -18,14 +18,36 @@
  * License along with this library; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
  */
+#define CU_LOG_CATEGORY CU_LOG_METHOD
+
 #include <stdio.h>
 #include <string.h>
 
 #include "libcmpiutil.h"
+#include "cu_upcall.h"
+#include "cu_record.h"
+#include "cu_histogram.h"
+#include "cu_stats.h"
+#include "cu_probes.h"
+#include "cu_trace.h"
+#include "cu_watchdog.h"
+#include "cu_arena.h"
+#include "cu_flight.h"
+
 #include "std_invokemethod.h"
 
 #define STREQ(a,b) (strcmp(a, b) == 0)
 
+CU_PROBE_DEFINE(method__entry);
+CU_PROBE_DEFINE(method__return);
+
+static CU_STAT(handler_stat, CU_STAT_COUNTER,
+               "cu_method_handler_calls_total",
+               "Calls made to method handlers");
+static CU_STAT(handler_err_stat, CU_STAT_COUNTER,
+               "cu_method_handler_errors_total",
+               "Method handler calls that did not return CMPI_RC_OK");
+
 static CMPIType check_for_eo(CMPIType type, CMPIType exp_type)
 {
      if ((exp_type == CMPI_instance) && (type == CMPI_string)) {
@@ -47,6 +69,8 @@ static int parse_eo_inst_arg(CMPIString *string_in,
 {
         int ret;
         const char *str;
+        struct cu_span span;
+        CU_UPCALL_SITE();
 
         str = CMGetCharPtr(string_in);
 
@@ -57,11 +81,18 @@ static int parse_eo_inst_arg(CMPIString *string_in,
                 return 0;
         }
 
+        cu_span_begin(&span, "parse embedded instance");
+        if (cu_trace_enabled())
+                cu_span_int(&span, "bytes", strlen(str));
+
         ret = cu_parse_embedded_instance(str,
                                          broker,
                                          ns,
                                          instance_out);
 
+        cu_span_int(&span, "ret", ret);
+        cu_span_end(&span);
+
         /* cu_parse_embedded_instance() returns 0 on success */
         if ((ret != 0) || CMIsNullObject(instance_out)) {
                 cu_statusf(broker, s,
@@ -82,6 +113,7 @@ static int parse_eo_array(CMPIArray *strings_in,
         int i;
         int ret;
         int count;
+        CU_UPCALL_SITE();
 
         if (CMIsNullObject(strings_in)) {
                 cu_statusf(broker, s,
@@ -132,6 +164,7 @@ static int parse_eo_param(CMPIArgs *args,
 {
         CMPIData newdata;
         int ret = 0;
+        CU_UPCALL_SITE();
 
         if (type == CMPI_instance) {
                 ret = parse_eo_inst_arg(data.value.string,
@@ -178,6 +211,7 @@ static int validate_arg_type(struct method_arg *arg,
         CMPIData argdata;
         CMPIType type;
         int ret;
+        CU_UPCALL_SITE();
 
         argdata = CMGetArg(args, arg->name, s);
         if (((s->rc != CMPI_RC_OK) || (CMIsNullValue(argdata)))
@@ -221,9 +255,9 @@ static int validate_arg_type(struct method_arg *arg,
                 }
         }
 
-        CU_DEBUG("Method parameter `%s' validated type 0x%x",
-                 arg->name,
-                 arg->type);
+        CU_LOG(CU_LOG_TRACE, "Method parameter `%s' validated type 0x%x",
+                             arg->name,
+                             arg->type);
 
         return 1;
 }
@@ -236,6 +270,7 @@ static int validate_args(struct method_handler *h,
 {
         CMPIArgs *new_args;
         int i;
+        CU_UPCALL_SITE();
 
         new_args = CMNewArgs(broker, s);
 
@@ -268,12 +303,30 @@ CMPIStatus _std_invokemethod(CMPIMethodMI *self,
 {
         struct std_invokemethod_ctx *ctx = self->hdl;
         struct method_handler *h = NULL;
+        const CMPIArgs *orig_argsin = argsin;
+        uint64_t start = cu_record_start();
+        struct cu_histogram_timer timer = cu_histogram_timer_start();
+        struct cu_histogram_timer handler_timer;
+        struct cu_watch *watch;
+        char handler_op[128];
+        struct cu_arena arena;
+        struct cu_span span;
+        struct cu_span phase;
         int hi;
         int ret;
         CMPIStatus s;
+        CU_UPCALL_SITE();
 
         CU_DEBUG("Method `%s' execution attempted", methodname);
 
+        cu_arena_begin(&arena);
+
+        cu_span_begin(&span, "InvokeMethod");
+        cu_span_str(&span, "mi", self->ft->miName);
+        cu_span_str(&span, "method", methodname);
+        if (cu_trace_enabled())
+                cu_span_str(&span, "class", CLASSNAME(reference));
+
         for (hi = 0; ctx->handlers[hi]; hi++) {
                 if (STREQ(methodname, ctx->handlers[hi]->name)) {
                         h = ctx->handlers[hi];
@@ -288,20 +341,64 @@ CMPIStatus _std_invokemethod(CMPIMethodMI *self,
                 goto exit;
         }
 
+        cu_span_begin(&phase, "validate_args");
+
         ret = validate_args(h,
                             &argsin,
                             reference,
                             ctx->broker,
                             &s);
+
+        cu_span_int(&phase, "rc", s.rc);
+        cu_span_end(&phase);
+
         if (!ret)
                 goto exit;
 
         CU_DEBUG("Executing handler for method `%s'", methodname);
+        CU_PROBE3(method__entry,
+                  self->ft->miName, methodname, CLASSNAME(reference));
+
+        cu_span_begin(&phase, "handler");
+        handler_timer = cu_histogram_timer_start();
+        watch = cu_watch_begin(self->ft->miName, h->name, reference);
+
         s = h->handler(self, context, results, reference, argsin, argsout);
+
+        cu_watch_end(watch);
+        cu_flight_dump_failed(s.rc, "method handler failed");
+
+        if (cu_histogram_enabled()) {
+                snprintf(handler_op, sizeof(handler_op), "%s handler",
+                         h->name);
+                cu_histogram_timer_end(&handler_timer, self->ft->miName,
+                                       handler_op);
+        }
+
+        cu_span_int(&phase, "rc", s.rc);
+        cu_span_end(&phase);
+
+        CU_PROBE3(method__return, self->ft->miName, methodname, s.rc);
         CU_DEBUG("Method `%s' returned %i", methodname, s.rc);
+
+        cu_stat_add(&handler_stat, 1);
+        if (s.rc != CMPI_RC_OK)
+                cu_stat_add(&handler_err_stat, 1);
  exit:
         CMReturnDone(results);
 
+        cu_span_int(&span, "rc", s.rc);
+        cu_span_end(&span);
+
+        /* Only known methods get a histogram, the names come from clients */
+        cu_histogram_timer_end(&timer, self->ft->miName,
+                               h != NULL ? h->name : "(unknown method)");
+
+        cu_record_method(start, self->ft->miName, s,
+                         reference, methodname, orig_argsin);
+
+        cu_arena_end(&arena);
+
         return s;
 }
 
@@ -24,6 +24,8 @@
 #include <cmpidt.h>
 #include <cmpift.h>
 
+#include "cu_upcall.h"
+
 typedef CMPIStatus (*method_handler_fn)(CMPIMethodMI *self,
                                         const CMPIContext *context,
                                         const CMPIResult *results,
@@ -91,11 +93,11 @@ struct std_invokemethod_ctx {
                                      CMPIStatus *rc) {       \
     static CMPIMethodMI mi;                                  \
     static struct std_invokemethod_ctx _ctx;                 \
-    _ctx.broker = brkr;                                      \
+    _ctx.broker = cu_upcall_broker(brkr);                    \
     _ctx.handlers = (struct method_handler **)funcs;         \
     mi.hdl = (void *)&_ctx;                                  \
     mi.ft = &methMIFT__;                                     \
-    _broker = brkr;                                          \
+    _broker = _ctx.broker;                                   \
     hook;                                                    \
     return &mi;                                              \
   }
@@ -0,0 +1,135 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cu_arena.h"
+#include "test.h"
+
+#define FILL "0123456789abcdef0123456789abcdef"
+
+/* What the other thread is given, and does with it */
+struct handoff {
+        char *ptr;
+        bool own_arena;
+        bool realloc;
+};
+
+static void *other_thread(void *data)
+{
+        struct handoff *h = data;
+        struct cu_arena arena;
+        char *new;
+
+        if (h->own_arena)
+                cu_arena_begin(&arena);
+
+        if (h->realloc) {
+                new = cu_tmp_realloc(CU_MEM_INST_LIST, h->ptr,
+                                     sizeof(FILL), 4 * sizeof(FILL));
+                CHECK(new != NULL);
+                CHECK(new != h->ptr);
+                if (new != NULL) {
+                        CHECK(strcmp(new, FILL) == 0);
+                        memset(new + sizeof(FILL), 'x', 3 * sizeof(FILL));
+                        cu_tmp_free(CU_MEM_INST_LIST, new);
+                }
+        } else {
+                cu_tmp_free(CU_MEM_INST_LIST, h->ptr);
+        }
+
+        if (h->own_arena)
+                cu_arena_end(&arena);
+
+        return NULL;
+}
+
+/*
+ * Hand memory from the calling thread's arena to another thread, which
+ * frees or resizes it, then check the arena still holds what it did.
+ */
+static void cross_thread(bool own_arena, bool realloc)
+{
+        struct handoff h = {NULL, own_arena, realloc};
+        struct cu_arena arena;
+        pthread_t thread;
+        char *after;
+
+        cu_arena_begin(&arena);
+
+        h.ptr = cu_tmp_strdup(CU_MEM_INST_LIST, FILL);
+        CHECK(h.ptr != NULL);
+        CHECK(cu_arena_find(h.ptr) == &arena);
+
+        CHECK(pthread_create(&thread, NULL, other_thread, &h) == 0);
+        pthread_join(thread, NULL);
+
+        /* Left alone in the arena, which still works */
+        CHECK(strcmp(h.ptr, FILL) == 0);
+        after = cu_tmp_strdup(CU_MEM_INST_LIST, FILL);
+        CHECK((after != NULL) && (cu_arena_find(after) == &arena));
+
+        cu_arena_end(&arena);
+}
+
+static void test_same_thread(void)
+{
+        struct cu_arena arena;
+        char *ptr;
+        char *new;
+
+        /* Heap memory outside an arena */
+        ptr = cu_tmp_strdup(CU_MEM_INST_LIST, FILL);
+        CHECK((ptr != NULL) && (cu_arena_find(ptr) == NULL));
+        new = cu_tmp_realloc(CU_MEM_INST_LIST, ptr, sizeof(FILL), 4096);
+        CHECK((new != NULL) && (strcmp(new, FILL) == 0));
+        cu_tmp_free(CU_MEM_INST_LIST, new);
+
+        /* The last allocation of an arena grows in place */
+        cu_arena_begin(&arena);
+        ptr = cu_tmp_strdup(CU_MEM_INST_LIST, FILL);
+        new = cu_tmp_realloc(CU_MEM_INST_LIST, ptr, sizeof(FILL), 256);
+        CHECK(new == ptr);
+        CHECK(strcmp(new, FILL) == 0);
+        cu_tmp_free(CU_MEM_INST_LIST, new);
+        cu_arena_end(&arena);
+}
+
+int main(void)
+{
+        test_same_thread();
+        cross_thread(false, false);
+        cross_thread(false, true);
+        cross_thread(true, false);
+        cross_thread(true, true);
+
+        return TEST_EXIT();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
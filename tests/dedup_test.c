@@ -0,0 +1,148 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+
+#include "mock/mock_broker.h"
+#include "test.h"
+
+static const CMPIBroker *broker;
+
+static const char *dev_keys[] = {"SystemName", "DeviceID", NULL};
+
+static CMPIInstance *dev(const char *ns, const char *sys, const char *id)
+{
+        CMPIObjectPath *op;
+        CMPIInstance *inst;
+
+        op = CMNewObjectPath(broker, ns, "Test_Device", NULL);
+        inst = CMNewInstance(broker, op, NULL);
+        CMSetProperty(inst, "SystemName", (CMPIValue *)sys, CMPI_chars);
+        CMSetProperty(inst, "DeviceID", (CMPIValue *)id, CMPI_chars);
+
+        return inst;
+}
+
+static CMPIInstance *keyless(const char *ns, const char *name)
+{
+        CMPIObjectPath *op;
+        CMPIInstance *inst;
+
+        op = CMNewObjectPath(broker, ns, "Test_Keyless", NULL);
+        inst = CMNewInstance(broker, op, NULL);
+        CMSetProperty(inst, "Name", (CMPIValue *)name, CMPI_chars);
+
+        return inst;
+}
+
+static void test_duplicates(void)
+{
+        struct inst_list list;
+        CMPIInstance *a;
+        CMPIInstance *b;
+
+        inst_list_init(&list);
+
+        a = dev("root/test", "sys0", "dev0");
+        b = dev("root/test", "sys0", "dev1");
+
+        inst_list_add(&list, a);
+        inst_list_add(&list, b);
+        inst_list_add(&list, dev("root/test", "sys0", "dev0"));
+
+        CHECK(inst_list_dedup(&list) == 1);
+        CHECK(list.cur == 2);
+        CHECK((list.list[0] == a) && (list.list[1] == b));
+
+        inst_list_free(&list);
+}
+
+/* Paths without keys don't tell instances apart, so all are kept */
+static void test_keyless(void)
+{
+        struct inst_list list;
+
+        inst_list_init(&list);
+
+        inst_list_add(&list, keyless("root/test", "first"));
+        inst_list_add(&list, keyless("root/test", "second"));
+        inst_list_add(&list, keyless("root/test", "third"));
+
+        CHECK(inst_list_dedup(&list) == 0);
+        CHECK(list.cur == 3);
+
+        inst_list_free(&list);
+}
+
+static void test_namespaces(void)
+{
+        struct inst_list list;
+
+        inst_list_init(&list);
+
+        inst_list_add(&list, dev("root/test", "sys0", "dev0"));
+        inst_list_add(&list, dev("root/other", "sys0", "dev0"));
+        inst_list_add(&list, dev(NULL, "sys0", "dev0"));
+
+        CHECK(inst_list_dedup(&list) == 0);
+        CHECK(list.cur == 3);
+
+        inst_list_free(&list);
+}
+
+int main(void)
+{
+        CMPIBroker *mb;
+
+        mb = mock_broker_new();
+        if (mb == NULL) {
+                fprintf(stderr, "Unable to create mock broker\n");
+                return 1;
+        }
+
+        mock_broker_add_class(mb, "Test_Device", NULL, dev_keys);
+        mock_broker_add_class(mb, "Test_Keyless", NULL, NULL);
+
+        broker = mb;
+
+        test_duplicates();
+        test_keyless();
+        test_namespaces();
+
+        mock_release_objects();
+        mock_broker_free(mb);
+
+        return TEST_EXIT();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
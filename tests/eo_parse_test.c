@@ -0,0 +1,195 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+
+#include "mock/mock_broker.h"
+#include "test.h"
+
+#define NS "root/test"
+
+static const CMPIBroker *broker;
+
+static CMPIInstance *parse(const char *eo)
+{
+        CMPIInstance *inst = NULL;
+
+        cu_parse_embedded_instance(eo, broker, NS, &inst);
+
+        return inst;
+}
+
+/* More values than parse_array() starts with, so it grows too */
+static void test_xml_array(void)
+{
+        const char *eo =
+                "<INSTANCE CLASSNAME=\"Test_Array\">\n"
+                "<PROPERTY.ARRAY NAME=\"Values\" TYPE=\"string\">"
+                "<VALUE.ARRAY>\n"
+                "<VALUE>v0</VALUE><VALUE>v1</VALUE><VALUE>v2</VALUE>\n"
+                "<VALUE>v3</VALUE><VALUE>v4</VALUE><VALUE>v5</VALUE>\n"
+                "<VALUE>v6</VALUE><VALUE>v7</VALUE><VALUE>v8</VALUE>\n"
+                "<VALUE>v9</VALUE><VALUE>v10</VALUE>\n"
+                "</VALUE.ARRAY></PROPERTY.ARRAY>\n"
+                "</INSTANCE>\n";
+        CMPIInstance *inst;
+        CMPIArray *array;
+        CMPIData data;
+        CMPIStatus s;
+        char name[8];
+        int i;
+
+        inst = parse(eo);
+        CHECK(inst != NULL);
+        if (inst == NULL)
+                return;
+
+        data = CMGetProperty(inst, "Values", &s);
+        CHECK(s.rc == CMPI_RC_OK);
+        CHECK(data.type == CMPI_stringA);
+        if ((s.rc != CMPI_RC_OK) || (data.type != CMPI_stringA))
+                return;
+
+        array = data.value.array;
+        CHECK(CMGetArrayCount(array, NULL) == 11);
+
+        for (i = 0; i < 11; i++) {
+                data = CMGetArrayElementAt(array, i, NULL);
+                snprintf(name, sizeof(name), "v%i", i);
+                CHECK(STREQ(CMGetCharPtr(data.value.string), name));
+        }
+}
+
+/* CIM-XML is recognised by its first non-blank character */
+static void test_xml_dispatch(void)
+{
+        const char *eo =
+                "\n  <INSTANCE CLASSNAME=\"Test_Dispatch\">\n"
+                "<PROPERTY NAME=\"Name\" TYPE=\"string\">"
+                "<VALUE>xml</VALUE></PROPERTY>\n"
+                "</INSTANCE>\n";
+        CMPIInstance *inst;
+        CMPIData data;
+
+        inst = parse(eo);
+        CHECK(inst != NULL);
+        if (inst == NULL)
+                return;
+
+        data = CMGetProperty(inst, "Name", NULL);
+        CHECK(data.type == CMPI_string);
+        if (data.type == CMPI_string)
+                CHECK(STREQ(CMGetCharPtr(data.value.string), "xml"));
+}
+
+#ifdef HAVE_EOPARSER
+/* A MOF instance that quotes CIM-XML is still MOF */
+static void test_mof_dispatch(void)
+{
+        const char *eo =
+                "instance of Test_Dispatch {\n"
+                "Name = \"<instance classname='Other'/>\";\n"
+                "};\n";
+        CMPIInstance *inst;
+        CMPIData data;
+
+        inst = parse(eo);
+        CHECK(inst != NULL);
+        if (inst == NULL)
+                return;
+
+        data = CMGetProperty(inst, "Name", NULL);
+        CHECK(data.type == CMPI_string);
+        if (data.type == CMPI_string)
+                CHECK(STREQ(CMGetCharPtr(data.value.string),
+                            "<instance classname='Other'/>"));
+}
+
+/* Each MOF parse goes through a temporary FILE, which must not leak */
+static void test_mof_file(void)
+{
+        const char *eo =
+                "instance of Test_File {\n"
+                "Name = \"file\";\n"
+                "Count = 1;\n"
+                "};\n";
+        const void *mark;
+        size_t before;
+        size_t after;
+        int i;
+
+        mark = mock_objects_mark();
+        CHECK(parse(eo) != NULL);
+        mock_release_objects_since(mark);
+
+        before = mallinfo2().uordblks;
+
+        for (i = 0; i < 100; i++) {
+                mark = mock_objects_mark();
+                parse(eo);
+                mock_release_objects_since(mark);
+        }
+
+        after = mallinfo2().uordblks;
+
+        CHECK(after < before + (100 * sizeof(FILE)));
+}
+#endif
+
+int main(void)
+{
+        CMPIBroker *mb;
+
+        mb = mock_broker_new();
+        if (mb == NULL) {
+                fprintf(stderr, "Unable to create mock broker\n");
+                return 1;
+        }
+
+        broker = mb;
+
+        test_xml_array();
+        test_xml_dispatch();
+#ifdef HAVE_EOPARSER
+        test_mof_file();
+        test_mof_dispatch();
+#endif
+
+        mock_release_objects();
+        mock_broker_free(mb);
+
+        return TEST_EXIT();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
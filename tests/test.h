@@ -0,0 +1,52 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#ifndef __CU_TEST_H
+#define __CU_TEST_H
+
+#include <stdio.h>
+
+/*
+ * Each test is a program run by `make check'.  CHECK() reports a
+ * failed condition and carries on; the program exits non-zero if any
+ * check failed.
+ */
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                     \
+        do {                                                            \
+                if (!(cond)) {                                          \
+                        fprintf(stderr, "%s:%i: %s failed\n",           \
+                                __FILE__, __LINE__, #cond);             \
+                        test_failures++;                                \
+                }                                                       \
+        } while (0)
+
+#define TEST_EXIT() ((test_failures == 0) ? 0 : 1)
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
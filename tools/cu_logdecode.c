@@ -0,0 +1,582 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+
+/*
+ * Turn a log written with CU_DEBUG_FORMAT=binary back into the text
+ * debug_print() would have written:
+ *
+ *   cu_logdecode [-p] FILE...
+ *
+ * Formats are looked up in a first pass over each file, since a
+ * thread may log with a format that another thread defined in a batch
+ * written later.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cu_binlog.h"
+
+/* The formats are the ones the library logged with */
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+
+struct format {
+        uint32_t pid;
+        uint32_t session;
+        uint32_t id;
+        char *text;
+};
+
+struct process {
+        uint32_t pid;
+        uint32_t session;
+};
+
+struct reader {
+        const unsigned char *data;
+        size_t len;
+        size_t off;
+};
+
+struct decoder {
+        struct format *formats;
+        size_t num_formats;
+        struct process *procs;
+        size_t num_procs;
+        uint32_t pid;
+        const char *inline_fmt;
+        size_t inline_len;
+        bool show_pid;
+};
+
+static bool get(struct reader *r, void *dst, size_t len)
+{
+        if (r->len - r->off < len)
+                return false;
+
+        memcpy(dst, r->data + r->off, len);
+        r->off += len;
+
+        return true;
+}
+
+static bool get32(struct reader *r, uint32_t *val)
+{
+        return get(r, val, sizeof(*val));
+}
+
+static bool get64(struct reader *r, uint64_t *val)
+{
+        return get(r, val, sizeof(*val));
+}
+
+static struct process *find_proc(struct decoder *dec, uint32_t pid)
+{
+        struct process *tmp;
+        size_t i;
+
+        for (i = 0; i < dec->num_procs; i++) {
+                if (dec->procs[i].pid == pid)
+                        return &dec->procs[i];
+        }
+
+        tmp = realloc(dec->procs, (dec->num_procs + 1) * sizeof(*tmp));
+        if (tmp == NULL)
+                return NULL;
+
+        dec->procs = tmp;
+        dec->procs[dec->num_procs].pid = pid;
+        dec->procs[dec->num_procs].session = 0;
+
+        return &dec->procs[dec->num_procs++];
+}
+
+static uint32_t cur_session(struct decoder *dec)
+{
+        struct process *proc = find_proc(dec, dec->pid);
+
+        return (proc != NULL) ? proc->session : 0;
+}
+
+static void add_format(struct decoder *dec,
+                       uint32_t id,
+                       const unsigned char *text,
+                       size_t len)
+{
+        struct format *tmp;
+        struct format *fmt;
+
+        tmp = realloc(dec->formats, (dec->num_formats + 1) * sizeof(*tmp));
+        if (tmp == NULL)
+                return;
+        dec->formats = tmp;
+
+        fmt = &dec->formats[dec->num_formats];
+        fmt->text = strndup((const char *)text, len);
+        if (fmt->text == NULL)
+                return;
+
+        fmt->pid = dec->pid;
+        fmt->session = cur_session(dec);
+        fmt->id = id;
+        dec->num_formats++;
+}
+
+static const char *lookup_format(struct decoder *dec, uint32_t id)
+{
+        uint32_t session = cur_session(dec);
+        size_t i;
+
+        for (i = 0; i < dec->num_formats; i++) {
+                if ((dec->formats[i].id == id) &&
+                    (dec->formats[i].pid == dec->pid) &&
+                    (dec->formats[i].session == session))
+                        return dec->formats[i].text;
+        }
+
+        return NULL;
+}
+
+static void print_header(struct decoder *dec,
+                         uint32_t tid,
+                         uint64_t real_ns,
+                         uint64_t mono_ns)
+{
+        time_t sec = real_ns / 1000000000ULL;
+        struct tm tm;
+        char date[32];
+
+        localtime_r(&sec, &tm);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+
+        if (dec->show_pid)
+                printf("%u ", dec->pid);
+
+        printf("[%s.%06u] [%llu.%06u] [%u]: ",
+               date,
+               (unsigned)((real_ns % 1000000000ULL) / 1000),
+               (unsigned long long)(mono_ns / 1000000000ULL),
+               (unsigned)((mono_ns % 1000000000ULL) / 1000),
+               tid);
+}
+
+/* Read a string argument into a NUL terminated copy */
+static char *get_string(struct reader *r, bool *ok)
+{
+        uint32_t len;
+        char *str;
+
+        if (!get32(r, &len)) {
+                *ok = false;
+                return NULL;
+        }
+
+        if (len == CU_BINLOG_NULL_STRING)
+                return NULL;
+
+        if (r->len - r->off < len) {
+                *ok = false;
+                return NULL;
+        }
+
+        str = strndup((const char *)r->data + r->off, len);
+        r->off += len;
+
+        return str;
+}
+
+static bool print_conv(const struct cu_binlog_conv *conv,
+                       struct reader *r)
+{
+        char spec[64];
+        int stars[2] = {0, 0};
+        size_t len = conv->end - conv->start;
+        uint32_t val32;
+        uint64_t val64;
+        double dval;
+        char *str = NULL;
+        bool ok = true;
+        int i;
+
+        if (len >= sizeof(spec))
+                return false;
+
+        memcpy(spec, conv->start, len);
+        spec[len] = '\0';
+
+        for (i = 0; i < conv->stars; i++) {
+                if (!get32(r, &val32))
+                        return false;
+                stars[i] = (int)val32;
+        }
+
+#define PRINT(val)                                                      \
+        do {                                                            \
+                if (conv->stars == 2)                                   \
+                        printf(spec, stars[0], stars[1], val);          \
+                else if (conv->stars == 1)                              \
+                        printf(spec, stars[0], val);                    \
+                else                                                    \
+                        printf(spec, val);                              \
+        } while (0)
+
+        switch (conv->kind) {
+        case 'i':
+                if (!get32(r, &val32))
+                        return false;
+                PRINT((int)val32);
+                break;
+        case 'l':
+        case 'q':
+        case 'j':
+        case 'z':
+        case 't':
+        case 'p':
+                if (!get64(r, &val64))
+                        return false;
+                if (conv->kind == 'l')
+                        PRINT((long)val64);
+                else if (conv->kind == 'q')
+                        PRINT((long long)val64);
+                else if (conv->kind == 'j')
+                        PRINT((intmax_t)val64);
+                else if (conv->kind == 'z')
+                        PRINT((size_t)val64);
+                else if (conv->kind == 't')
+                        PRINT((ptrdiff_t)val64);
+                else
+                        PRINT((void *)(uintptr_t)val64);
+                break;
+        case 'd':
+        case 'D':
+                if (!get(r, &dval, sizeof(dval)))
+                        return false;
+                if (conv->kind == 'D')
+                        PRINT((long double)dval);
+                else
+                        PRINT(dval);
+                break;
+        case 'm':
+                spec[len - 1] = 's';
+                /* fall through */
+        case 's':
+                str = get_string(r, &ok);
+                if (!ok)
+                        return false;
+                PRINT(str);
+                free(str);
+                break;
+        default:
+                fputs(spec, stdout);
+                break;
+        }
+
+#undef PRINT
+
+        return true;
+}
+
+static void print_message(const char *fmt, struct reader *r)
+{
+        struct cu_binlog_conv conv;
+        const char *p = fmt;
+
+        for (;;) {
+                const char *start = p;
+
+                if (!cu_binlog_next_conv(&p, &conv)) {
+                        fputs(start, stdout);
+                        break;
+                }
+
+                fwrite(start, 1, conv.start - start, stdout);
+
+                if (conv.kind == '%') {
+                        putchar('%');
+                        continue;
+                }
+
+                if (!print_conv(&conv, r)) {
+                        printf("<truncated>\n");
+                        break;
+                }
+        }
+}
+
+static void decode_message(struct decoder *dec, struct reader *r)
+{
+        const char *fmt;
+        char *inline_fmt = NULL;
+        uint32_t id;
+        uint32_t tid;
+        uint64_t real_ns;
+        uint64_t mono_ns;
+
+        if (!get32(r, &id) || !get32(r, &tid) ||
+            !get64(r, &real_ns) || !get64(r, &mono_ns))
+                return;
+
+        if (id == 0) {
+                if (dec->inline_fmt == NULL)
+                        return;
+                inline_fmt = strndup(dec->inline_fmt, dec->inline_len);
+                dec->inline_fmt = NULL;
+                fmt = inline_fmt;
+        } else {
+                fmt = lookup_format(dec, id);
+        }
+
+        print_header(dec, tid, real_ns, mono_ns);
+
+        if (fmt == NULL)
+                printf("<format %u not found>\n", id);
+        else
+                print_message(fmt, r);
+
+        free(inline_fmt);
+}
+
+static void decode_text(struct decoder *dec, struct reader *r)
+{
+        uint32_t tid;
+        uint64_t real_ns;
+        uint64_t mono_ns;
+
+        if (!get32(r, &tid) || !get64(r, &real_ns) || !get64(r, &mono_ns))
+                return;
+
+        print_header(dec, tid, real_ns, mono_ns);
+        fwrite(r->data + r->off, 1, r->len - r->off, stdout);
+}
+
+static void start_session(struct decoder *dec, struct reader *r, bool count)
+{
+        struct process *proc;
+        uint32_t order;
+        uint32_t version;
+        uint32_t pid;
+
+        if (!get32(r, &order) || !get32(r, &version) || !get32(r, &pid))
+                return;
+
+        dec->pid = pid;
+
+        proc = find_proc(dec, pid);
+        if ((proc != NULL) && count)
+                proc->session++;
+}
+
+/*
+ * Walk the records of a file.  The first pass collects the formats,
+ * the second prints the messages.
+ */
+static int decode(struct decoder *dec,
+                  const char *name,
+                  const unsigned char *data,
+                  size_t size,
+                  bool print)
+{
+        struct reader rec;
+        size_t off = 0;
+        uint32_t len;
+        uint32_t val;
+        unsigned char type;
+
+        dec->num_procs = 0;
+        dec->pid = 0;
+        dec->inline_fmt = NULL;
+
+        while (off < size) {
+                if (size - off < CU_BINLOG_HEADER)
+                        goto bad;
+
+                memcpy(&len, data + off, sizeof(len));
+                type = data[off + 4];
+                if ((len < CU_BINLOG_HEADER) || (len > size - off))
+                        goto bad;
+
+                if ((off == 0) && (type != CU_BINLOG_SESSION))
+                        goto bad;
+
+                rec.data = data + off;
+                rec.len = len;
+                rec.off = CU_BINLOG_HEADER;
+
+                switch (type) {
+                case CU_BINLOG_SESSION:
+                        memcpy(&val, data + off + CU_BINLOG_HEADER,
+                               sizeof(val));
+                        if (val != CU_BINLOG_ORDER) {
+                                fprintf(stderr, "%s: written with a different "
+                                        "byte order\n", name);
+                                return -1;
+                        }
+                        start_session(dec, &rec, true);
+                        break;
+                case CU_BINLOG_BATCH:
+                        if (get32(&rec, &val))
+                                dec->pid = val;
+                        break;
+                case CU_BINLOG_FORMAT:
+                        if (!get32(&rec, &val))
+                                break;
+                        if (val == 0) {
+                                dec->inline_fmt = (const char *)rec.data +
+                                        rec.off;
+                                dec->inline_len = rec.len - rec.off;
+                        } else if (!print) {
+                                add_format(dec, val, rec.data + rec.off,
+                                           rec.len - rec.off);
+                        }
+                        break;
+                case CU_BINLOG_MESSAGE:
+                        if (print)
+                                decode_message(dec, &rec);
+                        break;
+                case CU_BINLOG_TEXT:
+                        if (print)
+                                decode_text(dec, &rec);
+                        break;
+                default:
+                        goto bad;
+                }
+
+                off += len;
+        }
+
+        return 0;
+ bad:
+        fprintf(stderr, "%s: not a binary log, or damaged at offset %zu\n",
+                name, off);
+        return -1;
+}
+
+static unsigned char *read_file(const char *name, size_t *size)
+{
+        unsigned char *data = NULL;
+        unsigned char *tmp;
+        size_t alloc = 0;
+        size_t len = 0;
+        size_t ret;
+        FILE *file;
+
+        file = (strcmp(name, "-") == 0) ? stdin : fopen(name, "rb");
+        if (file == NULL) {
+                fprintf(stderr, "%s: %s\n", name, strerror(errno));
+                return NULL;
+        }
+
+        for (;;) {
+                if (len == alloc) {
+                        alloc = alloc ? alloc * 2 : 1 << 20;
+                        tmp = realloc(data, alloc);
+                        if (tmp == NULL) {
+                                fprintf(stderr, "%s: out of memory\n", name);
+                                free(data);
+                                data = NULL;
+                                break;
+                        }
+                        data = tmp;
+                }
+
+                ret = fread(data + len, 1, alloc - len, file);
+                if (ret == 0)
+                        break;
+                len += ret;
+        }
+
+        if (file != stdin)
+                fclose(file);
+
+        *size = len;
+
+        return data;
+}
+
+static void usage(const char *prog)
+{
+        fprintf(stderr,
+                "Usage: %s [-p] FILE...\n"
+                "\n"
+                "Print a CU_DEBUG_FORMAT=binary log as text (- for stdin)\n"
+                "\n"
+                "  -p  Start each line with the process ID\n",
+                prog);
+}
+
+int main(int argc, char **argv)
+{
+        struct decoder dec;
+        unsigned char *data;
+        size_t size;
+        int ret = 0;
+        int c;
+        int i;
+
+        memset(&dec, 0, sizeof(dec));
+
+        while ((c = getopt(argc, argv, "ph")) != -1) {
+                switch (c) {
+                case 'p':
+                        dec.show_pid = true;
+                        break;
+                default:
+                        usage(argv[0]);
+                        return c == 'h' ? 0 : 1;
+                }
+        }
+
+        if (optind == argc) {
+                usage(argv[0]);
+                return 1;
+        }
+
+        for (i = optind; i < argc; i++) {
+                data = read_file(argv[i], &size);
+                if (data == NULL) {
+                        ret = 1;
+                        continue;
+                }
+
+                dec.num_formats = 0;
+
+                if ((decode(&dec, argv[i], data, size, false) != 0) ||
+                    (decode(&dec, argv[i], data, size, true) != 0))
+                        ret = 1;
+
+                free(data);
+        }
+
+        return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
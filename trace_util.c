@@ -0,0 +1,347 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "libcmpiutil.h"
+#include "cu_trace.h"
+
+/* Longest event written, attributes are cut short to fit */
+#define MAX_EVENT 2048
+
+/* Room kept free for closing the event */
+#define EVENT_SLACK 64
+
+struct ev_buf {
+        char data[MAX_EVENT];
+        size_t len;
+};
+
+static FILE *trace_file = NULL;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int trace_pid;
+
+static __thread int thread_id = 0;
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static int get_tid(void)
+{
+        if (thread_id == 0)
+                thread_id = syscall(SYS_gettid);
+
+        return thread_id;
+}
+
+static void ev_str(struct ev_buf *buf, const char *str)
+{
+        size_t len = strlen(str);
+
+        if (buf->len + len >= MAX_EVENT)
+                len = MAX_EVENT - buf->len - 1;
+
+        memcpy(buf->data + buf->len, str, len);
+        buf->len += len;
+        buf->data[buf->len] = '\0';
+}
+
+static void ev_printf(struct ev_buf *buf, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+
+static void ev_printf(struct ev_buf *buf, const char *fmt, ...)
+{
+        va_list ap;
+        int len;
+
+        va_start(ap, fmt);
+        len = vsnprintf(buf->data + buf->len, MAX_EVENT - buf->len, fmt, ap);
+        va_end(ap);
+
+        if (len < 0)
+                buf->data[buf->len] = '\0';
+        else if (buf->len + len >= MAX_EVENT)
+                buf->len = MAX_EVENT - 1;
+        else
+                buf->len += len;
+}
+
+/* Append str as a JSON string, leaving EVENT_SLACK bytes free */
+static void ev_quote(struct ev_buf *buf, const char *str)
+{
+        const unsigned char *p;
+        char esc[8];
+
+        if (str == NULL) {
+                ev_str(buf, "null");
+                return;
+        }
+
+        ev_str(buf, "\"");
+
+        for (p = (const unsigned char *)str; *p != '\0'; p++) {
+                if (buf->len + sizeof(esc) >= MAX_EVENT - EVENT_SLACK)
+                        break;
+
+                if ((*p == '"') || (*p == '\\')) {
+                        esc[0] = '\\';
+                        esc[1] = *p;
+                        esc[2] = '\0';
+                } else if (*p < 0x20) {
+                        snprintf(esc, sizeof(esc), "\\u%04x", *p);
+                } else {
+                        buf->data[buf->len++] = *p;
+                        continue;
+                }
+
+                ev_str(buf, esc);
+        }
+
+        buf->data[buf->len] = '\0';
+        ev_str(buf, "\"");
+}
+
+static void write_event(struct ev_buf *buf)
+{
+        pthread_mutex_lock(&trace_lock);
+
+        if (trace_file != NULL)
+                fwrite(buf->data, 1, buf->len, trace_file);
+
+        pthread_mutex_unlock(&trace_lock);
+}
+
+bool cu_trace_enabled(void)
+{
+        return trace_file != NULL;
+}
+
+void cu_span_begin(struct cu_span *span, const char *name)
+{
+        span->name = name;
+        span->attr_count = 0;
+        span->start = (trace_file != NULL) ? now_ns() : 0;
+}
+
+static struct cu_span_attr *new_attr(struct cu_span *span, const char *key)
+{
+        struct cu_span_attr *attr;
+
+        if ((span->start == 0) || (span->attr_count >= CU_SPAN_MAX_ATTRS))
+                return NULL;
+
+        attr = &span->attrs[span->attr_count++];
+        attr->key = key;
+
+        return attr;
+}
+
+void cu_span_str(struct cu_span *span, const char *key, const char *value)
+{
+        struct cu_span_attr *attr = new_attr(span, key);
+
+        if (attr == NULL)
+                return;
+
+        attr->is_str = true;
+        attr->str = value;
+}
+
+void cu_span_int(struct cu_span *span, const char *key, int64_t value)
+{
+        struct cu_span_attr *attr = new_attr(span, key);
+
+        if (attr == NULL)
+                return;
+
+        attr->is_str = false;
+        attr->num = value;
+}
+
+void cu_span_end(struct cu_span *span)
+{
+        struct ev_buf buf;
+        uint64_t end;
+        int i;
+
+        if (span->start == 0)
+                return;
+
+        end = now_ns();
+        buf.len = 0;
+        buf.data[0] = '\0';
+
+        ev_str(&buf, "{\"name\":");
+        ev_quote(&buf, span->name);
+        ev_printf(&buf,
+                  ",\"cat\":\"libcmpiutil\",\"ph\":\"X\","
+                  "\"ts\":%" PRIu64 ".%03u,\"dur\":%" PRIu64 ".%03u,"
+                  "\"pid\":%d,\"tid\":%d",
+                  span->start / 1000, (unsigned)(span->start % 1000),
+                  (end - span->start) / 1000,
+                  (unsigned)((end - span->start) % 1000),
+                  trace_pid, get_tid());
+
+        if (span->attr_count > 0) {
+                ev_str(&buf, ",\"args\":{");
+
+                for (i = 0; i < span->attr_count; i++) {
+                        struct cu_span_attr *attr = &span->attrs[i];
+
+                        if (buf.len >= MAX_EVENT - EVENT_SLACK)
+                                break;
+
+                        if (i > 0)
+                                ev_str(&buf, ",");
+
+                        ev_quote(&buf, attr->key);
+                        ev_str(&buf, ":");
+
+                        if (attr->is_str)
+                                ev_quote(&buf, attr->str);
+                        else
+                                ev_printf(&buf, "%" PRId64, attr->num);
+                }
+
+                ev_str(&buf, "}");
+        }
+
+        ev_str(&buf, "},\n");
+
+        write_event(&buf);
+}
+
+/* Copy path, replacing each %p with the process ID */
+static char *expand_path(const char *path)
+{
+        char pid[16];
+        char *ret;
+        char *p;
+        size_t len;
+
+        snprintf(pid, sizeof(pid), "%d", (int)getpid());
+
+        ret = malloc(strlen(path) * (strlen(pid) + 1) + 1);
+        if (ret == NULL)
+                return NULL;
+
+        for (p = ret; *path != '\0'; path++) {
+                if ((path[0] == '%') && (path[1] == 'p')) {
+                        len = strlen(pid);
+                        memcpy(p, pid, len);
+                        p += len;
+                        path++;
+                } else {
+                        *p++ = *path;
+                }
+        }
+
+        *p = '\0';
+
+        return ret;
+}
+
+static void trace_init(void) __attribute__((constructor));
+static void trace_init(void)
+{
+        const char *val;
+        char *path;
+
+        val = getenv("CU_TRACE_FILE");
+        if ((val == NULL) || (*val == '\0'))
+                return;
+
+        path = expand_path(val);
+        if (path == NULL)
+                return;
+
+        trace_file = fopen(path, "w");
+        if (trace_file == NULL) {
+                CU_DEBUG("Unable to open %s for tracing: %s",
+                         path, strerror(errno));
+                free(path);
+                return;
+        }
+
+        free(path);
+
+        trace_pid = getpid();
+
+        /* Whole events only, so a reader never sees half of one */
+        setvbuf(trace_file, NULL, _IOLBF, 0);
+        fputs("[\n", trace_file);
+}
+
+/*
+ * Events end with a comma, which trace viewers accept in an array that
+ * is never closed (if the process is killed).  On a clean exit the
+ * process name goes last, without one, and closes the array.
+ */
+static void trace_cleanup(void) __attribute__((destructor));
+static void trace_cleanup(void)
+{
+        struct ev_buf buf;
+        FILE *file;
+
+        if (trace_file == NULL)
+                return;
+
+        buf.len = 0;
+        buf.data[0] = '\0';
+
+        ev_printf(&buf,
+                  "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                  "\"args\":{\"name\":",
+                  trace_pid);
+        ev_quote(&buf, program_invocation_short_name);
+        ev_str(&buf, "}}\n]\n");
+
+        pthread_mutex_lock(&trace_lock);
+
+        file = trace_file;
+        trace_file = NULL;
+        fwrite(buf.data, 1, buf.len, file);
+        fclose(file);
+
+        pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,1246 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+
+#include "libcmpiutil.h"
+#include "cu_upcall.h"
+
+#ifdef WITH_UPCALL_STATS
+
+#define MAX_STATS   1024
+#define MAX_BROKERS 8
+
+enum upcall_fn {
+        UC_NEW_INSTANCE,
+        UC_NEW_OBJECT_PATH,
+        UC_NEW_ARGS,
+        UC_NEW_STRING,
+        UC_NEW_ARRAY,
+        UC_CLASS_PATH_IS_A,
+        UC_DELIVER_INDICATION,
+        UC_INVOKE_METHOD,
+        UC_ENUM_INSTANCE_NAMES,
+        UC_GET_INSTANCE,
+        UC_CREATE_INSTANCE,
+        UC_MODIFY_INSTANCE,
+        UC_DELETE_INSTANCE,
+        UC_EXEC_QUERY,
+        UC_ENUM_INSTANCES,
+        UC_ASSOCIATORS,
+        UC_ASSOCIATOR_NAMES,
+        UC_REFERENCES,
+        UC_REFERENCE_NAMES,
+        UC_BROKER_SET_PROPERTY,
+        UC_BROKER_GET_PROPERTY,
+        UC_MAX,
+};
+
+static const char *fn_names[UC_MAX] = {
+        [UC_NEW_INSTANCE] = "CMNewInstance",
+        [UC_NEW_OBJECT_PATH] = "CMNewObjectPath",
+        [UC_NEW_ARGS] = "CMNewArgs",
+        [UC_NEW_STRING] = "CMNewString",
+        [UC_NEW_ARRAY] = "CMNewArray",
+        [UC_CLASS_PATH_IS_A] = "CMClassPathIsA",
+        [UC_DELIVER_INDICATION] = "CBDeliverIndication",
+        [UC_INVOKE_METHOD] = "CBInvokeMethod",
+        [UC_ENUM_INSTANCE_NAMES] = "CBEnumInstanceNames",
+        [UC_GET_INSTANCE] = "CBGetInstance",
+        [UC_CREATE_INSTANCE] = "CBCreateInstance",
+        [UC_MODIFY_INSTANCE] = "CBModifyInstance",
+        [UC_DELETE_INSTANCE] = "CBDeleteInstance",
+        [UC_EXEC_QUERY] = "CBExecQuery",
+        [UC_ENUM_INSTANCES] = "CBEnumInstances",
+        [UC_ASSOCIATORS] = "CBAssociators",
+        [UC_ASSOCIATOR_NAMES] = "CBAssociatorNames",
+        [UC_REFERENCES] = "CBReferences",
+        [UC_REFERENCE_NAMES] = "CBReferenceNames",
+        [UC_BROKER_SET_PROPERTY] = "CBSetProperty",
+        [UC_BROKER_GET_PROPERTY] = "CBGetProperty",
+};
+
+/*
+ * One slot per (function, site) pair.  Slots are claimed under
+ * stats_lock and never released, so lookups can run without it.
+ */
+struct upcall_stat {
+        int used;
+        enum upcall_fn fn;
+        const char *file;
+        const char *func;
+        unsigned long count;
+        uint64_t total_ns;
+        uint64_t max_ns;
+};
+
+static struct upcall_stat stats[MAX_STATS];
+static unsigned long stats_dropped = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool upcall_on = false;
+static char *dump_path = NULL;
+
+static __thread struct cu_upcall_site cur_site;
+
+struct cu_upcall_site cu_upcall_site_enter(const char *file,
+                                           const char *func)
+{
+        struct cu_upcall_site prev = {NULL, NULL, 0};
+
+        if (__builtin_expect(!upcall_on, 1))
+                return prev;
+
+        prev = cur_site;
+        prev.active = 1;
+
+        cur_site.file = file;
+        cur_site.func = func;
+
+        return prev;
+}
+
+void cu_upcall_site_leave(struct cu_upcall_site *prev)
+{
+        if (prev->active) {
+                cur_site.file = prev->file;
+                cur_site.func = prev->func;
+        }
+}
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static unsigned int site_hash(enum upcall_fn fn,
+                              const char *file,
+                              const char *func)
+{
+        uintptr_t h;
+
+        h = (uintptr_t)file ^ ((uintptr_t)func * 31) ^ (fn * 2654435761U);
+        h ^= h >> 16;
+
+        return h & (MAX_STATS - 1);
+}
+
+static struct upcall_stat *find_stat(enum upcall_fn fn,
+                                     const char *file,
+                                     const char *func)
+{
+        struct upcall_stat *st;
+        unsigned int start;
+        unsigned int i;
+        int pass;
+
+        start = site_hash(fn, file, func);
+
+        /* First look without the lock, then again with it to insert */
+        for (pass = 0; pass < 2; pass++) {
+                i = start;
+                do {
+                        st = &stats[i];
+
+                        if (!__atomic_load_n(&st->used, __ATOMIC_ACQUIRE))
+                                break;
+
+                        if ((st->fn == fn) &&
+                            (st->file == file) &&
+                            (st->func == func))
+                                goto out;
+
+                        i = (i + 1) & (MAX_STATS - 1);
+                } while (i != start);
+
+                if (pass == 0)
+                        pthread_mutex_lock(&stats_lock);
+        }
+
+        st = NULL;
+
+        i = start;
+        do {
+                if (!stats[i].used) {
+                        st = &stats[i];
+                        st->fn = fn;
+                        st->file = file;
+                        st->func = func;
+                        __atomic_store_n(&st->used, 1, __ATOMIC_RELEASE);
+                        break;
+                }
+
+                i = (i + 1) & (MAX_STATS - 1);
+        } while (i != start);
+
+        pthread_mutex_unlock(&stats_lock);
+
+        return st;
+
+ out:
+        if (pass == 1)
+                pthread_mutex_unlock(&stats_lock);
+
+        return st;
+}
+
+static void record(enum upcall_fn fn,
+                   const struct cu_upcall_site *site,
+                   uint64_t start)
+{
+        struct upcall_stat *st;
+        uint64_t ns = now_ns() - start;
+        uint64_t max;
+
+        st = find_stat(fn, site->file, site->func);
+        if (st == NULL) {
+                __atomic_fetch_add(&stats_dropped, 1, __ATOMIC_RELAXED);
+                return;
+        }
+
+        __atomic_fetch_add(&st->count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&st->total_ns, ns, __ATOMIC_RELAXED);
+
+        max = __atomic_load_n(&st->max_ns, __ATOMIC_RELAXED);
+        while ((ns > max) &&
+               !__atomic_compare_exchange_n(&st->max_ns, &max, ns, true,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED))
+                ;
+}
+
+/*
+ * The site is captured before the call, since a broker call can
+ * re-enter the library (CBInvokeMethod on one of our own providers).
+ */
+#define UPCALL_BEGIN()                                  \
+        struct cu_upcall_site _site = cur_site;         \
+        uint64_t _start = now_ns()
+
+#define UPCALL_END(fn) record(fn, &_site, _start)
+
+/* CMPIBroker */
+
+struct wrapped_broker {
+        CMPIBroker broker;
+        CMPIBrokerFT bft;
+        CMPIBrokerEncFT eft;
+#ifdef CMPI_VER_200
+        CMPIBrokerMemFT mft;
+#endif
+        const CMPIBroker *orig;
+};
+
+static struct wrapped_broker *brokers[MAX_BROKERS];
+
+/*
+ * Calls are forwarded with the CIMOM's own broker, which some CIMOMs
+ * extend with private fields, so every entry that takes a broker is
+ * wrapped.  The xft functions don't take one and are shared as-is.
+ */
+#define BROKER_ORIG(mb) (((const struct wrapped_broker *)(mb))->orig)
+
+static CMPIInstance *broker_newInstance(const CMPIBroker *mb,
+                                        const CMPIObjectPath *op,
+                                        CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIInstance *inst;
+        UPCALL_BEGIN();
+
+        inst = orig->eft->newInstance(orig, op, rc);
+        UPCALL_END(UC_NEW_INSTANCE);
+
+        return inst;
+}
+
+static CMPIObjectPath *broker_newObjectPath(const CMPIBroker *mb,
+                                            const char *ns,
+                                            const char *cn,
+                                            CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIObjectPath *path;
+        UPCALL_BEGIN();
+
+        path = orig->eft->newObjectPath(orig, ns, cn, rc);
+        UPCALL_END(UC_NEW_OBJECT_PATH);
+
+        return path;
+}
+
+static CMPIArgs *broker_newArgs(const CMPIBroker *mb, CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIArgs *args;
+        UPCALL_BEGIN();
+
+        args = orig->eft->newArgs(orig, rc);
+        UPCALL_END(UC_NEW_ARGS);
+
+        return args;
+}
+
+static CMPIString *broker_newString(const CMPIBroker *mb,
+                                    const char *data,
+                                    CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIString *str;
+        UPCALL_BEGIN();
+
+        str = orig->eft->newString(orig, data, rc);
+        UPCALL_END(UC_NEW_STRING);
+
+        return str;
+}
+
+static CMPIArray *broker_newArray(const CMPIBroker *mb,
+                                  CMPICount max,
+                                  CMPIType type,
+                                  CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIArray *array;
+        UPCALL_BEGIN();
+
+        array = orig->eft->newArray(orig, max, type, rc);
+        UPCALL_END(UC_NEW_ARRAY);
+
+        return array;
+}
+
+static CMPIBoolean broker_classPathIsA(const CMPIBroker *mb,
+                                       const CMPIObjectPath *op,
+                                       const char *type,
+                                       CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIBoolean ret;
+        UPCALL_BEGIN();
+
+        ret = orig->eft->classPathIsA(orig, op, type, rc);
+        UPCALL_END(UC_CLASS_PATH_IS_A);
+
+        return ret;
+}
+
+static CMPIStatus broker_deliverIndication(const CMPIBroker *mb,
+                                           const CMPIContext *ctx,
+                                           const char *ns,
+                                           const CMPIInstance *ind)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIStatus s;
+        UPCALL_BEGIN();
+
+        s = orig->bft->deliverIndication(orig, ctx, ns, ind);
+        UPCALL_END(UC_DELIVER_INDICATION);
+
+        return s;
+}
+
+static CMPIData broker_invokeMethod(const CMPIBroker *mb,
+                                    const CMPIContext *ctx,
+                                    const CMPIObjectPath *op,
+                                    const char *method,
+                                    const CMPIArgs *in,
+                                    CMPIArgs *out,
+                                    CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIData data;
+        UPCALL_BEGIN();
+
+        data = orig->bft->invokeMethod(orig, ctx, op, method, in, out, rc);
+        UPCALL_END(UC_INVOKE_METHOD);
+
+        return data;
+}
+
+static CMPIContext *broker_prepareAttachThread(const CMPIBroker *mb,
+                                               const CMPIContext *ctx)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->bft->prepareAttachThread(orig, ctx);
+}
+
+static CMPIStatus broker_attachThread(const CMPIBroker *mb,
+                                      const CMPIContext *ctx)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->bft->attachThread(orig, ctx);
+}
+
+static CMPIStatus broker_detachThread(const CMPIBroker *mb,
+                                      const CMPIContext *ctx)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->bft->detachThread(orig, ctx);
+}
+
+static CMPIEnumeration *broker_enumerateInstanceNames(const CMPIBroker *mb,
+                                                      const CMPIContext *ctx,
+                                                      const CMPIObjectPath *op,
+                                                      CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIEnumeration *en;
+        UPCALL_BEGIN();
+
+        en = orig->bft->enumerateInstanceNames(orig, ctx, op, rc);
+        UPCALL_END(UC_ENUM_INSTANCE_NAMES);
+
+        return en;
+}
+
+static CMPIInstance *broker_getInstance(const CMPIBroker *mb,
+                                        const CMPIContext *ctx,
+                                        const CMPIObjectPath *op,
+                                        const char **properties,
+                                        CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIInstance *inst;
+        UPCALL_BEGIN();
+
+        inst = orig->bft->getInstance(orig, ctx, op, properties, rc);
+        UPCALL_END(UC_GET_INSTANCE);
+
+        return inst;
+}
+
+static CMPIObjectPath *broker_createInstance(const CMPIBroker *mb,
+                                             const CMPIContext *ctx,
+                                             const CMPIObjectPath *op,
+                                             const CMPIInstance *inst,
+                                             CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIObjectPath *path;
+        UPCALL_BEGIN();
+
+        path = orig->bft->createInstance(orig, ctx, op, inst, rc);
+        UPCALL_END(UC_CREATE_INSTANCE);
+
+        return path;
+}
+
+static CMPIStatus broker_modifyInstance(const CMPIBroker *mb,
+                                        const CMPIContext *ctx,
+                                        const CMPIObjectPath *op,
+                                        const CMPIInstance *inst,
+                                        const char **properties)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIStatus s;
+        UPCALL_BEGIN();
+
+        s = orig->bft->modifyInstance(orig, ctx, op, inst, properties);
+        UPCALL_END(UC_MODIFY_INSTANCE);
+
+        return s;
+}
+
+static CMPIStatus broker_deleteInstance(const CMPIBroker *mb,
+                                        const CMPIContext *ctx,
+                                        const CMPIObjectPath *op)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIStatus s;
+        UPCALL_BEGIN();
+
+        s = orig->bft->deleteInstance(orig, ctx, op);
+        UPCALL_END(UC_DELETE_INSTANCE);
+
+        return s;
+}
+
+static CMPIEnumeration *broker_execQuery(const CMPIBroker *mb,
+                                         const CMPIContext *ctx,
+                                         const CMPIObjectPath *op,
+                                         const char *query,
+                                         const char *lang,
+                                         CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIEnumeration *en;
+        UPCALL_BEGIN();
+
+        en = orig->bft->execQuery(orig, ctx, op, query, lang, rc);
+        UPCALL_END(UC_EXEC_QUERY);
+
+        return en;
+}
+
+static CMPIEnumeration *broker_enumerateInstances(const CMPIBroker *mb,
+                                                  const CMPIContext *ctx,
+                                                  const CMPIObjectPath *op,
+                                                  const char **properties,
+                                                  CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIEnumeration *en;
+        UPCALL_BEGIN();
+
+        en = orig->bft->enumerateInstances(orig, ctx, op, properties, rc);
+        UPCALL_END(UC_ENUM_INSTANCES);
+
+        return en;
+}
+
+static CMPIEnumeration *broker_associators(const CMPIBroker *mb,
+                                           const CMPIContext *ctx,
+                                           const CMPIObjectPath *op,
+                                           const char *assocClass,
+                                           const char *resultClass,
+                                           const char *role,
+                                           const char *resultRole,
+                                           const char **properties,
+                                           CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIEnumeration *en;
+        UPCALL_BEGIN();
+
+        en = orig->bft->associators(orig, ctx, op, assocClass, resultClass,
+                                    role, resultRole, properties, rc);
+        UPCALL_END(UC_ASSOCIATORS);
+
+        return en;
+}
+
+static CMPIEnumeration *broker_associatorNames(const CMPIBroker *mb,
+                                               const CMPIContext *ctx,
+                                               const CMPIObjectPath *op,
+                                               const char *assocClass,
+                                               const char *resultClass,
+                                               const char *role,
+                                               const char *resultRole,
+                                               CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIEnumeration *en;
+        UPCALL_BEGIN();
+
+        en = orig->bft->associatorNames(orig, ctx, op, assocClass,
+                                        resultClass, role, resultRole, rc);
+        UPCALL_END(UC_ASSOCIATOR_NAMES);
+
+        return en;
+}
+
+static CMPIEnumeration *broker_references(const CMPIBroker *mb,
+                                          const CMPIContext *ctx,
+                                          const CMPIObjectPath *op,
+                                          const char *resultClass,
+                                          const char *role,
+                                          const char **properties,
+                                          CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIEnumeration *en;
+        UPCALL_BEGIN();
+
+        en = orig->bft->references(orig, ctx, op, resultClass, role,
+                                   properties, rc);
+        UPCALL_END(UC_REFERENCES);
+
+        return en;
+}
+
+static CMPIEnumeration *broker_referenceNames(const CMPIBroker *mb,
+                                              const CMPIContext *ctx,
+                                              const CMPIObjectPath *op,
+                                              const char *resultClass,
+                                              const char *role,
+                                              CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIEnumeration *en;
+        UPCALL_BEGIN();
+
+        en = orig->bft->referenceNames(orig, ctx, op, resultClass, role, rc);
+        UPCALL_END(UC_REFERENCE_NAMES);
+
+        return en;
+}
+
+static CMPIStatus broker_setProperty(const CMPIBroker *mb,
+                                     const CMPIContext *ctx,
+                                     const CMPIObjectPath *op,
+                                     const char *name,
+                                     const CMPIValue *value,
+                                     const CMPIType type)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIStatus s;
+        UPCALL_BEGIN();
+
+        s = orig->bft->setProperty(orig, ctx, op, name, value, type);
+        UPCALL_END(UC_BROKER_SET_PROPERTY);
+
+        return s;
+}
+
+static CMPIData broker_getProperty(const CMPIBroker *mb,
+                                   const CMPIContext *ctx,
+                                   const CMPIObjectPath *op,
+                                   const char *name,
+                                   CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        CMPIData data;
+        UPCALL_BEGIN();
+
+        data = orig->bft->getProperty(orig, ctx, op, name, rc);
+        UPCALL_END(UC_BROKER_GET_PROPERTY);
+
+        return data;
+}
+
+/*
+ * The rest of the encapsulated data and memory functions are only
+ * forwarded, not counted.
+ */
+
+static CMPIDateTime *broker_newDateTime(const CMPIBroker *mb,
+                                        CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->newDateTime(orig, rc);
+}
+
+static CMPIDateTime *broker_newDateTimeFromBinary(const CMPIBroker *mb,
+                                                  CMPIUint64 binTime,
+                                                  CMPIBoolean interval,
+                                                  CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->newDateTimeFromBinary(orig, binTime, interval, rc);
+}
+
+static CMPIDateTime *broker_newDateTimeFromChars(const CMPIBroker *mb,
+                                                 const char *datetime,
+                                                 CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->newDateTimeFromChars(orig, datetime, rc);
+}
+
+static CMPISelectExp *broker_newSelectExp(const CMPIBroker *mb,
+                                          const char *query,
+                                          const char *lang,
+                                          CMPIArray **projection,
+                                          CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->newSelectExp(orig, query, lang, projection, rc);
+}
+
+static CMPIString *broker_toString(const CMPIBroker *mb,
+                                   const void *object,
+                                   CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->toString(orig, object, rc);
+}
+
+static CMPIBoolean broker_isOfType(const CMPIBroker *mb,
+                                   const void *object,
+                                   const char *type,
+                                   CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->isOfType(orig, object, type, rc);
+}
+
+static CMPIString *broker_getType(const CMPIBroker *mb,
+                                  const void *object,
+                                  CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->getType(orig, object, rc);
+}
+
+/*
+ * CMGetMessage() takes up to ten (type, value) pairs, built by the
+ * CMFmt*() macros.  A va_list can't be passed on to another variadic
+ * function, so each value is turned into a string and all of them are
+ * passed as CMPI_chars.  The CIMOM substitutes text either way.
+ */
+#define MAX_MSG_ARGS 10
+
+struct msg_args {
+        CMPICount count;
+        char buf[MAX_MSG_ARGS][32];
+        const char *val[MAX_MSG_ARGS];
+};
+
+static void get_msg_args(struct msg_args *args, CMPICount count, va_list ap)
+{
+        CMPIString *str;
+        CMPICount i;
+
+        if (count > MAX_MSG_ARGS)
+                count = MAX_MSG_ARGS;
+
+        for (i = 0; i < MAX_MSG_ARGS; i++)
+                args->val[i] = "";
+
+        for (i = 0; i < count; i++) {
+                char *buf = args->buf[i];
+                size_t size = sizeof(args->buf[i]);
+
+                switch (va_arg(ap, int)) {
+                case CMPI_sint32:
+                        snprintf(buf, size, "%ld", va_arg(ap, long));
+                        break;
+                case CMPI_uint32:
+                        snprintf(buf, size, "%lu",
+                                 va_arg(ap, unsigned long));
+                        break;
+                case CMPI_sint64:
+                        snprintf(buf, size, "%lld", va_arg(ap, long long));
+                        break;
+                case CMPI_uint64:
+                        snprintf(buf, size, "%llu",
+                                 va_arg(ap, unsigned long long));
+                        break;
+                case CMPI_real64:
+                        snprintf(buf, size, "%g", va_arg(ap, double));
+                        break;
+                case CMPI_boolean:
+                        snprintf(buf, size, "%s",
+                                 va_arg(ap, int) ? "true" : "false");
+                        break;
+                case CMPI_chars:
+                        buf = va_arg(ap, char *);
+                        break;
+                case CMPI_string:
+                        str = va_arg(ap, CMPIString *);
+                        if (str != NULL)
+                                buf = str->ft->getCharPtr(str, NULL);
+                        else
+                                buf = NULL;
+                        break;
+                default:
+                        /* The size of anything else is unknown */
+                        CU_DEBUG("Unknown message argument type");
+                        goto out;
+                }
+
+                if (buf != NULL)
+                        args->val[i] = buf;
+        }
+ out:
+        args->count = i;
+}
+
+#define MSG_ARGS(a)                                                     \
+        CMPI_chars, (a).val[0], CMPI_chars, (a).val[1],                 \
+        CMPI_chars, (a).val[2], CMPI_chars, (a).val[3],                 \
+        CMPI_chars, (a).val[4], CMPI_chars, (a).val[5],                 \
+        CMPI_chars, (a).val[6], CMPI_chars, (a).val[7],                 \
+        CMPI_chars, (a).val[8], CMPI_chars, (a).val[9]
+
+static CMPIString *broker_getMessage(const CMPIBroker *mb,
+                                     const char *msgId,
+                                     const char *defMsg,
+                                     CMPIStatus *rc,
+                                     CMPICount count,
+                                     ...)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        struct msg_args args;
+        va_list ap;
+
+        va_start(ap, count);
+        get_msg_args(&args, count, ap);
+        va_end(ap);
+
+        return orig->eft->getMessage(orig, msgId, defMsg, rc,
+                                     args.count, MSG_ARGS(args));
+}
+
+static CMPIStatus broker_logMessage(const CMPIBroker *mb,
+                                    int severity,
+                                    const char *id,
+                                    const char *text,
+                                    const CMPIString *string)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->logMessage(orig, severity, id, text, string);
+}
+
+static CMPIStatus broker_trace(const CMPIBroker *mb,
+                               int level,
+                               const char *component,
+                               const char *text,
+                               const CMPIString *string)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->trace(orig, level, component, text, string);
+}
+
+#ifdef CMPI_VER_200
+static CMPIError *broker_newCMPIError(const CMPIBroker *mb,
+                                      const char *owner,
+                                      const char *msgId,
+                                      const char *msg,
+                                      const CMPIErrorSeverity sev,
+                                      const CMPIErrorProbableCause pc,
+                                      const CMPIrc cimStatusCode,
+                                      CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->newCMPIError(orig, owner, msgId, msg, sev, pc,
+                                       cimStatusCode, rc);
+}
+
+static CMPIStatus broker_openMessageFile(const CMPIBroker *mb,
+                                         const char *msgFile,
+                                         CMPIMsgFileHandle *msgFileHandle)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->openMessageFile(orig, msgFile, msgFileHandle);
+}
+
+static CMPIStatus broker_closeMessageFile(const CMPIBroker *mb,
+                                          const CMPIMsgFileHandle handle)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->eft->closeMessageFile(orig, handle);
+}
+
+static CMPIString *broker_getMessage2(const CMPIBroker *mb,
+                                      const char *msgId,
+                                      const CMPIMsgFileHandle handle,
+                                      const char *defMsg,
+                                      CMPIStatus *rc,
+                                      CMPICount count,
+                                      ...)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+        struct msg_args args;
+        va_list ap;
+
+        va_start(ap, count);
+        get_msg_args(&args, count, ap);
+        va_end(ap);
+
+        return orig->eft->getMessage2(orig, msgId, handle, defMsg, rc,
+                                      args.count, MSG_ARGS(args));
+}
+
+static CMPIGcStat *broker_mark(const CMPIBroker *mb, CMPIStatus *rc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->mft->mark(orig, rc);
+}
+
+static CMPIStatus broker_release(const CMPIBroker *mb, const CMPIGcStat *gc)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        return orig->mft->release(orig, gc);
+}
+
+static void broker_freeInstance(const CMPIBroker *mb, CMPIInstance *inst)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        orig->mft->freeInstance(orig, inst);
+}
+
+static void broker_freeObjectPath(const CMPIBroker *mb, CMPIObjectPath *obj)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        orig->mft->freeObjectPath(orig, obj);
+}
+
+static void broker_freeArgs(const CMPIBroker *mb, CMPIArgs *args)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        orig->mft->freeArgs(orig, args);
+}
+
+static void broker_freeString(const CMPIBroker *mb, CMPIString *str)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        orig->mft->freeString(orig, str);
+}
+
+static void broker_freeArray(const CMPIBroker *mb, CMPIArray *array)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        orig->mft->freeArray(orig, array);
+}
+
+static void broker_freeDateTime(const CMPIBroker *mb, CMPIDateTime *date)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        orig->mft->freeDateTime(orig, date);
+}
+
+static void broker_freeSelectExp(const CMPIBroker *mb, CMPISelectExp *se)
+{
+        const CMPIBroker *orig = BROKER_ORIG(mb);
+
+        orig->mft->freeSelectExp(orig, se);
+}
+#endif
+
+/* Entries the CIMOM left NULL stay NULL */
+#define WRAP(ft, fn)                                    \
+        do {                                            \
+                if ((ft).fn != NULL)                    \
+                        (ft).fn = broker_##fn;          \
+        } while (0)
+
+static struct wrapped_broker *make_broker(const CMPIBroker *orig)
+{
+        struct wrapped_broker *w;
+
+        w = calloc(1, sizeof(*w));
+        if (w == NULL)
+                return NULL;
+
+        w->orig = orig;
+        w->broker = *orig;
+
+        w->bft = *orig->bft;
+        WRAP(w->bft, prepareAttachThread);
+        WRAP(w->bft, attachThread);
+        WRAP(w->bft, detachThread);
+        WRAP(w->bft, deliverIndication);
+        WRAP(w->bft, enumerateInstanceNames);
+        WRAP(w->bft, getInstance);
+        WRAP(w->bft, createInstance);
+        WRAP(w->bft, modifyInstance);
+        WRAP(w->bft, deleteInstance);
+        WRAP(w->bft, execQuery);
+        WRAP(w->bft, enumerateInstances);
+        WRAP(w->bft, associators);
+        WRAP(w->bft, associatorNames);
+        WRAP(w->bft, references);
+        WRAP(w->bft, referenceNames);
+        WRAP(w->bft, invokeMethod);
+        WRAP(w->bft, setProperty);
+        WRAP(w->bft, getProperty);
+
+        w->eft = *orig->eft;
+        WRAP(w->eft, newInstance);
+        WRAP(w->eft, newObjectPath);
+        WRAP(w->eft, newArgs);
+        WRAP(w->eft, newString);
+        WRAP(w->eft, newArray);
+        WRAP(w->eft, newDateTime);
+        WRAP(w->eft, newDateTimeFromBinary);
+        WRAP(w->eft, newDateTimeFromChars);
+        WRAP(w->eft, newSelectExp);
+        WRAP(w->eft, classPathIsA);
+        WRAP(w->eft, toString);
+        WRAP(w->eft, isOfType);
+        WRAP(w->eft, getType);
+        WRAP(w->eft, getMessage);
+        WRAP(w->eft, logMessage);
+        WRAP(w->eft, trace);
+#ifdef CMPI_VER_200
+        WRAP(w->eft, newCMPIError);
+        WRAP(w->eft, openMessageFile);
+        WRAP(w->eft, closeMessageFile);
+        WRAP(w->eft, getMessage2);
+
+        if (orig->mft != NULL) {
+                /* ftVersion is const here, so no struct assignment */
+                memcpy(&w->mft, orig->mft, sizeof(w->mft));
+                WRAP(w->mft, mark);
+                WRAP(w->mft, release);
+                WRAP(w->mft, freeInstance);
+                WRAP(w->mft, freeObjectPath);
+                WRAP(w->mft, freeArgs);
+                WRAP(w->mft, freeString);
+                WRAP(w->mft, freeArray);
+                WRAP(w->mft, freeDateTime);
+                WRAP(w->mft, freeSelectExp);
+                w->broker.mft = &w->mft;
+        }
+#endif
+
+        w->broker.bft = &w->bft;
+        w->broker.eft = &w->eft;
+
+        return w;
+}
+
+static void dump_at_exit(void)
+{
+        FILE *out;
+
+        if (dump_path == NULL)
+                return;
+
+        if (strcmp(dump_path, "stderr") == 0) {
+                cu_upcall_dump(stderr);
+                return;
+        }
+
+        out = fopen(dump_path, "a");
+        if (out == NULL) {
+                CU_DEBUG("Unable to open %s for up-call stats", dump_path);
+                return;
+        }
+
+        cu_upcall_dump(out);
+        fclose(out);
+}
+
+const CMPIBroker *cu_upcall_broker(const CMPIBroker *broker)
+{
+        static bool registered = false;
+        const CMPIBroker *ret = broker;
+        int i;
+
+        if (!upcall_on || (broker == NULL) ||
+            (broker->eft->newInstance == broker_newInstance))
+                return broker;
+
+        pthread_mutex_lock(&stats_lock);
+
+        for (i = 0; i < MAX_BROKERS; i++) {
+                if (brokers[i] == NULL) {
+                        brokers[i] = make_broker(broker);
+                        if (brokers[i] != NULL)
+                                ret = &brokers[i]->broker;
+                        break;
+                } else if (brokers[i]->orig == broker) {
+                        ret = &brokers[i]->broker;
+                        break;
+                }
+        }
+
+        if (!registered && (dump_path != NULL)) {
+                atexit(dump_at_exit);
+                registered = true;
+        }
+
+        pthread_mutex_unlock(&stats_lock);
+
+        return ret;
+}
+
+bool cu_upcall_enabled(void)
+{
+        return upcall_on;
+}
+
+void cu_upcall_set_enabled(bool enabled)
+{
+        upcall_on = enabled;
+}
+
+static void upcall_init(void) __attribute__((constructor));
+static void upcall_init(void)
+{
+        const char *path;
+
+        path = getenv("CU_UPCALL_STATS");
+        if ((path == NULL) || (*path == '\0'))
+                return;
+
+        dump_path = strdup(path);
+        upcall_on = true;
+}
+
+static int cmp_total(const void *a, const void *b)
+{
+        const struct upcall_stat *x = *(const struct upcall_stat **)a;
+        const struct upcall_stat *y = *(const struct upcall_stat **)b;
+
+        if (x->total_ns > y->total_ns)
+                return -1;
+        else if (x->total_ns < y->total_ns)
+                return 1;
+        else
+                return 0;
+}
+
+static const char *base_name(const char *file)
+{
+        const char *slash;
+
+        slash = strrchr(file, '/');
+
+        return slash != NULL ? slash + 1 : file;
+}
+
+void cu_upcall_dump(FILE *out)
+{
+        struct upcall_stat *sorted[MAX_STATS];
+        unsigned long count[UC_MAX];
+        uint64_t total[UC_MAX];
+        char site[128];
+        int num = 0;
+        int i;
+
+        memset(count, 0, sizeof(count));
+        memset(total, 0, sizeof(total));
+
+        for (i = 0; i < MAX_STATS; i++) {
+                if (!__atomic_load_n(&stats[i].used, __ATOMIC_ACQUIRE) ||
+                    (stats[i].count == 0))
+                        continue;
+
+                sorted[num++] = &stats[i];
+                count[stats[i].fn] += stats[i].count;
+                total[stats[i].fn] += stats[i].total_ns;
+        }
+
+        qsort(sorted, num, sizeof(sorted[0]), cmp_total);
+
+        fprintf(out, "%-22s %12s %14s %10s\n",
+                "function", "calls", "total_us", "avg_ns");
+
+        for (i = 0; i < UC_MAX; i++) {
+                if (count[i] == 0)
+                        continue;
+
+                fprintf(out, "%-22s %12lu %14.1f %10.1f\n",
+                        fn_names[i], count[i], total[i] / 1000.0,
+                        (double)total[i] / count[i]);
+        }
+
+        fprintf(out, "\n%-22s %-40s %12s %14s %10s %10s\n",
+                "function", "site", "calls", "total_us", "avg_ns", "max_ns");
+
+        for (i = 0; i < num; i++) {
+                struct upcall_stat *st = sorted[i];
+
+                if (st->file != NULL)
+                        snprintf(site, sizeof(site), "%s:%s",
+                                 base_name(st->file), st->func);
+                else
+                        snprintf(site, sizeof(site), "(provider)");
+
+                fprintf(out, "%-22s %-40s %12lu %14.1f %10.1f %10llu\n",
+                        fn_names[st->fn], site, st->count,
+                        st->total_ns / 1000.0,
+                        (double)st->total_ns / st->count,
+                        (unsigned long long)st->max_ns);
+        }
+
+        if (stats_dropped)
+                fprintf(out, "\n%lu calls not recorded (table full)\n",
+                        stats_dropped);
+}
+
+void cu_upcall_reset(void)
+{
+        int i;
+
+        for (i = 0; i < MAX_STATS; i++) {
+                __atomic_store_n(&stats[i].count, 0, __ATOMIC_RELAXED);
+                __atomic_store_n(&stats[i].total_ns, 0, __ATOMIC_RELAXED);
+                __atomic_store_n(&stats[i].max_ns, 0, __ATOMIC_RELAXED);
+        }
+
+        stats_dropped = 0;
+}
+
+#else
+
+const CMPIBroker *cu_upcall_broker(const CMPIBroker *broker)
+{
+        return broker;
+}
+
+bool cu_upcall_enabled(void)
+{
+        return false;
+}
+
+void cu_upcall_set_enabled(bool enabled)
+{
+        if (enabled)
+                CU_DEBUG("Up-call accounting is not built in");
+}
+
+void cu_upcall_dump(FILE *out)
+{
+}
+
+void cu_upcall_reset(void)
+{
+}
+
+static void upcall_init(void) __attribute__((constructor));
+static void upcall_init(void)
+{
+        const char *path;
+
+        path = getenv("CU_UPCALL_STATS");
+        if ((path != NULL) && (*path != '\0'))
+                CU_DEBUG("CU_UPCALL_STATS is set, but up-call accounting "
+                         "is not built in (--enable-upcall-stats)");
+}
+
+#endif
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,523 @@
+/*
+ * Copyright IBM Corp. 2007
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <cmpidt.h>
+#include <cmpift.h>
+#include <cmpimacs.h>
+
+#include "libcmpiutil.h"
+#include "cu_stats.h"
+#include "cu_watchdog.h"
+#include "cu_flight.h"
+
+/* Calls tracked at once; more than this go unwatched */
+#define MAX_WATCHES 256
+
+#define MAX_FRAMES 32
+
+/* How long the watchdog waits for a stuck thread to take its stack */
+#define STACK_WAIT_MS 100
+
+enum watch_state {
+        WATCH_FREE,
+        WATCH_SETUP,
+        WATCH_ACTIVE,
+        WATCH_REPORTING,
+};
+
+/*
+ * A call in progress.  The thread that claims a slot fills it in
+ * before making it WATCH_ACTIVE; the watchdog moves it to
+ * WATCH_REPORTING while it reads it, and the owner waits for that to
+ * finish before freeing it, so the strings it points to stay valid.
+ */
+struct cu_watch {
+        int state;
+        bool reported;
+        pthread_t thread;
+        long tid;
+        uint64_t start_ns;
+        const char *mi_name;
+        const char *op;
+        char ref[256];
+        void *frames[MAX_FRAMES];
+        int nframes;
+        bool have_frames;
+};
+
+static struct cu_watch watches[MAX_WATCHES];
+static __thread struct cu_watch *my_watch = NULL;
+
+static uint64_t threshold_ns = 0;
+static int stack_signal = 0;
+static struct sigaction old_action;
+
+static pthread_t watchdog;
+static bool watchdog_started = false;
+static bool watchdog_stop = false;
+static pthread_mutex_t watchdog_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_cond = PTHREAD_COND_INITIALIZER;
+
+static CU_STAT(slow_stat, CU_STAT_COUNTER,
+               "cu_watchdog_slow_total",
+               "Handler calls that ran past CU_WATCHDOG_MS");
+
+static CU_STAT(unwatched_stat, CU_STAT_COUNTER,
+               "cu_watchdog_unwatched_total",
+               "Handler calls not watched for lack of a free slot");
+
+static uint64_t now_ns(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void ref_add(char *buf, size_t size, size_t *len, const char *fmt, ...)
+        __attribute__((format(printf, 4, 5)));
+static void ref_add(char *buf, size_t size, size_t *len, const char *fmt, ...)
+{
+        va_list ap;
+        int ret;
+
+        if (*len >= size - 1)
+                return;
+
+        va_start(ap, fmt);
+        ret = vsnprintf(buf + *len, size - *len, fmt, ap);
+        va_end(ap);
+
+        if (ret > 0)
+                *len += ret;
+        if (*len > size - 1)
+                *len = size - 1;
+}
+
+/*
+ * Render the reference as namespace:Class.Key="value",... now, on the
+ * calling thread, since the broker's objects are not for the watchdog
+ * thread to use.  Keys of types other than strings, numbers and
+ * booleans are shown as "?".
+ */
+static void format_ref(char *buf, size_t size, const CMPIObjectPath *ref)
+{
+        CMPIString *name;
+        CMPIData data;
+        CMPIStatus s;
+        unsigned int count;
+        unsigned int i;
+        size_t len = 0;
+        const char *str;
+
+        buf[0] = '\0';
+
+        if (CMIsNullObject(ref))
+                return;
+
+        str = NAMESPACE(ref);
+        ref_add(buf, size, &len, "%s:", str != NULL ? str : "");
+        str = CLASSNAME(ref);
+        ref_add(buf, size, &len, "%s", str != NULL ? str : "");
+
+        count = CMGetKeyCount(ref, NULL);
+        for (i = 0; i < count; i++) {
+                data = CMGetKeyAt(ref, i, &name, &s);
+                if ((s.rc != CMPI_RC_OK) || (name == NULL))
+                        continue;
+
+                ref_add(buf, size, &len, "%s%s=",
+                        i == 0 ? "." : ",", CMGetCharPtr(name));
+
+                if (data.state & CMPI_nullValue)
+                        ref_add(buf, size, &len, "NULL");
+                else if (data.type == CMPI_string)
+                        ref_add(buf, size, &len, "\"%s\"",
+                                CMGetCharPtr(data.value.string));
+                else if (data.type == CMPI_boolean)
+                        ref_add(buf, size, &len, "%s",
+                                data.value.boolean ? "TRUE" : "FALSE");
+                else if (data.type == CMPI_uint64)
+                        ref_add(buf, size, &len, "%llu",
+                                (unsigned long long)data.value.uint64);
+                else if (data.type == CMPI_uint32)
+                        ref_add(buf, size, &len, "%" PRIu32,
+                                data.value.uint32);
+                else if (data.type == CMPI_uint16)
+                        ref_add(buf, size, &len, "%u",
+                                (unsigned)data.value.uint16);
+                else if (data.type == CMPI_uint8)
+                        ref_add(buf, size, &len, "%u",
+                                (unsigned)data.value.uint8);
+                else if (data.type == CMPI_sint64)
+                        ref_add(buf, size, &len, "%lld",
+                                (long long)data.value.sint64);
+                else if (data.type == CMPI_sint32)
+                        ref_add(buf, size, &len, "%" PRId32,
+                                data.value.sint32);
+                else if (data.type == CMPI_sint16)
+                        ref_add(buf, size, &len, "%d",
+                                (int)data.value.sint16);
+                else if (data.type == CMPI_sint8)
+                        ref_add(buf, size, &len, "%d",
+                                (int)data.value.sint8);
+                else
+                        ref_add(buf, size, &len, "?");
+        }
+}
+
+/*
+ * Runs on the stuck thread.  backtrace() was called once when the
+ * library was loaded, so that it does not need to load anything here.
+ */
+static void stack_handler(int sig)
+{
+        struct cu_watch *watch = my_watch;
+
+        if ((watch == NULL) || watch->have_frames)
+                return;
+
+        watch->nframes = backtrace(watch->frames, MAX_FRAMES);
+        __atomic_store_n(&watch->have_frames, true, __ATOMIC_RELEASE);
+}
+
+static void report_stack(struct cu_watch *watch)
+{
+        struct timespec ts = {0, 1000000L};
+        char **symbols;
+        int waited;
+        int i;
+
+        if ((stack_signal == 0) ||
+            (pthread_kill(watch->thread, stack_signal) != 0))
+                return;
+
+        for (waited = 0; waited < STACK_WAIT_MS; waited++) {
+                if (__atomic_load_n(&watch->have_frames, __ATOMIC_ACQUIRE))
+                        break;
+                nanosleep(&ts, NULL);
+        }
+
+        if (!__atomic_load_n(&watch->have_frames, __ATOMIC_ACQUIRE)) {
+                CU_LOG(CU_LOG_WARNING, "No stack from thread %ld",
+                       watch->tid);
+                return;
+        }
+
+        symbols = backtrace_symbols(watch->frames, watch->nframes);
+
+        /* Frame 0 is the handler above, and 1 the signal trampoline */
+        for (i = 2; i < watch->nframes; i++) {
+                if (symbols != NULL)
+                        CU_LOG(CU_LOG_WARNING, "  #%d %s",
+                               i - 2, symbols[i]);
+                else
+                        CU_LOG(CU_LOG_WARNING, "  #%d %p",
+                               i - 2, watch->frames[i]);
+        }
+
+        free(symbols);
+}
+
+static void report(struct cu_watch *watch, uint64_t now)
+{
+        CU_LOG(CU_LOG_WARNING,
+               "Slow handler: %s %s on %s has been running for "
+               "%" PRIu64 " ms in thread %ld",
+               watch->mi_name, watch->op, watch->ref,
+               (now - watch->start_ns) / 1000000, watch->tid);
+
+        report_stack(watch);
+
+        cu_stat_add(&slow_stat, 1);
+        cu_flight_dump_thread(watch->tid, "slow handler");
+}
+
+static void scan(void)
+{
+        struct cu_watch *watch;
+        uint64_t now = now_ns();
+        int active;
+        int i;
+
+        for (i = 0; i < MAX_WATCHES; i++) {
+                watch = &watches[i];
+
+                if (__atomic_load_n(&watch->state, __ATOMIC_RELAXED) !=
+                    WATCH_ACTIVE)
+                        continue;
+
+                active = WATCH_ACTIVE;
+                if (!__atomic_compare_exchange_n(&watch->state, &active,
+                                                 WATCH_REPORTING, false,
+                                                 __ATOMIC_ACQUIRE,
+                                                 __ATOMIC_RELAXED))
+                        continue;
+
+                if (!watch->reported &&
+                    (now - watch->start_ns >= threshold_ns)) {
+                        report(watch, now);
+                        watch->reported = true;
+                }
+
+                __atomic_store_n(&watch->state, WATCH_ACTIVE,
+                                 __ATOMIC_RELEASE);
+        }
+}
+
+static void *watchdog_thread(void *arg)
+{
+        struct timespec ts;
+        uint64_t interval = threshold_ns / 4;
+        sigset_t mask;
+        bool stop = false;
+
+        /* Leave the CIMOM's signals to its own threads */
+        sigfillset(&mask);
+        pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+        if (interval < 10000000ULL)
+                interval = 10000000ULL;
+        else if (interval > 1000000000ULL)
+                interval = 1000000000ULL;
+
+        while (!stop) {
+                pthread_mutex_lock(&watchdog_lock);
+                if (!watchdog_stop) {
+                        clock_gettime(CLOCK_REALTIME, &ts);
+                        ts.tv_nsec += interval;
+                        while (ts.tv_nsec >= 1000000000L) {
+                                ts.tv_sec++;
+                                ts.tv_nsec -= 1000000000L;
+                        }
+                        pthread_cond_timedwait(&watchdog_cond,
+                                               &watchdog_lock, &ts);
+                }
+                stop = watchdog_stop;
+                pthread_mutex_unlock(&watchdog_lock);
+
+                if (!stop)
+                        scan();
+        }
+
+        return NULL;
+}
+
+static void start_watchdog(void)
+{
+        if (__atomic_load_n(&watchdog_started, __ATOMIC_ACQUIRE))
+                return;
+
+        pthread_mutex_lock(&watchdog_lock);
+
+        if (!watchdog_started && !watchdog_stop) {
+                if (pthread_create(&watchdog, NULL, watchdog_thread,
+                                   NULL) != 0)
+                        CU_DEBUG("Unable to start the watchdog thread");
+                else
+                        __atomic_store_n(&watchdog_started, true,
+                                         __ATOMIC_RELEASE);
+        }
+
+        pthread_mutex_unlock(&watchdog_lock);
+}
+
+struct cu_watch *cu_watch_begin(const char *mi_name,
+                                const char *op,
+                                const CMPIObjectPath *ref)
+{
+        struct cu_watch *watch;
+        int free_state;
+        int i;
+
+        if ((threshold_ns == 0) || (my_watch != NULL))
+                return NULL;
+
+        start_watchdog();
+
+        for (i = 0; i < MAX_WATCHES; i++) {
+                watch = &watches[i];
+                free_state = WATCH_FREE;
+                if (__atomic_compare_exchange_n(&watch->state, &free_state,
+                                                WATCH_SETUP, false,
+                                                __ATOMIC_ACQUIRE,
+                                                __ATOMIC_RELAXED))
+                        goto found;
+        }
+
+        cu_stat_add(&unwatched_stat, 1);
+
+        return NULL;
+
+ found:
+        watch->reported = false;
+        watch->have_frames = false;
+        watch->thread = pthread_self();
+        watch->tid = syscall(SYS_gettid);
+        watch->mi_name = mi_name != NULL ? mi_name : "(unknown)";
+        watch->op = op != NULL ? op : "(unknown)";
+        format_ref(watch->ref, sizeof(watch->ref), ref);
+        watch->start_ns = now_ns();
+
+        my_watch = watch;
+        __atomic_store_n(&watch->state, WATCH_ACTIVE, __ATOMIC_RELEASE);
+
+        return watch;
+}
+
+void cu_watch_end(struct cu_watch *watch)
+{
+        int active;
+
+        if (watch == NULL)
+                return;
+
+        for (;;) {
+                active = WATCH_ACTIVE;
+                if (__atomic_compare_exchange_n(&watch->state, &active,
+                                                WATCH_SETUP, false,
+                                                __ATOMIC_ACQUIRE,
+                                                __ATOMIC_RELAXED))
+                        break;
+
+                /* The watchdog is reporting on this call */
+                sched_yield();
+        }
+
+        if (watch->reported)
+                CU_LOG(CU_LOG_WARNING,
+                       "Slow handler: %s %s on %s finished after "
+                       "%" PRIu64 " ms",
+                       watch->mi_name, watch->op, watch->ref,
+                       (now_ns() - watch->start_ns) / 1000000);
+
+        my_watch = NULL;
+        __atomic_store_n(&watch->state, WATCH_FREE, __ATOMIC_RELEASE);
+}
+
+/*
+ * The child has only the thread that forked, and no watchdog thread
+ * until its next call.
+ */
+static void watchdog_child(void)
+{
+        int i;
+
+        for (i = 0; i < MAX_WATCHES; i++) {
+                if (&watches[i] != my_watch)
+                        watches[i].state = WATCH_FREE;
+        }
+
+        pthread_mutex_init(&watchdog_lock, NULL);
+        watchdog_started = false;
+}
+
+static void watchdog_init(void) __attribute__((constructor));
+static void watchdog_init(void)
+{
+        struct sigaction act;
+        void *frame;
+        const char *val;
+        int sig;
+
+        val = getenv("CU_WATCHDOG_MS");
+        if ((val == NULL) || (atoi(val) <= 0))
+                return;
+
+        val = getenv("CU_WATCHDOG_SIGNAL");
+        if (val != NULL) {
+                sig = atoi(val);
+                if ((sig < 0) || (sig >= NSIG))
+                        CU_DEBUG("Ignoring invalid CU_WATCHDOG_SIGNAL `%s'",
+                                 val);
+                else
+                        stack_signal = sig;
+        }
+
+        /* The signal belongs to the process, so only take a free one */
+        if ((stack_signal != 0) &&
+            ((sigaction(stack_signal, NULL, &old_action) != 0) ||
+             (old_action.sa_handler != SIG_DFL))) {
+                CU_DEBUG("Signal %i is in use, not taking stacks",
+                         stack_signal);
+                stack_signal = 0;
+        }
+
+        if (stack_signal != 0) {
+                /* Load what backtrace() needs before a handler calls it */
+                backtrace(&frame, 1);
+
+                memset(&act, 0, sizeof(act));
+                act.sa_handler = stack_handler;
+                act.sa_flags = SA_RESTART;
+                sigemptyset(&act.sa_mask);
+                if (sigaction(stack_signal, &act, NULL) != 0)
+                        stack_signal = 0;
+        }
+
+        if (pthread_atfork(NULL, NULL, watchdog_child) != 0)
+                return;
+
+        threshold_ns = (uint64_t)atoi(getenv("CU_WATCHDOG_MS")) * 1000000;
+}
+
+static void watchdog_cleanup(void) __attribute__((destructor));
+static void watchdog_cleanup(void)
+{
+        struct sigaction cur;
+        bool started;
+
+        pthread_mutex_lock(&watchdog_lock);
+        started = watchdog_started;
+        watchdog_stop = true;
+        pthread_cond_signal(&watchdog_cond);
+        pthread_mutex_unlock(&watchdog_lock);
+
+        if (started)
+                pthread_join(watchdog, NULL);
+
+        /* Put the old action back unless someone replaced ours */
+        if ((stack_signal != 0) &&
+            (sigaction(stack_signal, NULL, &cur) == 0) &&
+            (cur.sa_handler == stack_handler))
+                sigaction(stack_signal, &old_action, NULL);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-set-style: "K&R"
+ * tab-width: 8
+ * c-basic-offset: 8
+ * indent-tabs-mode: nil
+ * End:
+ */